@@ -18,7 +18,12 @@ local math = require('math')
 -- a.pid()      -- same as `rtorrent.autocall.system.pid()`
 local mt = {}
 function mt.__call (t, ...)
-   name = table.concat(rawget(t, "__namestack"), ".")
+   -- Cache the joined name so reused aliases don't rebuild it.
+   name = rawget(t, "__name")
+   if name == nil then
+      name = table.concat(rawget(t, "__namestack"), ".")
+      rawset(t, "__name", name)
+   end
    tg = rawget(t, "__target") or ""
    success, ret = pcall(rtorrent.call, name, tg, ...)
    if not success then error(name..": "..ret, 2) end
@@ -59,6 +64,25 @@ for i, p in ipairs({ "d", "f", "p", "t", "load" }) do
    rtorrent[p] = function (target) return Target(target, p) end
 end
 
+-- Native Lua methods
+-- `rtorrent.insert_method(name, func)` adds the rtorrent method `name`
+-- calling `func` with the target followed by the method's arguments,
+-- without compiling a string on each call:
+--
+--   rtorrent.insert_method('d.watch_handler', function (target, path) ... end)
+--
+--   gives the rtorrent event handler:
+--     d.watch_handler=$argument.0=
+
+-- Native multicall
+-- `rtorrent.multicall(view, fields)` calls the commands in `fields` on
+-- every download in `view`, building the rows directly rather than
+-- through Autocall. Rows use the keys of `fields`:
+--
+--   for _, row in ipairs(rtorrent.multicall("main", {hash = "d.hash=", name = "d.name="})) do
+--      print(row.hash, row.name)
+--   end
+
 -- Insert Lua method
 -- Allow insert global lua-finction `func_name` at rtorrent slot `name`
 -- @param name string rtorrent's slot
@@ -28,6 +28,8 @@
 #include "core/manager.h"
 #include "rpc/parse.h"
 #include "session/session_manager.h"
+#include "utils/diskspace_cache.h"
+#include "utils/tied_file_watcher.h"
 
 #include "globals.h"
 #include "control.h"
@@ -199,6 +201,44 @@ retrieve_d_ratio(core::Download* download) {
   return bytesDone > 0 ? (1000 * upTotal) / bytesDone : 0;
 }
 
+// The lowest free diskspace of the filesystems holding the root
+// directory and the files, like libtorrent's free_diskspace but using
+// the shared per-filesystem cache. Files not being downloaded are
+// skipped, as are files that don't exist yet. If none of the paths can
+// be stat'ed libtorrent is used instead.
+//
+// Sets 'path' to the path the filesystem is cached by, or the root
+// directory when falling back to libtorrent.
+uint64_t
+download_free_diskspace(core::Download* download, std::string* path) {
+  std::vector<std::string> paths{download->file_list()->root_dir()};
+
+  for (const auto& file : *download->file_list())
+    if (file->priority() != torrent::PRIORITY_OFF)
+      paths.push_back(file->frozen_path());
+
+  auto     cache = control->core()->diskspace_cache();
+  dev_t    device;
+  uint64_t free;
+
+  if (!cache->lookup_lowest(paths, &device, &free)) {
+    *path = download->file_list()->root_dir();
+    return download->file_list()->free_diskspace();
+  }
+
+  auto itr = cache->devices().find(device);
+
+  *path = itr != cache->devices().end() ? itr->second.path : download->file_list()->root_dir();
+  return free;
+}
+
+torrent::Object
+retrieve_d_free_diskspace(core::Download* download) {
+  std::string path;
+
+  return (int64_t)download_free_diskspace(download, &path);
+}
+
 torrent::Object
 apply_d_custom(core::Download* download, const torrent::Object::list_type& args) {
   torrent::Object::list_const_iterator itr = args.begin();
@@ -344,10 +384,12 @@ f_multicall(core::Download* download, const torrent::Object::list_type& args) {
   // We ignore the first arg for now, but it will be used for
   // selecting what files to include.
 
-  // Add some pre-parsing of the commands, so we don't spend time
-  // parsing and searching command map for every single call.
+  // Pre-parse the commands on the first target, so we don't spend
+  // time parsing and searching command map for every single call, and
+  // bad commands still return an empty list when there are no targets.
   torrent::Object             resultRaw = torrent::Object::create_list();
   torrent::Object::list_type& result = resultRaw.as_list();
+  rpc::parsed_command_list    commands;
   std::vector<rak::regex>     regex_list;
 
   bool use_regex = true;
@@ -367,10 +409,11 @@ f_multicall(core::Download* download, const torrent::Object::list_type& args) {
 
     torrent::Object::list_type& row = result.insert(result.end(), torrent::Object::create_list())->as_list();
 
-    for (torrent::Object::list_const_iterator cItr = ++args.begin(); cItr != args.end(); cItr++) {
-      const std::string& cmd = cItr->as_string();
-      row.push_back(rpc::parse_command(rpc::make_target(file.get()), cmd.c_str(), cmd.c_str() + cmd.size()).first);
-    }
+    if (commands.empty())
+      commands = rpc::parse_command_compile_list(++args.begin(), args.end());
+
+    for (const auto& cmd : commands)
+      row.push_back(rpc::parse_command_call(*cmd, rpc::make_target(rpc::command_base::target_file, file.get(), download)));
   }
 
   return resultRaw;
@@ -384,10 +427,10 @@ t_multicall(core::Download* download, const torrent::Object::list_type& args) {
   // We ignore the first arg for now, but it will be used for
   // selecting what files to include.
 
-  // Add some pre-parsing of the commands, so we don't spend time
-  // parsing and searching command map for every single call.
+  // Pre-parse the commands on the first target, as in f.multicall.
   torrent::Object             result_raw = torrent::Object::create_list();
   torrent::Object::list_type& result     = result_raw.as_list();
+  rpc::parsed_command_list    commands;
 
   for (uint32_t idx = 0, last = download->tracker_list_size(); idx < last; idx++) {
     auto& row = result.insert(result.end(), torrent::Object::create_list())->as_list();
@@ -396,11 +439,11 @@ t_multicall(core::Download* download, const torrent::Object::list_type& args) {
     if (!tracker.is_valid())
       continue;
 
-    for (torrent::Object::list_const_iterator cItr = ++args.begin(); cItr != args.end(); cItr++) {
-      const std::string& cmd = cItr->as_string();
+    if (commands.empty())
+      commands = rpc::parse_command_compile_list(++args.begin(), args.end());
 
-      row.push_back(rpc::parse_command(rpc::make_target(&tracker), cmd.c_str(), cmd.c_str() + cmd.size()).first);
-    }
+    for (const auto& cmd : commands)
+      row.push_back(rpc::parse_command_call(*cmd, rpc::make_target(rpc::command_base::target_tracker, &tracker, download)));
   }
 
   return result_raw;
@@ -414,19 +457,19 @@ p_multicall(core::Download* download, const torrent::Object::list_type& args) {
   // We ignore the first arg for now, but it will be used for
   // selecting what files to include.
 
-  // Add some pre-parsing of the commands, so we don't spend time
-  // parsing and searching command map for every single call.
+  // Pre-parse the commands on the first target, as in f.multicall.
   torrent::Object             resultRaw = torrent::Object::create_list();
   torrent::Object::list_type& result = resultRaw.as_list();
+  rpc::parsed_command_list    commands;
 
   for (const auto& connection : *download->connection_list()) {
     torrent::Object::list_type& row = result.insert(result.end(), torrent::Object::create_list())->as_list();
 
-    for (torrent::Object::list_const_iterator cItr = ++args.begin(); cItr != args.end(); cItr++) {
-      const std::string& cmd = cItr->as_string();
+    if (commands.empty())
+      commands = rpc::parse_command_compile_list(++args.begin(), args.end());
 
-      row.push_back(rpc::parse_command(rpc::make_target(connection), cmd.c_str(), cmd.c_str() + cmd.size()).first);
-    }
+    for (const auto& cmd : commands)
+      row.push_back(rpc::parse_command_call(*cmd, rpc::make_target(rpc::command_base::target_peer, connection, download)));
   }
 
   return resultRaw;
@@ -712,7 +755,11 @@ initialize_command_download() {
   CMD2_DL_V       ("d.save_resume",       [](core::Download* download, auto) { session_thread::manager()->save_resume_download(download); });
   CMD2_DL_V       ("d.save_full_session", [](core::Download* download, auto) { session_thread::manager()->save_full_download(download); });
 
-  CMD2_DL_V       ("d.update_priorities", CMD2_ON_DL(update_priorities));
+  // File priorities are saved with the resume data.
+  CMD2_DL_V       ("d.update_priorities", [](core::Download* download, auto) {
+      download->download()->update_priorities();
+      download->mark_changed();
+    });
 
   CMD2_DL_STRING_V("add_peer",   std::bind(&apply_d_add_peer, std::placeholders::_1, std::placeholders::_2));
 
@@ -757,7 +804,12 @@ initialize_command_download() {
   //
   // 'loaded_file' is the file this instance of the torrent was loaded
   // from, and should not be changed.
-  CMD2_DL_VAR_STRING_PUBLIC("d.tied_to_file", "rtorrent", "tied_to_file");
+  CMD2_DL          ("d.tied_to_file",     std::bind(&download_get_variable, std::placeholders::_1, "rtorrent", "tied_to_file"));
+  CMD2_DL_STRING   ("d.tied_to_file.set", [](core::Download* download, const std::string& path) {
+      download_set_variable_string(download, path, "rtorrent", "tied_to_file");
+      control->tied_file_watcher()->update(download);
+      return torrent::Object();
+    });
   CMD2_DL_VAR_STRING("d.loaded_file",  "rtorrent", "loaded_file");
 
   // The "state_changed" variable is required to be a valid unix time
@@ -833,7 +885,7 @@ initialize_command_download() {
   CMD2_DL         ("d.bytes_done",     CMD2_ON_DL(bytes_done));
   CMD2_DL         ("d.ratio",          std::bind(&retrieve_d_ratio, std::placeholders::_1));
   CMD2_DL         ("d.chunks_hashed",  CMD2_ON_DL(chunks_hashed));
-  CMD2_DL         ("d.free_diskspace", CMD2_ON_FL(free_diskspace));
+  CMD2_DL         ("d.free_diskspace", std::bind(&retrieve_d_free_diskspace, std::placeholders::_1));
 
   CMD2_DL         ("d.size_files",     CMD2_ON_FL(size_files));
   CMD2_DL         ("d.size_bytes",     CMD2_ON_FL(size_bytes));
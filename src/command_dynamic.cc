@@ -1,6 +1,7 @@
 #include "config.h"
 
 #include <algorithm>
+#include <chrono>
 #include <torrent/utils/log.h>
 #include <torrent/utils/option_strings.h>
 
@@ -389,6 +390,46 @@ system_method_list_keys(const torrent::Object::string_type& args) {
   return rawResult;
 }
 
+static torrent::Object
+system_method_stats_node(const rpc::object_storage_node& node) {
+  torrent::Object result = torrent::Object::create_map();
+
+  result.insert_key("calls", int64_t(node.calls));
+  result.insert_key("time", int64_t(std::chrono::duration_cast<std::chrono::microseconds>(node.call_time).count()));
+
+  return result;
+}
+
+static bool
+system_method_stats_is_function(const rpc::object_storage_node& node) {
+  return (node.flags & rpc::object_storage::mask_type) == rpc::object_storage::flag_function_type ||
+         (node.flags & rpc::object_storage::mask_type) == rpc::object_storage::flag_multi_type;
+}
+
+// method.stats <> {name}
+//
+// Call count and cumulative time in microseconds of function and multi
+// methods, either for 'name' or as a map of all such methods.
+torrent::Object
+system_method_stats(const torrent::Object::string_type& args) {
+  if (!args.empty()) {
+    rpc::object_storage::iterator itr = control->object_storage()->find_raw_string_const(torrent::raw_string::from_string(args));
+
+    if (!system_method_stats_is_function(itr->second))
+      throw torrent::input_error("Method is not a function or multi type.");
+
+    return system_method_stats_node(itr->second);
+  }
+
+  torrent::Object result = torrent::Object::create_map();
+
+  for (const auto& itr : *control->object_storage())
+    if (system_method_stats_is_function(itr.second))
+      result.insert_key(itr.first.c_str(), system_method_stats_node(itr.second));
+
+  return result;
+}
+
 torrent::Object
 cmd_catch(rpc::target_type target, const torrent::Object& args) {
   try {
@@ -438,6 +479,7 @@ initialize_command_dynamic() {
   CMD2_ANY_LIST    ("method.has_key",   std::bind(&system_method_has_key, std::placeholders::_2));
   CMD2_ANY_LIST    ("method.set_key",   std::bind(&system_method_set_key, std::placeholders::_2));
   CMD2_ANY_STRING  ("method.list_keys", std::bind(&system_method_list_keys, std::placeholders::_2));
+  CMD2_ANY_STRING  ("method.stats",     std::bind(&system_method_stats, std::placeholders::_2));
 
   CMD2_ANY_STRING  ("method.rlookup",       std::bind(&rpc::object_storage::rlookup_obj_list, control->object_storage(), std::placeholders::_2));
   CMD2_ANY_STRING_V("method.rlookup.clear", std::bind(&rpc::object_storage::rlookup_clear, control->object_storage(), std::placeholders::_2));
@@ -464,6 +506,7 @@ initialize_command_dynamic() {
   rpc::rpc.mark_safe("method.const");
   rpc::rpc.mark_safe("method.has_key");
   rpc::rpc.mark_safe("method.list_keys");
+  rpc::rpc.mark_safe("method.stats");
   rpc::rpc.mark_safe("method.get");
   rpc::rpc.mark_safe("method.rlookup");
   rpc::rpc.mark_safe("catch");
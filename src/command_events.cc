@@ -2,6 +2,7 @@
 
 #include <functional>
 #include <cstdio>
+#include <map>
 #include <string>
 #include <vector>
 #include <torrent/rate.h>
@@ -21,6 +22,7 @@
 #include "rpc/command_scheduler.h"
 #include "rpc/parse.h"
 #include "rpc/parse_commands.h"
+#include "utils/tied_file_watcher.h"
 #include "utils/watch_ready_queue.h"
 
 torrent::Object
@@ -164,28 +166,38 @@ apply_load(const torrent::Object::list_type& args, int flags) {
 void apply_import(const std::string& path)     { if (!rpc::parse_command_file(path)) throw torrent::input_error("Could not open option file: " + path); }
 void apply_try_import(const std::string& path) { if (!rpc::parse_command_file(path)) control->core()->push_log_std("Could not read resource file: " + path); }
 
+uint64_t download_free_diskspace(core::Download* download, std::string* path);
+
+// Downloads are grouped by the filesystem with the lowest free
+// diskspace of those holding their files, as d.free_diskspace, so each
+// filesystem is logged once per sweep.
 torrent::Object
 apply_close_low_diskspace(int64_t arg, uint32_t skip_priority) {
-  bool closed = false;
+  std::map<std::string, std::vector<core::Download*>> at_risk;
 
   for (auto download : *control->core()->download_list()) {
     if (!download->is_downloading())
       continue;
     if (download->priority() >= skip_priority)
       continue;
-    if (download->file_list()->free_diskspace() >= (uint64_t)arg)
-      continue;
-
-    control->core()->download_list()->close(download);
 
-    download->set_hash_failed(true);
-    download->set_message(std::string("Low diskspace."));
+    std::string path;
 
-    closed = true;
+    if (download_free_diskspace(download, &path) < (uint64_t)arg)
+      at_risk[path].push_back(download);
   }
 
-  if (closed)
-    lt_log_print(torrent::LOG_TORRENT_ERROR, "Closed torrents due to low diskspace.");
+  for (const auto& [path, downloads] : at_risk) {
+    for (auto download : downloads) {
+      control->core()->download_list()->close(download);
+
+      download->set_hash_failed(true);
+      download->set_message(std::string("Low diskspace."));
+    }
+
+    lt_log_print(torrent::LOG_TORRENT_ERROR, "Closed %zu torrents due to low diskspace on filesystem of '%s'.",
+                 downloads.size(), path.c_str());
+  }
 
   return torrent::Object();
 }
@@ -233,8 +245,10 @@ d_multicall(const torrent::Object::list_type& args) {
   if (view_itr == viewManager->end())
     throw torrent::input_error("Could not find view.");
 
-  // Add some pre-parsing of the commands, so we don't spend time
-  // parsing and searching command map for every single call.
+  // Pre-parse the commands on the first target, so we don't spend
+  // time parsing and searching command map for every single call, and
+  // bad commands still return an empty list when there are no targets.
+  rpc::parsed_command_list     commands;
   std::vector<core::Download*> dlist((*view_itr)->begin_visible(), (*view_itr)->end_visible());
 
   torrent::Object             resultRaw = torrent::Object::create_list();
@@ -243,10 +257,11 @@ d_multicall(const torrent::Object::list_type& args) {
   for (auto download : dlist) {
     torrent::Object::list_type& row = result.insert(result.end(), torrent::Object::create_list())->as_list();
 
-    for (torrent::Object::list_const_iterator cItr = ++args.begin(); cItr != args.end(); cItr++) {
-      auto& cmd = cItr->as_string();
-      row.push_back(rpc::parse_command(rpc::make_target(download), cmd.c_str(), cmd.c_str() + cmd.size()).first);
-    }
+    if (commands.empty())
+      commands = rpc::parse_command_compile_list(++args.begin(), args.end());
+
+    for (const auto& cmd : commands)
+      row.push_back(rpc::parse_command_call(*cmd, rpc::make_target(download)));
   }
 
   return resultRaw;
@@ -272,22 +287,95 @@ d_multicall_filtered(const torrent::Object::list_type& args) {
   // Generate result by iterating over all items
   torrent::Object             resultRaw = torrent::Object::create_list();
   torrent::Object::list_type& result = resultRaw.as_list();
+  rpc::parsed_command_list    commands;
+
   ++arg;  // skip to first command
 
   for (const auto& item : dlist) {
     // Add empty row to result
     torrent::Object::list_type& row = result.insert(result.end(), torrent::Object::create_list())->as_list();
 
+    // Compiled on the first item, see d.multicall2.
+    if (commands.empty())
+      commands = rpc::parse_command_compile_list(arg, args.end());
+
     // Call the provided commands and assemble their results
-    for (torrent::Object::list_const_iterator command = arg; command != args.end(); command++) {
-      auto& cmdstr = command->as_string();
-      row.push_back(rpc::parse_command(rpc::make_target(item), cmdstr.c_str(), cmdstr.c_str() + cmdstr.size()).first);
-    }
+    for (const auto& cmd : commands)
+      row.push_back(rpc::parse_command_call(*cmd, rpc::make_target(item)));
   }
 
   return resultRaw;
 }
 
+// Like d.multicall2, but only returns the rows of downloads changed
+// after the given generation, each prefixed with the info hash, along
+// with the hashes of downloads that left the view.
+//
+// Clients apply 'removed' before 'rows' and pass the returned
+// 'generation' to the next call. All visible downloads are returned,
+// with 'full' set, for generation 0 or if the removals since the
+// generation are no longer known.
+torrent::Object
+d_multicall_since(const torrent::Object::list_type& args) {
+  if (args.size() < 2)
+    throw torrent::input_error("d.multicall.since requires at least 2 arguments.");
+
+  torrent::Object::list_const_iterator arg = args.begin();
+
+  core::ViewManager* viewManager = control->view_manager();
+  core::ViewManager::iterator view_itr = viewManager->find(arg->as_string().empty() ? "default" : arg->as_string());
+
+  if (view_itr == viewManager->end())
+    throw torrent::input_error("Could not find view '" + arg->as_string() + "'.");
+
+  int64_t since = rpc::convert_to_value(*++arg);
+
+  if (since < 0)
+    throw torrent::input_error("Invalid generation.");
+
+  rpc::parsed_command_list         commands = rpc::parse_command_compile_list(++arg, args.end());
+  std::vector<torrent::HashString> removed;
+
+  bool full = since == 0 || static_cast<uint64_t>(since) > core::Download::last_generation() ||
+              !(*view_itr)->removed_since(since, &removed);
+
+  if (full)
+    removed.clear();
+
+  std::vector<core::Download*> dlist;
+
+  for (auto itr = (*view_itr)->begin_visible(), last = (*view_itr)->end_visible(); itr != last; itr++) {
+    (*itr)->refresh_changes();
+
+    if (full || (*itr)->change_generation() > static_cast<uint64_t>(since))
+      dlist.push_back(*itr);
+  }
+
+  // Changes made by the commands below are returned by the next call.
+  uint64_t generation = core::Download::last_generation();
+
+  torrent::Object             resultRaw = torrent::Object::create_map();
+  torrent::Object::list_type& rows      = resultRaw.insert_key("rows", torrent::Object::create_list()).as_list();
+  torrent::Object::list_type& hashes    = resultRaw.insert_key("removed", torrent::Object::create_list()).as_list();
+
+  for (auto download : dlist) {
+    torrent::Object::list_type& row = rows.insert(rows.end(), torrent::Object::create_list())->as_list();
+
+    row.push_back(torrent::utils::transform_to_hex_str(download->info()->hash()));
+
+    for (const auto& cmd : commands)
+      row.push_back(rpc::parse_command_call(*cmd, rpc::make_target(download)));
+  }
+
+  for (const auto& hash : removed)
+    hashes.push_back(torrent::utils::transform_to_hex_str(hash));
+
+  resultRaw.insert_key("generation", static_cast<int64_t>(generation));
+  resultRaw.insert_key("full", static_cast<int64_t>(full));
+
+  return resultRaw;
+}
+
 static void
 call_watch_command(const std::string& command, const std::string& path) {
   rpc::commands.call_catch(command.c_str(), rpc::make_target(), path);
@@ -336,6 +424,17 @@ initialize_command_events() {
   CMD2_ANY         ("close_untied",    std::bind(&apply_close_untied));
   CMD2_ANY         ("remove_untied",   std::bind(&apply_remove_untied));
 
+  CMD2_ANY         ("tied.watch.start",         [](auto, auto)        { return (int64_t)control->tied_file_watcher()->has_action(utils::TiedFileWatcher::action_start); });
+  CMD2_ANY_VALUE_V ("tied.watch.start.set",     [](auto, auto& value) { return control->tied_file_watcher()->set_action(utils::TiedFileWatcher::action_start, value); });
+  CMD2_ANY         ("tied.watch.stop",          [](auto, auto)        { return (int64_t)control->tied_file_watcher()->has_action(utils::TiedFileWatcher::action_stop); });
+  CMD2_ANY_VALUE_V ("tied.watch.stop.set",      [](auto, auto& value) { return control->tied_file_watcher()->set_action(utils::TiedFileWatcher::action_stop, value); });
+  CMD2_ANY         ("tied.watch.close",         [](auto, auto)        { return (int64_t)control->tied_file_watcher()->has_action(utils::TiedFileWatcher::action_close); });
+  CMD2_ANY_VALUE_V ("tied.watch.close.set",     [](auto, auto& value) { return control->tied_file_watcher()->set_action(utils::TiedFileWatcher::action_close, value); });
+  CMD2_ANY         ("tied.watch.remove",        [](auto, auto)        { return (int64_t)control->tied_file_watcher()->has_action(utils::TiedFileWatcher::action_remove); });
+  CMD2_ANY_VALUE_V ("tied.watch.remove.set",    [](auto, auto& value) { return control->tied_file_watcher()->set_action(utils::TiedFileWatcher::action_remove, value); });
+  CMD2_ANY         ("tied.watch.files",         [](auto, auto)        { return (int64_t)control->tied_file_watcher()->size_files(); });
+  CMD2_ANY         ("tied.watch.directories",   [](auto, auto)        { return (int64_t)control->tied_file_watcher()->size_directories(); });
+
   // TODO: Deprecate schedule2 in the future.
   CMD2_ANY_LIST    ("schedule",         std::bind(&apply_schedule, std::placeholders::_2));
   CMD2_ANY_LIST    ("schedule2",        std::bind(&apply_schedule, std::placeholders::_2));
@@ -362,6 +461,7 @@ initialize_command_events() {
   CMD2_ANY_LIST    ("download_list",       std::bind(&apply_download_list, std::placeholders::_2));
   CMD2_ANY_LIST    ("d.multicall2",        std::bind(&d_multicall, std::placeholders::_2));
   CMD2_ANY_LIST    ("d.multicall.filtered", std::bind(&d_multicall_filtered, std::placeholders::_2));
+  CMD2_ANY_LIST    ("d.multicall.since",    std::bind(&d_multicall_since, std::placeholders::_2));
 
   CMD2_ANY_LIST    ("directory.watch.added", std::bind(&directory_watch_added, std::placeholders::_2));
   CMD2_ANY_LIST    ("directory.watch.ready", std::bind(&directory_watch_ready, std::placeholders::_2));
@@ -370,10 +470,17 @@ initialize_command_events() {
   rpc::rpc.mark_safe("stop_untied");
   rpc::rpc.mark_safe("close_untied");
   rpc::rpc.mark_safe("remove_untied");
+  rpc::rpc.mark_safe("tied.watch.start");
+  rpc::rpc.mark_safe("tied.watch.stop");
+  rpc::rpc.mark_safe("tied.watch.close");
+  rpc::rpc.mark_safe("tied.watch.remove");
+  rpc::rpc.mark_safe("tied.watch.files");
+  rpc::rpc.mark_safe("tied.watch.directories");
 
   rpc::rpc.mark_safe("close_low_diskspace");
   rpc::rpc.mark_safe("close_low_diskspace.normal");
   rpc::rpc.mark_safe("download_list");
   rpc::rpc.mark_safe("d.multicall2");
   rpc::rpc.mark_safe("d.multicall.filtered");
+  rpc::rpc.mark_safe("d.multicall.since");
 }
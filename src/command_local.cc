@@ -1,5 +1,6 @@
 #include "config.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <fcntl.h>
 #include <functional>
@@ -18,10 +19,14 @@
 #include "core/download.h"
 #include "core/download_list.h"
 #include "core/manager.h"
+#include "rpc/parse.h"
 #include "rpc/parse_commands.h"
 #include "rpc/scgi.h"
+#include "session/session_log.h"
 #include "session/session_manager.h"
+#include "utils/diskspace_cache.h"
 #include "utils/file_status_cache.h"
+#include "utils/loop_stats.h"
 
 #include "globals.h"
 #include "rpc/lua.h"
@@ -197,6 +202,142 @@ cmd_file_append(const torrent::Object::list_type& args) {
   return torrent::Object();
 }
 
+template <typename Result>
+torrent::Object
+session_log_value(Result (session::SessionLog::*getter)()) {
+  auto log = session_thread::manager()->session_log();
+
+  return log != nullptr ? (int64_t)(log->*getter)() : (int64_t)0;
+}
+
+// Returns the commands called while profiling as a list of maps, sorted
+// in descending order by 'calls', 'total', 'self', 'max' or 'mean', with
+// an optional limit on the number of rows. Times are in microseconds.
+torrent::Object
+system_profile_dump(const torrent::Object::list_type& args) {
+  typedef std::pair<const std::string*, const rpc::command_profile_type*> entry_type;
+
+  auto        arg      = args.begin();
+  std::string sort_key = arg != args.end() ? (arg++)->as_string() : std::string();
+  int64_t     limit    = arg != args.end() ? rpc::convert_to_value(*arg++) : 0;
+
+  if (sort_key.empty())
+    sort_key = "total";
+
+  auto usec = [](std::chrono::nanoseconds t) { return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(t).count(); };
+  auto mean = [](const rpc::command_profile_type* p) { return p->total / std::max<uint64_t>(p->calls, 1); };
+
+  std::function<bool(const entry_type&, const entry_type&)> compare;
+
+  if (sort_key == "calls")
+    compare = [](auto& a, auto& b) { return a.second->calls > b.second->calls; };
+  else if (sort_key == "total")
+    compare = [](auto& a, auto& b) { return a.second->total > b.second->total; };
+  else if (sort_key == "self")
+    compare = [](auto& a, auto& b) { return a.second->self > b.second->self; };
+  else if (sort_key == "max")
+    compare = [](auto& a, auto& b) { return a.second->max > b.second->max; };
+  else if (sort_key == "mean")
+    compare = [mean](auto& a, auto& b) { return mean(a.second) > mean(b.second); };
+  else
+    throw torrent::input_error("Invalid sort key, expected 'calls', 'total', 'self', 'max' or 'mean'.");
+
+  std::vector<entry_type> entries;
+
+  for (const auto& itr : rpc::commands)
+    if (itr.second.m_profile != nullptr && itr.second.m_profile->calls != 0)
+      entries.emplace_back(&itr.first, itr.second.m_profile.get());
+
+  std::stable_sort(entries.begin(), entries.end(), compare);
+
+  if (limit > 0 && entries.size() > (size_t)limit)
+    entries.resize(limit);
+
+  torrent::Object             result = torrent::Object::create_list();
+  torrent::Object::list_type& rows   = result.as_list();
+
+  for (const auto& [name, profile] : entries) {
+    torrent::Object& row = *rows.insert(rows.end(), torrent::Object::create_map());
+    torrent::Object  histogram = torrent::Object::create_list();
+
+    for (auto count : profile->histogram)
+      histogram.as_list().push_back((int64_t)count);
+
+    row.insert_key("name",      *name);
+    row.insert_key("calls",     (int64_t)profile->calls);
+    row.insert_key("total",     usec(profile->total));
+    row.insert_key("self",      usec(profile->self));
+    row.insert_key("max",       usec(profile->max));
+    row.insert_key("mean",      usec(mean(profile)));
+    row.insert_key("p50",       (int64_t)profile->percentile(0.50).count());
+    row.insert_key("p99",       (int64_t)profile->percentile(0.99).count());
+    row.insert_key("histogram", histogram);
+  }
+
+  return result;
+}
+
+torrent::Object
+loop_stats_entry(const utils::LoopStats::entry_type& entry) {
+  torrent::Object result = torrent::Object::create_map();
+
+  result.insert_key("count",    (int64_t)entry.count);
+  result.insert_key("total",    (int64_t)entry.total);
+  result.insert_key("max",      (int64_t)entry.max);
+  result.insert_key("mean",     (int64_t)(entry.total / std::max<uint64_t>(entry.count, 1)));
+  result.insert_key("stalls",   (int64_t)entry.stalls);
+  result.insert_key("max_name", entry.max_name);
+
+  return result;
+}
+
+// Returns the time spent in each category of main thread tasks, with
+// scheduler items also listed by key. Times are in microseconds.
+torrent::Object
+system_loop_stats() {
+  torrent::Object result    = torrent::Object::create_map();
+  torrent::Object scheduler = torrent::Object::create_map();
+
+  for (int i = 0; i != utils::LoopStats::CATEGORY_SIZE; i++) {
+    auto category = (utils::LoopStats::category_type)i;
+
+    result.insert_key(utils::LoopStats::category_name(category), loop_stats_entry(loop_stats.category(category)));
+  }
+
+  for (const auto& [key, entry] : loop_stats.scheduler_keys())
+    scheduler.insert_key(key, loop_stats_entry(entry));
+
+  result.insert_key("scheduler_keys",  scheduler);
+  result.insert_key("stalls",          (int64_t)loop_stats.stalls());
+  result.insert_key("stall_threshold", (int64_t)loop_stats.stall_threshold() / 1000);
+
+  return result;
+}
+
+void
+system_loop_stats_set_stall_threshold(int64_t msec) {
+  if (msec < 0 || msec > 3600 * 1000)
+    throw torrent::input_error("Stall threshold must be between 0 and 3600000 milliseconds.");
+
+  loop_stats.set_stall_threshold(msec * 1000);
+}
+
+// Returns the cached free diskspace of each filesystem in use by
+// downloads, keyed by device id.
+torrent::Object
+system_diskspace_cache() {
+  torrent::Object result = torrent::Object::create_map();
+
+  for (const auto& [device, entry] : control->core()->diskspace_cache()->devices()) {
+    torrent::Object& item = result.insert_key(std::to_string(device), torrent::Object::create_map());
+
+    item.insert_key("path", entry.path);
+    item.insert_key("free", (int64_t)entry.free);
+  }
+
+  return result;
+}
+
 void
 initialize_command_local() {
   core::DownloadList*    dList = control->core()->download_list();
@@ -257,6 +398,20 @@ initialize_command_local() {
   CMD2_ANY         ("system.cwd",                      std::bind(&system_get_cwd));
   CMD2_ANY_STRING  ("system.cwd.set",                  std::bind(&system_set_cwd, std::placeholders::_2));
 
+  CMD2_ANY         ("system.profile.enable",           [](auto, auto)        { return rpc::commands.is_profiling(); });
+  CMD2_ANY_VALUE_V ("system.profile.enable.set",       [](auto, auto& value) { return rpc::commands.set_profiling(value); });
+  CMD2_ANY_V       ("system.profile.reset",            [](auto, auto)        { return rpc::commands.profile_reset(); });
+  CMD2_ANY_LIST    ("system.profile.dump",             [](auto, auto& args)  { return system_profile_dump(args); });
+
+  CMD2_ANY         ("system.loop_stats",                       [](auto, auto)        { return system_loop_stats(); });
+  CMD2_ANY_V       ("system.loop_stats.reset",                 [](auto, auto)        { return loop_stats.reset(); });
+  CMD2_ANY         ("system.loop_stats.stall_threshold",       [](auto, auto)        { return (int64_t)loop_stats.stall_threshold() / 1000; });
+  CMD2_ANY_VALUE_V ("system.loop_stats.stall_threshold.set",   [](auto, auto& value) { return system_loop_stats_set_stall_threshold(value); });
+
+  CMD2_ANY         ("system.diskspace_cache",                  [](auto, auto)        { return system_diskspace_cache(); });
+  CMD2_ANY         ("system.diskspace_cache.ttl",              [](auto, auto)        { return (int64_t)control->core()->diskspace_cache()->ttl().count(); });
+  CMD2_ANY_VALUE_V ("system.diskspace_cache.ttl.set",          [](auto, auto& value) { return control->core()->diskspace_cache()->set_ttl(std::chrono::seconds(value)); });
+
   CMD2_ANY         ("pieces.sync.always_safe",         std::bind(&CM_t::safe_sync, chunkManager));
   CMD2_ANY_VALUE_V ("pieces.sync.always_safe.set",     std::bind(&CM_t::set_safe_sync, chunkManager, std::placeholders::_2));
   CMD2_ANY         ("pieces.sync.safe_free_diskspace", std::bind(&CM_t::safe_free_diskspace, chunkManager));
@@ -294,6 +449,20 @@ initialize_command_local() {
   CMD2_ANY         ("session.use_lock",                [](auto, auto)        { return session_thread::manager()->use_lock(); });
   CMD2_ANY_VALUE_V ("session.use_lock.set",            [](auto, auto& value) { return session_thread::manager()->set_use_lock(value); });
   CMD2_VAR_BOOL    ("session.on_completion",           true);
+  CMD2_ANY         ("session.format",                  [](auto, auto)        { return session_thread::manager()->format_name(); });
+  CMD2_ANY_STRING_V("session.format.set",              [](auto, auto& str)   { return session_thread::manager()->set_format(str); });
+
+  CMD2_ANY         ("session.log.size",                [](auto, auto)        { return session_log_value(&session::SessionLog::total_size); });
+  CMD2_ANY         ("session.log.live_size",           [](auto, auto)        { return session_log_value(&session::SessionLog::live_size); });
+  CMD2_ANY         ("session.log.segments",            [](auto, auto)        { return session_log_value(&session::SessionLog::segment_count); });
+
+  CMD2_ANY         ("session.save_workers",            [](auto, auto)        { return (int64_t)session_thread::manager()->save_workers(); });
+  CMD2_ANY_VALUE_V ("session.save_workers.set",        [](auto, auto& value) { return session_thread::manager()->set_save_workers(value); });
+  CMD2_ANY         ("session.save_queue.size",         [](auto, auto)        { return session_thread::manager()->save_queue_size(); });
+  CMD2_ANY         ("session.save_count",              [](auto, auto)        { return session_thread::manager()->save_count(); });
+  CMD2_ANY         ("session.save_skipped",            [](auto, auto)        { return session_thread::manager()->save_skipped_count(); });
+  CMD2_ANY         ("session.save_rate",               [](auto, auto)        { return session_thread::manager()->save_rate(); });
+  CMD2_ANY         ("session.save_latency.p99",        [](auto, auto)        { return session_thread::manager()->save_latency_p99(); });
 
   CMD2_ANY_V       ("session.save",                    [dList](auto, auto)   { return dList->session_save(); });
 
@@ -305,6 +474,8 @@ initialize_command_local() {
 
   CMD2_ANY         ("lua.execute",                    std::bind(&rpc::execute_lua, lua_engine, std::placeholders::_1, std::placeholders::_2, 0));
   CMD2_ANY         ("lua.execute.str",                std::bind(&rpc::execute_lua, lua_engine, std::placeholders::_1, std::placeholders::_2, rpc::LuaEngine::flag_string));
+  CMD2_ANY         ("lua.cache.size",                 [lua_engine](auto, auto) { return (int64_t)lua_engine->size_chunks(); });
+  CMD2_ANY_V       ("lua.cache.clear",                [lua_engine](auto, auto) { return lua_engine->clear_chunks(); });
 #endif
 
 #define CMD2_EXECUTE(key, flags)                                        \
@@ -323,6 +494,9 @@ initialize_command_local() {
   CMD2_EXECUTE     ("execute.capture",         rpc::ExecFile::flag_throw | rpc::ExecFile::flag_expand_tilde | rpc::ExecFile::flag_capture);
   CMD2_EXECUTE     ("execute.capture_nothrow", rpc::ExecFile::flag_expand_tilde | rpc::ExecFile::flag_capture);
 
+  CMD2_ANY_LIST    ("execute.async",         std::bind(&rpc::ExecFile::execute_async, &rpc::execFile, std::placeholders::_1, std::placeholders::_2));
+  CMD2_ANY         ("execute.async.pending", [](auto, auto) { return (int64_t)rpc::execFile.size_async(); });
+
   CMD2_ANY_LIST    ("file.append",    std::bind(&cmd_file_append, std::placeholders::_2));
 
   // TODO: Convert to new command types:
@@ -343,11 +517,29 @@ initialize_command_local() {
   rpc::rpc.mark_safe("system.file.max_size");
   rpc::rpc.mark_safe("system.file.split_size");
   rpc::rpc.mark_safe("system.file.split_suffix");
+  rpc::rpc.mark_safe("system.profile.enable");
+  rpc::rpc.mark_safe("system.profile.dump");
+  rpc::rpc.mark_safe("system.loop_stats");
+  rpc::rpc.mark_safe("system.loop_stats.stall_threshold");
+  rpc::rpc.mark_safe("system.diskspace_cache");
+  rpc::rpc.mark_safe("system.diskspace_cache.ttl");
+  rpc::rpc.mark_safe("lua.cache.size");
+  rpc::rpc.mark_safe("execute.async.pending");
 
   rpc::rpc.mark_safe("directory.default");
   rpc::rpc.mark_safe("session.path");
   rpc::rpc.mark_safe("session.use_lock");
   rpc::rpc.mark_safe("session.on_completion");
+  rpc::rpc.mark_safe("session.format");
+  rpc::rpc.mark_safe("session.log.size");
+  rpc::rpc.mark_safe("session.log.live_size");
+  rpc::rpc.mark_safe("session.log.segments");
+  rpc::rpc.mark_safe("session.save_workers");
+  rpc::rpc.mark_safe("session.save_queue.size");
+  rpc::rpc.mark_safe("session.save_count");
+  rpc::rpc.mark_safe("session.save_skipped");
+  rpc::rpc.mark_safe("session.save_rate");
+  rpc::rpc.mark_safe("session.save_latency.p99");
 
   rpc::rpc.mark_safe("pieces.sync.always_safe");
   rpc::rpc.mark_safe("pieces.sync.timeout");
@@ -81,15 +81,38 @@ initialize_rpc_handlers() {
 }
 
 torrent::Object
-apply_scgi(const std::string& arg, int type) {
-  if (scgi_thread::scgi() != nullptr)
-    throw torrent::input_error("SCGI already enabled.");
+apply_scgi_stats(rpc::SCgi* scgi) {
+  torrent::Object result = torrent::Object::create_map();
+
+  result.insert_key("accepted",       scgi != nullptr ? int64_t(scgi->accepted()) : int64_t());
+  result.insert_key("rejected",       scgi != nullptr ? int64_t(scgi->rejected()) : int64_t());
+  result.insert_key("requests",       scgi != nullptr ? int64_t(scgi->requests()) : int64_t());
+  result.insert_key("in_flight",      scgi != nullptr ? int64_t(scgi->in_flight()) : int64_t());
+  result.insert_key("pool_size",      scgi != nullptr ? int64_t(scgi->pool_size()) : int64_t());
+  result.insert_key("queue_wait",     scgi != nullptr ? int64_t(scgi->queue_wait().count()) : int64_t());
+  result.insert_key("queue_wait_max", scgi != nullptr ? int64_t(scgi->queue_wait_max().count()) : int64_t());
+
+  return result;
+}
+
+torrent::Object
+apply_scgi(const std::string& arg, int type, rpc::SCgi::Protocol protocol) {
+  bool        is_http = protocol == rpc::SCgi::HTTP;
+  const char* name    = is_http ? "HTTP RPC" : "SCGI";
+
+  if ((is_http ? scgi_thread::http() : scgi_thread::scgi()) != nullptr)
+    throw torrent::input_error(std::string(name) + " already enabled.");
 
   initialize_rpc_handlers();
 
   torrent::sa_unique_ptr sa;
 
-  auto scgi = std::make_unique<rpc::SCgi>();
+  auto scgi = std::make_unique<rpc::SCgi>(protocol);
+
+  if (is_http) {
+    scgi->set_http_trusted(rpc::call_command_value("network.rpc.http.trusted"));
+    scgi->set_http_host(rpc::call_command_string("network.rpc.http.host"));
+  }
 
   try {
     int port{};
@@ -102,7 +125,7 @@ apply_scgi(const std::string& arg, int type) {
       if (std::sscanf(arg.c_str(), ":%i%c", &port, &dummy) == 1) {
         sa = torrent::sa_make_inet();
 
-        lt_log_print(torrent::LOG_RPC_EVENTS, "SCGI socket is open to any address and is a security risk");
+        lt_log_print(torrent::LOG_RPC_EVENTS, "%s socket is open to any address and is a security risk", name);
 
       } else if (std::sscanf(arg.c_str(), "%1023[^:]:%i%c", address, &port, &dummy) == 2 ||
                  std::sscanf(arg.c_str(), "[%64[^]]]:%i%c", address, &port, &dummy) == 2) { // [xx::xx]:port format
@@ -113,7 +136,7 @@ apply_scgi(const std::string& arg, int type) {
           throw torrent::input_error("Could not bind address: " + std::string(e.what()));
         }
 
-        lt_log_print(torrent::LOG_RPC_EVENTS, "SCGI socket is bound to an address and might be a security risk");
+        lt_log_print(torrent::LOG_RPC_EVENTS, "%s socket is bound to an address and might be a security risk", name);
 
       } else {
         throw torrent::input_error("Could not parse address.");
@@ -140,7 +163,11 @@ apply_scgi(const std::string& arg, int type) {
     throw torrent::input_error(e.what());
   }
 
-  scgi_thread::set_scgi(scgi.release());
+  if (is_http)
+    scgi_thread::set_http(scgi.release());
+  else
+    scgi_thread::set_scgi(scgi.release());
+
   return torrent::Object();
 }
 
@@ -294,8 +321,8 @@ initialize_command_network() {
   CMD2_ANY         ("network.max_open_sockets",      [](auto, auto)                    { return torrent::runtime::socket_manager()->max_size(); });
   CMD2_ANY_VALUE_V ("network.max_open_sockets.set",  [](auto, auto& value)             { return torrent::runtime::socket_manager()->set_max_size_and_adjust(value); });
 
-  CMD2_ANY_STRING  ("network.scgi.open_port",        std::bind(&apply_scgi, std::placeholders::_2, 1));
-  CMD2_ANY_STRING  ("network.scgi.open_local",       std::bind(&apply_scgi, std::placeholders::_2, 2));
+  CMD2_ANY_STRING  ("network.scgi.open_port",        std::bind(&apply_scgi, std::placeholders::_2, 1, rpc::SCgi::SCGI));
+  CMD2_ANY_STRING  ("network.scgi.open_local",       std::bind(&apply_scgi, std::placeholders::_2, 2, rpc::SCgi::SCGI));
   CMD2_VAR_BOOL    ("network.scgi.dont_route",       false);
   CMD2_ANY         ("network.scgi.open_systemd",     [](auto, auto) { return apply_scgi_systemd(); });
 
@@ -303,6 +330,20 @@ initialize_command_network() {
   CMD2_ANY_VALUE_V ("network.scgi.use_gzip.set",      [](const auto&, const auto& arg) { return rpc::rpc.set_scgi_allow_compression(arg); });
   CMD2_ANY         ("network.scgi.gzip.min_size",     [](const auto&, const auto&)     { return rpc::rpc.scgi_min_compress_size(); });
   CMD2_ANY_VALUE_V ("network.scgi.gzip.min_size.set", [](const auto&, const auto& arg) { return rpc::rpc.set_scgi_min_compress_size(arg); });
+  CMD2_ANY         ("network.scgi.gzip.level",        [](const auto&, const auto&)     { return rpc::rpc.scgi_compress_level(); });
+  CMD2_ANY_VALUE_V ("network.scgi.gzip.level.set",    [](const auto&, const auto& arg) { return rpc::rpc.set_scgi_compress_level(arg); });
+  CMD2_ANY         ("network.scgi.max_connections",     [](const auto&, const auto&)     { return rpc::rpc.scgi_max_connections(); });
+  CMD2_ANY_VALUE_V ("network.scgi.max_connections.set", [](const auto&, const auto& arg) { return rpc::rpc.set_scgi_max_connections(arg); });
+  CMD2_ANY         ("network.scgi.stats",               [](const auto&, const auto&)     { return apply_scgi_stats(scgi_thread::scgi()); });
+
+  // HTTP/1.1 listener for the same RPC requests, sharing the SCGI
+  // connection limit and gzip settings. Trust and the accepted Host are
+  // read when the listener is opened.
+  CMD2_VAR_BOOL    ("network.rpc.http.trusted",      false);
+  CMD2_VAR_STRING  ("network.rpc.http.host",         "");
+  CMD2_ANY_STRING  ("network.rpc.http.open_port",    std::bind(&apply_scgi, std::placeholders::_2, 1, rpc::SCgi::HTTP));
+  CMD2_ANY_STRING  ("network.rpc.http.open_local",   std::bind(&apply_scgi, std::placeholders::_2, 2, rpc::SCgi::HTTP));
+  CMD2_ANY         ("network.rpc.http.stats",        [](const auto&, const auto&) { return apply_scgi_stats(scgi_thread::http()); });
 
   CMD2_ANY_STRING  ("network.xmlrpc.dialect.set",     [](const auto&, const auto& arg) { return apply_xmlrpc_dialect(arg); })
   CMD2_ANY         ("network.xmlrpc.size_limit",      [](const auto&, const auto&)     { return rpc::rpc.size_limit(); });
@@ -349,6 +390,9 @@ initialize_command_network() {
   rpc::rpc.mark_safe("network.http.proxy_address");
   rpc::rpc.mark_safe("network.proxy_address");
   rpc::rpc.mark_safe("network.scgi.dont_route");
+  rpc::rpc.mark_safe("network.scgi.max_connections");
+  rpc::rpc.mark_safe("network.scgi.stats");
+  rpc::rpc.mark_safe("network.rpc.http.stats");
   rpc::rpc.mark_safe("protocol.pex");
 
   rpc::rpc.mark_safe("network.rpc.use_xmlrpc");
@@ -546,6 +546,34 @@ cmd_view_size_not_visible(const torrent::Object::string_type& args) {
   return (*control->view_manager()->find_throw(args))->size_not_visible();
 }
 
+torrent::Object
+cmd_view_filter_stats(const torrent::Object::string_type& args) {
+  core::View* view = *control->view_manager()->find_throw(args);
+
+  torrent::Object result = torrent::Object::create_map();
+  result.insert_key("evaluated", (int64_t)view->filter_evaluated());
+  result.insert_key("skipped",   (int64_t)view->filter_skipped());
+  result.insert_key("rebuilds",  (int64_t)view->filter_rebuilds());
+
+  return result;
+}
+
+torrent::Object
+cmd_view_filter_incremental(const torrent::Object::string_type& args) {
+  return (int64_t)(*control->view_manager()->find_throw(args))->filter_incremental();
+}
+
+torrent::Object
+cmd_view_filter_incremental_set(const torrent::Object::list_type& args) {
+  if (args.size() != 2)
+    throw torrent::input_error("Wrong argument count.");
+
+  core::View* view = *control->view_manager()->find_throw(args.front().as_string());
+
+  view->set_filter_incremental(rpc::convert_to_value(args.back()));
+  return torrent::Object();
+}
+
 torrent::Object
 cmd_view_persistent(const torrent::Object::string_type& args) {
   core::View* view = *control->view_manager()->find_throw(args);
@@ -557,6 +585,9 @@ cmd_view_persistent(const torrent::Object::string_type& args) {
   view->set_event_added("d.views.push_back_unique=" + args);
   view->set_event_removed("d.views.remove=" + args);
 
+  // Only depends on the download's own state.
+  view->set_filter_incremental(true);
+
   return torrent::Object();
 }
 
@@ -821,7 +852,11 @@ initialize_command_ui() {
   CMD2_ANY_STRING("view.size_not_visible",  std::bind(&cmd_view_size_not_visible, std::placeholders::_2));
   CMD2_ANY_STRING("view.persistent",        std::bind(&cmd_view_persistent, std::placeholders::_2));
 
-  CMD2_ANY_STRING_V("view.filter_all",      std::bind(&core::View::filter, std::bind(&core::ViewManager::find_ptr_throw, control->view_manager(), std::placeholders::_2)));
+  CMD2_ANY_STRING_V("view.filter_all",      std::bind(&core::View::filter_rebuild, std::bind(&core::ViewManager::find_ptr_throw, control->view_manager(), std::placeholders::_2)));
+  CMD2_ANY_STRING  ("view.filter.stats",    std::bind(&cmd_view_filter_stats, std::placeholders::_2));
+
+  CMD2_ANY_STRING  ("view.filter.incremental",     std::bind(&cmd_view_filter_incremental, std::placeholders::_2));
+  CMD2_ANY_LIST    ("view.filter.incremental.set", std::bind(&cmd_view_filter_incremental_set, std::placeholders::_2));
 
   CMD2_DL_STRING ("view.filter_download", std::bind(&cmd_view_filter_download, std::placeholders::_1, std::placeholders::_2));
   CMD2_DL_STRING ("view.set_visible",     std::bind(&cmd_view_set_visible,     std::placeholders::_1, std::placeholders::_2));
@@ -25,8 +25,11 @@
 #include "rpc/lua.h"
 #include "rpc/parse_commands.h"
 #include "rpc/object_storage.h"
+#include "session/session_loader.h"
 #include "session/session_manager.h"
 #include "ui/root.h"
+#include "utils/diskspace_cache.h"
+#include "utils/tied_file_watcher.h"
 #include "utils/watch_ready_queue.h"
 
 Control::Control()
@@ -38,7 +41,8 @@ Control::Control()
     m_objectStorage(new rpc::object_storage()),
     m_lua_engine(new rpc::LuaEngine()),
     m_directory_events(new torrent::directory_events()),
-    m_watch_ready_queue(new utils::WatchReadyQueue()) {
+    m_watch_ready_queue(new utils::WatchReadyQueue()),
+    m_tied_file_watcher(new utils::TiedFileWatcher()) {
 
   m_core         = std::make_unique<core::Manager>();
   m_view_manager = std::make_unique<core::ViewManager>();
@@ -82,6 +86,7 @@ Control::initialize() {
 void
 Control::cleanup() {
   rpc::rpc.cleanup();
+  rpc::execFile.cleanup();
 
   torrent::this_thread::scheduler()->erase(&m_task_shutdown);
 
@@ -91,6 +96,17 @@ Control::cleanup() {
   if (scgi_thread::thread()->is_active())
     scgi_thread::thread()->stop_thread_wait();
 
+  // The workers read from the session log, so they must be stopped
+  // before the session thread.
+  if (m_session_loader != nullptr) {
+    m_session_loader->cleanup();
+
+    delete m_session_loader;
+    m_session_loader = nullptr;
+  }
+
+  m_core->diskspace_cache()->cleanup();
+
   // Wait for all session files to be written.
   session_thread::manager()->flush_all_pending_builds();
   session_thread::thread()->stop_thread_wait();
@@ -107,6 +123,10 @@ Control::cleanup() {
 void
 Control::cleanup_exception() {
   display::Canvas::cleanup();
+
+  // Children of execute.async are registered with the poll, and must be
+  // closed before the global ExecFile is destroyed.
+  rpc::execFile.cleanup();
 }
 
 bool
@@ -139,6 +159,7 @@ Control::handle_shutdown() {
     torrent::runtime::network_manager()->listen_close();
 
     m_directory_events->close();
+    m_tied_file_watcher->shutdown();
     m_core->shutdown(false);
 
     if (!m_task_shutdown.is_scheduled())
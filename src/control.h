@@ -34,11 +34,16 @@ namespace rpc {
   class LuaEngine;
 }
 
+namespace session {
+  class SessionLoader;
+}
+
 namespace torrent {
   class directory_events;
 }
 
 namespace utils {
+  class TiedFileWatcher;
   class WatchReadyQueue;
 }
 
@@ -75,6 +80,12 @@ public:
 
   torrent::directory_events* directory_events()     { return m_directory_events.get(); }
   utils::WatchReadyQueue*    watch_ready_queue()    { return m_watch_ready_queue.get(); }
+  utils::TiedFileWatcher*    tied_file_watcher()    { return m_tied_file_watcher.get(); }
+
+  // Set while the session torrents are loading, the loader deletes
+  // itself once done.
+  session::SessionLoader*    session_loader()       { return m_session_loader; }
+  void                       set_session_loader(session::SessionLoader* loader) { m_session_loader = loader; }
 
   uint64_t            tick() const                  { return m_tick; }
   void                inc_tick()                    { m_tick++; }
@@ -100,6 +111,8 @@ private:
   std::unique_ptr<rpc::LuaEngine>            m_lua_engine;
   std::unique_ptr<torrent::directory_events> m_directory_events;
   std::unique_ptr<utils::WatchReadyQueue>    m_watch_ready_queue;
+  std::unique_ptr<utils::TiedFileWatcher>    m_tied_file_watcher;
+  session::SessionLoader*                    m_session_loader{};
 
   uint64_t            m_tick{};
 
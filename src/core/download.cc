@@ -2,6 +2,7 @@
 
 #include "core/download.h"
 
+#include <chrono>
 #include <list>
 #include <torrent/exceptions.h>
 #include <torrent/rate.h>
@@ -9,6 +10,7 @@
 #include <torrent/tracker/tracker.h>
 #include <torrent/data/file.h>
 #include <torrent/data/file_list.h>
+#include <torrent/system/thread.h>
 #include <torrent/utils/file_stat.h>
 
 #include "rpc/parse_commands.h"
@@ -18,9 +20,16 @@
 
 namespace core {
 
+// Starts from the wall clock, so the generations handed out to RPC
+// clients keep increasing across restarts.
+uint64_t Download::m_last_generation =
+  std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
 Download::Download(download_type d)
   : m_download(d) {
 
+  mark_changed();
+
   m_download.info()->signal_tracker_success().push_back(std::bind(&Download::receive_tracker_msg, this, ""));
   m_download.info()->signal_tracker_failed().push_back(std::bind(&Download::receive_tracker_msg, this, std::placeholders::_1));
 }
@@ -48,6 +57,7 @@ Download::set_priority(uint32_t p) {
     torrent::download_set_priority(m_download, p * p);
 
   bencode()->get_key("rtorrent").insert_key("priority", (int64_t)p);
+  mark_changed();
 }
 
 uint32_t
@@ -55,12 +65,66 @@ Download::connection_list_size() const {
   return m_download.connection_list()->size();
 }
 
+// Tracker replies set the same message on every announce, which should
+// not mark the download as changed.
+void
+Download::set_message(const std::string& msg) {
+  if (m_message == msg)
+    return;
+
+  m_message = msg;
+  mark_changed();
+}
+
 void
 Download::receive_tracker_msg(std::string msg) {
   if (msg.empty())
-    m_message = "";
+    set_message("");
   else
-    m_message = "Tracker: [" + msg + "]";
+    set_message("Tracker: [" + msg + "]");
+}
+
+bool
+Download::change_state::operator == (const change_state& rhs) const {
+  return
+    up_total == rhs.up_total && down_total == rhs.down_total &&
+    up_rate == rhs.up_rate && down_rate == rhs.down_rate &&
+    completed_chunks == rhs.completed_chunks && connections == rhs.connections &&
+    flags == rhs.flags;
+}
+
+// Compares the transfer state against the last refresh, at most once
+// per cached time tick as every view refreshes all downloads before
+// filtering.
+void
+Download::refresh_changes() {
+  if (m_change_refreshed == torrent::this_thread::cached_time())
+    return;
+
+  m_change_refreshed = torrent::this_thread::cached_time();
+
+  change_state state{
+    m_download.info()->up_rate()->total(),
+    m_download.info()->down_rate()->total(),
+    m_download.info()->up_rate()->rate(),
+    m_download.info()->down_rate()->rate(),
+    m_download.file_list()->completed_chunks(),
+    m_download.connection_list()->size(),
+    (uint32_t)is_open() << 0 | (uint32_t)is_active() << 1 | (uint32_t)is_done() << 2 | (uint32_t)is_hash_checking() << 3 | (uint32_t)is_hash_checked() << 4
+  };
+
+  if (state == m_change_state)
+    return;
+
+  m_change_state = state;
+  mark_changed();
+}
+
+bool
+Download::is_session_dirty() {
+  refresh_changes();
+
+  return m_change_generation > m_session_generation;
 }
 
 float
@@ -97,6 +161,7 @@ Download::set_throttle_name(const std::string& throttleName) {
   m_download.set_download_throttle(throttles.second);
 
   m_download.bencode()->get_key("rtorrent").insert_key("throttle_name", throttleName);
+  mark_changed();
 }
 
 void
@@ -129,6 +194,7 @@ Download::set_root_directory(const std::string& path) {
   file_list->set_root_dir(expand_path(path));
 
   bencode()->get_key("rtorrent").insert_key("directory", path);
+  mark_changed();
 }
 
 }
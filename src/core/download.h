@@ -1,6 +1,8 @@
 #ifndef RTORRENT_CORE_DOWNLOAD_H
 #define RTORRENT_CORE_DOWNLOAD_H
 
+#include <algorithm>
+#include <chrono>
 #include <torrent/common.h>
 #include <torrent/download.h>
 #include <torrent/download_info.h>
@@ -48,7 +50,7 @@ public:
   bool                is_hash_checking() const                 { return m_download.is_hash_checking(); }
 
   bool                is_hash_failed() const                   { return m_hashFailed; }
-  void                set_hash_failed(bool v)                  { m_hashFailed = v; }
+  void                set_hash_failed(bool v)                  { m_hashFailed = v; mark_changed(); }
 
   download_type*       download()                              { return &m_download; }
   const download_type* c_download() const                      { return &m_download; }
@@ -68,7 +70,7 @@ public:
   uint32_t            connection_list_size() const;
 
   const std::string&  message() const                          { return m_message; }
-  void                set_message(const std::string& msg)      { m_message = msg; }
+  void                set_message(const std::string& msg);
 
   uint32_t            priority();
   void                set_priority(uint32_t p);
@@ -86,7 +88,27 @@ public:
 
   // HACK: Choke group setting.
   unsigned int        group() const { return m_group; }
-  void                set_group(unsigned int g) { m_group = g; }
+  void                set_group(unsigned int g) { m_group = g; mark_changed(); }
+
+  // Change tracking lets views skip downloads that have not changed
+  // since they were last filtered.
+  //
+  // The generation is taken from a counter shared by all downloads,
+  // and is bumped by download events, setters and by refresh_changes()
+  // when the transfer state has changed. State that is only derived
+  // from the current time is not tracked.
+  uint64_t            change_generation() const { return m_change_generation; }
+  void                mark_changed()            { m_change_generation = ++m_last_generation; }
+
+  void                refresh_changes();
+
+  static uint64_t     last_generation()         { return m_last_generation; }
+
+  // Downloads that have not changed since their resume data was last
+  // saved are skipped by session.save. The generation is the one the
+  // resume data was built at, set once it has been written.
+  bool                is_session_dirty();
+  void                set_session_saved(uint64_t generation) { m_session_generation = std::max(m_session_generation, generation); }
 
 private:
   Download(const Download&);
@@ -96,12 +118,31 @@ private:
 
   void                receive_chunk_failed(uint32_t idx);
 
+  struct change_state {
+    uint64_t up_total;
+    uint64_t down_total;
+    uint64_t up_rate;
+    uint64_t down_rate;
+    uint32_t completed_chunks;
+    uint32_t connections;
+    uint32_t flags;
+
+    bool operator == (const change_state& rhs) const;
+  };
+
+  static uint64_t     m_last_generation;
+
   // Store the FileList instance so we can use slots etc on it.
   download_type       m_download;
   bool                m_hashFailed{};
   std::string         m_message;
   uint32_t            m_resumeFlags{~uint32_t{}};
   unsigned int        m_group{};
+
+  uint64_t                  m_change_generation{};
+  change_state              m_change_state{};
+  std::chrono::microseconds m_change_refreshed{};
+  uint64_t                  m_session_generation{};
 };
 
 inline bool
@@ -93,6 +93,24 @@ DownloadFactory::load_raw_data(const std::string& input) {
   m_loaded = true;
 }
 
+// This function must be called before DownloadFactory::commit().
+void
+DownloadFactory::load_session_objects(const std::string& uri, bool is_file,
+                                      std::unique_ptr<torrent::Object> object,
+                                      std::unique_ptr<torrent::Object> rtorrent,
+                                      std::unique_ptr<torrent::Object> libtorrent_resume) {
+  if (m_stream || m_object)
+    throw torrent::internal_error("DownloadFactory::load*() called on an already loaded object");
+
+  m_uri                       = uri;
+  m_isFile                    = is_file;
+  m_object                    = object.release();
+  m_session_rtorrent          = std::move(rtorrent);
+  m_session_libtorrent_resume = std::move(libtorrent_resume);
+  m_session_objects           = true;
+  m_loaded                    = true;
+}
+
 void
 DownloadFactory::commit() {
   torrent::this_thread::scheduler()->wait_for(&m_task_commit, 0ms);
@@ -158,8 +176,18 @@ DownloadFactory::receive_commit() {
 
 void
 DownloadFactory::receive_success() {
-  auto rtorrent_object          = download_factory_load_stream((expand_path(m_uri) + ".rtorrent").c_str());
-  auto libtorrent_resume_object = download_factory_load_stream((expand_path(m_uri) + ".libtorrent_resume").c_str());
+  auto started = std::chrono::steady_clock::now();
+
+  std::unique_ptr<torrent::Object> rtorrent_object;
+  std::unique_ptr<torrent::Object> libtorrent_resume_object;
+
+  if (m_session_objects) {
+    rtorrent_object          = std::move(m_session_rtorrent);
+    libtorrent_resume_object = std::move(m_session_libtorrent_resume);
+  } else {
+    rtorrent_object          = download_factory_load_stream((expand_path(m_uri) + ".rtorrent").c_str());
+    libtorrent_resume_object = download_factory_load_stream((expand_path(m_uri) + ".libtorrent_resume").c_str());
+  }
 
   uint32_t tracker_key;
 
@@ -301,8 +329,14 @@ DownloadFactory::receive_success() {
     if (!m_session)
        rpc::call_command("d.state.set", (int64_t)m_start, rpc::make_target(download));
 
-    rpc::commands.call_catch(m_session ? "event.download.inserted_session" : "event.download.inserted_new",
-                             rpc::make_target(download), torrent::Object(), "Download event action failed: ");
+    auto inserted = std::chrono::steady_clock::now();
+    m_insert_time = std::chrono::duration_cast<std::chrono::microseconds>(inserted - started);
+
+    if (m_defer_event)
+      m_deferred_download = download;
+    else
+      rpc::commands.call_catch(m_session ? "event.download.inserted_session" : "event.download.inserted_new",
+                               rpc::make_target(download), torrent::Object(), "Download event action failed: ");
 
   } catch (torrent::input_error& e) {
     std::string msg = "Command on torrent creation failed: " + std::string(e.what());
@@ -5,8 +5,10 @@
 #ifndef RTORRENT_CORE_DOWNLOAD_FACTORY_H
 #define RTORRENT_CORE_DOWNLOAD_FACTORY_H
 
+#include <chrono>
 #include <functional>
 #include <iosfwd>
+#include <memory>
 
 #include <torrent/object.h>
 #include <torrent/utils/scheduler.h>
@@ -32,6 +34,13 @@ public:
   // load() or commit().
   void                load(const std::string& uri);
   void                load_raw_data(const std::string& input);
+
+  // Load a session download from objects already read and decoded by
+  // session::SessionLoader, taking ownership of the objects.
+  void                load_session_objects(const std::string& uri, bool is_file,
+                                           std::unique_ptr<torrent::Object> object,
+                                           std::unique_ptr<torrent::Object> rtorrent,
+                                           std::unique_ptr<torrent::Object> libtorrent_resume);
   void                commit();
 
   command_list_type&         commands()     { return m_commands; }
@@ -49,8 +58,21 @@ public:
   bool                print_log() const     { return m_printLog; }
   void                set_print_log(bool v) { m_printLog = v; }
 
+  // Leave calling event.download.inserted_session or inserted_new to
+  // the caller, e.g. to dispatch the event for a batch of downloads.
+  bool                get_defer_event() const { return m_defer_event; }
+  void                set_defer_event(bool v) { m_defer_event = v; }
+
+  // The download left for the caller to call the event on, valid when
+  // slot_finished is called.
+  Download*           deferred_download() const { return m_deferred_download; }
+
   void                slot_finished(slot_void s) { m_slot_finished = s; }
 
+  // Time spent creating and inserting the download. Valid when
+  // slot_finished is called.
+  std::chrono::microseconds insert_time() const { return m_insert_time; }
+
 private:
   void                receive_load();
   void                receive_loaded();
@@ -66,19 +88,28 @@ private:
   std::shared_ptr<std::iostream> m_stream;
   torrent::Object*               m_object{};
 
+  std::unique_ptr<torrent::Object> m_session_rtorrent;
+  std::unique_ptr<torrent::Object> m_session_libtorrent_resume;
+
   bool                m_commited{};
   bool                m_loaded{};
 
   std::string         m_uri;
+  bool                m_session_objects{};
   bool                m_session{};
   bool                m_start{};
   bool                m_printLog{true};
   bool                m_isFile{};
   bool                m_initLoad{};
+  bool                m_defer_event{};
+
+  Download*           m_deferred_download{};
 
   command_list_type         m_commands;
   torrent::Object::map_type m_variables;
 
+  std::chrono::microseconds      m_insert_time{};
+
   slot_void                      m_slot_finished;
   torrent::utils::SchedulerEntry m_task_load;
   torrent::utils::SchedulerEntry m_task_commit;
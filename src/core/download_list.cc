@@ -28,9 +28,15 @@
 #include "core/download_list.h"
 #include "session/session_manager.h"
 #include "ui/root.h"
+#include "utils/loop_stats.h"
+#include "utils/tied_file_watcher.h"
 
-#define DL_TRIGGER_EVENT(download, event_name) \
-  rpc::commands.call_catch(event_name, rpc::make_target(download), torrent::Object(), "Event '" event_name "' failed: ");
+#define DL_TRIGGER_EVENT(download, event_name)                                   \
+  do {                                                                            \
+    utils::LoopTimer loop_timer(&loop_stats, utils::LoopStats::EVENT, event_name); \
+    (download)->mark_changed();                                                   \
+    rpc::commands.call_catch(event_name, rpc::make_target(download), torrent::Object(), "Event '" event_name "' failed: "); \
+  } while (false)
 
 namespace core {
 
@@ -51,6 +57,7 @@ DownloadList::clear() {
 
     try {
       close(download);
+      m_hash_index.erase(download->info()->hash());
       base_type::pop_back();
 
       torrent::download_remove(*download->download());
@@ -69,8 +76,10 @@ DownloadList::clear() {
 
 void
 DownloadList::session_save() {
+  bool save_all = session_thread::manager()->reset_save_failed();
+
   for (auto& download : *this)
-    session_thread::manager()->save_resume_download(download);
+    session_thread::manager()->save_changed_download(download, save_all);
 
   control->dht_manager()->save_dht_cache();
   control->ui()->save_input_history();
@@ -78,7 +87,9 @@ DownloadList::session_save() {
 
 DownloadList::iterator
 DownloadList::find(const torrent::HashString& hash) {
-  return std::find_if(begin(), end(), [hash](Download* d) { return hash == d->info()->hash(); });
+  iterator* itr = m_hash_index.find(hash);
+
+  return itr != NULL ? *itr : end();
 }
 
 DownloadList::iterator
@@ -91,7 +102,7 @@ DownloadList::find_hex(const char* hash) {
   if (torrent::utils::transform_from_hex(hash, hash + 40, key) != key.end())
     return end();
 
-  return std::find_if(begin(), end(), [key](Download* d) { return key == d->info()->hash(); });
+  return find(key);
 }
 
 Download*
@@ -159,7 +170,11 @@ DownloadList::create(std::istream* str, uint32_t tracker_key, bool printLog) {
 
 DownloadList::iterator
 DownloadList::insert(Download* download) {
+  if (m_hash_index.find(download->info()->hash()) != NULL)
+    throw torrent::internal_error("DownloadList::insert(...) download with the same info-hash already inserted.");
+
   iterator itr = base_type::insert(end(), download);
+  m_hash_index.insert(download->info()->hash(), itr);
 
   lt_log_print_info(torrent::LOG_TORRENT_INFO, download->info(), "download_list", "Inserting download.");
 
@@ -174,6 +189,8 @@ DownloadList::insert(Download* download) {
     for (auto v : *control->view_manager())
       v->filter_download(download);
 
+    control->tied_file_watcher()->insert(download);
+
     DL_TRIGGER_EVENT(*itr, "event.download.inserted");
 
   } catch (torrent::local_error& e) {
@@ -187,7 +204,9 @@ DownloadList::insert(Download* download) {
 
 void
 DownloadList::erase_ptr(Download* download) {
-  erase(std::find(begin(), end(), download));
+  iterator itr = find(download->info()->hash());
+
+  erase(itr != end() && *itr == download ? itr : end());
 }
 
 DownloadList::iterator
@@ -208,6 +227,10 @@ DownloadList::erase(iterator itr) {
   for (auto v : *control->view_manager())
     v->erase(*itr);
 
+  control->tied_file_watcher()->erase(*itr);
+
+  m_hash_index.erase((*itr)->info()->hash());
+
   torrent::download_remove(*(*itr)->download());
   delete *itr;
 
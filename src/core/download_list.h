@@ -5,8 +5,9 @@
 #include <list>
 #include <string>
 
+#include "core/hash_string_index.h"
+
 namespace torrent {
-  class HashString;
   class Object;
 }
 
@@ -45,6 +46,8 @@ public:
 
   void                session_save();
 
+  // Lookups by info-hash go through an index kept in sync by insert
+  // and erase, rather than scanning the list.
   iterator            find(const torrent::HashString& hash);
 
   iterator            find_hex(const char* hash);
@@ -129,6 +132,8 @@ private:
   void                confirm_finished(Download* d);
 
   void                process_meta_download(Download* d);
+
+  HashStringIndex<iterator> m_hash_index;
 };
 
 }
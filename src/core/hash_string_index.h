@@ -0,0 +1,161 @@
+#ifndef RTORRENT_CORE_HASH_STRING_INDEX_H
+#define RTORRENT_CORE_HASH_STRING_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <torrent/hash_string.h>
+
+namespace core {
+
+// Open-addressing index from info-hash to T, using linear probing and
+// backward-shift deletion so that erased slots don't leave tombstones.
+//
+// Info-hashes are already uniformly distributed, so the leading bytes
+// are used directly as the hash value.
+
+template <typename T>
+class HashStringIndex {
+public:
+  typedef torrent::HashString key_type;
+  typedef T                   mapped_type;
+
+  static constexpr size_t min_capacity = 16;
+
+  HashStringIndex() = default;
+
+  size_t              size() const     { return m_size; }
+  size_t              capacity() const { return m_slots.size(); }
+  bool                empty() const    { return m_size == 0; }
+
+  void                clear()          { m_slots.clear(); m_size = 0; }
+
+  // Returns NULL if the key is not in the index.
+  T*                  find(const key_type& key);
+  const T*            find(const key_type& key) const { return const_cast<HashStringIndex*>(this)->find(key); }
+
+  // Returns false if the key is already in the index.
+  bool                insert(const key_type& key, const T& value);
+  bool                erase(const key_type& key);
+
+private:
+  struct slot_type {
+    bool     used{false};
+    key_type key;
+    T        value;
+  };
+
+  static size_t       hash_key(const key_type& key);
+
+  size_t              mask() const     { return m_slots.size() - 1; }
+  size_t              find_slot(const key_type& key) const;
+
+  void                resize(size_t new_capacity);
+
+  std::vector<slot_type> m_slots;
+  size_t                 m_size{0};
+};
+
+template <typename T>
+inline size_t
+HashStringIndex<T>::hash_key(const key_type& key) {
+  size_t value;
+  std::memcpy(&value, key.c_str(), sizeof(value));
+
+  return value;
+}
+
+// Returns the slot index, or capacity() if not found.
+template <typename T>
+inline size_t
+HashStringIndex<T>::find_slot(const key_type& key) const {
+  if (m_slots.empty())
+    return 0;
+
+  for (size_t idx = hash_key(key) & mask(); ; idx = (idx + 1) & mask()) {
+    if (!m_slots[idx].used)
+      return m_slots.size();
+
+    if (m_slots[idx].key == key)
+      return idx;
+  }
+}
+
+template <typename T>
+inline T*
+HashStringIndex<T>::find(const key_type& key) {
+  size_t idx = find_slot(key);
+
+  return idx != m_slots.size() ? &m_slots[idx].value : NULL;
+}
+
+template <typename T>
+inline bool
+HashStringIndex<T>::insert(const key_type& key, const T& value) {
+  // Keep the load factor at or below 1/2 so probe sequences stay short.
+  if ((m_size + 1) * 2 > m_slots.size())
+    resize(std::max<size_t>(min_capacity, m_slots.size() * 2));
+
+  size_t idx = hash_key(key) & mask();
+
+  while (m_slots[idx].used) {
+    if (m_slots[idx].key == key)
+      return false;
+
+    idx = (idx + 1) & mask();
+  }
+
+  m_slots[idx].used  = true;
+  m_slots[idx].key   = key;
+  m_slots[idx].value = value;
+  m_size++;
+
+  return true;
+}
+
+template <typename T>
+inline bool
+HashStringIndex<T>::erase(const key_type& key) {
+  size_t hole = find_slot(key);
+
+  if (hole == m_slots.size())
+    return false;
+
+  // Shift back any following entries whose probe sequence passes
+  // through the hole.
+  for (size_t idx = (hole + 1) & mask(); m_slots[idx].used; idx = (idx + 1) & mask()) {
+    size_t home = hash_key(m_slots[idx].key) & mask();
+
+    bool in_place = hole <= idx ? (hole < home && home <= idx) : (hole < home || home <= idx);
+
+    if (in_place)
+      continue;
+
+    m_slots[hole] = m_slots[idx];
+    hole = idx;
+  }
+
+  m_slots[hole].used  = false;
+  m_slots[hole].value = T();
+  m_size--;
+
+  return true;
+}
+
+template <typename T>
+void
+HashStringIndex<T>::resize(size_t new_capacity) {
+  std::vector<slot_type> old_slots(new_capacity);
+  old_slots.swap(m_slots);
+
+  m_size = 0;
+
+  for (const auto& slot : old_slots)
+    if (slot.used)
+      insert(slot.key, slot.value);
+}
+
+}
+
+#endif
@@ -25,6 +25,7 @@
 #include "rpc/parse_commands.h"
 #include "utils/directory.h"
 #include "utils/base64.h"
+#include "utils/diskspace_cache.h"
 #include "utils/file_status_cache.h"
 
 #include "globals.h"
@@ -53,6 +54,7 @@ Manager::Manager()
 
   m_download_list     = std::make_unique<DownloadList>();
   m_file_status_cache = std::make_unique<FileStatusCache>();
+  m_diskspace_cache   = std::make_unique<DiskspaceCache>();
   m_http_queue        = std::make_unique<HttpQueue>();
 
   torrent::Throttle* unthrottled = torrent::Throttle::create_throttle();
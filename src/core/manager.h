@@ -16,6 +16,7 @@ namespace torrent {
 }
 
 namespace utils {
+class DiskspaceCache;
 class FileStatusCache;
 }
 
@@ -30,6 +31,7 @@ class View;
 class Manager {
 public:
   typedef DownloadList::iterator                    DListItr;
+  typedef utils::DiskspaceCache                     DiskspaceCache;
   typedef utils::FileStatusCache                    FileStatusCache;
 
   Manager();
@@ -39,6 +41,7 @@ public:
 
   DownloadList*       download_list()                     { return m_download_list.get(); }
   FileStatusCache*    file_status_cache()                 { return m_file_status_cache.get(); }
+  DiskspaceCache*     diskspace_cache()                   { return m_diskspace_cache.get(); }
 
   HttpQueue*          http_queue()                        { return m_http_queue.get(); }
 
@@ -99,6 +102,7 @@ private:
 
   std::unique_ptr<DownloadList>    m_download_list;
   std::unique_ptr<FileStatusCache> m_file_status_cache;
+  std::unique_ptr<DiskspaceCache>  m_diskspace_cache;
   std::unique_ptr<HttpQueue>       m_http_queue;
 
   View*               m_hashingView{};
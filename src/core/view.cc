@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <functional>
+#include <string>
+#include <vector>
 #include <torrent/download.h>
 #include <torrent/exceptions.h>
 
@@ -50,6 +52,159 @@ struct view_downloads_compare {
   const torrent::Object& m_command;
 };
 
+// Typed fast path for the common '((less,((cmd))))' and
+// '((greater,((cmd))))' sort commands.
+//
+// The commands are called once per download to extract the sort keys,
+// rather than twice for every comparison, and the keys are compared
+// directly instead of going through 'less' or 'greater'.
+class view_downloads_sort_keys {
+public:
+  struct key_type {
+    torrent::Object::type_type type{torrent::Object::TYPE_NONE};
+    int64_t                    value{};
+    std::string                string;
+    bool                       failed{};
+  };
+
+  struct entry_type {
+    key_type  left;
+    key_type  right;
+    Download* download;
+  };
+
+  typedef std::vector<entry_type> entry_list;
+
+  // Returns false if the sort command needs the generic comparator.
+  bool initialize(const torrent::Object& cmd);
+
+  key_type   left_key(Download* d)  { return make_key(*m_left, d); }
+  key_type   right_key(Download* d) { return make_key(*m_right, d); }
+  entry_type make_entry(Download* d);
+
+  bool       compare(const key_type& k1, const key_type& k2);
+  bool       compare_entry(const entry_type& e1, const entry_type& e2) { return compare(e1.left, m_single ? e2.left : e2.right); }
+
+  // Type mismatches are logged once per sort rather than for every
+  // comparison.
+  void       log_errors();
+
+private:
+  static bool is_key_command(const torrent::Object& arg) { return arg.is_dict_key() || arg.is_string(); }
+
+  key_type    make_key(const torrent::Object& arg, Download* d);
+
+  const torrent::Object* m_left{};
+  const torrent::Object* m_right{};
+  bool                   m_single{};
+  bool                   m_greater{};
+  bool                   m_mismatch{};
+};
+
+bool
+view_downloads_sort_keys::initialize(const torrent::Object& cmd) {
+  if (!cmd.is_dict_key())
+    return false;
+
+  if (cmd.as_dict_key() == "greater")
+    m_greater = true;
+  else if (cmd.as_dict_key() != "less")
+    return false;
+
+  const torrent::Object& args = cmd.as_dict_obj();
+
+  if (!args.is_list()) {
+    m_left = m_right = &args;
+
+  } else {
+    if (args.as_list().empty() || args.as_list().size() > 2)
+      return false;
+
+    m_left  = &args.as_list().front();
+    m_right = &args.as_list().back();
+  }
+
+  m_single = m_left == m_right;
+
+  return is_key_command(*m_left) && is_key_command(*m_right);
+}
+
+view_downloads_sort_keys::key_type
+view_downloads_sort_keys::make_key(const torrent::Object& arg, Download* d) {
+  key_type        key;
+  torrent::Object result;
+
+  try {
+    if (arg.is_dict_key())
+      result = rpc::commands.call_command(arg.as_dict_key().c_str(), arg.as_dict_obj(), rpc::make_target(d));
+    else
+      result = rpc::parse_command_single(rpc::make_target(d), arg.as_string());
+
+  } catch (torrent::input_error& e) {
+    control->core()->push_log(e.what());
+
+    // Like the generic comparator, comparisons with a key that failed
+    // are always false.
+    key.failed = true;
+    return key;
+  }
+
+  key.type = result.type();
+
+  switch (result.type()) {
+  case torrent::Object::TYPE_VALUE:
+    key.value = result.as_value();
+    break;
+  case torrent::Object::TYPE_STRING:
+    key.string = std::move(result.as_string());
+    break;
+  default:
+    break;
+  }
+
+  return key;
+}
+
+view_downloads_sort_keys::entry_type
+view_downloads_sort_keys::make_entry(Download* d) {
+  entry_type entry;
+  entry.left     = left_key(d);
+  entry.download = d;
+
+  if (!m_single)
+    entry.right = right_key(d);
+
+  return entry;
+}
+
+bool
+view_downloads_sort_keys::compare(const key_type& k1, const key_type& k2) {
+  if (k1.failed || k2.failed)
+    return false;
+
+  if (k1.type != k2.type) {
+    m_mismatch = true;
+    return false;
+  }
+
+  switch (k1.type) {
+  case torrent::Object::TYPE_VALUE:
+    return m_greater ? k1.value > k2.value : k1.value < k2.value;
+  case torrent::Object::TYPE_STRING:
+    return m_greater ? k1.string.compare(k2.string) > 0 : k1.string.compare(k2.string) < 0;
+  default:
+    return false;
+  }
+}
+
+void
+view_downloads_sort_keys::log_errors() {
+  if (m_mismatch)
+    control->core()->push_log("Type mismatch.");
+
+  m_mismatch = false;
+}
+
 struct view_downloads_filter {
   view_downloads_filter(const torrent::Object& cmd, const torrent::Object& cmd2) :
       m_command(cmd), m_command2(cmd2) {}
@@ -147,6 +302,8 @@ View::initialize(const std::string& name) {
   m_size  = base_type::size();
   m_focus = 0;
 
+  m_removed.reset(Download::last_generation());
+
   m_delay_changed.slot() = [this]() { emit_changed_now(); };
 }
 
@@ -154,11 +311,15 @@ void
 View::erase(Download* download) {
   iterator itr = std::find(base_type::begin(), base_type::end(), download);
 
+  m_filter_pending.erase(download);
+
   if (itr >= end_visible()) {
     erase_internal(itr);
 
   } else {
     erase_internal(itr);
+    mark_removed(download);
+
     rpc::call_object_nothrow(m_event_removed, rpc::make_target(download));
   }
 }
@@ -175,6 +336,9 @@ View::set_visible(Download* download) {
   base_type::erase(itr);
   insert_visible(download);
 
+  m_filter_pending.insert(download);
+  mark_added(download);
+
   rpc::call_object_nothrow(m_event_added, rpc::make_target(download));
 }
 
@@ -193,6 +357,9 @@ View::set_not_visible(Download* download) {
   base_type::erase(itr);
   base_type::push_back(download);
 
+  m_filter_pending.insert(download);
+  mark_removed(download);
+
   rpc::call_object_nothrow(m_event_removed, rpc::make_target(download));
 }
 
@@ -243,8 +410,25 @@ void
 View::sort() {
   Download* curFocus = focus() != end_visible() ? *focus() : NULL;
 
-  // Don't go randomly switching around equivalent elements.
-  std::stable_sort(begin(), end_visible(), view_downloads_compare(m_sortCurrent));
+  view_downloads_sort_keys keys;
+
+  if (keys.initialize(m_sortCurrent)) {
+    view_downloads_sort_keys::entry_list entries;
+    entries.reserve(m_size);
+
+    for (auto itr = begin_visible(), last = end_visible(); itr != last; ++itr)
+      entries.push_back(keys.make_entry(*itr));
+
+    // Don't go randomly switching around equivalent elements.
+    std::stable_sort(entries.begin(), entries.end(), [&keys](const auto& e1, const auto& e2) { return keys.compare_entry(e1, e2); });
+    std::transform(entries.begin(), entries.end(), begin_visible(), [](const auto& e) { return e.download; });
+
+    keys.log_errors();
+
+  } else {
+    // Don't go randomly switching around equivalent elements.
+    std::stable_sort(begin(), end_visible(), view_downloads_compare(m_sortCurrent));
+  }
 
   m_focus = position(std::find(begin(), end_visible(), curFocus));
   emit_changed();
@@ -256,21 +440,48 @@ View::filter() {
   if (m_name == "started" || m_name == "stopped")
     return;
 
-  // Parition the list in two steps so we know which elements changed.
-  iterator  splitVisible  = std::stable_partition(begin_visible(), end_visible(), view_downloads_filter(m_filter, m_temp_filter));
-  iterator  splitFiltered = std::stable_partition(begin_filtered(), end_filtered(), view_downloads_filter(m_filter, m_temp_filter));
+  bool rebuild = !m_filter_incremental || m_filter_rebuild || m_filter_command_generation != rpc::commands.generation();
+
+  // Refresh before taking the generation, so downloads are only
+  // evaluated again once their transfer state changed.
+  if (m_filter_incremental)
+    for (auto download : *static_cast<base_type*>(this))
+      download->refresh_changes();
+
+  uint64_t generation         = Download::last_generation();
+  uint64_t command_generation = rpc::commands.generation();
+
+  view_downloads_filter matches(m_filter, m_temp_filter);
+
+  auto evaluate = [&](Download* download) {
+    if (needs_filter(rebuild, download->change_generation(), m_filter_generation, m_filter_pending.find(download) != m_filter_pending.end())) {
+      m_filter_evaluated++;
+      return true;
+    }
+
+    m_filter_skipped++;
+    return false;
+  };
+
+  base_type removed;
+  base_type added;
 
-  base_type changed(splitVisible, splitFiltered);
-  iterator  splitChanged = changed.begin() + std::distance(splitVisible, end_visible());
+  m_size = position(filter_range(begin(), end_visible(), end_filtered(), evaluate, matches, &removed, &added));
 
-  m_size = std::distance(begin(), std::copy(splitChanged, changed.end(), splitVisible));
-  std::copy(changed.begin(), splitChanged, begin_filtered());
+  m_filter_rebuild            = false;
+  m_filter_generation         = generation;
+  m_filter_command_generation = command_generation;
+  m_filter_pending.clear();
+  m_filter_rebuilds += rebuild;
 
   // Fix this...
   m_focus = std::min(m_focus, m_size);
 
+  std::for_each(removed.begin(), removed.end(), [this](Download* d) { mark_removed(d); });
+  std::for_each(added.begin(), added.end(), [this](Download* d) { mark_added(d); });
+
   // The commands are allowed to remove itself from or change View
-  // sorting since the commands are being called on the 'changed'
+  // sorting since the commands are being called on the 'removed'
   // vector. But this will cause undefined behavior if elements are
   // removed.
   //
@@ -280,14 +491,20 @@ View::filter() {
   // set the elements to NULL as we trigger commands on them. Or
   // perhaps always clear them, thus not throwing anything.
   if (!m_event_removed.is_empty())
-    std::for_each(changed.begin(), splitChanged, std::bind(&rpc::call_object_d_nothrow, m_event_removed, std::placeholders::_1));
+    std::for_each(removed.begin(), removed.end(), std::bind(&rpc::call_object_d_nothrow, m_event_removed, std::placeholders::_1));
 
   if (!m_event_added.is_empty())
-    std::for_each(changed.begin(), splitChanged, std::bind(&rpc::call_object_d_nothrow, m_event_added, std::placeholders::_1));
+    std::for_each(removed.begin(), removed.end(), std::bind(&rpc::call_object_d_nothrow, m_event_added, std::placeholders::_1));
 
   emit_changed();
 }
 
+void
+View::filter_rebuild() {
+  m_filter_rebuild = true;
+  filter();
+}
+
 void
 View::filter_by(const torrent::Object& condition, View::base_type& result) {
   // std::copy_if(begin_visible(), end_visible(), result.begin(), view_downloads_filter(condition));
@@ -305,10 +522,13 @@ View::filter_download(core::Download* download) {
   if (itr == base_type::end())
     throw torrent::internal_error("View::filter_download(...) could not find download.");
 
+  m_filter_pending.erase(download);
+
   if (view_downloads_filter(m_filter, m_temp_filter)(download)) {
     if (itr >= end_visible()) {
       erase_internal(itr);
       insert_visible(download);
+      mark_added(download);
 
       rpc::call_object_nothrow(m_event_added, rpc::make_target(download));
 
@@ -327,6 +547,7 @@ View::filter_download(core::Download* download) {
 
     erase_internal(itr);
     base_type::push_back(download);
+    mark_removed(download);
 
     rpc::call_object_nothrow(m_event_removed, rpc::make_target(download));
   }
@@ -334,6 +555,23 @@ View::filter_download(core::Download* download) {
   emit_changed();
 }
 
+bool
+View::removed_since(uint64_t generation, std::vector<torrent::HashString>* result) const {
+  return m_removed.since(generation, result);
+}
+
+void
+View::mark_added(Download* d) {
+  d->mark_changed();
+}
+
+void
+View::mark_removed(Download* d) {
+  d->mark_changed();
+
+  m_removed.push_back(d->change_generation(), d->info()->hash());
+}
+
 void
 View::set_filter_on_event(const std::string& event) {
   control->object_storage()->set_str_multi_key(event, "!view." + m_name, "view.filter_download=" + m_name);
@@ -344,9 +582,26 @@ View::clear_filter_on() {
   control->object_storage()->rlookup_clear("!view." + m_name);
 }
 
+View::iterator
+View::find_insert_position(iterator first, iterator last, Download* d, const torrent::Object& sort) {
+  view_downloads_sort_keys keys;
+
+  if (!keys.initialize(sort))
+    return std::find_if(first, last, [&sort, d](auto d2) { return view_downloads_compare(sort)(d, d2); });
+
+  // The range is ordered by the current sort, which may differ from
+  // 'sort', so it can't be binary searched. Only the key of 'd' is
+  // reused between the comparisons.
+  auto key = keys.left_key(d);
+  auto itr = std::find_if(first, last, [&keys, &key](auto d2) { return keys.compare(key, keys.right_key(d2)); });
+
+  keys.log_errors();
+  return itr;
+}
+
 inline void
 View::insert_visible(Download* d) {
-  auto itr = std::find_if(begin_visible(), end_visible(), [this, d](auto d2) { return view_downloads_compare(m_sortNew)(d, d2); });
+  auto itr = find_insert_position(begin_visible(), end_visible(), d, m_sortNew);
 
   m_size++;
   m_focus += (m_focus >= position(itr));
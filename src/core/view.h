@@ -9,14 +9,29 @@
 // remain visible, e.g. has not been filtered out. The Download's that
 // were filtered are still in the underlying vector, but cannot be
 // accessed through the normal stl container functions.
+//
+// Filtering can be made incremental per view, then only Download's
+// that changed since the last filter pass are evaluated again, see
+// Download::change_generation(). This is only correct for filters that
+// depend on the download's own state, so views filter every Download
+// on each pass unless enabled. The whole view is filtered again when
+// the filter or the command map changes, or through filter_rebuild().
+//
+// Downloads are marked as changed when they enter or leave the visible
+// range, and the hashes of those that left are kept for a while so
+// clients can ask for the changes since a generation.
 
 #ifndef RTORRENT_CORE_VIEW_DOWNLOADS_H
 #define RTORRENT_CORE_VIEW_DOWNLOADS_H
 
+#include <algorithm>
+#include <deque>
 #include <functional>
 #include <list>
 #include <string>
+#include <unordered_set>
 #include <vector>
+#include <torrent/hash_string.h>
 #include <torrent/object.h>
 #include <torrent/utils/scheduler.h>
 
@@ -26,6 +41,61 @@ namespace core {
 
 class Download;
 
+// Hashes of the downloads that left a view, with the change generation
+// they left at. Only the last 'max_size' are kept, and generations
+// below the floor can no longer be answered.
+class ViewRemovedLog {
+public:
+  typedef std::vector<torrent::HashString> hash_list;
+
+  ViewRemovedLog(size_t max_size) : m_max_size(max_size) {}
+
+  size_t             size() const  { return m_removed.size(); }
+  uint64_t           floor() const { return m_floor; }
+
+  void               reset(uint64_t floor) { m_removed.clear(); m_floor = floor; }
+
+  // Generations must be pushed in increasing order.
+  void               push_back(uint64_t generation, const torrent::HashString& hash);
+
+  // Appends the hashes removed after 'generation', returns false if
+  // some of them are no longer known.
+  bool               since(uint64_t generation, hash_list* result) const;
+
+private:
+  struct removed_type {
+    uint64_t            generation;
+    torrent::HashString hash;
+  };
+
+  size_t                   m_max_size;
+  uint64_t                 m_floor{};
+  std::deque<removed_type> m_removed;
+};
+
+inline void
+ViewRemovedLog::push_back(uint64_t generation, const torrent::HashString& hash) {
+  m_removed.push_back(removed_type{generation, hash});
+
+  if (m_removed.size() > m_max_size) {
+    m_floor = m_removed.front().generation;
+    m_removed.pop_front();
+  }
+}
+
+inline bool
+ViewRemovedLog::since(uint64_t generation, hash_list* result) const {
+  if (generation < m_floor)
+    return false;
+
+  auto itr = std::partition_point(m_removed.begin(), m_removed.end(), [generation](const auto& r) { return r.generation <= generation; });
+
+  for (; itr != m_removed.end(); ++itr)
+    result->push_back(itr->hash);
+
+  return true;
+}
+
 class View : private std::vector<Download*> {
 public:
   typedef std::vector<Download*> base_type;
@@ -39,6 +109,8 @@ public:
 
   using base_type::size_type;
 
+  static constexpr size_type max_removed_size = 4096;
+
   View() = default;
   ~View();
 
@@ -72,7 +144,7 @@ public:
     emit_changed();
   }
 
-  void insert(Download* download) { base_type::push_back(download); }
+  void insert(Download* download) { base_type::push_back(download); m_filter_pending.insert(download); }
   void erase(Download* download);
 
   void set_visible(Download* download);
@@ -86,22 +158,58 @@ public:
 
   void sort();
 
+  // Finds where 'd' goes in a range when inserted with the 'sort'
+  // command, before the first download it compares less than.
+  static iterator find_insert_position(iterator first, iterator last, Download* d, const torrent::Object& sort);
+
   void set_sort_new(const torrent::Object& s) { m_sortNew = s; }
   void set_sort_current(const torrent::Object& s) { m_sortCurrent = s; }
 
   // Need to explicity trigger filtering.
   void                   filter();
+  void                   filter_rebuild();
   void                   filter_by(const torrent::Object& condition, base_type& result);
   void                   filter_download(core::Download* download);
 
   const torrent::Object& get_filter() const { return m_filter; }
-  void                   set_filter(const torrent::Object& s) { m_filter = s; }
+  // A new filter might not only depend on the download's own state, so
+  // incremental filtering must be enabled again after setting it.
+  void                   set_filter(const torrent::Object& s) { m_filter = s; m_filter_incremental = false; m_filter_rebuild = true; }
   const torrent::Object& get_filter_temp() const { return m_temp_filter; }
-  void                   set_filter_temp(const torrent::Object& s) { m_temp_filter = s; }
+  void                   set_filter_temp(const torrent::Object& s) { m_temp_filter = s; m_filter_rebuild = true; }
   void                   set_filter_on_event(const std::string& event);
 
   void                   clear_filter_on();
 
+  bool                   filter_incremental() const { return m_filter_incremental; }
+  void                   set_filter_incremental(bool v) { m_filter_incremental = v; m_filter_rebuild = true; }
+
+  // Splits [first, last) into downloads that match and those that
+  // don't, with [first, split) being the current visible range.
+  // Downloads 'evaluate' returns false for keep their place and aren't
+  // passed to 'matches'. Returns the new split, and appends the
+  // downloads that left and entered the visible range to 'removed' and
+  // 'added'.
+  template <typename Evaluate, typename Matches>
+  static iterator        filter_range(iterator first, iterator split, iterator last, Evaluate evaluate, Matches matches,
+                                      base_type* removed, base_type* added);
+
+  // Returns true if a download with the given change generation needs
+  // to be evaluated by an incremental filter pass.
+  static bool            needs_filter(bool rebuild, uint64_t change_generation, uint64_t filter_generation, bool pending) {
+    return rebuild || change_generation > filter_generation || pending;
+  }
+
+  // Number of filter evaluations done and skipped by filter(), and the
+  // number of passes that filtered the whole view.
+  uint64_t               filter_evaluated() const { return m_filter_evaluated; }
+  uint64_t               filter_skipped() const { return m_filter_skipped; }
+  uint64_t               filter_rebuilds() const { return m_filter_rebuilds; }
+
+  // Appends the hashes of downloads that left the visible range after
+  // 'generation', returns false if some of them are no longer known.
+  bool                   removed_since(uint64_t generation, std::vector<torrent::HashString>* result) const;
+
   const torrent::Object& event_added() const { return m_event_added; }
   const torrent::Object& event_removed() const { return m_event_removed; }
   void                   set_event_added(const torrent::Object& cmd) { m_event_added = cmd; }
@@ -129,6 +237,9 @@ private:
   inline void insert_visible(Download* d);
   inline void erase_internal(iterator itr);
 
+  void        mark_added(Download* d);
+  void        mark_removed(Download* d);
+
   void        emit_changed();
   void        emit_changed_now();
 
@@ -153,10 +264,42 @@ private:
 
   std::chrono::microseconds m_last_changed{};
 
+  // Downloads with a change generation above m_filter_generation, or
+  // that were added or moved between the visible and filtered ranges
+  // since the last pass, are filtered again.
+  bool                          m_filter_incremental{};
+  bool                          m_filter_rebuild{true};
+  uint64_t                      m_filter_generation{};
+  uint64_t                      m_filter_command_generation{};
+  std::unordered_set<Download*> m_filter_pending;
+
+  uint64_t                      m_filter_evaluated{};
+  uint64_t                      m_filter_skipped{};
+  uint64_t                      m_filter_rebuilds{};
+
+  ViewRemovedLog                m_removed{max_removed_size};
+
   signal_void                    m_signal_changed;
   torrent::utils::SchedulerEntry m_delay_changed;
 };
 
+template <typename Evaluate, typename Matches>
+inline View::iterator
+View::filter_range(iterator first, iterator split, iterator last, Evaluate evaluate, Matches matches,
+                   base_type* removed, base_type* added) {
+  // Parition the list in two steps so we know which elements changed.
+  iterator split_visible  = std::stable_partition(first, split, [&](Download* d) { return !evaluate(d) || matches(d); });
+  iterator split_filtered = std::stable_partition(split, last, [&](Download* d) { return evaluate(d) && matches(d); });
+
+  auto removed_first = removed->insert(removed->end(), split_visible, split);
+  auto added_first   = added->insert(added->end(), split, split_filtered);
+
+  iterator new_split = std::copy(added_first, added->end(), split_visible);
+  std::copy(removed_first, removed->end(), new_split);
+
+  return new_split;
+}
+
 } // namespace core
 
 #endif
@@ -7,6 +7,7 @@
 #include "globals.h"
 #include "manager.h"
 #include "window.h"
+#include "utils/loop_stats.h"
 
 namespace display {
 
@@ -51,6 +52,8 @@ Manager::adjust_layout() {
 
 void
 Manager::receive_update() {
+  utils::LoopTimer timer(&loop_stats, utils::LoopStats::DISPLAY, m_force_redraw ? "redraw" : "update");
+
   if (m_force_redraw) {
     m_force_redraw = false;
 
@@ -9,6 +9,8 @@ rpc::ip_table_list ip_tables;
 
 Control*           control{};
 
+utils::LoopStats   loop_stats;
+
 std::string
 expand_path(const std::string& path) {
   if (path.empty())
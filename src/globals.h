@@ -4,12 +4,16 @@
 #include <torrent/common.h>
 
 #include "rpc/ip_table_list.h"
+#include "utils/loop_stats.h"
 
 class Control;
 
 extern rpc::ip_table_list ip_tables;
 extern Control*           control;
 
+// Time spent in tasks on the main thread, see utils::LoopStats.
+extern utils::LoopStats   loop_stats;
+
 std::string expand_path(const std::string& path);
 
 namespace rpc {
@@ -29,6 +33,8 @@ void                     callback_interrupt(torrent::system::callback_id& id, st
 
 rpc::SCgi*               scgi();
 void                     set_scgi(rpc::SCgi* scgi);
+rpc::SCgi*               http();
+void                     set_http(rpc::SCgi* http);
 void                     set_rpc_log(const std::string& filename);
 
 } // namespace torrent::scgi_thread
@@ -256,6 +256,7 @@ main(int argc, char** argv) {
 
        "view.add = active\n"
        "view.filter = active,((false))\n"
+       "view.filter.incremental.set = active,1\n"
 
        "view.add = started\n"
        "view.filter = started,((false))\n"
@@ -269,25 +270,30 @@ main(int argc, char** argv) {
 
        "view.add = complete\n"
        "view.filter = complete,((d.complete))\n"
+       "view.filter.incremental.set = complete,1\n"
        "view.filter_on    = complete,event.download.hash_done,event.download.hash_failed,event.download.hash_final_failed,event.download.finished\n"
 
        "view.add = incomplete\n"
        "view.filter = incomplete,((not,((d.complete))))\n"
+       "view.filter.incremental.set = incomplete,1\n"
        "view.filter_on    = incomplete,event.download.hash_done,event.download.hash_failed,"
                                       "event.download.hash_final_failed,event.download.finished\n"
 
        // The hashing view does not include stopped torrents.
        "view.add = hashing\n"
        "view.filter = hashing,((d.hashing))\n"
+       "view.filter.incremental.set = hashing,1\n"
        "view.filter_on = hashing,event.download.hash_queued,event.download.hash_removed,"
                                 "event.download.hash_done,event.download.hash_failed,event.download.hash_final_failed,event.download.finished\n"
 
        "view.add    = seeding\n"
        "view.filter = seeding,((and,((d.state)),((d.complete))))\n"
+       "view.filter.incremental.set = seeding,1\n"
        "view.filter_on = seeding,event.download.resumed,event.download.paused,event.download.finished\n"
 
        "view.add    = leeching\n"
        "view.filter = leeching,((and,((d.state)),((not,((d.complete))))))\n"
+       "view.filter.incremental.set = leeching,1\n"
        "view.filter_on = leeching,event.download.resumed,event.download.paused,event.download.finished\n"
 
        "schedule2 = view.main,10,10,((view.sort,main,20))\n"
@@ -434,8 +440,9 @@ main(int argc, char** argv) {
     // session torrents are loaded before arg torrents.
     control->dht_manager()->load_dht_cache();
 
-    load_session_torrents(session_thread::manager()->path());
-    load_arg_torrents(argv + firstArg, argv + argc);
+    load_session_torrents(session_thread::manager()->path(), [argv, firstArg, argc]() {
+        load_arg_torrents(argv + firstArg, argv + argc);
+      });
 
     // Make sure we update the display before any scheduled tasks can
     // run, so that loading of torrents doesn't look like it hangs on
@@ -1,5 +1,9 @@
 #include "config.h"
 
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
 #include <torrent/exceptions.h>
 #include <torrent/object.h>
 #include <torrent/data/file_list_iterator.h>
@@ -7,6 +11,7 @@
 // Get better logging...
 #include "globals.h"
 #include "control.h"
+#include "core/download.h"
 #include "core/manager.h"
 
 #include "command.h"
@@ -19,6 +24,87 @@ namespace rpc {
 
 command_base::stack_type command_base::current_stack;
 
+// Download commands that change state are all named as setters or list
+// modifiers, which lets views know to filter the download again without
+// having to flag every command by hand. Setters of files, trackers and
+// peers change the download they belong to.
+static bool
+is_download_modifier(const std::string& key) {
+  static const char* prefixes[] = { "d.", "f.", "fi.", "p.", "t." };
+  static const char* suffixes[] = { ".push_back", ".push_back_unique", ".remove", ".insert" };
+
+  if (std::none_of(std::begin(prefixes), std::end(prefixes), [&key](auto prefix) { return key.compare(0, std::strlen(prefix), prefix) == 0; }))
+    return false;
+
+  // Matches '.set' and '.set_if_z' style names.
+  for (size_t pos = key.find(".set"); pos != std::string::npos; pos = key.find(".set", pos + 1))
+    if (pos + 4 == key.size() || key[pos + 4] == '_')
+      return true;
+
+  for (auto suffix : suffixes) {
+    size_t length = std::strlen(suffix);
+
+    if (key.size() > length && key.compare(key.size() - length, length, suffix) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+// Targets of files, trackers and peers hold the owning download in
+// 'third', see f.multicall and RpcManager::object_to_target.
+static inline void
+mark_target_changed(int flags, const target_type& target) {
+  if (!(flags & CommandMap::flag_modifies_download))
+    return;
+
+  switch (target.first) {
+  case command_base::target_download:
+    if (target.second != nullptr)
+      static_cast<core::Download*>(target.second)->mark_changed();
+    break;
+
+  case command_base::target_file:
+  case command_base::target_file_itr:
+  case command_base::target_peer:
+  case command_base::target_tracker:
+    if (target.third != nullptr)
+      static_cast<core::Download*>(target.third)->mark_changed();
+    break;
+
+  default:
+    break;
+  }
+}
+
+void
+command_profile_type::add(std::chrono::nanoseconds elapsed, std::chrono::nanoseconds self_elapsed) {
+  auto usec   = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+  auto bucket = std::min<unsigned int>(std::bit_width(usec), histogram_size - 1);
+
+  calls++;
+  total += elapsed;
+  self  += self_elapsed;
+  max    = std::max(max, elapsed);
+
+  histogram[bucket]++;
+}
+
+std::chrono::microseconds
+command_profile_type::percentile(double fraction) const {
+  uint64_t target = calls * fraction;
+  uint64_t count  = 0;
+
+  for (unsigned int i = 0; i != histogram_size - 1; i++) {
+    count += histogram[i];
+
+    if (count > target)
+      return std::chrono::microseconds(uint64_t{1} << i);
+  }
+
+  return std::chrono::duration_cast<std::chrono::microseconds>(max);
+}
+
 CommandMap::iterator
 CommandMap::insert(const key_type& key, int flags, const char* parm, const char* doc) {
   iterator itr = base_type::find(key);
@@ -30,6 +116,11 @@ CommandMap::insert(const key_type& key, int flags, const char* parm, const char*
   if (rpc::rpc.is_handlers_initialized() && (flags & flag_public_rpc))
     rpc::rpc.insert_command(key.c_str(), parm, doc);
 
+  m_generation++;
+
+  if (is_download_modifier(key))
+    flags |= flag_modifies_download;
+
   return base_type::insert(itr, value_type(key, command_map_data_type(flags, parm, doc)));
 }
 
@@ -45,6 +136,8 @@ CommandMap::erase(iterator itr) {
 //   if (!(itr->second.m_flags & flag_dont_delete))
 //     delete itr->second.m_variable;
 
+  m_generation++;
+
   base_type::erase(itr);
 }
 
@@ -67,10 +160,15 @@ CommandMap::create_redirect(const key_type& key_new, const key_type& key_dest, i
 
   flags |= dest_itr->second.m_flags & ~(flag_has_redirects | flag_public_rpc);
 
+  if (is_download_modifier(key_new))
+    flags |= flag_modifies_download;
+
   // TODO: This is not honoring the public_xmlrpc flags!!!
   if (rpc::rpc.is_handlers_initialized() && (flags & flag_public_rpc))
     rpc::rpc.insert_command(key_new.c_str(), dest_itr->second.m_parm, dest_itr->second.m_doc);
 
+  m_generation++;
+
   iterator itr = base_type::insert(base_type::end(),
                                    value_type(key_new, command_map_data_type(flags,
                                                                              dest_itr->second.m_parm,
@@ -81,6 +179,14 @@ CommandMap::create_redirect(const key_type& key_new, const key_type& key_dest, i
   itr->second.m_anySlot = dest_itr->second.m_anySlot;
 }
 
+void
+CommandMap::profile_reset() {
+  for (auto& itr : *this)
+    itr.second.m_profile.reset();
+
+  m_profile_nested = std::chrono::nanoseconds();
+}
+
 const CommandMap::mapped_type
 CommandMap::call_catch(const key_type& key, const target_type& target, const mapped_type& args, const char* err) {
   try {
@@ -101,6 +207,11 @@ CommandMap::call_command(const key_type& key, const mapped_type& arg, const targ
   if (!rpc.is_trusted() && !(itr->second.m_flags & flag_untrusted_safe))
     throw untrusted_error("Command \"" + std::string(key) + "\" is not allowed for untrusted connections.");
 
+  mark_target_changed(itr->second.m_flags, target);
+
+  if (m_profiling)
+    return call_profiled(itr, arg, target);
+
   return itr->second.m_anySlot(&itr->second.m_variable, target, arg);
 }
 
@@ -109,7 +220,42 @@ CommandMap::call_command(iterator itr, const mapped_type& arg, const target_type
   if (!rpc.is_trusted() && !(itr->second.m_flags & flag_untrusted_safe))
     throw untrusted_error("Command \"" + itr->first + "\" is not allowed for untrusted connections.");
 
+  mark_target_changed(itr->second.m_flags, target);
+
+  if (m_profiling)
+    return call_profiled(itr, arg, target);
+
   return itr->second.m_anySlot(&itr->second.m_variable, target, arg);
 }
 
+// Nested calls add their time to m_profile_nested, which is subtracted
+// from the time of the caller to get the time spent in the command
+// itself.
+const CommandMap::mapped_type
+CommandMap::call_profiled(iterator itr, const mapped_type& arg, const target_type& target) {
+  if (itr->second.m_profile == nullptr)
+    itr->second.m_profile = std::make_shared<command_profile_type>();
+
+  auto profile = itr->second.m_profile;
+  auto nested  = std::exchange(m_profile_nested, std::chrono::nanoseconds());
+  auto started = std::chrono::steady_clock::now();
+
+  auto record = [&]() {
+      auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started);
+
+      profile->add(elapsed, std::max(elapsed - m_profile_nested, std::chrono::nanoseconds()));
+      m_profile_nested = nested + elapsed;
+    };
+
+  try {
+    auto result = itr->second.m_anySlot(&itr->second.m_variable, target, arg);
+    record();
+    return result;
+
+  } catch (...) {
+    record();
+    throw;
+  }
+}
+
 }
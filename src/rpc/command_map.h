@@ -1,7 +1,10 @@
 #ifndef RTORRENT_RPC_COMMAND_MAP_H
 #define RTORRENT_RPC_COMMAND_MAP_H
 
+#include <array>
+#include <chrono>
 #include <map>
+#include <memory>
 #include <string>
 #include <cstring>
 #include <torrent/object.h>
@@ -10,6 +13,26 @@
 
 namespace rpc {
 
+// Collected for each command while profiling is enabled. The total time
+// includes nested commands, while the self time excludes them.
+struct command_profile_type {
+  static constexpr unsigned int histogram_size = 24;
+
+  uint64_t                 calls{};
+  std::chrono::nanoseconds total{};
+  std::chrono::nanoseconds self{};
+  std::chrono::nanoseconds max{};
+
+  // Bucket 'i' counts calls that took less than 2^i microseconds, with
+  // the last bucket also counting slower calls.
+  std::array<uint64_t, histogram_size> histogram{};
+
+  void                     add(std::chrono::nanoseconds elapsed, std::chrono::nanoseconds self_elapsed);
+
+  // Upper bound of the bucket holding the given fraction of calls.
+  std::chrono::microseconds percentile(double fraction) const;
+};
+
 struct command_map_data_type {
   // Some commands will need to share data, like get/set a variable. So
   // instead of using a single virtual member function, each command
@@ -20,7 +43,9 @@ struct command_map_data_type {
   command_map_data_type(int flags, const char* parm, const char* doc) :
     m_flags(flags), m_parm(parm), m_doc(doc) {}
 
-  command_map_data_type(const command_map_data_type& src) = default;
+  // The profile is not copied to redirects.
+  command_map_data_type(const command_map_data_type& src) :
+    m_variable(src.m_variable), m_anySlot(src.m_anySlot), m_flags(src.m_flags), m_parm(src.m_parm), m_doc(src.m_doc) {}
 
   command_base             m_variable;
   command_base::any_slot   m_anySlot;
@@ -29,6 +54,9 @@ struct command_map_data_type {
 
   const char*   m_parm;
   const char*   m_doc;
+
+  // Shared so the profile outlives commands that erase themselves.
+  std::shared_ptr<command_profile_type> m_profile;
 };
 
 class CommandMap : public std::map<std::string, command_map_data_type> {
@@ -58,12 +86,27 @@ public:
 
   static const int flag_untrusted_safe = 0x400;
 
+  // Download setters, calling these marks the target download as
+  // changed. Set on insert based on the command name.
+  static const int flag_modifies_download = 0x800;
+
   CommandMap() = default;
 
   bool                has(const std::string& key) const { return base_type::find(key) != base_type::end(); }
 
   bool                is_modifiable(const_iterator itr) { return itr != end() && (itr->second.m_flags & flag_modifiable); }
 
+  // Incremented whenever a command is inserted or erased, allowing
+  // callers to detect when cached iterators need to be looked up
+  // again.
+  uint64_t            generation() const { return m_generation; }
+
+  // Profiling adds two clock reads to every call, the results are kept
+  // in command_map_data_type::m_profile until reset.
+  bool                is_profiling() const          { return m_profiling; }
+  void                set_profiling(bool state)     { m_profiling = state; }
+  void                profile_reset();
+
   iterator            insert(const key_type& key, int flags, const char* parm, const char* doc);
 
   template <typename T, typename Slot>
@@ -93,6 +136,13 @@ public:
 private:
   CommandMap(const CommandMap&);
   void operator = (const CommandMap&);
+
+  const mapped_type   call_profiled(iterator itr, const mapped_type& arg, const target_type& target);
+
+  uint64_t            m_generation{0};
+
+  bool                     m_profiling{};
+  std::chrono::nanoseconds m_profile_nested{};
 };
 
 inline target_type make_target()                                  { return target_type((int)command_base::target_generic, NULL); }
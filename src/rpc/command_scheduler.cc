@@ -8,8 +8,10 @@
 #include <torrent/exceptions.h>
 #include <torrent/utils/chrono.h>
 
+#include "globals.h"
 #include "rpc/command_scheduler_item.h"
 #include "rpc/parse_commands.h"
+#include "utils/loop_stats.h"
 
 namespace rpc {
 
@@ -62,6 +64,8 @@ CommandScheduler::call_item(value_type item) {
   // removed.
 
   try {
+    utils::LoopTimer timer(&loop_stats, utils::LoopStats::SCHEDULER, item->key().c_str());
+
     rpc::call_object(item->command());
 
   } catch (torrent::input_error& e) {
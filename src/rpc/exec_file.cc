@@ -1,107 +1,249 @@
 #include "config.h"
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <cstring>
 #include <fcntl.h>
+#include <spawn.h>
 #include <string>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <torrent/exceptions.h>
+#include <torrent/net/poll.h>
+#include <torrent/system/callbacks.h>
 #include <torrent/system/thread.h>
+#include <torrent/utils/string_manip.h>
+
+#include "core/download.h"
+#include "rpc/rpc_manager.h"
 
 #include "exec_file.h"
 #include "parse.h"
 
+extern char** environ;
+
 namespace rpc {
 
 // TODO: Access fd through torrent logging?
 
+static void
+make_argv(const torrent::Object& rawArgs, int flags, char** argsBuffer, char* valueBuffer) {
+  char** argsCurrent  = argsBuffer;
+  char*  valueCurrent = valueBuffer;
+
+  if (rawArgs.is_list()) {
+    const torrent::Object::list_type& args = rawArgs.as_list();
+
+    if (args.empty())
+      throw torrent::input_error("Too few arguments.");
+
+    for (torrent::Object::list_const_iterator itr = args.begin(), last = args.end(); itr != last; itr++, argsCurrent++) {
+      if (argsCurrent == argsBuffer + ExecFile::max_args - 1)
+        throw torrent::input_error("Too many arguments.");
+
+      if (itr->is_string() && (!(flags & ExecFile::flag_expand_tilde) || *itr->as_string().c_str() != '~')) {
+        *argsCurrent = const_cast<char*>(itr->as_string().c_str());
+
+      } else {
+        *argsCurrent = valueCurrent;
+        valueCurrent = print_object(valueCurrent, valueBuffer + ExecFile::buffer_size, &*itr, flags) + 1;
+
+        if (valueCurrent >= valueBuffer + ExecFile::buffer_size)
+          throw torrent::input_error("Overflowed execute arg buffer.");
+      }
+    }
+
+  } else {
+    const torrent::Object::string_type& args = rawArgs.as_string();
+
+    if ((flags & ExecFile::flag_expand_tilde) && args.c_str()[0] == '~') {
+      *argsCurrent = valueCurrent;
+      valueCurrent = print_object(valueCurrent, valueBuffer + ExecFile::buffer_size, &rawArgs, flags) + 1;
+    } else {
+      *argsCurrent = const_cast<char*>(args.c_str());
+    }
+
+    argsCurrent++;
+  }
+
+  *argsCurrent = NULL;
+}
+
+static int64_t
+elapsed_usec(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+ExecFile::~ExecFile() = default;
+
+void
+ExecFile::initialize() {
+  if (m_initialized)
+    return;
+
+  m_initialized = true;
+  m_callback_id = torrent::system::make_callback_id();
+
+  m_task_reap.slot() = [this]() {
+      reap_background();
+
+      if (!m_background.empty())
+        torrent::this_thread::scheduler()->wait_for_ceil_seconds(&m_task_reap, reap_interval);
+    };
+}
+
+void
+ExecFile::write_log(const char* msg) {
+  if (m_log_fd == -1)
+    return;
+
+  [[maybe_unused]] int result = write(m_log_fd, msg, std::strlen(msg));
+}
+
+// Uses posix_spawn where the child's descriptors can be closed without
+// iterating up to the open file limit, otherwise falls back to fork.
+pid_t
+ExecFile::spawn(const char* file, char* const* argv, int stdout_fd, int stderr_fd) {
+#if defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP) || defined(POSIX_SPAWN_CLOEXEC_DEFAULT)
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t          attr;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attr);
+
+  posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDWR, 0);
+
+  if (stdout_fd != -1)
+    posix_spawn_file_actions_adddup2(&actions, stdout_fd, 1);
+  else
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+
+  if (stderr_fd != -1)
+    posix_spawn_file_actions_adddup2(&actions, stderr_fd, 2);
+  else
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+  posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+#else
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_CLOEXEC_DEFAULT);
+#endif
+
+  pid_t pid;
+  int   error = posix_spawnp(&pid, file, &actions, &attr, argv, environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+
+  return pid;
+
+#else
+  pid_t pid = fork();
+
+  if (pid != 0)
+    return pid;
+
+  int devNull = open("/dev/null", O_RDWR);
+
+  if (devNull != -1)
+    dup2(devNull, 0);
+  else
+    ::close(0);
+
+  if (stdout_fd != -1)
+    dup2(stdout_fd, 1);
+  else if (devNull != -1)
+    dup2(devNull, 1);
+  else
+    ::close(1);
+
+  if (stderr_fd != -1)
+    dup2(stderr_fd, 2);
+  else if (devNull != -1)
+    dup2(devNull, 2);
+  else
+    ::close(2);
+
+#ifdef HAVE_CLOSE_RANGE
+  close_range(3, ~0U, 0);
+#else
+  for (int i = 3, last = sysconf(_SC_OPEN_MAX); i != last; i++)
+    ::close(i);
+#endif
+
+  execvp(file, argv);
+  _exit(127);
+#endif
+}
+
 int
 ExecFile::execute(const char* file, char* const* argv, int flags) {
   // Write the executed command and its parameters to the log fd.
-  [[maybe_unused]] int result;
+  for (char* const* itr = argv; *itr != NULL; itr++) {
+    write_log(itr == argv ? "\n---\n" : " ");
+    write_log(*itr);
+  }
 
-  if (m_log_fd != -1) {
-    for (char* const* itr = argv; *itr != NULL; itr++) {
-      if (itr == argv)
-        result = write(m_log_fd, "\n---\n", sizeof("\n---\n"));
-      else
-        result = write(m_log_fd, " ", 1);
+  write_log("\n---\n");
 
-      result = write(m_log_fd, *itr, std::strlen(*itr));
-    }
+  initialize();
+  reap_background();
 
-    result = write(m_log_fd, "\n---\n", sizeof("\n---\n"));
-  }
+  // Background tasks aren't waited for, so their output can't be
+  // captured.
+  if (flags & flag_background)
+    flags &= ~flag_capture;
 
   int pipeFd[2];
 
   if ((flags & flag_capture) && pipe(pipeFd))
     throw torrent::input_error("ExecFile::execute(...) Pipe creation failed.");
 
-  pid_t childPid = fork();
+  // Background tasks may outlive the log, so like before their output
+  // is discarded.
+  int stdout_fd = (flags & flag_capture) ? pipeFd[1] : m_log_fd;
+  int stderr_fd = m_log_fd;
 
-  if (childPid == -1) {
-    if (flags & flag_capture) {
-      ::close(pipeFd[0]);
-      ::close(pipeFd[1]);
-    }
-    throw torrent::input_error("ExecFile::execute(...) Fork failed.");
-  }
+  if (flags & flag_background)
+    stdout_fd = stderr_fd = -1;
 
-  if (childPid == 0) {
-    if (flags & flag_background) {
-      pid_t detached_pid = fork();
+  auto  started  = std::chrono::steady_clock::now();
+  pid_t childPid = spawn(file, argv, stdout_fd, stderr_fd);
 
-      if (detached_pid == -1)
-        _exit(-1);
+  if (flags & flag_capture)
+    ::close(pipeFd[1]);
 
-      if (detached_pid != 0) {
-        if (m_log_fd != -1)
-          result = write(m_log_fd, "\n--- Background task ---\n", sizeof("\n--- Background task ---\n"));
+  if (childPid == -1) {
+    if (flags & flag_capture)
+      ::close(pipeFd[0]);
 
-        _exit(0);
-      }
+    write_log("\n--- Spawn failed: " + std::string(std::strerror(errno)) + " ---\n");
+    m_capture = std::string();
+    return -1;
+  }
 
-      m_log_fd = -1;
-      flags &= ~flag_capture;
-    }
+  write_log("\n--- Spawned in " + std::to_string(elapsed_usec(started)) + " us ---\n");
 
-    int devNull = open("/dev/null", O_RDWR);
+  if (flags & flag_background) {
+    m_background.push_back(childPid);
 
-    if (devNull != -1)
-      dup2(devNull, 0);
-    else
-      ::close(0);
+    if (!m_task_reap.is_scheduled())
+      torrent::this_thread::scheduler()->wait_for_ceil_seconds(&m_task_reap, reap_interval);
 
-    if (flags & flag_capture)
-      dup2(pipeFd[1], 1);
-    else if (m_log_fd != -1)
-      dup2(m_log_fd, 1);
-    else if (devNull != -1)
-      dup2(devNull, 1);
-    else
-      ::close(1);
-
-    if (m_log_fd != -1)
-      dup2(m_log_fd, 2);
-    else if (devNull != -1)
-      dup2(devNull, 2);
-    else
-      ::close(2);
-
-    // Close all fd's.
-    for (int i = 3, last = sysconf(_SC_OPEN_MAX); i != last; i++)
-      ::close(i);
-
-    result = execvp(file, argv);
-
-    _exit(result);
+    write_log("\n--- Background task ---\n");
+    m_capture = std::string();
+    return 0;
   }
 
   if (flags & flag_capture) {
     m_capture = std::string();
-    ::close(pipeFd[1]);
 
     char buffer[4096];
     ssize_t length;
@@ -111,14 +253,12 @@ ExecFile::execute(const char* file, char* const* argv, int flags) {
 
       if (length > 0)
         m_capture += std::string(buffer, length);
-    } while (length > 0);
+    } while (length > 0 || (length == -1 && errno == EINTR));
 
     ::close(pipeFd[0]);
 
-    if (m_log_fd != -1) {
-      result = write(m_log_fd, "Captured output:\n", sizeof("Captured output:\n"));
-      result = write(m_log_fd, m_capture.data(), m_capture.length());
-    }
+    write_log("Captured output:\n");
+    write_log(m_capture);
   }
 
   int status;
@@ -136,72 +276,269 @@ ExecFile::execute(const char* file, char* const* argv, int flags) {
     }
   };
 
+  auto elapsed = std::to_string(elapsed_usec(started) / 1000);
+
   // Check return value?
-  if (m_log_fd != -1) {
-    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
-      result = write(m_log_fd, "\n--- Success ---\n", sizeof("\n--- Success ---\n"));
-    else
-      result = write(m_log_fd, "\n--- Error ---\n", sizeof("\n--- Error ---\n"));
-  }
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    write_log("\n--- Success (" + elapsed + " ms) ---\n");
+  else
+    write_log("\n--- Error (" + elapsed + " ms) ---\n");
 
   return status;
 }
 
 torrent::Object
 ExecFile::execute_object(const torrent::Object& rawArgs, int flags) {
-  char*  argsBuffer[max_args];
-  char** argsCurrent = argsBuffer;
+  char* argsBuffer[max_args];
 
   // Size of value strings are less than 24.
-  char   valueBuffer[buffer_size+1];
-  char*  valueCurrent = valueBuffer;
+  char  valueBuffer[buffer_size+1];
 
-  if (rawArgs.is_list()) {
-    const torrent::Object::list_type& args = rawArgs.as_list();
+  make_argv(rawArgs, flags, argsBuffer, valueBuffer);
 
-    if (args.empty())
-      throw torrent::input_error("Too few arguments.");
+  int status = execute(argsBuffer[0], argsBuffer, flags);
 
-    for (torrent::Object::list_const_iterator itr = args.begin(), last = args.end(); itr != last; itr++, argsCurrent++) {
-      if (argsCurrent == argsBuffer + max_args - 1)
-        throw torrent::input_error("Too many arguments.");
+  if ((flags & flag_throw) && status != 0)
+    throw torrent::input_error("Bad return code.");
 
-      if (itr->is_string() && (!(flags & flag_expand_tilde) || *itr->as_string().c_str() != '~')) {
-        *argsCurrent = const_cast<char*>(itr->as_string().c_str());
+  if (flags & flag_capture)
+    return m_capture;
 
-      } else {
-        *argsCurrent = valueCurrent;
-        valueCurrent = print_object(valueCurrent, valueBuffer + buffer_size, &*itr, flags) + 1;
+  return torrent::Object((int64_t)status);
+}
 
-        if (valueCurrent >= valueBuffer + buffer_size)
-          throw torrent::input_error("Overflowed execute arg buffer.");
+torrent::Object
+ExecFile::execute_async(target_type target, const torrent::Object::list_type& args) {
+  if (args.size() < 2)
+    throw torrent::input_error("Too few arguments.");
+
+  const std::string& callback = args.front().as_string();
+
+  if (!callback.empty() && !commands.has(callback))
+    throw torrent::input_error("Command not found: " + callback);
+
+  torrent::Object rawArgs = torrent::Object::create_list();
+  rawArgs.as_list().assign(std::next(args.begin()), args.end());
+
+  char* argsBuffer[max_args];
+  char  valueBuffer[buffer_size+1];
+
+  make_argv(rawArgs, flag_expand_tilde, argsBuffer, valueBuffer);
+
+  for (char* const* itr = argsBuffer; *itr != NULL; itr++) {
+    write_log(itr == argsBuffer ? "\n--- Async ---\n" : " ");
+    write_log(*itr);
+  }
+
+  write_log("\n---\n");
+
+  initialize();
+
+  int pipeFd[2];
+
+  if (pipe(pipeFd))
+    throw torrent::input_error("ExecFile::execute_async(...) Pipe creation failed.");
+
+  if (fcntl(pipeFd[0], F_SETFL, O_NONBLOCK) == -1 || fcntl(pipeFd[0], F_SETFD, FD_CLOEXEC) == -1) {
+    ::close(pipeFd[0]);
+    ::close(pipeFd[1]);
+    throw torrent::input_error("ExecFile::execute_async(...) Could not set pipe flags.");
+  }
+
+  auto  started  = std::chrono::steady_clock::now();
+  pid_t childPid = spawn(argsBuffer[0], argsBuffer, pipeFd[1], m_log_fd);
+
+  ::close(pipeFd[1]);
+
+  if (childPid == -1) {
+    std::string error = std::strerror(errno);
+
+    ::close(pipeFd[0]);
+
+    write_log("\n--- Spawn failed: " + error + " ---\n");
+    throw torrent::input_error("Could not execute '" + std::string(argsBuffer[0]) + "': " + error);
+  }
+
+  write_log("\n--- Spawned " + std::to_string(childPid) + " in " + std::to_string(elapsed_usec(started)) + " us ---\n");
+
+  std::string target_hash;
+
+  if (target.first == command_base::target_download)
+    target_hash = torrent::utils::transform_to_hex_str(static_cast<core::Download*>(target.second)->info()->hash());
+
+  auto child = std::make_unique<ExecChild>(this, childPid, pipeFd[0], callback, target_hash);
+
+  child->start();
+  m_children.push_back(std::move(child));
+
+  return (int64_t)childPid;
+}
+
+void
+ExecFile::cleanup() {
+  if (!m_initialized)
+    return;
+
+  torrent::this_thread::scheduler()->erase(&m_task_reap);
+  torrent::main_thread::thread()->cancel_callback(m_callback_id);
+
+  // Children still running are left to exit on their own.
+  for (auto& child : m_children)
+    child->close();
+
+  m_children.clear();
+}
+
+void
+ExecFile::reap_background() {
+  auto itr = std::remove_if(m_background.begin(), m_background.end(), [](pid_t pid) {
+      int status;
+      return waitpid(pid, &status, WNOHANG) != 0;
+    });
+
+  m_background.erase(itr, m_background.end());
+}
+
+// Called from the child's own event or task, so finishing is deferred
+// until the child can be destroyed.
+void
+ExecFile::receive_child_done(ExecChild* child) {
+  torrent::main_thread::callback(m_callback_id, [this, child]() {
+      auto itr = std::find_if(m_children.begin(), m_children.end(), [child](const auto& c) { return c.get() == child; });
+
+      if (itr == m_children.end())
+        throw torrent::internal_error("ExecFile::receive_child_done(...) child not found.");
+
+      std::unique_ptr<ExecChild> done = std::move(*itr);
+      m_children.erase(itr);
+
+      // Follow the shell convention for children killed by signals, and
+      // use -1 if the child could not be waited for.
+      int     raw_status = done->status();
+      int64_t status     = -1;
+
+      if (raw_status != -1 && WIFEXITED(raw_status))
+        status = WEXITSTATUS(raw_status);
+      else if (raw_status != -1 && WIFSIGNALED(raw_status))
+        status = 128 + WTERMSIG(raw_status);
+
+      write_log("\n--- Async " + std::to_string(done->pid()) + " exited with " + std::to_string(status) +
+                " (" + std::to_string(done->elapsed().count() / 1000) + " ms) ---\n");
+
+      if (!done->output().empty()) {
+        write_log("Captured output:\n");
+        write_log(done->output());
       }
-    }
 
-  } else {
-    const torrent::Object::string_type& args = rawArgs.as_string();
+      if (done->callback().empty())
+        return;
 
-    if ((flags & flag_expand_tilde) && args.c_str()[0] == '~') {
-      *argsCurrent = valueCurrent;
-      valueCurrent = print_object(valueCurrent, valueBuffer + buffer_size, &rawArgs, flags) + 1;
-    } else {
-      *argsCurrent = const_cast<char*>(args.c_str());
+      target_type target = make_target();
+
+      if (!done->target().empty()) {
+        core::Download* download = rpc.slot_find_download()(done->target().c_str());
+
+        if (download != nullptr)
+          target = make_target(download);
+      }
+
+      commands.call_catch(done->callback(), target, create_object_list(status, done->output()), "Async execute callback failed: ");
+    });
+}
+
+ExecChild::ExecChild(ExecFile* parent, pid_t pid, int fd, std::string callback, std::string target) :
+    m_parent(parent),
+    m_pid(pid),
+    m_callback(std::move(callback)),
+    m_target(std::move(target)),
+    m_started(std::chrono::steady_clock::now()) {
+
+  m_fileDesc = fd;
+  m_task_wait.slot() = [this]() { try_wait(); };
+}
+
+ExecChild::~ExecChild() {
+  close();
+}
+
+std::chrono::microseconds
+ExecChild::elapsed() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_started);
+}
+
+void
+ExecChild::start() {
+  torrent::this_thread::poll()->open(this);
+  torrent::this_thread::poll()->insert_read(this);
+  torrent::this_thread::poll()->insert_error(this);
+}
+
+void
+ExecChild::close() {
+  torrent::this_thread::scheduler()->erase(&m_task_wait);
+
+  if (m_fileDesc == -1)
+    return;
+
+  torrent::this_thread::poll()->remove_and_close(this);
+
+  ::close(m_fileDesc);
+  m_fileDesc = -1;
+}
+
+void
+ExecChild::event_read() {
+  char buffer[ExecFile::buffer_size];
+
+  while (true) {
+    ssize_t length = ::read(m_fileDesc, buffer, sizeof(buffer));
+
+    if (length > 0) {
+      m_output.append(buffer, std::min<size_t>(length, max_output - m_output.size()));
+      continue;
     }
 
-    argsCurrent++;
+    if (length == -1 && errno == EINTR)
+      continue;
+
+    if (length == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+
+    break;
   }
 
-  *argsCurrent = NULL;
+  receive_closed();
+}
 
-  int status = execute(argsBuffer[0], argsBuffer, flags);
+void
+ExecChild::event_write() {
+}
 
-  if ((flags & flag_throw) && status != 0)
-    throw torrent::input_error("Bad return code.");
+void
+ExecChild::event_error() {
+  receive_closed();
+}
 
-  if (flags & flag_capture)
-    return m_capture;
+void
+ExecChild::receive_closed() {
+  close();
+  try_wait();
+}
 
-  return torrent::Object((int64_t)status);
+// The child may close its output before exiting, in which case it is
+// polled until it exits.
+void
+ExecChild::try_wait() {
+  int   status;
+  pid_t result = waitpid(m_pid, &status, WNOHANG);
+
+  if (result == 0 || (result == -1 && errno == EINTR)) {
+    torrent::this_thread::scheduler()->wait_for(&m_task_wait, wait_interval);
+    return;
+  }
+
+  m_status = result == -1 ? -1 : status;
+  m_parent->receive_child_done(this);
 }
 
 }
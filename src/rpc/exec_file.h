@@ -1,10 +1,23 @@
 #ifndef RTORRENT_RPC_EXEC_FILE_H
 #define RTORRENT_RPC_EXEC_FILE_H
 
+#include <chrono>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <torrent/common.h>
+#include <torrent/event.h>
 #include <torrent/object.h>
+#include <torrent/utils/scheduler.h>
+
+#include "rpc/command.h"
 
 namespace rpc {
 
+class ExecChild;
+
 class ExecFile {
 public:
   static constexpr unsigned int max_args    = 128;
@@ -15,15 +28,104 @@ public:
   static constexpr int flag_capture      = 0x4;
   static constexpr int flag_background   = 0x8;
 
+  // Interval at which background children are reaped.
+  static constexpr auto reap_interval = std::chrono::seconds(10);
+
+  ExecFile() = default;
+  ~ExecFile();
+
   int                 log_fd() const     { return m_log_fd; }
   void                set_log_fd(int fd) { m_log_fd = fd; }
 
+  size_t              size_async() const { return m_children.size(); }
+
+  const std::list<std::unique_ptr<ExecChild>>& children() const { return m_children; }
+
   int                 execute(const char* file, char* const* argv, int flags);
   torrent::Object     execute_object(const torrent::Object& rawArgs, int flags);
 
+  // execute.async {callback, file, args...}
+  //
+  // Starts the command without waiting for it, and calls the callback
+  // command with the exit status and output once it exits. Downloads
+  // are passed to the callback as target if they still exist.
+  torrent::Object     execute_async(target_type target, const torrent::Object::list_type& args);
+
+  void                cleanup();
+
 private:
+  friend class ExecChild;
+
+  // The callback id and reap task are set up on first use rather than
+  // by the constructor of the global instance.
+  void                initialize();
+
+  // Returns -1 and sets errno if the command could not be started.
+  // Output to descriptors of -1 is discarded.
+  pid_t               spawn(const char* file, char* const* argv, int stdout_fd, int stderr_fd);
+
+  void                write_log(const char* msg);
+  void                write_log(const std::string& msg)  { write_log(msg.c_str()); }
+
+  void                reap_background();
+  void                receive_child_done(ExecChild* child);
+
   int                 m_log_fd{-1};
   std::string         m_capture;
+
+  std::vector<pid_t>  m_background;
+  torrent::utils::SchedulerEntry m_task_reap;
+
+  std::list<std::unique_ptr<ExecChild>> m_children;
+
+  bool                                  m_initialized{};
+  torrent::system::callback_id          m_callback_id{};
+};
+
+// A child started by execute.async, with the read end of its output
+// pipe registered with the main thread's poll. The child is waited for
+// once the pipe is closed.
+class ExecChild : public torrent::Event {
+public:
+  static constexpr auto   wait_interval = std::chrono::milliseconds(100);
+
+  // Output beyond this is read and discarded.
+  static constexpr size_t max_output    = 1 << 20;
+
+  ExecChild(ExecFile* parent, pid_t pid, int fd, std::string callback, std::string target);
+  ~ExecChild() override;
+
+  const char*         type_name() const override { return "exec_child"; }
+
+  pid_t               pid() const                { return m_pid; }
+  int                 status() const             { return m_status; }
+  const std::string&  output() const             { return m_output; }
+  const std::string&  callback() const           { return m_callback; }
+  const std::string&  target() const             { return m_target; }
+
+  std::chrono::microseconds elapsed() const;
+
+  void                start();
+  void                close();
+
+  void                event_read() override;
+  void                event_write() override;
+  void                event_error() override;
+
+private:
+  void                receive_closed();
+  void                try_wait();
+
+  ExecFile*           m_parent;
+  pid_t               m_pid;
+  int                 m_status{-1};
+
+  std::string         m_output;
+  std::string         m_callback;
+  std::string         m_target;
+
+  std::chrono::steady_clock::time_point m_started;
+  torrent::utils::SchedulerEntry        m_task_wait;
 };
 
 }
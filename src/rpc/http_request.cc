@@ -0,0 +1,257 @@
+#include "config.h"
+
+#include "rpc/http_request.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+namespace rpc {
+
+static inline std::string_view
+http_trim(std::string_view value) {
+  auto first = value.find_first_not_of(" \t");
+
+  if (first == std::string_view::npos)
+    return std::string_view();
+
+  return value.substr(first, value.find_last_not_of(" \t") - first + 1);
+}
+
+static inline bool
+http_equals(std::string_view value, std::string_view str) {
+  return value.size() == str.size() && ::strncasecmp(value.data(), str.data(), value.size()) == 0;
+}
+
+static inline bool
+http_contains(std::string_view value, std::string_view str) {
+  return std::search(value.begin(), value.end(), str.begin(), str.end(),
+                     [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; }) != value.end();
+}
+
+// Only the types a browser can't send without a preflight request are
+// accepted, so a form on another site can't submit RPC calls.
+static inline bool
+http_match_content_type(std::string_view content_type, std::string_view type) {
+  return http_equals(http_trim(content_type.substr(0, content_type.find(';'))), type);
+}
+
+bool
+http_accepts_gzip(std::string_view accept_encoding) {
+  bool accepts_any{};
+
+  while (!accept_encoding.empty()) {
+    auto next    = accept_encoding.find(',');
+    auto element = accept_encoding.substr(0, next);
+
+    accept_encoding = next == std::string_view::npos ? std::string_view() : accept_encoding.substr(next + 1);
+
+    auto params = element.find(';');
+    auto coding = http_trim(element.substr(0, params));
+
+    bool is_gzip = http_equals(coding, "gzip") || http_equals(coding, "x-gzip");
+
+    if (!is_gzip && coding != "*")
+      continue;
+
+    bool accepted = true;
+
+    if (params != std::string_view::npos) {
+      auto quality = http_trim(element.substr(params + 1));
+
+      if (quality.size() >= 2 && ::strncasecmp(quality.data(), "q=", 2) == 0)
+        accepted = quality.substr(2).find_first_not_of("0.") != std::string_view::npos;
+    }
+
+    if (is_gzip)
+      return accepted;
+
+    accepts_any = accepted;
+  }
+
+  return accepts_any;
+}
+
+bool
+http_is_allowed_host(std::string_view value, const std::string& host) {
+  std::string_view name;
+
+  if (!value.empty() && value.front() == '[') {
+    auto name_end = value.find(']');
+
+    if (name_end == std::string_view::npos)
+      return false;
+
+    name  = value.substr(1, name_end - 1);
+    value = value.substr(name_end + 1);
+
+  } else {
+    auto name_end = value.find(':');
+
+    name  = value.substr(0, name_end);
+    value = name_end == std::string_view::npos ? std::string_view() : value.substr(name_end);
+  }
+
+  if (!value.empty()) {
+    unsigned int port{};
+    auto [port_end, ec] = std::from_chars(value.data() + 1, value.data() + value.size(), port);
+
+    if (value.front() != ':' || ec != std::errc() || port_end != value.data() + value.size())
+      return false;
+  }
+
+  if (name.empty())
+    return false;
+
+  if (!host.empty() && http_equals(name, host))
+    return true;
+
+  if (http_equals(name, "localhost"))
+    return true;
+
+  std::string address(name);
+
+  in_addr  addr4;
+  in6_addr addr6;
+
+  if (inet_pton(AF_INET, address.c_str(), &addr4) == 1)
+    return (ntohl(addr4.s_addr) >> 24) == 127;
+
+  if (inet_pton(AF_INET6, address.c_str(), &addr6) == 1)
+    return IN6_IS_ADDR_LOOPBACK(&addr6);
+
+  return false;
+}
+
+int
+http_parse_request(std::string_view header, const std::string& host, unsigned int max_content_size, HttpRequest* request) {
+  request->header_size = header.size();
+
+  // Each line, including the last header, ends with a CRLF.
+  header = header.substr(0, header.size() - 2);
+
+  auto request_end  = header.find("\r\n");
+  auto request_line = header.substr(0, request_end);
+
+  auto method_end = request_line.find(' ');
+  auto target_end = request_line.rfind(' ');
+
+  if (method_end == std::string_view::npos || target_end == method_end)
+    return 400;
+
+  auto version = request_line.substr(target_end + 1);
+
+  if (version == "HTTP/1.1")
+    request->keep_alive = true;
+  else if (version == "HTTP/1.0")
+    request->keep_alive = false;
+  else
+    return 505;
+
+  if (request_line.substr(0, method_end) != "POST")
+    return 405;
+
+  bool has_content_length{};
+  bool has_host{};
+
+  for (auto current = request_end + 2; current < header.size(); ) {
+    auto line_end = header.find("\r\n", current);
+    auto line     = header.substr(current, line_end - current);
+
+    current = line_end == std::string_view::npos ? header.size() : line_end + 2;
+
+    auto separator = line.find(':');
+
+    if (separator == std::string_view::npos || separator == 0)
+      return 400;
+
+    auto name  = line.substr(0, separator);
+    auto value = http_trim(line.substr(separator + 1));
+
+    if (http_equals(name, "Content-Length")) {
+      uint64_t content_length{};
+      auto [value_end, ec] = std::from_chars(value.data(), value.data() + value.size(), content_length);
+
+      // Conflicting lengths could make the connection fall out of step
+      // with the client, so they are refused along with invalid values.
+      if (has_content_length || ec != std::errc() || value_end != value.data() + value.size() || content_length == 0)
+        return 400;
+
+      if (content_length > max_content_size)
+        return 413;
+
+      request->content_length = content_length;
+      has_content_length      = true;
+
+    } else if (http_equals(name, "Host")) {
+      if (has_host)
+        return 400;
+
+      if (!http_is_allowed_host(value, host))
+        return 403;
+
+      has_host = true;
+
+    } else if (http_equals(name, "Origin")) {
+      // Only browsers send an Origin with a POST request, and RPC
+      // clients have no reason to run in one.
+      return 403;
+
+    } else if (http_equals(name, "Transfer-Encoding")) {
+      return 501;
+
+    } else if (http_equals(name, "Content-Type")) {
+      request->content_type = value;
+
+    } else if (http_equals(name, "Accept-Encoding")) {
+      request->accepts_compression = http_accepts_gzip(value);
+
+    } else if (http_equals(name, "Connection")) {
+      if (http_contains(value, "close"))
+        request->keep_alive = false;
+      else if (http_contains(value, "keep-alive"))
+        request->keep_alive = true;
+
+    } else if (http_equals(name, "Expect")) {
+      if (!http_equals(value, "100-continue"))
+        return 417;
+
+      request->expect_continue = true;
+    }
+  }
+
+  if (!has_host)
+    return 400;
+
+  if (!has_content_length)
+    return 411;
+
+  if (!http_match_content_type(request->content_type, "application/json") &&
+      !http_match_content_type(request->content_type, "text/xml"))
+    return 415;
+
+  return 0;
+}
+
+unsigned int
+http_shift_pipelined(std::vector<char>* buffer, unsigned int position, unsigned int request_end, unsigned int default_size) {
+  unsigned int remaining = position - request_end;
+
+  std::memmove(buffer->data(), buffer->data() + request_end, remaining);
+
+  // Don't hold on to a buffer grown for a large request for the rest of
+  // the connection. The last byte is kept free for a nul terminator.
+  if (buffer->size() > default_size && remaining < default_size - 1) {
+    buffer->resize(default_size);
+    buffer->shrink_to_fit();
+  }
+
+  return remaining;
+}
+
+}
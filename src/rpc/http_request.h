@@ -0,0 +1,50 @@
+#ifndef RTORRENT_RPC_HTTP_REQUEST_H
+#define RTORRENT_RPC_HTTP_REQUEST_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rpc {
+
+// The header of an RPC request received by the HTTP listener.
+//
+// Browsers may be made to send requests to a listener on localhost by
+// any page they visit, so requests carrying an Origin header, a Host
+// that doesn't name the listener or a content type a form could submit
+// are refused.
+
+struct HttpRequest {
+  unsigned int        header_size{};
+  unsigned int        content_length{};
+  std::string         content_type;
+
+  bool                keep_alive{};
+  bool                expect_continue{};
+  bool                accepts_compression{};
+
+  unsigned int        size() const { return header_size + content_length; }
+};
+
+// Returns zero if the request can be handled, or the HTTP status code to
+// reply with before closing the connection. The header includes the
+// empty line that ends it, and 'host' is a name accepted in the Host
+// header in addition to loopback addresses.
+int                 http_parse_request(std::string_view header, const std::string& host, unsigned int max_content_size, HttpRequest* request);
+
+// Matches the Host header, with an optional port, against loopback
+// addresses and the configured name.
+bool                http_is_allowed_host(std::string_view value, const std::string& host);
+
+// Accepts "gzip" unless given a zero quality value, e.g. "gzip;q=0",
+// falling back to "*" if gzip isn't listed.
+bool                http_accepts_gzip(std::string_view accept_encoding);
+
+// Moves the input following the current request to the front of the
+// buffer and returns its length. Buffers grown for a large request are
+// shrunk back to 'default_size' if the remaining input fits.
+unsigned int        http_shift_pipelined(std::vector<char>* buffer, unsigned int position, unsigned int request_end, unsigned int default_size);
+
+}
+
+#endif
@@ -3,7 +3,9 @@
 #include "rpc/jsonrpc.h"
 
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 #include <torrent/common.h>
 #include <torrent/torrent.h>
 
@@ -11,7 +13,10 @@
 #include "rpc/command.h"
 #include "rpc/command_map.h"
 #include "rpc/nlohmann/json.h"
+#include "rpc/object_encoder.h"
 #include "rpc/parse_commands.h"
+#include "rpc/response_buffer.h"
+#include "rpc/rpc_request.h"
 #include "torrent/exceptions.h"
 #include "torrent/object.h"
 #include "utils/functional.h"
@@ -27,6 +32,26 @@ constexpr int JSONRPC_INTERNAL_ERROR         = -32000;
 
 using json = nlohmann::json;
 
+// Lets the serializer write the response directly to the output
+// buffer, rather than to a temporary string.
+class response_output_adapter : public nlohmann::detail::output_adapter_protocol<char> {
+public:
+  response_output_adapter(ResponseBuffer* output) : m_output(output) {}
+
+  void write_character(char c) override                              { m_output->push_back(c); }
+  void write_characters(const char* s, std::size_t length) override { m_output->append(s, length); }
+
+private:
+  ResponseBuffer* m_output;
+};
+
+void
+json_dump(const json& value, ResponseBuffer* output, json::error_handler_t error_handler = json::error_handler_t::strict) {
+  nlohmann::detail::serializer<json> serializer(std::make_shared<response_output_adapter>(output), ' ', error_handler);
+
+  serializer.dump(value, false, false, 0);
+}
+
 torrent::Object
 json_to_object(const json& value) {
   switch (value.type()) {
@@ -62,61 +87,71 @@ json_to_object(const json& value) {
 }
 
 json
-object_to_json(const torrent::Object& object) noexcept {
-  switch (object.type()) {
-  case torrent::Object::TYPE_VALUE:
-    return object.as_value();
-  case torrent::Object::TYPE_STRING:
-    return object.as_string();
-  case torrent::Object::TYPE_LIST: {
-    json result = json::array();
-    for (const auto& obj : object.as_list())
-      result.push_back(object_to_json(obj));
-    return result;
-  }
-  case torrent::Object::TYPE_MAP: {
-    json result = json::object();
-    for (const auto& entry : object.as_map()) {
-      result.emplace(entry.first, object_to_json(entry.second));
-    }
-    return result;
-  }
-  case torrent::Object::TYPE_DICT_KEY: {
-    json result = json::array();
-    result.push_back(object_to_json(object.as_dict_key()));
-
-    const auto& dict_obj = object.as_dict_obj();
-    if (dict_obj.is_list()) {
-      for (const auto& element : dict_obj.as_list())
-        result.push_back(object_to_json(element));
-    } else {
-      result.push_back(object_to_json(dict_obj));
-    }
+json_error(int code, const std::string& msg, json id) {
+  return json{{"jsonrpc", "2.0"}, {"id", id}, {"error", {{"code", code}, {"message", msg}}}};
+}
 
-    return result;
-  }
-  default:
-    return 0;
+// Checks the request and converts the parameters, leaving only the
+// method lookup, target resolution and the call itself for the main
+// thread.
+//
+// Notifications are basically the same as requests, except we can just
+// drop the message on the floor if there are any errors.
+void
+parse_call(const json& request, RpcCall* call) {
+  call->is_notification = !request.contains("id");
+
+  if (call->is_notification) {
+    if (!request.contains("method") || !request["method"].is_string())
+      call->set_error(JSONRPC_INVALID_REQUEST_ERROR, "method string not present");
+
+  } else {
+    call->id = "null";
+
+    if (!request["id"].is_number() && !request["id"].is_string() && !request["id"].is_null())
+      return call->set_error(JSONRPC_INVALID_REQUEST_ERROR, "request id is invalid type " + std::string(request["id"].type_name()));
+
+    call->id = request["id"].dump();
+
+    if (!request.contains("method") || !request["method"].is_string())
+      return call->set_error(JSONRPC_INVALID_REQUEST_ERROR, "method string not present");
   }
-}
 
-json
-jsonrpc_call_command(const std::string& method, const json& params) {
+  if (call->failed)
+    return;
+
+  call->method = request["method"].get<std::string>();
+
+  static const json blank_params = json::array({""});
+
+  const json& params = request.contains("params") ? request["params"] : blank_params;
+
   if (params.type() == json::value_t::object) {
     // Named parameters is valid JSON-RPC, rtorrent just doesn't support it
-    throw rpc_error(JSONRPC_INVALID_PARAMS_ERROR, "invalid parameter: procedure named parameter not supported");
+    return call->set_error(JSONRPC_INVALID_PARAMS_ERROR, "invalid parameter: procedure named parameter not supported");
   } else if (params.type() != json::value_t::array) {
-    throw rpc_error(JSONRPC_INVALID_REQUEST_ERROR, "invalid request: params field must be an array");
+    return call->set_error(JSONRPC_INVALID_REQUEST_ERROR, "invalid request: params field must be an array");
+  }
+
+  try {
+    call->params = json_to_object(params);
+  } catch (torrent::input_error& e) {
+    call->set_parse_error(RpcCall::parse_error_after_lookup, JSONRPC_INVALID_PARAMS_ERROR, e.what());
   }
+}
 
-  CommandMap::iterator itr = commands.find(method.c_str());
+torrent::Object
+jsonrpc_call_command(RpcCall* call) {
+  CommandMap::iterator itr = commands.find(call->method.c_str());
 
   if (itr == commands.end()) {
-    throw rpc_error(JSONRPC_METHOD_NOT_FOUND_ERROR, "method not found: " + method);
+    throw rpc_error(JSONRPC_METHOD_NOT_FOUND_ERROR, "method not found: " + call->method);
   }
 
-  torrent::Object  params_object      = json_to_object(params);
-  auto&            params_object_list = params_object.as_list();
+  if (call->parse_error != RpcCall::parse_error_none)
+    throw rpc_error(call->parse_error_code, call->parse_error_message);
+
+  auto&            params_object_list = call->params.as_list();
   rpc::target_type target             = rpc::make_target();
 
   std::function<void()> deleter = []() {};
@@ -134,109 +169,144 @@ jsonrpc_call_command(const std::string& method, const json& params) {
   params_object_list.erase(params_object_list.begin());
 
   try {
-    const auto& result = rpc::commands.call_command(itr, params_object, target);
-    return object_to_json(result);
+    return rpc::commands.call_command(itr, call->params, target);
   } catch (untrusted_error& e) {
     throw rpc_error(JSONRPC_METHOD_NOT_FOUND_ERROR, e.what());
   }
 }
 
-json
-json_error(int code, const std::string& msg, json id) {
-  return json{{"jsonrpc", "2.0"}, {"id", id}, {"error", {{"code", code}, {"message", msg}}}};
+void
+JsonRpc::parse(const char* in_buffer, uint32_t length, RpcRequest* request) {
+  try {
+    json body = json::parse(in_buffer, in_buffer + length);
+
+    switch (body.type()) {
+    case json::value_t::object:
+      request->calls.emplace_back();
+      parse_call(body, &request->calls.back());
+      return;
+
+    case json::value_t::array:
+      // Empty batch requests are invalid as per the spec
+      if (body.empty())
+        return request->set_error(JSONRPC_INVALID_REQUEST_ERROR, "invalid request: empty batch");
+
+      request->is_batch = true;
+      request->calls.resize(body.size());
+
+      for (size_t i = 0; i < body.size(); i++)
+        parse_call(body[i], &request->calls[i]);
+
+      return;
+
+    default:
+      return request->set_error(JSONRPC_PARSE_ERROR, "message type " + std::string(body.type_name()) + " unsupported");
+    }
+
+  } catch (json::parse_error& e) {
+    request->calls.clear();
+    request->set_error(JSONRPC_PARSE_ERROR, e.what());
+  } catch (json::type_error& e) {
+    // Type errors may be caused by ids with invalid UTF-8 strings
+    request->calls.clear();
+    request->set_error(JSONRPC_PARSE_ERROR, e.what());
+  }
 }
 
-json
-handle_request(const json& request) {
-  json response = {{"jsonrpc", "2.0"}, {"id", nullptr}};
+void
+JsonRpc::execute(RpcRequest* request, ResponseBuffer*) {
+  for (auto& call : request->calls) {
+    if (call.failed)
+      continue;
 
-  try {
-    if (!request["id"].is_number() && !request["id"].is_string() && !request["id"].is_null())
-      return json_error(JSONRPC_INVALID_REQUEST_ERROR, "request id is invalid type " + std::string(request["id"].type_name()), response["id"]);
-    response["id"] = request["id"];
-    if (!request.contains("method") || !request["method"].is_string())
-      return json_error(JSONRPC_INVALID_REQUEST_ERROR, "method string not present", response["id"]);
-    if (request.contains("params"))
-      response["result"] = jsonrpc_call_command(request["method"], request["params"]);
-    else
-      response["result"] = jsonrpc_call_command(request["method"], json::array({""}));
-    return response;
-  } catch (rpc_error& e) {
-    return json_error(e.type(), e.what(), response["id"]);
-  } catch (torrent::input_error& e) {
-    return json_error(JSONRPC_INVALID_PARAMS_ERROR, e.what(), response["id"]);
-  } catch (torrent::local_error& e) {
-    return json_error(JSONRPC_INTERNAL_ERROR, e.what(), response["id"]);
+    try {
+      call.result = jsonrpc_call_command(&call);
+    } catch (rpc_error& e) {
+      call.set_error(e.type(), e.what());
+    } catch (torrent::input_error& e) {
+      call.set_error(JSONRPC_INVALID_PARAMS_ERROR, e.what());
+    } catch (torrent::local_error& e) {
+      call.set_error(JSONRPC_INTERNAL_ERROR, e.what());
+    }
   }
 }
 
-// Notifications are basically the same as requests, except we can
-// just drop the message on the floor if there are any errors
+// Keys are written in the same order as the json document would have
+// sorted them.
 void
-handle_notification(const json& request) noexcept {
-  if (!request.contains("method") || !request["method"].is_string())
+write_response(const RpcCall& call, ResponseBuffer* output) {
+  static constexpr char response_first[]  = "{\"id\":";
+  static constexpr char response_result[] = ",\"jsonrpc\":\"2.0\",\"result\":";
+
+  if (call.failed) {
+    static constexpr char error_first[] = "{\"error\":";
+    static constexpr char error_id[]    = ",\"id\":";
+    static constexpr char error_last[]  = ",\"jsonrpc\":\"2.0\"}";
+
+    output->append(error_first, sizeof(error_first) - 1);
+    json_dump(json{{"code", call.error_code}, {"message", call.error_message}}, output);
+    output->append(error_id, sizeof(error_id) - 1);
+    output->append(call.id.c_str(), call.id.size());
+    output->append(error_last, sizeof(error_last) - 1);
     return;
-  try {
-    if (request.contains("params"))
-      jsonrpc_call_command(request["method"], request["params"]);
-    else
-      jsonrpc_call_command(request["method"], json::array({""}));
-  } catch (std::exception& e) {
   }
-}
 
-bool
-JsonRpc::process(const char* in_buffer, uint32_t length, slot_write callback) {
-  json response;
-  json body;
+  output->append(response_first, sizeof(response_first) - 1);
+  output->append(call.id.c_str(), call.id.size());
+  output->append(response_result, sizeof(response_result) - 1);
+  object_encode_json(call.result, output);
+  output->push_back('}');
+}
 
+void
+JsonRpc::serialize(const RpcRequest& request, ResponseBuffer* output) {
   try {
-    body = json::parse(in_buffer, in_buffer + length);
-    switch (body.type()) {
-    case json::value_t::object: {
-      if (!body.contains("id")) {
-        handle_notification(body);
-        return callback("", 0);
-      } else {
-        response = handle_request(body);
-      }
-      break;
-    }
-    case json::value_t::array: {
-      // Empty batch requests are invalid as per the spec
-      if (body.empty()) {
-        response = json_error(JSONRPC_INVALID_REQUEST_ERROR, "invalid request: empty batch", nullptr);
-        break;
-      }
-      response = json::array();
-      for (const auto& sub_body : body) {
-        if (!sub_body.contains("id"))
-          handle_notification(sub_body);
-        else
-          response.push_back(handle_request(sub_body));
-      }
-      // This indicates the batch was composed entirely of
-      // notifications, in which case nothing is returned
-      if (response.empty())
-        return callback("", 0);
-      break;
-    }
-    default:
-      response = json_error(JSONRPC_PARSE_ERROR, "message type " + std::string(body.type_name()) + " unsupported", nullptr);
+    if (request.failed) {
+      json_dump(json_error(request.error_code, request.error_message, nullptr), output, json::error_handler_t::replace);
+      return;
     }
 
-    std::string response_str = response.dump();
+    // Nothing is returned for notifications, or batches composed
+    // entirely of notifications.
+    bool first = true;
 
-    return callback(response_str.c_str(), response_str.size());
+    for (const auto& call : request.calls) {
+      if (call.is_notification)
+        continue;
+
+      if (first && request.is_batch)
+        output->push_back('[');
+      else if (!first)
+        output->push_back(',');
+
+      write_response(call, output);
+      first = false;
+    }
+
+    if (!first && request.is_batch)
+      output->push_back(']');
 
-  } catch (json::parse_error& e) {
-    auto err_str = json_error(JSONRPC_PARSE_ERROR, e.what(), nullptr).dump(-1, ' ', false, json::error_handler_t::replace);
-    return callback(err_str.c_str(), err_str.size());
   } catch (json::type_error& e) {
     // Type errors may be caused by invalid UTF-8 strings in exception strings, hence the ::replace
-    auto err_str = json_error(JSONRPC_PARSE_ERROR, e.what(), nullptr).dump(-1, ' ', false, json::error_handler_t::replace);
-    return callback(err_str.c_str(), err_str.size());
+    //
+    // The serializer might have written part of the response before failing.
+    output->clear();
+    json_dump(json_error(JSONRPC_PARSE_ERROR, e.what(), nullptr), output, json::error_handler_t::replace);
+  } catch (torrent::input_error& e) {
+    // Results with strings that are not valid UTF-8.
+    output->clear();
+    json_dump(json_error(JSONRPC_PARSE_ERROR, e.what(), nullptr), output, json::error_handler_t::replace);
   }
 }
 
+bool
+JsonRpc::process(const char* in_buffer, uint32_t length, ResponseBuffer* output) {
+  RpcRequest request;
+
+  parse(in_buffer, length, &request);
+  execute(&request, output);
+  serialize(request, output);
+  return true;
+}
+
 } // namespace rpc
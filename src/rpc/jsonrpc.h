@@ -1,20 +1,24 @@
 #ifndef RTORRENT_RPC_JSONRPC_H
 #define RTORRENT_RPC_JSONRPC_H
 
-#include <functional>
-
 #include <cstdint>
 
 namespace rpc {
 
+class ResponseBuffer;
+struct RpcRequest;
+
 class JsonRpc {
 public:
-  using slot_write = std::function<bool(const char*, uint32_t)>;
-
   void initialize() {};
   void cleanup() {};
 
-  bool process(const char* in_buffer, uint32_t length, slot_write callback);
+  bool process(const char* in_buffer, uint32_t length, ResponseBuffer* output);
+
+  // Only 'execute' needs to be called from the main thread.
+  void parse(const char* in_buffer, uint32_t length, RpcRequest* request);
+  void execute(RpcRequest* request, ResponseBuffer* output);
+  void serialize(const RpcRequest& request, ResponseBuffer* output);
 
   void insert_command(const char* name, const char* parm, const char* doc) {};
 };
@@ -1,10 +1,12 @@
 #include "config.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <fstream>
 #include <string>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
 
 #include "rpc/lua.h"
 
@@ -15,7 +17,11 @@
 #include <torrent/object.h>
 #include <torrent/utils/string_manip.h>
 
+#include "control.h"
+#include "globals.h"
 #include "core/download.h"
+#include "core/view.h"
+#include "core/view_manager.h"
 #include "rpc/command.h"
 #include "rpc/command_map.h"
 #include "rpc/parse_commands.h"
@@ -29,6 +35,16 @@ const int         LuaEngine::flag_string;
 const std::string LuaEngine::module_name = "rtorrent";
 const std::string LuaEngine::local_path = LUA_DATADIR "/?.lua;" LUA_DATADIR "/?/init.lua";
 
+// Files rewritten within the same second must not reuse the old chunk.
+static inline const timespec&
+stat_mtime(const struct stat& file_stat) {
+#ifdef __APPLE__
+  return file_stat.st_mtimespec;
+#else
+  return file_stat.st_mtim;
+#endif
+}
+
 LuaEngine::LuaEngine() {
   m_luaState = luaL_newstate();
   luaL_openlibs(m_luaState);
@@ -38,12 +54,145 @@ LuaEngine::LuaEngine() {
 
 LuaEngine::~LuaEngine() { lua_close(m_luaState); }
 
+size_t
+LuaEngine::size_chunks() const {
+  return m_file_chunks.size() + m_string_chunks.size();
+}
+
+void
+LuaEngine::clear_chunks() {
+  for (const auto& [path, chunk] : m_file_chunks)
+    luaL_unref(m_luaState, LUA_REGISTRYINDEX, chunk.ref);
+
+  for (const auto& [source, ref] : m_string_chunks)
+    luaL_unref(m_luaState, LUA_REGISTRYINDEX, ref);
+
+  m_file_chunks.clear();
+  m_string_chunks.clear();
+}
+
+void
+LuaEngine::push_chunk(const std::string& source, bool is_string) {
+  auto l_state = m_luaState;
+
+  if (is_string) {
+    auto itr = m_string_chunks.find(source);
+
+    if (itr != m_string_chunks.end()) {
+      lua_rawgeti(l_state, LUA_REGISTRYINDEX, itr->second);
+      return;
+    }
+
+    check_lua_status(l_state, luaL_loadstring(l_state, source.c_str()));
+
+    if (m_string_chunks.size() >= max_string_chunks) {
+      for (const auto& [chunk_source, ref] : m_string_chunks)
+        luaL_unref(l_state, LUA_REGISTRYINDEX, ref);
+
+      m_string_chunks.clear();
+    }
+
+    lua_pushvalue(l_state, -1);
+    m_string_chunks.emplace(source, luaL_ref(l_state, LUA_REGISTRYINDEX));
+    return;
+  }
+
+  struct stat file_stat;
+
+  // Let luaL_loadfile report missing files.
+  if (::stat(source.c_str(), &file_stat) != 0) {
+    check_lua_status(l_state, luaL_loadfile(l_state, source.c_str()));
+    return;
+  }
+
+  auto itr = m_file_chunks.find(source);
+
+  const timespec& mtime = stat_mtime(file_stat);
+
+  if (itr != m_file_chunks.end()) {
+    if (itr->second.inode == file_stat.st_ino && itr->second.size == file_stat.st_size &&
+        itr->second.mtime.tv_sec == mtime.tv_sec && itr->second.mtime.tv_nsec == mtime.tv_nsec) {
+      lua_rawgeti(l_state, LUA_REGISTRYINDEX, itr->second.ref);
+      return;
+    }
+
+    luaL_unref(l_state, LUA_REGISTRYINDEX, itr->second.ref);
+    m_file_chunks.erase(itr);
+  }
+
+  check_lua_status(l_state, luaL_loadfile(l_state, source.c_str()));
+
+  lua_pushvalue(l_state, -1);
+  m_file_chunks.emplace(source, file_chunk_type{luaL_ref(l_state, LUA_REGISTRYINDEX), file_stat.st_ino, mtime, file_stat.st_size});
+}
+
+torrent::Object
+LuaEngine::call(int top, int argc) {
+  auto l_state = m_luaState;
+
+  // On errors only the message is left on the stack, and is popped.
+  check_lua_status(l_state, lua_pcall(l_state, argc, LUA_MULTRET, 0));
+
+  torrent::Object result = lua_gettop(l_state) > top ? lua_to_object(l_state) : torrent::Object();
+
+  lua_settop(l_state, top);
+  return result;
+}
+
+CommandMap::iterator
+LuaEngine::find_method(const std::string& name) {
+  if (m_methods_generation != rpc::commands.generation()) {
+    m_methods.clear();
+    m_methods_generation = rpc::commands.generation();
+  }
+
+  auto itr = m_methods.find(name);
+
+  if (itr != m_methods.end())
+    return itr->second;
+
+  auto command_itr = rpc::commands.find(name);
+
+  if (command_itr != rpc::commands.end())
+    m_methods.emplace(name, command_itr);
+
+  return command_itr;
+}
+
+void
+LuaEngine::insert_method(const std::string& name, int ref) {
+  if (name.empty() || rpc::commands.has(name)) {
+    luaL_unref(m_luaState, LUA_REGISTRYINDEX, ref);
+    throw torrent::input_error("Invalid key.");
+  }
+
+  // Methods erased with method.erase keep their function until the
+  // name is reused.
+  auto itr = m_method_refs.find(name);
+
+  if (itr != m_method_refs.end()) {
+    luaL_unref(m_luaState, LUA_REGISTRYINDEX, itr->second);
+    itr->second = ref;
+  } else {
+    m_method_refs.emplace(name, ref);
+  }
+
+  rpc::commands.insert_slot<rpc::command_base_is_type<rpc::command_base_call<rpc::target_type>>::type>(
+    name,
+    [this, ref](rpc::target_type target, const torrent::Object& args) { return call_method(ref, target, args); },
+    &rpc::command_base_call<rpc::target_type>,
+    CommandMap::flag_modifiable | CommandMap::flag_public_rpc,
+    NULL,
+    NULL);
+}
+
 void
 LuaEngine::set_package_preload() {
   auto l_state = m_luaState;
   lua_getglobal(l_state, "package");
   lua_getfield(l_state, -1, "preload");
-  lua_pushcfunction(l_state, LuaEngine::lua_init_module);
+  lua_pushlightuserdata(l_state, this);
+  lua_pushcclosure(l_state, LuaEngine::lua_init_module, 1);
   lua_setfield(l_state, -2, LuaEngine::module_name.c_str());
   lua_pop(l_state, 2);
 }
@@ -65,7 +214,10 @@ LuaEngine::override_package_path() {
 void
 check_lua_status(lua_State* l_state, int status) {
   if (status != LUA_OK) {
-    throw torrent::input_error(lua_tostring(l_state, -1));
+    std::string message = lua_isstring(l_state, -1) ? lua_tostring(l_state, -1) : "unknown lua error";
+
+    lua_pop(l_state, 1);
+    throw torrent::input_error(message);
   }
 }
 
@@ -104,58 +256,231 @@ LuaEngine::search_lua_path(lua_State* l_state) {
   return "";
 }
 
+// Lua errors skip destructors and C++ exceptions must not unwind
+// through the Lua C frames, so the lua_CFunctions catch exceptions and
+// raise them as Lua errors once the C++ objects are gone.
 int
 LuaEngine::lua_rtorrent_call(lua_State* l_state) {
-  auto method = lua_tostring(l_state, 1);
-  lua_remove(l_state, 1);
+  luaL_checkstring(l_state, 1);
 
-  rpc::CommandMap::iterator itr = rpc::commands.find(std::string(method).c_str());
+  bool failed = false;
 
-  if (itr == rpc::commands.end()) {
-    throw torrent::input_error("method not found: " + std::string(method));
+  try {
+    call_to_lua(l_state);
+
+  } catch (const std::exception& e) {
+    lua_settop(l_state, 0);
+    lua_pushstring(l_state, e.what());
+    failed = true;
   }
 
+  if (failed)
+    return lua_error(l_state);
+
+  return 1;
+}
+
+void
+LuaEngine::call_to_lua(lua_State* l_state) {
+  auto        engine = static_cast<LuaEngine*>(lua_touserdata(l_state, lua_upvalueindex(1)));
+  std::string method = lua_tostring(l_state, 1);
+  lua_remove(l_state, 1);
+
+  rpc::CommandMap::iterator itr = engine->find_method(method);
+
+  if (itr == rpc::commands.end())
+    throw torrent::input_error("method not found: " + method);
+
   auto target  = rpc::make_target();
   auto deleter = std::function<void()>();
 
-  auto object = lua_callstack_to_object(l_state, itr->second.m_flags, &target, &deleter);
-
   try {
-    const auto& result = rpc::commands.call_command(itr, object, target);
+    auto object = lua_callstack_to_object(l_state, itr->second.m_flags, &target, &deleter);
 
-    object_to_lua(l_state, result);
-    if (deleter) deleter();
+    object_to_lua(l_state, rpc::commands.call_command(itr, object, target));
 
-    return 1;
-
-  } catch (torrent::base_error& e) {
+  } catch (...) {
     if (deleter) deleter();
-    throw luaL_error(l_state, e.what());
+    throw;
   }
+
+  if (deleter) deleter();
 }
 
 int
 LuaEngine::lua_init_module(lua_State* l_state) {
-  // Should this throw if it fails to find the file?
-  auto lua_file = search_lua_path(l_state);
+  bool has_file = false;
+  int  status   = LUA_OK;
 
-  if (!lua_file.empty()) {
-    check_lua_status(l_state, luaL_loadfile(l_state, lua_file.c_str()));
+  {
+    // Should this throw if it fails to find the file?
+    auto lua_file = search_lua_path(l_state);
+
+    if (!lua_file.empty()) {
+      has_file = true;
+      status   = luaL_loadfile(l_state, lua_file.c_str());
+    }
   }
 
-  lua_createtable(l_state, 0, 1);
+  if (status != LUA_OK)
+    return lua_error(l_state);
+
+  lua_createtable(l_state, 0, 3);
   // Assign functions
   lua_pushliteral(l_state, "call");
-  lua_pushcfunction(l_state, LuaEngine::lua_rtorrent_call);
+  lua_pushvalue(l_state, lua_upvalueindex(1));
+  lua_pushcclosure(l_state, LuaEngine::lua_rtorrent_call, 1);
+  lua_settable(l_state, -3);
+
+  lua_pushliteral(l_state, "insert_method");
+  lua_pushvalue(l_state, lua_upvalueindex(1));
+  lua_pushcclosure(l_state, LuaEngine::lua_insert_method, 1);
   lua_settable(l_state, -3);
 
-  if (!lua_file.empty()) {
-    check_lua_status(l_state, lua_pcall(l_state, 1, 1, 0));
+  lua_pushliteral(l_state, "multicall");
+  lua_pushcfunction(l_state, LuaEngine::lua_multicall);
+  lua_settable(l_state, -3);
+
+  // Errors in the module propagate to the caller of require.
+  if (has_file)
+    lua_call(l_state, 1, 1);
+
+  return 1;
+}
+
+// rtorrent.insert_method(name, function)
+//
+// Adds a modifiable method that calls the function with the target
+// followed by the arguments, without recompiling it on each call.
+int
+LuaEngine::lua_insert_method(lua_State* l_state) {
+  auto engine = static_cast<LuaEngine*>(lua_touserdata(l_state, lua_upvalueindex(1)));
+  auto name   = luaL_checkstring(l_state, 1);
+
+  luaL_checktype(l_state, 2, LUA_TFUNCTION);
+  lua_pushvalue(l_state, 2);
+
+  int  ref    = luaL_ref(l_state, LUA_REGISTRYINDEX);
+  bool failed = false;
+
+  try {
+    engine->insert_method(name, ref);
+
+  } catch (const std::exception& e) {
+    lua_pushstring(l_state, e.what());
+    failed = true;
+  }
+
+  if (failed)
+    return lua_error(l_state);
+
+  return 0;
+}
+
+// rtorrent.multicall(view, fields)
+//
+// Calls the commands in 'fields' on each download in the view, like
+// d.multicall2, and returns a table with a row per download. Rows are
+// arrays if 'fields' is an array, otherwise they use the same keys as
+// 'fields', e.g. {name = "d.name=", size = "d.size_bytes="}.
+//
+// The commands are compiled once per call, and the results converted
+// directly into the row tables.
+int
+LuaEngine::lua_multicall(lua_State* l_state) {
+  // Lua errors skip destructors, so check the arguments before any
+  // objects are created and raise C++ errors after they are gone.
+  luaL_checkstring(l_state, 1);
+  luaL_checktype(l_state, 2, LUA_TTABLE);
+  lua_settop(l_state, 2);
+
+  bool failed = false;
+
+  try {
+    multicall_to_lua(l_state);
+
+  } catch (const std::exception& e) {
+    lua_settop(l_state, 2);
+    lua_pushstring(l_state, e.what());
+    failed = true;
   }
 
+  if (failed)
+    return lua_error(l_state);
+
   return 1;
 }
 
+void
+LuaEngine::multicall_to_lua(lua_State* l_state) {
+  struct column_type {
+    lua_Integer        index;
+    std::string        key;
+    parsed_command_ptr command;
+  };
+
+  std::vector<column_type> columns;
+  size_t                   array_size   = 0;
+  lua_Unsigned             array_length = lua_rawlen(l_state, 2);
+
+  lua_pushnil(l_state);
+
+  while (lua_next(l_state, 2) != 0) {
+    if (lua_type(l_state, -1) != LUA_TSTRING)
+      throw torrent::input_error("invalid parameters: fields must be strings");
+
+    if (lua_type(l_state, -2) == LUA_TNUMBER) {
+      // Only the array part is accepted, so the rows can't be made to
+      // allocate tables with arbitrary sizes.
+      int  is_integer{};
+      auto index = lua_tointegerx(l_state, -2, &is_integer);
+
+      if (!is_integer || index < 1 || static_cast<lua_Unsigned>(index) > array_length)
+        throw torrent::input_error("invalid parameters: invalid field index");
+
+      columns.push_back(column_type{index, std::string(), parse_command_compile_cached(lua_tostring(l_state, -1))});
+      array_size = std::max<size_t>(array_size, index);
+
+    } else if (lua_type(l_state, -2) == LUA_TSTRING) {
+      columns.push_back(column_type{0, lua_tostring(l_state, -2), parse_command_compile_cached(lua_tostring(l_state, -1))});
+
+    } else {
+      throw torrent::input_error("invalid parameters: invalid field key");
+    }
+
+    lua_pop(l_state, 1);
+  }
+
+  std::string view_name = lua_tostring(l_state, 1);
+  auto        view_itr  = control->view_manager()->find(view_name.empty() ? "default" : view_name);
+
+  if (view_itr == control->view_manager()->end())
+    throw torrent::input_error("Could not find view '" + view_name + "'.");
+
+  // Commands might change the view.
+  std::vector<core::Download*> dlist((*view_itr)->begin_visible(), (*view_itr)->end_visible());
+
+  lua_createtable(l_state, dlist.size(), 0);
+
+  int         result_idx = lua_gettop(l_state);
+  lua_Integer row_index  = 1;
+
+  for (auto download : dlist) {
+    lua_createtable(l_state, array_size, columns.size() - std::min(columns.size(), array_size));
+
+    for (const auto& column : columns) {
+      object_to_lua(l_state, parse_command_call(*column.command, rpc::make_target(download)));
+
+      if (column.index != 0)
+        lua_rawseti(l_state, -2, column.index);
+      else
+        lua_setfield(l_state, -2, column.key.c_str());
+    }
+
+    lua_rawseti(l_state, result_idx, row_index++);
+  }
+}
+
 void
 object_to_target(const torrent::Object& obj, int call_flags, rpc::target_type* target, std::function<void()>* deleter) {
   if (!obj.is_string()) {
@@ -203,7 +528,7 @@ object_to_target(const torrent::Object& obj, int call_flags, rpc::target_type* t
       break;
 
     case 'f':
-      *target = rpc::make_target(command_base::target_file, rpc.slot_find_file()(download, std::stoi(std::string(index))));
+      *target = rpc::make_target(command_base::target_file, rpc.slot_find_file()(download, std::stoi(std::string(index))), download);
       break;
 
     case 't':
@@ -211,7 +536,7 @@ object_to_target(const torrent::Object& obj, int call_flags, rpc::target_type* t
         auto tracker = new torrent::tracker::Tracker(rpc.slot_find_tracker()(download, std::stoi(std::string(index))));
 
         *deleter = [tracker]() { delete tracker; };
-        *target  = rpc::make_target(command_base::target_tracker, tracker);
+        *target  = rpc::make_target(command_base::target_tracker, tracker, download);
       }
       break;
 
@@ -225,7 +550,7 @@ object_to_target(const torrent::Object& obj, int call_flags, rpc::target_type* t
         if (torrent::utils::transform_from_hex(index.c_str(), index.c_str() + 40, hash) != hash.end())
           throw torrent::input_error("invalid parameters: target is not a hex string");
 
-        *target = rpc::make_target(command_base::target_peer, rpc.slot_find_peer()(download, hash));
+        *target = rpc::make_target(command_base::target_peer, rpc.slot_find_peer()(download, hash), download);
       }
       break;
 
@@ -373,29 +698,60 @@ lua_callstack_to_object(lua_State* l_state, int command_flags, rpc::target_type*
   return result;
 }
 
-torrent::Object
-execute_lua(LuaEngine* engine, rpc::target_type target_type, torrent::Object const& raw_args, int flags) {
-  size_t      lua_argc = 1; // Target is always present, even if empty
-  lua_State*  l_state  = engine->state();
+static void
+push_target(lua_State* l_state, rpc::target_type target) {
   std::string target_string;
 
-  switch (target_type.first) {
+  switch (target.first) {
   case (command_base::target_download):
-    core::Download*     dl_target = (core::Download*)target_type.second;
+    core::Download*     dl_target = (core::Download*)target.second;
     torrent::HashString infohash  = dl_target->info()->hash();
     target_string                 = torrent::utils::transform_to_hex_str(infohash);
     break;
   }
 
+  object_to_lua(l_state, target_string);
+}
+
+torrent::Object
+LuaEngine::call_method(int ref, rpc::target_type target, const torrent::Object& args) {
+  auto l_state  = m_luaState;
+  int  top      = lua_gettop(l_state);
+  int  lua_argc = 1; // Target is always present, even if empty
+
+  lua_rawgeti(l_state, LUA_REGISTRYINDEX, ref);
+  push_target(l_state, target);
+
+  if (args.is_list()) {
+    for (const auto& arg : args.as_list())
+      object_to_lua(l_state, arg);
+
+    lua_argc += args.as_list().size();
+
+  } else if (!args.is_empty()) {
+    object_to_lua(l_state, args);
+    lua_argc++;
+  }
+
+  return call(top, lua_argc);
+}
+
+torrent::Object
+execute_lua(LuaEngine* engine, rpc::target_type target, torrent::Object const& raw_args, int flags) {
+  size_t     lua_argc = 1; // Target is always present, even if empty
+  lua_State* l_state  = engine->state();
+  int        top      = lua_gettop(l_state);
+
   switch (raw_args.type()) {
   case torrent::Object::TYPE_LIST: {
     const torrent::Object::list_type& args = raw_args.as_list();
-    if (flags & LuaEngine::flag_string) {
-      check_lua_status(l_state, luaL_loadstring(l_state, args.begin()->as_string().c_str()));
-    } else {
-      check_lua_status(l_state, luaL_loadfile(l_state, args.begin()->as_string().c_str()));
-    }
-    object_to_lua(l_state, target_string);
+
+    if (args.empty())
+      throw torrent::input_error("execute_lua(...): no script given");
+
+    engine->push_chunk(args.begin()->as_string(), flags & LuaEngine::flag_string);
+    push_target(l_state, target);
+
     for (torrent::Object::list_const_iterator itr = std::next(args.begin()), last = args.end(); itr != last; itr++) {
       object_to_lua(l_state, *itr);
     }
@@ -403,26 +759,21 @@ execute_lua(LuaEngine* engine, rpc::target_type target_type, torrent::Object con
     break;
   }
   case torrent::Object::TYPE_STRING: {
-    const torrent::Object::string_type& target = raw_args.as_string();
-    if (flags & LuaEngine::flag_string) {
-      check_lua_status(l_state, luaL_loadstring(l_state, target.c_str()));
-    } else {
-      check_lua_status(l_state, luaL_loadfile(l_state, target.c_str()));
-    }
-    object_to_lua(l_state, target_string);
+    engine->push_chunk(raw_args.as_string(), flags & LuaEngine::flag_string);
+    push_target(l_state, target);
     break;
   }
   default:
     throw torrent::input_error("execute_lua(...): cannot call lua with arg type " + std::to_string(raw_args.type()));
   }
-  check_lua_status(l_state, lua_pcall(l_state, lua_argc, LUA_MULTRET, 0));
-  return lua_to_object(l_state);
+
+  return engine->call(top, lua_argc);
 }
 
 #else
 
 torrent::Object
-execute_lua([[maybe_unused]] LuaEngine* engine, [[maybe_unused]] torrent::Object const& rawArgs, [[maybe_unused]] int flags) {
+execute_lua([[maybe_unused]] LuaEngine* engine, [[maybe_unused]] rpc::target_type target, [[maybe_unused]] torrent::Object const& rawArgs, [[maybe_unused]] int flags) {
   throw torrent::input_error("Lua support not enabled");
   return torrent::Object();
 }
@@ -430,6 +781,9 @@ execute_lua([[maybe_unused]] LuaEngine* engine, [[maybe_unused]] torrent::Object
 LuaEngine::LuaEngine() {}
 LuaEngine::~LuaEngine() {}
 
+size_t LuaEngine::size_chunks() const { return 0; }
+void   LuaEngine::clear_chunks() {}
+
 #endif
 
 } // namespace rpc
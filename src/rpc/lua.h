@@ -1,7 +1,13 @@
 #ifndef RTORRENT_LUA_H
 #define RTORRENT_LUA_H
 
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <sys/types.h>
+
 #include "rpc/command.h"
+#include "rpc/command_map.h"
 #include <torrent/object.h>
 
 #ifdef HAVE_LUA
@@ -16,20 +22,64 @@ public:
   static const std::string module_name;
   static const std::string local_path;
 
+  // Compiled strings are all dropped when the limit is reached, as
+  // scripts generating unique strings would otherwise grow the cache
+  // without bound.
+  static constexpr size_t  max_string_chunks = 1024;
+
   LuaEngine();
   ~LuaEngine();
 
+  size_t     size_chunks() const;
+  void       clear_chunks();
+
 #ifdef HAVE_LUA
-  // lua_CFunctions
+  // lua_CFunctions, with the engine as the first upvalue.
   static int lua_init_module(lua_State* l_state);
   static int lua_rtorrent_call(lua_State* l_state);
+  static int lua_insert_method(lua_State* l_state);
+  static int lua_multicall(lua_State* l_state);
   void       set_package_preload();
   void       override_package_path();
   lua_State* state() { return m_luaState; }
 
+  // Pushes the compiled chunk of a file or string, reusing the cached
+  // chunk unless the file was modified.
+  void       push_chunk(const std::string& source, bool is_string);
+
+  // Calls the function below the 'argc' arguments on top of the stack,
+  // and restores the stack to 'top'.
+  torrent::Object call(int top, int argc);
+
+  // Calls a function registered with rtorrent.insert_method(...).
+  torrent::Object call_method(int ref, rpc::target_type target, const torrent::Object& args);
+
+  CommandMap::iterator find_method(const std::string& name);
+
 private:
+  struct file_chunk_type {
+    int      ref;
+    ino_t    inode;
+    timespec mtime;
+    off_t    size;
+  };
+
   static std::string search_lua_path(lua_State* l_state);
+  static void        call_to_lua(lua_State* l_state);
+  static void        multicall_to_lua(lua_State* l_state);
+
+  void               insert_method(const std::string& name, int ref);
+
   lua_State*         m_luaState;
+
+  std::unordered_map<std::string, file_chunk_type>      m_file_chunks;
+  std::unordered_map<std::string, int>                  m_string_chunks;
+
+  // Cleared when commands are inserted or erased.
+  std::unordered_map<std::string, CommandMap::iterator> m_methods;
+  uint64_t                                              m_methods_generation{};
+
+  std::unordered_map<std::string, int>                  m_method_refs;
 #endif
 };
 
@@ -0,0 +1,308 @@
+#include "config.h"
+
+#include "rpc/object_encoder.h"
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <torrent/exceptions.h>
+
+#include "rpc/response_buffer.h"
+
+namespace rpc {
+
+namespace {
+
+template <size_t N>
+inline void
+append_literal(ResponseBuffer* output, const char (&str)[N]) {
+  output->append(str, N - 1);
+}
+
+inline void
+append_value(ResponseBuffer* output, int64_t value) {
+  char buffer[24];
+  auto [last, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+
+  output->append(buffer, last - buffer);
+}
+
+// Returns the length of the UTF-8 sequence at 'first', or zero if it is
+// malformed, overlong or encodes a surrogate.
+inline size_t
+utf8_sequence_length(const unsigned char* first, const unsigned char* last) {
+  unsigned int  c = *first;
+  size_t        length;
+  unsigned char min_second = 0x80;
+  unsigned char max_second = 0xbf;
+
+  if (c >= 0xc2 && c <= 0xdf) {
+    length = 2;
+  } else if (c >= 0xe0 && c <= 0xef) {
+    length = 3;
+    min_second = c == 0xe0 ? 0xa0 : 0x80;
+    max_second = c == 0xed ? 0x9f : 0xbf;
+  } else if (c >= 0xf0 && c <= 0xf4) {
+    length = 4;
+    min_second = c == 0xf0 ? 0x90 : 0x80;
+    max_second = c == 0xf4 ? 0x8f : 0xbf;
+  } else {
+    return 0;
+  }
+
+  if (static_cast<size_t>(last - first) < length)
+    return 0;
+
+  if (first[1] < min_second || first[1] > max_second)
+    return 0;
+
+  for (size_t i = 2; i < length; i++)
+    if ((first[i] & 0xc0) != 0x80)
+      return 0;
+
+  return length;
+}
+
+void
+encode_json_escape(unsigned char c, ResponseBuffer* output) {
+  switch (c) {
+  case '"':  append_literal(output, "\\\""); break;
+  case '\\': append_literal(output, "\\\\"); break;
+  case '\b': append_literal(output, "\\b"); break;
+  case '\f': append_literal(output, "\\f"); break;
+  case '\n': append_literal(output, "\\n"); break;
+  case '\r': append_literal(output, "\\r"); break;
+  case '\t': append_literal(output, "\\t"); break;
+  default: {
+    static constexpr char hex[] = "0123456789abcdef";
+    char escaped[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf] };
+
+    output->append(escaped, sizeof(escaped));
+    break;
+  }
+  }
+}
+
+} // namespace
+
+void
+object_encode_json_string(const std::string& str, ResponseBuffer* output) {
+  auto begin = reinterpret_cast<const unsigned char*>(str.data());
+  auto last  = begin + str.size();
+  auto first = begin;
+  auto run   = begin;
+
+  output->push_back('"');
+
+  while (first != last) {
+    unsigned char c = *first;
+
+    if (c >= 0x80) {
+      size_t length = utf8_sequence_length(first, last);
+
+      if (length == 0) {
+        char byte[8];
+        std::snprintf(byte, sizeof(byte), "0x%02X", c);
+
+        throw torrent::input_error("invalid UTF-8 byte at index " + std::to_string(first - begin) + ": " + byte);
+      }
+
+      first += length;
+      continue;
+    }
+
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      first++;
+      continue;
+    }
+
+    output->append(reinterpret_cast<const char*>(run), first - run);
+    encode_json_escape(c, output);
+
+    run = ++first;
+  }
+
+  output->append(reinterpret_cast<const char*>(run), first - run);
+  output->push_back('"');
+}
+
+void
+object_encode_json(const torrent::Object& object, ResponseBuffer* output) {
+  switch (object.type()) {
+  case torrent::Object::TYPE_VALUE:
+    append_value(output, object.as_value());
+    break;
+
+  case torrent::Object::TYPE_STRING:
+    object_encode_json_string(object.as_string(), output);
+    break;
+
+  case torrent::Object::TYPE_LIST: {
+    bool first = true;
+
+    output->push_back('[');
+
+    for (const auto& itr : object.as_list()) {
+      if (!first)
+        output->push_back(',');
+
+      object_encode_json(itr, output);
+      first = false;
+    }
+
+    output->push_back(']');
+    break;
+  }
+  case torrent::Object::TYPE_MAP: {
+    bool first = true;
+
+    output->push_back('{');
+
+    for (const auto& itr : object.as_map()) {
+      if (!first)
+        output->push_back(',');
+
+      object_encode_json_string(itr.first, output);
+      output->push_back(':');
+      object_encode_json(itr.second, output);
+      first = false;
+    }
+
+    output->push_back('}');
+    break;
+  }
+  case torrent::Object::TYPE_DICT_KEY: {
+    output->push_back('[');
+    object_encode_json(object.as_dict_key(), output);
+
+    const auto& dict_obj = object.as_dict_obj();
+
+    if (dict_obj.is_list()) {
+      for (const auto& itr : dict_obj.as_list()) {
+        output->push_back(',');
+        object_encode_json(itr, output);
+      }
+    } else {
+      output->push_back(',');
+      object_encode_json(dict_obj, output);
+    }
+
+    output->push_back(']');
+    break;
+  }
+  default:
+    output->push_back('0');
+    break;
+  }
+}
+
+// Escapes the same characters as tinyxml2 does for text, and like it
+// stops at the first nul character.
+
+void
+object_encode_xml_text(const std::string& str, ResponseBuffer* output) {
+  const char* first = str.c_str();
+  const char* run   = first;
+
+  for (; *first != '\0'; first++) {
+    switch (*first) {
+    case '&':
+      output->append(run, first - run);
+      append_literal(output, "&amp;");
+      break;
+    case '<':
+      output->append(run, first - run);
+      append_literal(output, "&lt;");
+      break;
+    case '>':
+      output->append(run, first - run);
+      append_literal(output, "&gt;");
+      break;
+    default:
+      continue;
+    }
+
+    run = first + 1;
+  }
+
+  output->append(run, first - run);
+}
+
+void
+object_encode_xml(const torrent::Object& object, ResponseBuffer* output) {
+  switch (object.type()) {
+  case torrent::Object::TYPE_STRING:
+    append_literal(output, "<string>");
+    object_encode_xml_text(object.as_string(), output);
+    append_literal(output, "</string>");
+    break;
+
+  case torrent::Object::TYPE_VALUE:
+    append_literal(output, "<i8>");
+    append_value(output, object.as_value());
+    append_literal(output, "</i8>");
+    break;
+
+  case torrent::Object::TYPE_LIST:
+    if (object.as_list().empty()) {
+      append_literal(output, "<array><data/></array>");
+      break;
+    }
+
+    append_literal(output, "<array><data>");
+
+    for (const auto& itr : object.as_list()) {
+      append_literal(output, "<value>");
+      object_encode_xml(itr, output);
+      append_literal(output, "</value>");
+    }
+
+    append_literal(output, "</data></array>");
+    break;
+
+  case torrent::Object::TYPE_MAP:
+    if (object.as_map().empty()) {
+      append_literal(output, "<struct/>");
+      break;
+    }
+
+    append_literal(output, "<struct>");
+
+    for (const auto& itr : object.as_map()) {
+      append_literal(output, "<member><name>");
+      object_encode_xml_text(itr.first, output);
+      append_literal(output, "</name><value>");
+      object_encode_xml(itr.second, output);
+      append_literal(output, "</value></member>");
+    }
+
+    append_literal(output, "</struct>");
+    break;
+
+  case torrent::Object::TYPE_DICT_KEY:
+    append_literal(output, "<array><data><value>");
+    object_encode_xml(object.as_dict_key(), output);
+    append_literal(output, "</value>");
+
+    if (object.as_dict_obj().is_list()) {
+      for (const auto& itr : object.as_dict_obj().as_list()) {
+        append_literal(output, "<value>");
+        object_encode_xml(itr, output);
+        append_literal(output, "</value>");
+      }
+    } else {
+      append_literal(output, "<value>");
+      object_encode_xml(object.as_dict_obj(), output);
+      append_literal(output, "</value>");
+    }
+
+    append_literal(output, "</data></array>");
+    break;
+
+  default:
+    append_literal(output, "<i8>0</i8>");
+    break;
+  }
+}
+
+} // namespace rpc
@@ -0,0 +1,28 @@
+// Encodes torrent::Object values as JSON-RPC and XML-RPC text, writing
+// directly to the response buffer without building an intermediate
+// document.
+
+#ifndef RTORRENT_RPC_OBJECT_ENCODER_H
+#define RTORRENT_RPC_OBJECT_ENCODER_H
+
+#include <string>
+#include <torrent/object.h>
+
+namespace rpc {
+
+class ResponseBuffer;
+
+// Output matches nlohmann::json::dump() of the equivalent document. Strings
+// that are not valid UTF-8 throw torrent::input_error, in which case part of
+// the value may already have been written.
+void object_encode_json(const torrent::Object& object, ResponseBuffer* output);
+void object_encode_json_string(const std::string& str, ResponseBuffer* output);
+
+// Output matches what a compact tinyxml2::XMLPrinter generated for the
+// contents of a <value> element.
+void object_encode_xml(const torrent::Object& object, ResponseBuffer* output);
+void object_encode_xml_text(const std::string& str, ResponseBuffer* output);
+
+} // namespace rpc
+
+#endif
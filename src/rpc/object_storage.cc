@@ -93,6 +93,8 @@ object_storage::insert(const char* key_data, uint32_t key_size, const torrent::O
   result.first->second.flags = flags;
   result.first->second.object = use_raw ? rawObject : object;
 
+  compile(&result.first->second);
+
   return result.first;
 }
 
@@ -149,22 +151,49 @@ object_storage::list_push_back(const torrent::raw_string& key, const torrent::Ob
 const torrent::Object&
 object_storage::set_function(const torrent::raw_string& key, const std::string& object) {
   iterator itr = find_raw_string_mutable(key, flag_function_type);
-  return itr->second.object = object;
+  itr->second.object = object;
+
+  compile(&itr->second);
+  return itr->second.object;
 }
 
 torrent::Object
 object_storage::call_function(const torrent::raw_string& key, target_type target, const torrent::Object& object) {
+  return call_function_node(find_function(key), target, object);
+}
+
+object_storage_node*
+object_storage::find_function(const torrent::raw_string& key) {
   iterator itr = find_raw_string_const(key);
 
   switch (itr->second.flags & mask_type) {
   case flag_function_type:
   case flag_multi_type:
-    return command_function_call_object(itr->second.object, target, object);
+    return &itr->second;
   default:
     throw torrent::input_error("Key not found or wrong type.");
   }
 }
 
+torrent::Object
+object_storage::call_function_node(object_storage_node* node, target_type target, const torrent::Object& object) {
+  // Hold a reference as the method may be redefined while called.
+  compiled_object_ptr compiled = node->compiled;
+  auto                start    = std::chrono::steady_clock::now();
+
+  node->calls++;
+
+  try {
+    torrent::Object result = command_function_call_compiled(*compiled, target, object);
+    node->call_time += std::chrono::steady_clock::now() - start;
+    return result;
+
+  } catch (...) {
+    node->call_time += std::chrono::steady_clock::now() - start;
+    throw;
+  }
+}
+
 bool
 object_storage::has_multi_key(const torrent::raw_string& key, const std::string& cmd_key) {
   iterator itr = find_raw_string_const(key, flag_multi_type);
@@ -176,6 +205,7 @@ object_storage::erase_multi_key(const torrent::raw_string& key, const std::strin
   iterator itr = find_raw_string_mutable(key, flag_multi_type);
 
   itr->second.object.erase_key(cmd_key);
+  compile(&itr->second);
 
   if (!(itr->second.flags & flag_rlookup))
     return;
@@ -210,6 +240,7 @@ object_storage::set_multi_key_obj(const torrent::raw_string& key, const std::str
   }
 
   itr->second.object.insert_key(cmd_key, object);
+  compile(&itr->second);
 }
 
 torrent::Object::list_type
@@ -232,10 +263,24 @@ object_storage::rlookup_clear(const std::string& cmd_key) {
   if (r_itr == m_rlookup.end())
     return;
 
-  for (auto& first : r_itr->second)
+  for (auto& first : r_itr->second) {
     first->second.object.erase_key(cmd_key);
+    compile(&first->second);
+  }
 
   r_itr->second.clear();
 }
 
+void
+object_storage::compile(object_storage_node* node) {
+  switch (node->flags & mask_type) {
+  case flag_function_type:
+  case flag_multi_type:
+    node->compiled = parse_command_compile_object(node->object);
+    break;
+  default:
+    break;
+  }
+}
+
 }
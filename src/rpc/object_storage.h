@@ -5,7 +5,9 @@
 #ifndef RTORRENT_RPC_OBJECT_STORAGE_H
 #define RTORRENT_RPC_OBJECT_STORAGE_H
 
+#include <chrono>
 #include <cstring>
+#include <memory>
 #include <unordered_map>
 #include <torrent/object.h>
 #include <torrent/utils/unordered_vector.h>
@@ -15,9 +17,19 @@
 
 namespace rpc {
 
+struct compiled_object_type;
+
+typedef std::shared_ptr<const compiled_object_type> compiled_object_ptr;
+
 struct object_storage_node {
   torrent::Object object;
   unsigned int    flags;
+
+  // Function and multi type bodies are compiled when set, and the
+  // calls counted for 'method.stats'.
+  compiled_object_ptr      compiled;
+  uint64_t                 calls{};
+  std::chrono::nanoseconds call_time{};
 };
 
 typedef std::unordered_map<fixed_key_type<64>, object_storage_node, hash_fixed_key_type> object_storage_base_type;
@@ -114,6 +126,15 @@ public:
   torrent::Object        call_function(const torrent::raw_string& key, target_type target, const torrent::Object& object);
   torrent::Object        call_function_str(const std::string& key, target_type target, const torrent::Object& object);
 
+  // Look up a function or multi type once in order to call it for many
+  // targets, e.g. an event for a batch of downloads. The node stays
+  // valid until the object_storage is cleared, and always calls the
+  // current body.
+  object_storage_node*   find_function(const torrent::raw_string& key);
+  object_storage_node*   find_function_c_str(const char* key) { return find_function(torrent::raw_string::from_c_str(key)); }
+
+  static torrent::Object call_function_node(object_storage_node* node, target_type target, const torrent::Object& object);
+
   // Single-command function:
 
   const torrent::Object& set_function(const torrent::raw_string& key, const std::string& object);
@@ -137,6 +158,8 @@ public:
   void                       rlookup_clear(const std::string& cmd_key);
 
 private:
+  static void            compile(object_storage_node* node);
+
   rlookup_type m_rlookup;
 };
 
@@ -4,6 +4,8 @@
 #include <fstream>
 #include <string>
 #include <functional>
+#include <list>
+#include <unordered_map>
 #include <torrent/exceptions.h>
 
 #include "globals.h"
@@ -84,25 +86,24 @@ parse_command_name(const char* first, const char* last, char* dest_first, char*
   return first;
 }
 
-// Set 'download' to NULL to call the generic functions, thus reusing
-// the code below for both cases.
-parse_command_type
-parse_command(target_type target, const char* first, const char* last) {
+// Parse the command name and arguments without executing anything,
+// leaving 'key' empty for blank lines and comments.
+static const char*
+parse_command_split(const char* first, const char* last, char* key, char* key_last, torrent::Object* args) {
   first = std::find_if(first, last, [&](char c) { return !command_map_is_space(c); });
 
-  if (first == last || *first == '#')
-    return std::make_pair(torrent::Object(), first);
-
-  char key[128];
+  if (first == last || *first == '#') {
+    *key = '\0';
+    return first;
+  }
 
-  first = parse_command_name(first, last, key, key + 128);
+  first = parse_command_name(first, last, key, key_last);
   first = std::find_if(first, last, [&](char c) { return !command_map_is_space(c); });
 
   if (first == last || *first != '=')
     throw torrent::input_error("Could not find '=' in command '" + std::string(key) + "'.");
 
-  torrent::Object args;
-  first = parse_whole_list(first + 1, last, &args, &parse_is_delim_command);
+  first = parse_whole_list(first + 1, last, args, &parse_is_delim_command);
 
   // Find the last character that is part of this command, skipping
   // the whitespace at the end. This ensures us that the caller
@@ -116,6 +117,21 @@ parse_command(target_type target, const char* first, const char* last) {
     first++;
   }
 
+  return first;
+}
+
+// Set 'download' to NULL to call the generic functions, thus reusing
+// the code below for both cases.
+parse_command_type
+parse_command(target_type target, const char* first, const char* last) {
+  char key[128];
+  torrent::Object args;
+
+  first = parse_command_split(first, last, key, key + 128, &args);
+
+  if (*key == '\0')
+    return std::make_pair(torrent::Object(), first);
+
   // Replace any strings starting with '$' with the result of the
   // following command.
   parse_command_execute(target, &args);
@@ -123,6 +139,244 @@ parse_command(target_type target, const char* first, const char* last) {
   return std::make_pair(commands.call_command(key, args, target), first);
 }
 
+// Check if 'parse_command_execute' would modify the object, so that
+// pre-parsed arguments without any '$' commands can be passed along
+// without making a copy.
+static bool
+parse_command_needs_execute(const torrent::Object& object) {
+  if (object.is_list())
+    return std::any_of(object.as_list().begin(), object.as_list().end(), [](const torrent::Object& o) {
+        return !o.is_list() && parse_command_needs_execute(o);
+      });
+
+  return object.is_dict_key() || (object.is_string() && *object.as_string().c_str() == '$');
+}
+
+static const char*
+parse_command_compile_next(const char* first, const char* last, parsed_command_ptr* dest) {
+  char key[128];
+  auto cmd = std::make_shared<parsed_command_type>();
+
+  first = parse_command_split(first, last, key, key + 128, &cmd->args);
+
+  cmd->key           = key;
+  cmd->itr           = commands.find(cmd->key);
+  cmd->generation    = commands.generation();
+  cmd->needs_execute = parse_command_needs_execute(cmd->args);
+
+  *dest = std::move(cmd);
+  return first;
+}
+
+// Only the first command of the string is compiled, matching what
+// 'parse_command' does when called by the multicall commands.
+parsed_command_ptr
+parse_command_compile(const char* first, const char* last) {
+  parsed_command_ptr cmd;
+  parse_command_compile_next(first, last, &cmd);
+
+  return cmd;
+}
+
+// Compiles all the commands of the string, as called by
+// 'parse_command_multiple'. A comment ends the string.
+parsed_command_list
+parse_command_compile_multiple(const char* first, const char* last) {
+  parsed_command_list result;
+
+  while (first != last) {
+    result.emplace_back();
+    first = parse_command_compile_next(first, last, &result.back());
+
+    if (result.back()->key.empty())
+      break;
+  }
+
+  return result;
+}
+
+// Resolve '((cmd,args))' the same way as 'call_object', unless the
+// root object would be called by 'parse_command_execute' once unquoted.
+static bool
+parse_command_compile_dict_key(const torrent::Object& object, parsed_command_list* dest) {
+  uint32_t flags = ((object.flags() & torrent::Object::mask_function) >> 1) & torrent::Object::mask_function;
+
+  if (flags & torrent::Object::flag_function)
+    return false;
+
+  auto cmd = std::make_shared<parsed_command_type>();
+
+  cmd->key           = object.as_dict_key();
+  cmd->args          = object.as_dict_obj();
+  cmd->itr           = commands.find(cmd->key);
+  cmd->generation    = commands.generation();
+  cmd->needs_execute = parse_command_needs_execute(cmd->args);
+
+  dest->push_back(std::move(cmd));
+  return true;
+}
+
+// Append the commands of an element of a multi method, whose result is
+// discarded, or return false if it must be called as-is.
+static bool
+parse_command_compile_flatten(const compiled_object_type& object, parsed_command_list* dest) {
+  switch (object.kind) {
+  case compiled_object_type::kind_commands:
+    dest->insert(dest->end(), object.commands.begin(), object.commands.end());
+    return true;
+
+  case compiled_object_type::kind_list:
+    return std::all_of(object.elements.begin(), object.elements.end(), [dest](const compiled_object_type& element) {
+        return parse_command_compile_flatten(element, dest);
+      });
+
+  default:
+    return false;
+  }
+}
+
+static void
+parse_command_compile_object_into(const torrent::Object& object, compiled_object_type* dest) {
+  switch (object.type()) {
+  case torrent::Object::TYPE_STRING:
+    try {
+      const std::string& str = object.as_string();
+
+      dest->commands = parse_command_compile_multiple(str.c_str(), str.c_str() + str.size());
+      dest->kind     = compiled_object_type::kind_commands;
+
+    } catch (torrent::input_error& e) {
+      // Leave the string to be parsed when called, so the error is
+      // thrown by the call rather than the definition.
+      dest->commands.clear();
+      dest->object = object;
+    }
+    break;
+
+  case torrent::Object::TYPE_LIST:
+    dest->kind = compiled_object_type::kind_list;
+
+    for (const auto& itr : object.as_list()) {
+      dest->elements.emplace_back();
+      parse_command_compile_object_into(itr, &dest->elements.back());
+    }
+    break;
+
+  case torrent::Object::TYPE_MAP:
+  {
+    dest->kind = compiled_object_type::kind_map;
+
+    for (const auto& itr : object.as_map()) {
+      dest->elements.emplace_back();
+      parse_command_compile_object_into(itr.second, &dest->elements.back());
+    }
+
+    parsed_command_list flattened;
+
+    if (std::all_of(dest->elements.begin(), dest->elements.end(), [&flattened](const compiled_object_type& element) {
+          return parse_command_compile_flatten(element, &flattened);
+        })) {
+      dest->commands = std::move(flattened);
+      dest->elements.clear();
+    }
+    break;
+  }
+  case torrent::Object::TYPE_DICT_KEY:
+    if (parse_command_compile_dict_key(object, &dest->commands))
+      dest->kind = compiled_object_type::kind_commands;
+    else
+      dest->object = object;
+    break;
+
+  default:
+    dest->object = object;
+    break;
+  }
+}
+
+compiled_object_ptr
+parse_command_compile_object(const torrent::Object& object) {
+  auto compiled = std::make_shared<compiled_object_type>();
+  parse_command_compile_object_into(object, compiled.get());
+
+  return compiled;
+}
+
+// Small LRU of compiled commands keyed by the command string, so that
+// repeated polls with the same columns skip parsing entirely. Parsing
+// does not depend on the command map, so entries stay valid when it
+// changes.
+static const size_t parsed_command_cache_size = 256;
+
+typedef std::list<std::pair<std::string, parsed_command_ptr>> parsed_command_cache_type;
+
+static parsed_command_cache_type parsed_command_cache;
+static std::unordered_map<std::string, parsed_command_cache_type::iterator> parsed_command_cache_index;
+
+parsed_command_ptr
+parse_command_compile_cached(const std::string& cmd) {
+  auto index_itr = parsed_command_cache_index.find(cmd);
+
+  if (index_itr != parsed_command_cache_index.end()) {
+    auto cache_itr = index_itr->second;
+
+    parsed_command_cache.splice(parsed_command_cache.begin(), parsed_command_cache, cache_itr);
+    return cache_itr->second;
+  }
+
+  auto compiled = parse_command_compile(cmd.c_str(), cmd.c_str() + cmd.size());
+
+  if (parsed_command_cache.size() >= parsed_command_cache_size) {
+    parsed_command_cache_index.erase(parsed_command_cache.back().first);
+    parsed_command_cache.pop_back();
+  }
+
+  parsed_command_cache.emplace_front(cmd, compiled);
+  parsed_command_cache_index.emplace(cmd, parsed_command_cache.begin());
+
+  return compiled;
+}
+
+parsed_command_list
+parse_command_compile_list(torrent::Object::list_const_iterator first, torrent::Object::list_const_iterator last) {
+  parsed_command_list result;
+  result.reserve(std::distance(first, last));
+
+  for (; first != last; first++)
+    result.push_back(parse_command_compile_cached(first->as_string()));
+
+  return result;
+}
+
+static torrent::Object
+parse_command_call_args(const parsed_command_type& cmd, const torrent::Object& args, target_type target) {
+  // Commands might have been added or removed since the last call.
+  if (cmd.generation != commands.generation()) {
+    cmd.itr        = commands.find(cmd.key);
+    cmd.generation = commands.generation();
+  }
+
+  // Let the lookup by key throw the error for missing commands.
+  if (cmd.itr == commands.end())
+    return commands.call_command(cmd.key, args, target);
+
+  return commands.call_command(cmd.itr, args, target);
+}
+
+torrent::Object
+parse_command_call(const parsed_command_type& cmd, target_type target) {
+  if (cmd.key.empty())
+    return torrent::Object();
+
+  if (!cmd.needs_execute)
+    return parse_command_call_args(cmd, cmd.args, target);
+
+  torrent::Object args = cmd.args;
+  parse_command_execute(target, &args);
+
+  return parse_command_call_args(cmd, args, target);
+}
+
 torrent::Object
 parse_command_multiple(target_type target, const char* first, const char* last) {
   parse_command_type result;
@@ -235,12 +489,49 @@ call_object(const torrent::Object& command, target_type target) {
   }
 }
 
+torrent::Object
+call_compiled_object(const compiled_object_type& object, target_type target) {
+  switch (object.kind) {
+  case compiled_object_type::kind_commands:
+  {
+    torrent::Object result;
+
+    for (const auto& itr : object.commands)
+      result = parse_command_call(*itr, target);
+
+    return result;
+  }
+  case compiled_object_type::kind_list:
+  {
+    torrent::Object result;
+
+    for (const auto& itr : object.elements)
+      result = call_compiled_object(itr, target);
+
+    return result;
+  }
+  case compiled_object_type::kind_map:
+  {
+    for (const auto& itr : object.commands)
+      parse_command_call(*itr, target);
+
+    for (const auto& itr : object.elements)
+      call_compiled_object(itr, target);
+
+    return torrent::Object();
+  }
+  default:
+    return call_object(object.object, target);
+  }
+}
+
 //
 //
 //
 
-const torrent::Object
-command_function_call_object(const torrent::Object& cmd, target_type target, const torrent::Object& args) {
+template <typename Func>
+static const torrent::Object
+command_function_call_stack(const torrent::Object& args, Func func) {
   rpc::command_base::stack_type stack;
   torrent::Object* last_stack;
 
@@ -252,7 +543,7 @@ command_function_call_object(const torrent::Object& cmd, target_type target, con
     last_stack = rpc::command_base::push_stack(NULL, NULL, &stack);
 
   try {
-    torrent::Object result = call_object(cmd, target);
+    torrent::Object result = func();
     rpc::command_base::pop_stack(&stack, last_stack);
     return result;
 
@@ -262,4 +553,14 @@ command_function_call_object(const torrent::Object& cmd, target_type target, con
   }
 }
 
+const torrent::Object
+command_function_call_object(const torrent::Object& cmd, target_type target, const torrent::Object& args) {
+  return command_function_call_stack(args, [&]() { return call_object(cmd, target); });
+}
+
+const torrent::Object
+command_function_call_compiled(const compiled_object_type& cmd, target_type target, const torrent::Object& args) {
+  return command_function_call_stack(args, [&]() { return call_compiled_object(cmd, target); });
+}
+
 }
@@ -35,8 +35,10 @@
 #ifndef RTORRENT_RPC_PARSE_COMMANDS_H
 #define RTORRENT_RPC_PARSE_COMMANDS_H
 
+#include <memory>
 #include <string>
 #include <cstring>
+#include <vector>
 
 #include "xmlrpc.h"
 #include "rpc_manager.h"
@@ -59,6 +61,52 @@ void                   parse_command_execute(target_type target, torrent::Object
 inline torrent::Object parse_command_single(target_type target, const char* first)   { return parse_command(target, first, first + std::strlen(first)).first; }
 inline torrent::Object parse_command_multiple(target_type target, const char* first) { return parse_command_multiple(target, first, first + std::strlen(first)); }
 
+// Pre-parsed form of a single command, with the argument parsing and
+// command map lookup done once so that it can be called for many
+// targets, e.g. by the multicall commands. An empty key means the
+// command string was empty or a comment.
+//
+// The command is looked up again when called after the command map
+// changed, and the new iterator kept for later calls.
+struct parsed_command_type {
+  std::string                  key;
+  torrent::Object              args;
+  mutable CommandMap::iterator itr;
+  mutable uint64_t             generation;
+  bool                         needs_execute;
+};
+
+typedef std::shared_ptr<const parsed_command_type> parsed_command_ptr;
+typedef std::vector<parsed_command_ptr>            parsed_command_list;
+
+parsed_command_ptr     parse_command_compile(const char* first, const char* last);
+parsed_command_list    parse_command_compile_multiple(const char* first, const char* last);
+parsed_command_ptr     parse_command_compile_cached(const std::string& cmd);
+parsed_command_list    parse_command_compile_list(torrent::Object::list_const_iterator first, torrent::Object::list_const_iterator last);
+
+torrent::Object        parse_command_call(const parsed_command_type& cmd, target_type target);
+
+// Pre-parsed form of a function or multi method body, with each string
+// split into its commands once when the method is defined rather than
+// on every call, and '((cmd,args))' objects resolved the same way.
+// Other objects, and strings that fail to parse, are passed to
+// 'call_object' when called.
+//
+// The commands of multi methods, e.g. the event.download.* handlers,
+// are flattened into a single list when possible.
+struct compiled_object_type {
+  enum kind_type { kind_object, kind_commands, kind_list, kind_map };
+
+  kind_type                         kind{kind_object};
+  torrent::Object                   object;
+  parsed_command_list               commands;
+  std::vector<compiled_object_type> elements;
+};
+
+typedef std::shared_ptr<const compiled_object_type> compiled_object_ptr;
+
+compiled_object_ptr    parse_command_compile_object(const torrent::Object& object);
+
 bool                   parse_command_file(const std::string& path);
 const char*            parse_command_name(const char* first, const char* last, std::string* dest);
 
@@ -108,6 +156,7 @@ call_command_d_range(const char* key, core::Download* download, torrent::Object:
 }
 
 torrent::Object call_object(const torrent::Object& command, target_type target = make_target());
+torrent::Object call_compiled_object(const compiled_object_type& object, target_type target = make_target());
 
 inline torrent::Object
 call_object_nothrow(const torrent::Object& command, target_type target = make_target()) {
@@ -125,6 +174,8 @@ call_object_d_nothrow(const torrent::Object& command, core::Download* download)
 
 const torrent::Object
 command_function_call_object(const torrent::Object& cmd, target_type target, const torrent::Object& args);
+const torrent::Object
+command_function_call_compiled(const compiled_object_type& cmd, target_type target, const torrent::Object& args);
 
 inline const torrent::Object
 command_function_call_str(const std::string& cmd, target_type target, const torrent::Object& args) {
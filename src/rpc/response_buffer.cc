@@ -0,0 +1,85 @@
+#include "config.h"
+
+#include "rpc/response_buffer.h"
+
+#include <torrent/exceptions.h>
+
+namespace rpc {
+
+ResponseBuffer::ResponseBuffer(size_t reserved) :
+    m_reserved(reserved) {
+
+  if (m_reserved >= chunk_size)
+    throw torrent::internal_error("ResponseBuffer::ResponseBuffer(...) reserved space larger than chunk size.");
+}
+
+ResponseBuffer::~ResponseBuffer() = default;
+
+void
+ResponseBuffer::clear() {
+  m_size = 0;
+
+  if (m_chunks.empty())
+    return;
+
+  m_chunks.resize(1);
+
+  m_chunks.back().first = m_reserved;
+  m_chunks.back().last  = m_reserved;
+}
+
+void
+ResponseBuffer::add_chunk() {
+  size_t first = m_chunks.empty() ? m_reserved : 0;
+
+  m_chunks.push_back(chunk_type{std::make_unique<char[]>(chunk_size), first, first});
+}
+
+void
+ResponseBuffer::prepend(const char* data, size_t length) {
+  if (length > m_reserved)
+    throw torrent::internal_error("ResponseBuffer::prepend(...) header does not fit in reserved space.");
+
+  if (m_chunks.empty())
+    add_chunk();
+
+  auto& chunk = m_chunks.front();
+
+  std::memcpy(chunk.data.get() + m_reserved - length, data, length);
+
+  chunk.first = m_reserved - length;
+}
+
+void
+ResponseBuffer::body_iovecs(std::vector<struct iovec>* iovecs) const {
+  for (const auto& chunk : m_chunks) {
+    size_t first = &chunk == &m_chunks.front() ? m_reserved : chunk.first;
+
+    if (first != chunk.last)
+      iovecs->push_back(iovec{chunk.data.get() + first, chunk.last - first});
+  }
+}
+
+void
+ResponseBuffer::iovecs(std::vector<struct iovec>* iovecs) const {
+  for (const auto& chunk : m_chunks) {
+    if (chunk.first != chunk.last)
+      iovecs->push_back(iovec{chunk.data.get() + chunk.first, chunk.last - chunk.first});
+  }
+}
+
+std::string
+ResponseBuffer::to_string() const {
+  std::string result;
+  result.reserve(m_size);
+
+  for (const auto& chunk : m_chunks) {
+    size_t first = &chunk == &m_chunks.front() ? m_reserved : chunk.first;
+
+    result.append(chunk.data.get() + first, chunk.last - first);
+  }
+
+  return result;
+}
+
+} // namespace rpc
@@ -0,0 +1,100 @@
+#ifndef RTORRENT_RPC_RESPONSE_BUFFER_H
+#define RTORRENT_RPC_RESPONSE_BUFFER_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+namespace rpc {
+
+// Output sink for RPC responses, the XML-RPC and JSON-RPC encoders
+// append the response body directly to the buffer.
+//
+// The body is stored in fixed size chunks so large responses never need
+// to be reallocated and copied as they grow, and the chunks are sent
+// as-is using writev.
+//
+// Space is reserved at the front of the first chunk for the transport to
+// prepend its header once the size of the body is known. The first chunk
+// is allocated on first use, and kept when cleared.
+
+class ResponseBuffer {
+public:
+  static constexpr size_t chunk_size = 64 << 10;
+
+  ResponseBuffer(size_t reserved);
+  ~ResponseBuffer();
+
+  ResponseBuffer(const ResponseBuffer&) = delete;
+  ResponseBuffer& operator=(const ResponseBuffer&) = delete;
+
+  bool                empty() const     { return m_size == 0; }
+
+  size_t              reserved() const  { return m_reserved; }
+  size_t              size() const      { return m_size; }
+  size_t              chunk_count() const { return m_chunks.size(); }
+
+  // Keeps the first chunk for reuse.
+  void                clear();
+
+  void                push_back(char c);
+  void                append(const char* data, size_t length);
+
+  // Writes the header so it ends where the body starts.
+  void                prepend(const char* data, size_t length);
+
+  // Appends iovecs for the body, or the header followed by the body.
+  void                body_iovecs(std::vector<struct iovec>* iovecs) const;
+  void                iovecs(std::vector<struct iovec>* iovecs) const;
+
+  std::string         to_string() const;
+
+private:
+  struct chunk_type {
+    std::unique_ptr<char[]> data;
+    size_t                  first;
+    size_t                  last;
+  };
+
+  void                add_chunk();
+
+  size_t              m_reserved;
+  size_t              m_size{};
+
+  std::vector<chunk_type> m_chunks;
+};
+
+inline void
+ResponseBuffer::push_back(char c) {
+  if (m_chunks.empty() || m_chunks.back().last == chunk_size)
+    add_chunk();
+
+  m_chunks.back().data[m_chunks.back().last++] = c;
+  m_size++;
+}
+
+inline void
+ResponseBuffer::append(const char* data, size_t length) {
+  m_size += length;
+
+  while (length != 0) {
+    if (m_chunks.empty() || m_chunks.back().last == chunk_size)
+      add_chunk();
+
+    auto&  chunk = m_chunks.back();
+    size_t count = std::min(length, chunk_size - chunk.last);
+
+    std::memcpy(chunk.data.get() + chunk.last, data, count);
+    chunk.last += count;
+
+    data   += count;
+    length -= count;
+  }
+}
+
+} // namespace rpc
+
+#endif
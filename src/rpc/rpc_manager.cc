@@ -6,7 +6,9 @@
 #include <torrent/utils/string_manip.h>
 
 #include "parse_commands.h"
+#include "rpc/response_buffer.h"
 #include "rpc/rpc_manager.h"
+#include "rpc/rpc_request.h"
 
 namespace rpc {
 
@@ -76,14 +78,15 @@ RpcManager::object_to_target(const torrent::Object& obj, int call_flags, rpc::ta
 
     case 'f':
       *target = rpc::make_target(command_base::target_file,
-                                 rpc.slot_find_file()(download, std::stoi(std::string(index))));
+                                 rpc.slot_find_file()(download, std::stoi(std::string(index))),
+                                 download);
 
       break;
 
     case 't':
       tracker = new torrent::tracker::Tracker(rpc.slot_find_tracker()(download, std::stoi(std::string(index))));
 
-      *target = rpc::make_target(command_base::target_tracker, tracker);
+      *target = rpc::make_target(command_base::target_tracker, tracker, download);
       *deleter = [tracker]() { delete tracker; };
       break;
 
@@ -96,7 +99,7 @@ RpcManager::object_to_target(const torrent::Object& obj, int call_flags, rpc::ta
       if (torrent::utils::transform_from_hex(index.c_str(), index.c_str() + 40, hash) != hash.end())
         throw torrent::input_error("invalid parameters: target is not a hex string");
 
-      *target = rpc::make_target(command_base::target_peer, rpc.slot_find_peer()(download, hash));
+      *target = rpc::make_target(command_base::target_peer, rpc.slot_find_peer()(download, hash), download);
 
       break;
     }
@@ -109,50 +112,99 @@ RpcManager::object_to_target(const torrent::Object& obj, int call_flags, rpc::ta
   }
 }
 
-bool
-RpcManager::process(RPCType type, const char* in_buffer, uint32_t length, slot_response_callback callback) {
+void
+RpcManager::parse(RPCType type, const char* in_buffer, uint32_t length, RpcRequest* request) {
+  request->type = type;
+
   switch (type) {
   case RPCType::XML:
-    // TODO: 'network.rpc.use_xmlrpc' should be a bool in RpcManager, not a command variable.
-    if (m_xmlrpc.is_valid() && rpc::call_command_value("network.rpc.use_xmlrpc")) {
-      return m_xmlrpc.process(in_buffer, length, callback);
+    if (m_xmlrpc.is_valid())
+      m_xmlrpc.parse(in_buffer, length, request);
+    break;
+
+  case RPCType::JSON:
+    m_jsonrpc.parse(in_buffer, length, request);
+    break;
+
+  default:
+    throw torrent::input_error("invalid parameters: unknown RPC type");
+  }
+}
 
-    } else {
+void
+RpcManager::execute(RpcRequest* request, ResponseBuffer* output) {
+  switch (request->type) {
+  case RPCType::XML:
+    // TODO: 'network.rpc.use_xmlrpc' should be a bool in RpcManager, not a command variable.
+    if (!m_xmlrpc.is_valid() || !rpc::call_command_value("network.rpc.use_xmlrpc")) {
       const std::string response = "<?xml version=\"1.0\"?><methodResponse><fault><value><struct><member><name>faultCode</name><value><i8>-501</i8></value></member><member><name>faultString</name><value><string>XML-RPC not supported</string></value></member></struct></value></fault></methodResponse>";
-      return callback(response.c_str(), response.size());
+      output->append(response.c_str(), response.size());
+      request->is_complete = true;
+      return;
     }
     break;
 
   case RPCType::JSON:
-    if (rpc::call_command_value("network.rpc.use_jsonrpc")) {
-      return m_jsonrpc.process(in_buffer, length, callback);
-
-    } else {
+    if (!rpc::call_command_value("network.rpc.use_jsonrpc")) {
       const std::string response = "{\"jsonrpc\":\"2.0\",\"error\":{\"code\":-32601,\"message\":\"JSON-RPC not supported\"},\"id\":null}";
-      return callback(response.c_str(), response.size());
+      output->append(response.c_str(), response.size());
+      request->is_complete = true;
+      return;
     }
     break;
 
   default:
     throw torrent::input_error("invalid parameters: unknown RPC type");
   }
-}
 
-bool
-RpcManager::process_untrusted(RPCType type, const char* in_buffer, uint32_t length, slot_response_callback callback) {
   bool previous = m_trusted;
-  m_trusted = false;
+  m_trusted = request->trusted;
 
   try {
-    bool result = process(type, in_buffer, length, callback);
+    if (request->type == RPCType::XML)
+      m_xmlrpc.execute(request, output);
+    else
+      m_jsonrpc.execute(request, output);
+
     m_trusted = previous;
-    return result;
   } catch (...) {
     m_trusted = previous;
     throw;
   }
 }
 
+void
+RpcManager::serialize(const RpcRequest& request, ResponseBuffer* output) {
+  if (request.is_complete)
+    return;
+
+  if (request.type == RPCType::XML)
+    m_xmlrpc.serialize(request, output);
+  else
+    m_jsonrpc.serialize(request, output);
+}
+
+bool
+RpcManager::process(RPCType type, const char* in_buffer, uint32_t length, ResponseBuffer* output) {
+  RpcRequest request;
+
+  parse(type, in_buffer, length, &request);
+  execute(&request, output);
+  serialize(request, output);
+  return true;
+}
+
+bool
+RpcManager::process_untrusted(RPCType type, const char* in_buffer, uint32_t length, ResponseBuffer* output) {
+  RpcRequest request;
+  request.trusted = false;
+
+  parse(type, in_buffer, length, &request);
+  execute(&request, output);
+  serialize(request, output);
+  return true;
+}
+
 void
 RpcManager::initialize_handlers() {
   if (m_handlers_initialized)
@@ -198,6 +250,22 @@ RpcManager::set_type_enabled(RPCType type, bool enabled) {
   }
 }
 
+void
+RpcManager::set_scgi_compress_level(int level) {
+  if (level < -1 || level > 9)
+    throw torrent::input_error("Invalid gzip compression level.");
+
+  m_scgi_compress_level = level;
+}
+
+void
+RpcManager::set_scgi_max_connections(unsigned int count) {
+  if (count == 0 || count > (1 << 16))
+    throw torrent::input_error("Invalid number of SCGI connections.");
+
+  m_scgi_max_connections = count;
+}
+
 void
 RpcManager::insert_command(const char* name, const char* parm, const char* doc) {
   m_xmlrpc.insert_command(name, parm, doc);
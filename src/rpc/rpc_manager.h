@@ -48,7 +48,6 @@ public:
   using slot_file              = std::function<torrent::File*(core::Download*, uint32_t)>;
   using slot_tracker           = std::function<torrent::tracker::Tracker(core::Download*, uint32_t)>;
   using slot_peer              = std::function<torrent::Peer*(core::Download*, const torrent::HashString&)>;
-  using slot_response_callback = std::function<bool(const char*, uint32_t)>;
 
   enum RPCType { XML,
                  JSON };
@@ -70,8 +69,16 @@ public:
   bool                is_type_enabled(RPCType type) const;
   void                set_type_enabled(RPCType type, bool enabled);
 
-  bool                process(RPCType type, const char* in_buffer, uint32_t length, slot_response_callback callback);
-  bool                process_untrusted(RPCType type, const char* in_buffer, uint32_t length, slot_response_callback callback);
+  // The response is appended to 'output', which the caller owns.
+  bool                process(RPCType type, const char* in_buffer, uint32_t length, ResponseBuffer* output);
+  bool                process_untrusted(RPCType type, const char* in_buffer, uint32_t length, ResponseBuffer* output);
+
+  // Requests are processed in three steps, only 'execute' calls commands
+  // and needs to run on the main thread. The request buffer must be kept
+  // until 'execute' returns.
+  void                parse(RPCType type, const char* in_buffer, uint32_t length, RpcRequest* request);
+  void                execute(RpcRequest* request, ResponseBuffer* output);
+  void                serialize(const RpcRequest& request, ResponseBuffer* output);
 
   void                insert_command(const char* name, const char* parm, const char* doc);
   void                mark_safe(const std::string& key);
@@ -82,6 +89,13 @@ public:
   unsigned int        scgi_min_compress_size() const                { return m_scgi_min_compress_size; }
   void                set_scgi_min_compress_size(unsigned int size) { m_scgi_min_compress_size = size; }
 
+  // The gzip level is 0-9, or -1 for zlib's default.
+  int                 scgi_compress_level() const                   { return m_scgi_compress_level; }
+  void                set_scgi_compress_level(int level);
+
+  unsigned int        scgi_max_connections() const                  { return m_scgi_max_connections; }
+  void                set_scgi_max_connections(unsigned int count);
+
   slot_download&      slot_find_download() { return m_slot_find_download; }
   slot_file&          slot_find_file()     { return m_slot_find_file; }
   slot_tracker&       slot_find_tracker()  { return m_slot_find_tracker; }
@@ -107,6 +121,8 @@ private:
 
   std::atomic<bool>         m_scgi_allow_compression{true};
   std::atomic<unsigned int> m_scgi_min_compress_size{1000};
+  std::atomic<int>          m_scgi_compress_level{-1};
+  std::atomic<unsigned int> m_scgi_max_connections{512};
 
   slot_download m_slot_find_download;
   slot_file     m_slot_find_file;
@@ -0,0 +1,84 @@
+#ifndef RTORRENT_RPC_RPC_REQUEST_H
+#define RTORRENT_RPC_RPC_REQUEST_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <torrent/object.h>
+
+namespace rpc {
+
+// A single command call parsed from an XML-RPC or JSON-RPC request.
+//
+// Errors found while parsing are not reported until execution reaches
+// the same point the error was raised at before the parsing and
+// execution were split, so the error returned for invalid requests
+// stays the same.
+
+struct RpcCall {
+  enum parse_error_type {
+    parse_error_none,
+    parse_error_after_lookup,
+    parse_error_after_target
+  };
+
+  std::string      method;
+
+  // JSON-RPC id, encoded as JSON.
+  std::string      id;
+  bool             is_notification{};
+
+  bool             has_target{};
+  torrent::Object  target;
+  torrent::Object  params{torrent::Object::create_list()};
+
+  parse_error_type parse_error{parse_error_none};
+  int              parse_error_code{};
+  std::string      parse_error_message;
+
+  bool             failed{};
+  int              error_code{};
+  std::string      error_message;
+
+  torrent::Object  result;
+
+  void             set_error(int code, const std::string& message) { failed = true; error_code = code; error_message = message; }
+
+  void             set_parse_error(parse_error_type type, int code, const std::string& message) {
+    parse_error         = type;
+    parse_error_code    = code;
+    parse_error_message = message;
+  }
+};
+
+// Requests are parsed and their responses encoded on the SCGI thread,
+// leaving only the command calls to the main thread.
+
+struct RpcRequest {
+  int                  type{};
+  bool                 trusted{true};
+
+  // JSON-RPC batch or XML-RPC system.multicall.
+  bool                 is_batch{};
+  std::vector<RpcCall> calls;
+
+  // Set if the request as a whole could not be parsed.
+  bool                 failed{};
+  int                  error_code{};
+  std::string          error_message;
+
+  // Set if the response was written while executing the request, e.g.
+  // when the RPC type is disabled or the request could not be parsed
+  // separately.
+  bool                 is_complete{};
+
+  // Requests that are processed as a whole on the main thread.
+  const char*          buffer{};
+  uint32_t             length{};
+
+  void                 set_error(int code, const std::string& message) { failed = true; error_code = code; error_message = message; }
+};
+
+} // namespace rpc
+
+#endif
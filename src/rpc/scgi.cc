@@ -4,6 +4,7 @@
 #include <cassert>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <sys/un.h>
 #include <torrent/torrent.h>
 #include <torrent/exceptions.h>
@@ -14,6 +15,7 @@
 
 #include "control.h"
 #include "globals.h"
+#include "rpc/rpc_manager.h"
 #include "rpc/scgi_task.h"
 
 // TODO: Figure out why moving this to the top causes a build error.
@@ -21,10 +23,8 @@
 
 namespace rpc {
 
-SCgi::SCgi() {
-  std::generate(m_tasks.begin(), m_tasks.end(), []() { return std::make_unique<SCgiTask>(); });
-
-  m_current = m_tasks.begin();
+SCgi::SCgi(Protocol protocol) :
+  m_protocol(protocol) {
 }
 
 SCgi::~SCgi() {
@@ -95,7 +95,7 @@ SCgi::open(sockaddr* sa, unsigned int length) {
     if (::bind(file_descriptor(), sa, length) == -1)
       throw torrent::resource_error("Could not bind socket for listening: " + std::string(std::strerror(errno)));
 
-    if (!torrent::fd_listen(file_descriptor(), max_tasks))
+    if (!torrent::fd_listen(file_descriptor(), listen_backlog))
       throw torrent::resource_error("Could not prepare socket for listening: " + std::string(std::strerror(errno)));
 
   } catch (torrent::resource_error& e) {
@@ -140,19 +140,8 @@ SCgi::stop() {
 
 void
 SCgi::event_read() {
-  if (m_current < m_tasks.begin() || m_current >= m_tasks.end())
-    throw torrent::internal_error("SCgi::event_read() m_current is out of bounds");
-
-  while (true) {
-    // TODO: Optimize this by keeping track of count.
-    auto prev = m_current;
-
-    m_current = std::find_if(m_current + 1, m_tasks.end(), [](const auto& task) { return !task->is_open(); });
-
-    if (m_current == m_tasks.end())
-      m_current = std::find_if(m_tasks.begin(), prev, [](const auto& task) { return !task->is_open(); });
-
-    int fd = torrent::fd_accept(file_descriptor());
+  for (int i = 0; i < accept_batch_size; i++) {
+    int fd = accept_connection();
 
     if (fd == -1) {
       if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
@@ -165,31 +154,104 @@ SCgi::event_read() {
       throw torrent::resource_error("Listener port accept() failed: " + std::string(std::strerror(errno)));
     }
 
-    if (m_current == prev) {
-      torrent::fd_close(fd);
+    m_accepted++;
+
+    SCgiTask* task = acquire_task();
+
+    if (task == nullptr) {
+      reject_connection(fd);
       continue;
     }
 
-    auto open_func = [this, fd, task = m_current->get()]() {
+    auto open_func = [this, fd, task]() {
         task->open(this, fd);
       };
 
-    auto cleanup_func = [fd, task = m_current->get()](bool opened) {
+    auto cleanup_func = [this, fd, task](bool opened) {
         if (!opened) {
           torrent::fd_close(fd);
+          release_task(task);
           return;
         }
 
         task->cancel_open();
       };
 
-    bool result = torrent::runtime::socket_manager()->open_event_or_cleanup(m_current->get(), torrent::runtime::category_scgi, open_func, cleanup_func);
+    bool result = torrent::runtime::socket_manager()->open_event_or_cleanup(task, torrent::runtime::category_scgi, open_func, cleanup_func);
 
     if (!result)
       break;
   }
 }
 
+int
+SCgi::accept_connection() {
+#ifdef HAVE_ACCEPT4
+  return ::accept4(file_descriptor(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+  return torrent::fd_accept(file_descriptor());
+#endif
+}
+
+SCgiTask*
+SCgi::acquire_task() {
+  // Tasks left over after lowering the limit stay in the pool, but the
+  // number of connections in flight is still capped.
+  if (m_in_flight >= rpc.scgi_max_connections())
+    return nullptr;
+
+  if (m_free_tasks.empty()) {
+    m_tasks.push_back(std::make_unique<SCgiTask>());
+    m_free_tasks.push_back(m_tasks.back().get());
+    m_pool_size = m_tasks.size();
+  }
+
+  SCgiTask* task = m_free_tasks.back();
+  m_free_tasks.pop_back();
+
+  m_in_flight++;
+  return task;
+}
+
+void
+SCgi::release_task(SCgiTask* task) {
+  assert(torrent::this_thread::thread() == scgi_thread::thread());
+
+  m_free_tasks.push_back(task);
+  m_in_flight--;
+}
+
+// The response is written without waiting for the request, and any error
+// is ignored as the connection is closed either way.
+void
+SCgi::reject_connection(int fd) {
+  static constexpr char response[]      = "Status: 503 Service Unavailable\r\nContent-Type: text/plain\r\nContent-Length: 0\r\n\r\n";
+  static constexpr char http_response[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+  [[maybe_unused]] ssize_t result;
+
+  if (is_http())
+    result = ::send(fd, http_response, sizeof(http_response) - 1, 0);
+  else
+    result = ::send(fd, response, sizeof(response) - 1, 0);
+
+  torrent::fd_close(fd);
+
+  m_rejected++;
+}
+
+void
+SCgi::receive_queue_wait(std::chrono::microseconds wait) {
+  int64_t count    = wait.count();
+  int64_t prev_max = m_queue_wait_max;
+
+  m_requests++;
+  m_queue_wait += count;
+
+  while (count > prev_max && !m_queue_wait_max.compare_exchange_weak(prev_max, count))
+    ;
+}
+
 void
 SCgi::event_write() {
   throw torrent::internal_error("Listener does not support write().");
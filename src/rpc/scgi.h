@@ -1,22 +1,48 @@
 #ifndef RTORRENT_RPC_SCGI_H
 #define RTORRENT_RPC_SCGI_H
 
-#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <string>
+#include <vector>
 #include <torrent/event.h>
 
 #include "rpc/scgi_task.h"
 
 namespace rpc {
 
+// The tasks are allocated as needed up to the limit set by
+// RpcManager::scgi_max_connections(), and reused through a free-list.
+// Connections accepted while all tasks are busy receive a 503 response
+// and are closed, rather than left waiting in the listen backlog.
+//
+// The counters are updated on the SCGI thread and may be read from any
+// thread.
+//
+// An HTTP listener serves the same RPC requests as HTTP/1.1 POST
+// requests, with persistent connections so clients polling at short
+// intervals don't need to reconnect for every request. Its connections
+// are untrusted unless opened with 'network.rpc.http.trusted' enabled,
+// and the settings are fixed once the listener is open.
+
 class SCgi : public torrent::Event {
 public:
-  static const int max_tasks = 100;
+  static constexpr int listen_backlog    = 1024;
+
+  // Connections accepted per read event, so a burst of connections
+  // doesn't keep the SCGI thread from serving the open ones.
+  static constexpr int accept_batch_size = 64;
 
-  SCgi();
+  enum Protocol { SCGI, HTTP };
+
+  explicit SCgi(Protocol protocol = SCGI);
   ~SCgi() override;
 
-  const char*         type_name() const override { return "scgi"; }
+  const char*         type_name() const override { return m_protocol == HTTP ? "http-rpc" : "scgi"; }
+
+  Protocol            protocol() const                         { return m_protocol; }
+  bool                is_http() const                          { return m_protocol == HTTP; }
 
   void                open_port(sockaddr* sa, unsigned int length, bool dont_route);
   void                open_named(const std::string& filename);
@@ -28,23 +54,64 @@ public:
 
   const std::string&  path() const                             { return m_path; }
 
+  bool                is_http_trusted() const                  { return m_http_trusted; }
+  void                set_http_trusted(bool trusted)           { m_http_trusted = trusted; }
+
+  // Name accepted in the Host header of HTTP requests, in addition to
+  // loopback addresses.
+  const std::string&  http_host() const                        { return m_http_host; }
+  void                set_http_host(const std::string& host)   { m_http_host = host; }
+
   int                 log_fd() const                           { return m_logFd; }
   void                set_log_fd(int fd)                       { m_logFd = fd; }
 
+  uint64_t            accepted() const                         { return m_accepted; }
+  uint64_t            rejected() const                         { return m_rejected; }
+  uint64_t            requests() const                         { return m_requests; }
+  unsigned int        in_flight() const                        { return m_in_flight; }
+  unsigned int        pool_size() const                        { return m_pool_size; }
+
+  // Time requests spent waiting for the main thread to execute them.
+  std::chrono::microseconds queue_wait() const                 { return std::chrono::microseconds(m_queue_wait); }
+  std::chrono::microseconds queue_wait_max() const             { return std::chrono::microseconds(m_queue_wait_max); }
+
   void                event_read() override;
   void                event_write() override;
   void                event_error() override;
 
+  // Called by the tasks.
+  void                release_task(SCgiTask* task);
+  void                receive_queue_wait(std::chrono::microseconds wait);
+
+  // Called by event_read() for accepted connections. Returns nullptr
+  // when the connection limit is reached.
+  SCgiTask*           acquire_task();
+  void                reject_connection(int fd);
+
 private:
-  using task_list = std::array<std::unique_ptr<SCgiTask>, max_tasks>;
+  using task_list = std::vector<std::unique_ptr<SCgiTask>>;
 
   void                open(sockaddr* sa, unsigned int length);
 
+  int                 accept_connection();
+
+  Protocol            m_protocol;
   std::string         m_path;
   int                 m_logFd{-1};
 
-  task_list           m_tasks;
-  task_list::iterator m_current;
+  bool                m_http_trusted{};
+  std::string         m_http_host;
+
+  task_list              m_tasks;
+  std::vector<SCgiTask*> m_free_tasks;
+
+  std::atomic<uint64_t>     m_accepted{};
+  std::atomic<uint64_t>     m_rejected{};
+  std::atomic<uint64_t>     m_requests{};
+  std::atomic<unsigned int> m_in_flight{};
+  std::atomic<unsigned int> m_pool_size{};
+  std::atomic<int64_t>      m_queue_wait{};
+  std::atomic<int64_t>      m_queue_wait_max{};
 };
 
 }
@@ -3,24 +3,33 @@
 #include "rpc/scgi_task.h"
 
 #include <atomic>
+#include <algorithm>
 #include <cassert>
 #include <charconv>
+#include <chrono>
+#include <climits>
 #include <cstdio>
+#include <string_view>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <torrent/exceptions.h>
 #include <torrent/net/fd.h>
 #include <torrent/net/poll.h>
 #include <torrent/runtime/socket_manager.h>
 #include <torrent/utils/log.h>
+#include <torrent/utils/scheduler.h>
 #include <torrent/system/callbacks.h>
 
 #include "control.h"
 #include "globals.h"
+#include "rpc/http_request.h"
 #include "rpc/parse_commands.h"
+#include "rpc/response_buffer.h"
 #include "rpc/scgi.h"
 #include "utils/gzip.h"
+#include "utils/loop_stats.h"
 
 namespace rpc {
 
@@ -28,6 +37,8 @@ SCgiTask::SCgiTask()
   : m_callback_id(torrent::system::make_callback_id()) {
 
   set_file_descriptor(-1);
+
+  m_task_idle.slot() = [this]() { close(); };
 }
 
 void
@@ -37,20 +48,31 @@ SCgiTask::open(SCgi* parent, int fd) {
   m_parent      = parent;
   m_position    = 0;
   m_body        = 0;
+  m_iov_index   = 0;
 
   m_content_length      = 0;
   m_content_type        = XML;
   m_content_type_set    = false;
   m_accepts_compression = false;
-  m_trusted             = true;  // SCgiTask is pooled and reused; reset trust to default
-                                 // so a prior untrusted connection does not leak its
-                                 // m_trusted=false into the next reuse, given that the
-                                 // UNTRUSTED_CONNECTION=0 parse branch is a no-op.
+  m_http            = parent->is_http();
+
+  // SCgiTask is pooled and reused; reset trust to default so a prior
+  // untrusted connection does not leak its m_trusted=false into the next
+  // reuse, given that the UNTRUSTED_CONNECTION=0 parse branch is a no-op.
+  //
+  // HTTP connections carry no header the client could be trusted on, so
+  // they are only trusted if the listener was opened as trusted.
+  m_trusted         = !m_http || parent->is_http_trusted();
+  m_keep_alive      = false;
+  m_expect_continue = false;
 
   torrent::this_thread::poll()->open(this);
   torrent::this_thread::poll()->insert_read(this);
   torrent::this_thread::poll()->insert_error(this);
 
+  if (m_http)
+    torrent::this_thread::scheduler()->wait_for(&m_task_idle, keep_alive_timeout);
+
   auto lock = std::lock_guard<std::mutex>(m_result_mutex);
 
   // Leave room for terminating nul byte for parsing the header.
@@ -63,9 +85,12 @@ SCgiTask::cancel_open() {
     return;
 
   torrent::this_thread::poll()->remove_and_close(this);
+  torrent::this_thread::scheduler()->erase(&m_task_idle);
 
   torrent::fd_close(file_descriptor());
   set_file_descriptor(-1);
+
+  m_parent->release_task(this);
 };
 
 void
@@ -74,6 +99,7 @@ SCgiTask::close() {
     return;
 
   torrent::system::cancel_callback_and_wait(m_callback_id, scgi_thread::thread(), torrent::main_thread::thread());
+  torrent::this_thread::scheduler()->erase(&m_task_idle);
 
   torrent::runtime::socket_manager()->close_event_or_throw(this, [this]() {
       torrent::this_thread::poll()->remove_and_close(this);
@@ -86,10 +112,22 @@ SCgiTask::close() {
   auto lock = std::lock_guard<std::mutex>(m_result_mutex);
 
   m_buffer.clear();
+  m_request = RpcRequest();
+
+  // Only the first chunk of the response is kept for reuse.
+  m_response.clear();
+  m_iov.clear();
+
+  std::vector<char>().swap(m_compressed);
+
+  m_parent->release_task(this);
 }
 
 void
 SCgiTask::event_read() {
+  if (m_http)
+    return event_read_http();
+
   int read_length = m_buffer.size() - m_position;
 
   if (m_content_length == 0)
@@ -153,25 +191,7 @@ SCgiTask::event_read() {
   if (m_position < m_body + m_content_length)
     return;
 
-  torrent::this_thread::poll()->remove_read(this);
-
-  if (m_parent->log_fd() >= 0) {
-    [[maybe_unused]] int result;
-
-    // Clean up logging, this is just plain ugly...
-    //    write(m_logFd, "\n---\n", sizeof("\n---\n"));
-    result = ::write(m_parent->log_fd(), m_buffer.data() + m_body, m_position - m_body);
-    result = ::write(m_parent->log_fd(), "\n---\n", sizeof("\n---\n"));
-  }
-
-  lt_log_print_dump(torrent::LOG_RPC_DUMP, m_buffer.data() + m_body, m_content_length, "scgi", "RPC read.", 0);
-
-  if (!m_content_type_set) {
-    if (m_buffer[m_body] == '{' || m_buffer[m_body] == '[')
-      m_content_type = ContentType::JSON;
-  }
-
-  receive_call(m_buffer.data() + m_body, m_content_length);
+  receive_request();
   return;
 
 event_read_failed:
@@ -181,7 +201,8 @@ event_read_failed:
 
 void
 SCgiTask::event_write() {
-  int bytes = ::send(m_fileDesc, m_buffer.data() + m_position, m_buffer.size() - m_position, 0);
+  int     count = std::min<size_t>(m_iov.size() - m_iov_index, IOV_MAX);
+  ssize_t bytes = ::writev(m_fileDesc, m_iov.data() + m_iov_index, count);
 
   if (bytes == -1) {
     if (!(errno == EAGAIN || errno == EINTR || errno == EPIPE))
@@ -190,10 +211,21 @@ SCgiTask::event_write() {
     return;
   }
 
-  m_position += bytes;
+  if (bytes == 0)
+    return close();
+
+  while (m_iov_index != m_iov.size() && static_cast<size_t>(bytes) >= m_iov[m_iov_index].iov_len)
+    bytes -= m_iov[m_iov_index++].iov_len;
+
+  if (m_iov_index == m_iov.size()) {
+    if (m_http && m_keep_alive)
+      return restart_http();
 
-  if (bytes == 0 || m_position == m_buffer.size())
     return close();
+  }
+
+  m_iov[m_iov_index].iov_base = static_cast<char*>(m_iov[m_iov_index].iov_base) + bytes;
+  m_iov[m_iov_index].iov_len -= bytes;
 }
 
 void
@@ -240,10 +272,7 @@ SCgiTask::parse_headers(const char* current, unsigned int header_length) {
       content_type = value;
 
     } else if (std::strncmp(key, "ACCEPT_ENCODING", 15+1) == 0) {
-      std::string accept_encoding(value, value_end - value);
-
-      if (accept_encoding.find("gzip") != std::string::npos)
-        m_accepts_compression = true;
+      m_accepts_compression = http_accepts_gzip(std::string_view(value, value_end - value));
 
     } else if (std::strncmp(key, "UNTRUSTED_CONNECTION", 20+1) == 0) {
       if (std::strncmp(value, "1", 1+1) == 0)
@@ -324,6 +353,200 @@ SCgiTask::detect_content_type(const std::string& content_type) {
   return true;
 }
 
+void
+SCgiTask::event_read_http() {
+  int read_length = m_buffer.size() - m_position - 1;
+
+  if (read_length <= 0)
+    throw torrent::internal_error("SCgiTask::event_read_http() no space in buffer for event_read.");
+
+  int bytes = ::recv(m_fileDesc, m_buffer.data() + m_position, read_length, 0);
+
+  if (bytes <= 0) {
+    if (bytes == 0 || !(errno == EAGAIN || errno == EINTR))
+      close();
+
+    return;
+  }
+
+  m_position += bytes;
+
+  process_http_buffer();
+}
+
+// Called when new data has been read, and after a response has been
+// written in case the next request was pipelined behind it.
+
+void
+SCgiTask::process_http_buffer() {
+  if (m_content_length == 0) {
+    auto header_end = std::string_view(m_buffer.data(), m_position).find("\r\n\r\n");
+
+    if (header_end == std::string_view::npos) {
+      if (m_position >= max_http_header_size)
+        write_http_error(431);
+
+      return;
+    }
+
+    int status = parse_http_headers(header_end + 4);
+
+    if (status != 0)
+      return write_http_error(status);
+
+    // Clients that wait for the go-ahead before sending the body, e.g. curl
+    // with large requests, would otherwise stall for a second.
+    if (m_expect_continue && m_position < m_body + m_content_length) {
+      static constexpr char response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+      [[maybe_unused]] ssize_t result = ::send(m_fileDesc, response, sizeof(response) - 1, 0);
+    }
+  }
+
+  if (m_position < m_body + m_content_length)
+    return;
+
+  receive_request();
+}
+
+// Returns zero if the request can be handled, or the HTTP status code to
+// reply with before closing the connection.
+
+int
+SCgiTask::parse_http_headers(unsigned int header_size) {
+  HttpRequest request;
+
+  int status = http_parse_request(std::string_view(m_buffer.data(), header_size), m_parent->http_host(), max_content_size, &request);
+
+  if (status != 0)
+    return status;
+
+  if (!detect_content_type(request.content_type))
+    return 415;
+
+  m_content_length      = request.content_length;
+  m_accepts_compression = request.accepts_compression;
+  m_keep_alive          = request.keep_alive;
+  m_expect_continue     = request.expect_continue;
+
+  m_body = header_size;
+
+  if (m_body + m_content_length >= m_buffer.size())
+    m_buffer.resize(m_body + m_content_length + 1);
+
+  return 0;
+}
+
+static const char*
+http_status_reason(int status) {
+  switch (status) {
+  case 400: return "Bad Request";
+  case 403: return "Forbidden";
+  case 405: return "Method Not Allowed";
+  case 411: return "Length Required";
+  case 413: return "Content Too Large";
+  case 415: return "Unsupported Media Type";
+  case 417: return "Expectation Failed";
+  case 431: return "Request Header Fields Too Large";
+  case 501: return "Not Implemented";
+  case 505: return "HTTP Version Not Supported";
+  default:
+    throw torrent::internal_error("SCgiTask::write_http_error(...) unknown status code.");
+  }
+}
+
+// The connection is closed once the error response has been written, as
+// the rest of the buffered input can't be trusted to be in step.
+
+void
+SCgiTask::write_http_error(int status) {
+  torrent::this_thread::poll()->remove_read(this);
+  torrent::this_thread::scheduler()->erase(&m_task_idle);
+
+  char header[header_reserve];
+  int  length = std::snprintf(header, sizeof(header), "HTTP/1.1 %i %s\r\n%sContent-Length: 0\r\nConnection: close\r\n\r\n",
+                              status, http_status_reason(status), status == 405 ? "Allow: POST\r\n" : "");
+
+  if (length < 0 || static_cast<size_t>(length) >= sizeof(header))
+    throw torrent::internal_error("SCgiTask::write_http_error(...) header overflow.");
+
+  m_keep_alive = false;
+
+  m_response.clear();
+  m_response.prepend(header, length);
+
+  m_iov.clear();
+  m_iov_index = 0;
+  m_response.iovecs(&m_iov);
+
+  torrent::this_thread::poll()->insert_write(this);
+}
+
+// Moves any pipelined input to the front of the buffer and waits for the
+// next request on the connection.
+
+void
+SCgiTask::restart_http() {
+  torrent::this_thread::poll()->remove_write(this);
+
+  m_position  = http_shift_pipelined(&m_buffer, m_position, m_body + m_content_length, default_buffer_size + 1);
+  m_body      = 0;
+  m_iov_index = 0;
+
+  m_content_length      = 0;
+  m_content_type        = XML;
+  m_content_type_set    = false;
+  m_accepts_compression = false;
+  m_keep_alive          = false;
+  m_expect_continue     = false;
+
+  m_response.clear();
+  m_iov.clear();
+
+  torrent::this_thread::poll()->insert_read(this);
+  torrent::this_thread::scheduler()->update_wait_for(&m_task_idle, keep_alive_timeout);
+
+  process_http_buffer();
+}
+
+void
+SCgiTask::receive_request() {
+  torrent::this_thread::poll()->remove_read(this);
+
+  if (m_http)
+    torrent::this_thread::scheduler()->erase(&m_task_idle);
+
+  if (m_parent->log_fd() >= 0) {
+    [[maybe_unused]] int result;
+
+    // Clean up logging, this is just plain ugly...
+    //    write(m_logFd, "\n---\n", sizeof("\n---\n"));
+    result = ::write(m_parent->log_fd(), m_buffer.data() + m_body, m_content_length);
+    result = ::write(m_parent->log_fd(), "\n---\n", sizeof("\n---\n"));
+  }
+
+  lt_log_print_dump(torrent::LOG_RPC_DUMP, m_buffer.data() + m_body, m_content_length, "scgi", "RPC read.", 0);
+
+  if (!m_content_type_set) {
+    if (m_buffer[m_body] == '{' || m_buffer[m_body] == '[')
+      m_content_type = ContentType::JSON;
+  }
+
+  receive_call(m_buffer.data() + m_body, m_content_length);
+}
+
+// Names the request in the main loop stats after its first call.
+static std::string
+request_name(const RpcRequest& request) {
+  if (request.calls.empty())
+    return "rpc";
+
+  if (request.is_batch)
+    return "batch[" + std::to_string(request.calls.size()) + "] " + request.calls.front().method;
+
+  return request.calls.front().method;
+}
+
 void
 SCgiTask::receive_call(const char* buffer, uint32_t length) {
   assert(torrent::this_thread::thread() == scgi_thread::thread());
@@ -341,12 +564,38 @@ SCgiTask::receive_call(const char* buffer, uint32_t length) {
     throw torrent::internal_error("SCgiTask::receive_call(...) received bad input.");
   }
 
-  // TODO: Rewrite RpcManager.process to pass the result buffer instead of having to copy it.
-  // TODO: Also allow us to request RpcManager.process to reserve space for a header.
+  // The request is parsed here, and only the calls are executed on the
+  // main thread before the response is encoded back on this thread.
+  m_request = RpcRequest();
+  m_request.trusted = m_trusted;
+
+  rpc.parse(rpc_type, buffer, length, &m_request);
+
   // TODO: Completely remove the mutex, and align m_buffer?
 
-  auto result_callback = [this](const char* b, uint32_t l) {
-      receive_write(b, l);
+  // Memory barrier for the request data.
+  // std::atomic_thread_fence(std::memory_order_release);
+  m_result_mutex.lock();
+  m_result_mutex.unlock();
+
+  auto queued = std::chrono::steady_clock::now();
+
+  torrent::main_thread::callback_interrupt(m_callback_id, [this, queued]() {
+      // Memory barrier for the request data.
+      // std::atomic_thread_fence(std::memory_order_acquire);
+      m_result_mutex.lock();
+      m_result_mutex.unlock();
+
+      m_parent->receive_queue_wait(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - queued));
+
+      // The input is still held in m_buffer, so the response is written
+      // to a separate buffer.
+      m_response.clear();
+
+      {
+        utils::LoopTimer timer(&loop_stats, utils::LoopStats::RPC, [this]() { return request_name(m_request); });
+        rpc.execute(&m_request, &m_response);
+      }
 
       // Memory barrier for the result data.
       // std::atomic_thread_fence(std::memory_order_release);
@@ -357,105 +606,134 @@ SCgiTask::receive_call(const char* buffer, uint32_t length) {
           if (!is_open())
             return;
 
-          torrent::this_thread::poll()->insert_write(this);
-
           // Memory barrier for the result data.
           // std::atomic_thread_fence(std::memory_order_acquire);
           m_result_mutex.lock();
           m_result_mutex.unlock();
-        });
 
-      return true;
-    };
+          rpc.serialize(m_request, &m_response);
+          m_request = RpcRequest();
 
-  // Memory barrier for the input data.
-  // std::atomic_thread_fence(std::memory_order_release);
-  m_result_mutex.lock();
-  m_result_mutex.unlock();
-
-  torrent::main_thread::callback_interrupt(m_callback_id, [this, rpc_type, buffer, length, result_callback]() {
-      // Memory barrier for the input data.
-      // std::atomic_thread_fence(std::memory_order_acquire);
-      m_result_mutex.lock();
-      m_result_mutex.unlock();
+          receive_write(&m_response);
 
-      if (m_trusted)
-        rpc.process(rpc_type, buffer, length, result_callback);
-      else
-        rpc.process_untrusted(rpc_type, buffer, length, result_callback);
+          torrent::this_thread::poll()->insert_write(this);
+        });
     });
 }
 
 void
-SCgiTask::receive_write(const char* buffer, uint32_t length) {
-  assert(torrent::this_thread::thread() == torrent::main_thread::thread());
+SCgiTask::receive_write(ResponseBuffer* output) {
+  assert(torrent::this_thread::thread() == scgi_thread::thread());
 
-  if (buffer == nullptr || length > (100 << 20))
+  if (output->size() > (100 << 20))
     throw torrent::internal_error("SCgiTask::receive_write(...) received bad input.");
 
-  // Main thread callback already locked this mutex.
-  // auto lock = std::lock_guard<std::mutex>(m_result_mutex);
+  m_iov.clear();
+  m_iov_index = 0;
+
+  output->body_iovecs(&m_iov);
 
   // Write to log prior to possible compression
   if (m_parent->log_fd() >= 0) {
     int result [[maybe_unused]];
     // Clean up logging, this is just plain ugly...
     //    write(m_logFd, "\n---\n", sizeof("\n---\n"));
-    result = write(m_parent->log_fd(), buffer, length);
+    for (const auto& iov : m_iov)
+      result = write(m_parent->log_fd(), iov.iov_base, iov.iov_len);
+
     result = write(m_parent->log_fd(), "\n---\n", sizeof("\n---\n"));
   }
 
-  lt_log_print_dump(torrent::LOG_RPC_DUMP, buffer, length, "scgi", "RPC write.", 0);
+  for (const auto& iov : m_iov)
+    lt_log_print_dump(torrent::LOG_RPC_DUMP, iov.iov_base, iov.iov_len, "scgi", "RPC write.", 0);
 
-  if (m_accepts_compression && rpc.scgi_allow_compression() && length > rpc.scgi_min_compress_size())
-    gzip_response(buffer, length);
+  if (m_accepts_compression && rpc.scgi_allow_compression() && output->size() > rpc.scgi_min_compress_size())
+    gzip_response(output);
   else
-    plaintext_response(buffer, length);
+    plaintext_response(output);
 }
 
-// We don't know the size of the content-length string, so leave sufficient space for the header
-// strings plus max length of content-length.
+// The header is written into the space reserved in front of the
+// response body, so the header and body chunks can be sent without
+// copying.
 
 void
-SCgiTask::plaintext_response(const char* buffer, uint32_t content_length) {
-  auto header_first      = content_type() == ContentType::XML ? header_xml : header_json;
-  auto header_first_size = content_type() == ContentType::XML ? header_xml_size : header_json_size;
-  auto length_str        = std::to_string(content_length);
+SCgiTask::prepend_header(ResponseBuffer* output, uint32_t content_length, bool compressed) {
+  const char* header_first;
+  size_t      header_first_size;
+
+  if (m_http) {
+    header_first      = content_type() == ContentType::XML ? http_header_xml : http_header_json;
+    header_first_size = content_type() == ContentType::XML ? http_header_xml_size : http_header_json_size;
+  } else {
+    header_first      = content_type() == ContentType::XML ? header_xml : header_json;
+    header_first_size = content_type() == ContentType::XML ? header_xml_size : header_json_size;
+  }
+
+  char header[header_reserve];
+  char* last = header;
 
-  m_buffer.resize(header_first_size + length_str.size() + header_last_size + content_length);
+  std::memcpy(last, header_first, header_first_size);
+  last += header_first_size;
 
-  std::memcpy(m_buffer.data(),                                                            header_first, header_first_size);
-  std::memcpy(m_buffer.data() + header_first_size,                                        length_str.data(), length_str.size());
-  std::memcpy(m_buffer.data() + header_first_size + length_str.size(),                    header_last, header_last_size);
-  std::memcpy(m_buffer.data() + header_first_size + length_str.size() + header_last_size, buffer, content_length);
+  auto [length_last, ec] = std::to_chars(last, header + header_reserve - header_last_size, content_length);
 
-  m_position = 0;
+  if (ec != std::errc())
+    throw torrent::internal_error("SCgiTask::prepend_header(...) header overflow : content length does not fit");
+
+  last = length_last;
+
+  auto append = [&last](const char* str, size_t length) {
+      std::memcpy(last, str, length);
+      last += length;
+    };
+
+  // SCGI clients have always received the compressed body without a
+  // Content-Encoding header, and some depend on decompressing it
+  // themselves.
+  if (!m_http) {
+    append(header_last, header_last_size);
+
+  } else {
+    if (compressed)
+      append(http_header_gzip, http_header_gzip_size);
+
+    if (m_keep_alive)
+      append(http_header_keep_alive, http_header_keep_alive_size);
+    else
+      append(http_header_close, http_header_close_size);
+  }
+
+  output->prepend(header, last - header);
 }
 
 void
-SCgiTask::gzip_response(const char* buffer, uint32_t content_length) {
-  auto header_first      = content_type() == ContentType::XML ? header_xml : header_json;
-  auto header_first_size = content_type() == ContentType::XML ? header_xml_size : header_json_size;
+SCgiTask::plaintext_response(ResponseBuffer* output) {
+  prepend_header(output, output->size(), false);
 
-  unsigned int body_offset = header_first_size + 20 + header_last_size;
+  m_iov.clear();
+  output->iovecs(&m_iov);
+}
 
-  utils::gzip_compress_to_vector(buffer, content_length, m_buffer, body_offset);
+void
+SCgiTask::gzip_response(ResponseBuffer* output) {
+  auto started = std::chrono::steady_clock::now();
 
-  auto length_str   = std::to_string(m_buffer.size() - body_offset);
-  auto header_size  = header_first_size + length_str.size() + header_last_size;
-  auto header_start = body_offset - header_size;
+  utils::gzip_compress_to_vector(m_iov, m_compressed, rpc.scgi_compress_level());
 
-  if (header_size > body_offset)
-    throw torrent::internal_error("SCgiTask::gzip_response(...) header overflow : start position is negative");
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
 
-  if (header_start > body_offset)
-    throw torrent::internal_error("SCgiTask::gzip_response(...) header overflow : start position is beyond buffer start");
+  lt_log_print(torrent::LOG_RPC_DUMP, "RPC write compressed %zu bytes to %zu bytes in %lli usec.",
+               output->size(), m_compressed.size(), static_cast<long long>(elapsed.count()));
 
-  std::memcpy(m_buffer.data() + header_start,                                         header_first, header_first_size);
-  std::memcpy(m_buffer.data() + header_start + header_first_size,                     length_str.data(), length_str.size());
-  std::memcpy(m_buffer.data() + header_start + header_first_size + length_str.size(), header_last, header_last_size);
+  // The uncompressed body is no longer needed, only the header in the
+  // space reserved in front of it is sent.
+  output->clear();
+  prepend_header(output, m_compressed.size(), true);
 
-  m_position = header_start;
+  m_iov.clear();
+  output->iovecs(&m_iov);
+  m_iov.push_back(iovec{m_compressed.data(), m_compressed.size()});
 }
 
 } // namespace rpc
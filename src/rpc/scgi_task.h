@@ -1,21 +1,36 @@
 #ifndef RTORRENT_RPC_SCGI_TASK_H
 #define RTORRENT_RPC_SCGI_TASK_H
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <mutex>
 #include <vector>
+#include <sys/uio.h>
 #include <torrent/event.h>
+#include <torrent/utils/scheduler.h>
+
+#include "rpc/response_buffer.h"
+#include "rpc/rpc_request.h"
 
 namespace rpc {
 
 class SCgi;
 
+// Connections from an HTTP listener speak HTTP/1.1, with the requests
+// on a persistent connection handled one at a time in the order they
+// were received. Pipelined requests are kept in the buffer until the
+// response to the previous request has been written.
+
 class SCgiTask : public torrent::Event {
 public:
   static constexpr int default_buffer_size = 8191;
   static constexpr int max_header_size     = 2000;
   static constexpr int max_content_size    = (2 << 23);
 
+  static constexpr int  max_http_header_size = default_buffer_size;
+  static constexpr auto keep_alive_timeout   = std::chrono::seconds(60);
+
   enum ContentType { XML, JSON };
 
   SCgiTask();
@@ -31,6 +46,7 @@ public:
   void                close();
 
   ContentType         content_type() const { return m_content_type; }
+  bool                is_http() const      { return m_http; }
 
   void                event_read() override;
   void                event_write() override;
@@ -41,18 +57,45 @@ private:
   static constexpr char header_json[] = "Status: 200 OK\r\nContent-Type: application/json\r\nContent-Length: ";
   static constexpr char header_last[] = "\r\n\r\n";
 
+  static constexpr char http_header_xml[]        = "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-Length: ";
+  static constexpr char http_header_json[]       = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: ";
+  static constexpr char http_header_gzip[]       = "\r\nContent-Encoding: gzip";
+  static constexpr char http_header_keep_alive[] = "\r\nConnection: keep-alive\r\n\r\n";
+  static constexpr char http_header_close[]      = "\r\nConnection: close\r\n\r\n";
+
   static constexpr size_t header_xml_size  = sizeof(header_xml) - 1;
   static constexpr size_t header_json_size = sizeof(header_json) - 1;
   static constexpr size_t header_last_size = sizeof(header_last) - 1;
 
+  static constexpr size_t http_header_xml_size        = sizeof(http_header_xml) - 1;
+  static constexpr size_t http_header_json_size       = sizeof(http_header_json) - 1;
+  static constexpr size_t http_header_gzip_size       = sizeof(http_header_gzip) - 1;
+  static constexpr size_t http_header_keep_alive_size = sizeof(http_header_keep_alive) - 1;
+  static constexpr size_t http_header_close_size      = sizeof(http_header_close) - 1;
+
+  // Space reserved in front of the response body for the longest header
+  // and a 64-bit content length.
+  static constexpr size_t header_reserve =
+    std::max(std::max(header_xml_size, header_json_size) + 20 + header_last_size,
+             std::max(http_header_xml_size, http_header_json_size) + 20 + http_header_gzip_size + http_header_keep_alive_size);
+
   bool                parse_headers(const char* current, unsigned int header_length);
   bool                detect_content_type(const std::string& content_type);
 
+  void                event_read_http();
+  void                process_http_buffer();
+  int                 parse_http_headers(unsigned int header_size);
+  void                write_http_error(int status);
+  void                restart_http();
+
+  void                receive_request();
   void                receive_call(const char* buffer, uint32_t length);
-  void                receive_write(const char* buffer, uint32_t length);
+  void                receive_write(ResponseBuffer* output);
 
-  void                plaintext_response(const char* buffer, uint32_t content_length);
-  void                gzip_response(const char* buffer, uint32_t content_length);
+  void                prepend_header(ResponseBuffer* output, uint32_t content_length, bool compressed);
+
+  void                plaintext_response(ResponseBuffer* output);
+  void                gzip_response(ResponseBuffer* output);
 
   SCgi*                        m_parent{};
   torrent::system::callback_id m_callback_id;
@@ -63,12 +106,31 @@ private:
   unsigned int        m_position{};
   unsigned int        m_body{};
 
+  // Parsed on the SCGI thread, with the calls executed on the main
+  // thread.
+  RpcRequest          m_request;
+
+  // The response is written behind the space reserved for the header in
+  // m_response, and sent with writev from the entries in m_iov.
+  ResponseBuffer      m_response{header_reserve};
+  std::vector<char>   m_compressed;
+
+  std::vector<struct iovec> m_iov;
+  unsigned int        m_iov_index{};
+
   unsigned int        m_content_length{};
   ContentType         m_content_type{XML};
 
   bool                m_accepts_compression{};
   bool                m_trusted{true};
   bool                m_content_type_set{false};
+
+  bool                m_http{};
+  bool                m_keep_alive{};
+  bool                m_expect_continue{};
+
+  // Closes HTTP connections that stay idle between requests.
+  torrent::utils::SchedulerEntry m_task_idle;
 };
 
 }
@@ -3,6 +3,7 @@
 #include "xmlrpc.h"
 
 #include "parse_commands.h"
+#include "rpc/rpc_request.h"
 
 #include <cstring>
 #include <torrent/exceptions.h>
@@ -26,6 +27,19 @@ XmlRpc::store_command_name(const char* name) {
   return m_command_names.back().c_str();
 }
 
+bool
+XmlRpc::process(const char* inBuffer, uint32_t length, ResponseBuffer* output) {
+  if (!is_valid())
+    return false;
+
+  RpcRequest request;
+
+  parse(inBuffer, length, &request);
+  execute(&request, output);
+  serialize(request, output);
+  return true;
+}
+
 #ifndef HAVE_XMLRPC_C
 #ifndef HAVE_XMLRPC_TINYXML2
 
@@ -35,7 +49,9 @@ void XmlRpc::cleanup() {}
 void XmlRpc::insert_command(const char*, const char*, const char*) {}
 void XmlRpc::set_dialect(int) {}
 
-bool XmlRpc::process(const char*, uint32_t, slot_write) { return false; }
+void XmlRpc::parse(const char*, uint32_t, RpcRequest*) {}
+void XmlRpc::execute(RpcRequest*, ResponseBuffer*) {}
+void XmlRpc::serialize(const RpcRequest&, ResponseBuffer*) {}
 
 int64_t XmlRpc::size_limit() { return 0; }
 void    XmlRpc::set_size_limit(uint64_t size) {}
@@ -1,6 +1,7 @@
 #ifndef RTORRENT_RPC_XMLRPC_H
 #define RTORRENT_RPC_XMLRPC_H
 
+#include <atomic>
 #include <functional>
 #include <torrent/common.h>
 #include <torrent/hash_string.h>
@@ -15,13 +16,15 @@ namespace core {
 
 namespace rpc {
 
+class ResponseBuffer;
+struct RpcRequest;
+
 class XmlRpc {
 public:
   typedef std::function<core::Download* (const char*)>                                slot_download;
   typedef std::function<torrent::File* (core::Download*, uint32_t)>                   slot_file;
   typedef std::function<torrent::tracker::Tracker (core::Download*, uint32_t)>        slot_tracker;
   typedef std::function<torrent::Peer* (core::Download*, const torrent::HashString&)> slot_peer;
-  typedef std::function<bool (const char*, uint32_t)>                                 slot_write;
 
   static const int dialect_generic = 0;
   static const int dialect_i8      = 1;
@@ -43,7 +46,13 @@ public:
   void                initialize();
   void                cleanup();
 
-  bool                process(const char* inBuffer, uint32_t length, slot_write slotWrite);
+  bool                process(const char* inBuffer, uint32_t length, ResponseBuffer* output);
+
+  // Only 'execute' needs to be called from the main thread. With
+  // xmlrpc-c the whole request is processed by 'execute'.
+  void                parse(const char* inBuffer, uint32_t length, RpcRequest* request);
+  void                execute(RpcRequest* request, ResponseBuffer* output);
+  void                serialize(const RpcRequest& request, ResponseBuffer* output);
 
   void                insert_command(const char* name, const char* parm, const char* doc);
 
@@ -76,7 +85,7 @@ private:
 
   // Only used by tinyxml2
   bool                m_isValid;
-  uint64_t            m_sizeLimit{SCgiTask::max_content_size};
+  std::atomic<uint64_t> m_sizeLimit{SCgiTask::max_content_size};
 };
 
 }
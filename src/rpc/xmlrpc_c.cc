@@ -14,6 +14,8 @@
 #include <xmlrpc-c/server.h>
 
 #include "rpc_manager.h"
+#include "rpc/response_buffer.h"
+#include "rpc/rpc_request.h"
 #include "xmlrpc.h"
 #include "parse_commands.h"
 #include "utils/functional.h"
@@ -134,7 +136,7 @@ xmlrpc_to_index_type(int index, int call_type, core::Download* download) {
     throw xmlrpc_error_c(XMLRPC_TYPE_ERROR, e.what());
   }
 
-  return std::make_pair(rpc::make_target(call_type, result), deleter);
+  return std::make_pair(rpc::make_target(call_type, result, download), deleter);
 }
 
 torrent::Object
@@ -426,24 +428,35 @@ XmlRpc::cleanup() {
   delete (xmlrpc_env*)m_env;
 }
 
-bool
-XmlRpc::process(const char* inBuffer, uint32_t length, slot_write slotWrite) {
+// The xmlrpc-c registry parses, calls and encodes a request in one go,
+// so the request can only be processed as a whole on the main thread.
+void
+XmlRpc::parse(const char* inBuffer, uint32_t length, RpcRequest* request) {
+  request->buffer = inBuffer;
+  request->length = length;
+}
+
+void
+XmlRpc::execute(RpcRequest* request, ResponseBuffer* output) {
   xmlrpc_env local_env;
   xmlrpc_env_init(&local_env);
 
-  xmlrpc_mem_block* memblock = xmlrpc_registry_process_call(&local_env, (xmlrpc_registry*)m_registry, NULL, inBuffer, length);
+  xmlrpc_mem_block* memblock = xmlrpc_registry_process_call(&local_env, (xmlrpc_registry*)m_registry, NULL, request->buffer, request->length);
 
   if (local_env.fault_occurred && local_env.fault_code == XMLRPC_INTERNAL_ERROR)
     throw torrent::internal_error("Internal error in XMLRPC.");
 
-  bool result = slotWrite((const char*)xmlrpc_mem_block_contents(memblock),
-                          xmlrpc_mem_block_size(memblock));
+  output->append((const char*)xmlrpc_mem_block_contents(memblock), xmlrpc_mem_block_size(memblock));
 
   xmlrpc_mem_block_free(memblock);
   xmlrpc_env_clean(&local_env);
-  return result;
+
+  request->is_complete = true;
 }
 
+void
+XmlRpc::serialize(const RpcRequest&, ResponseBuffer*) {}
+
 void
 XmlRpc::insert_command(const char* name, const char* parm, const char* doc) {
   xmlrpc_env local_env;
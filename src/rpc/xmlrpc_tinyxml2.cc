@@ -6,6 +6,7 @@
 #endif
 
 #include <cctype>
+#include <cstring>
 #include <initializer_list>
 #include <string>
 
@@ -15,8 +16,12 @@
 #include <torrent/object.h>
 
 #include "parse_commands.h"
+#include "rpc/object_encoder.h"
 #include "rpc/tinyxml2/tinyxml2.h"
+#include "rpc/response_buffer.h"
 #include "rpc/rpc_manager.h"
+#include "rpc/rpc_request.h"
+#include "utils/functional.h"
 #include "utils/base64.h"
 #include "xmlrpc.h"
 
@@ -148,257 +153,242 @@ xml_value_to_object(const tinyxml2::XMLNode* elem) {
   return torrent::Object();
 }
 
+// Converts the parameters of a call, leaving the target and the
+// remaining arguments as objects to be resolved on the main thread.
+//
+// Conversion errors are raised when executing the call, after the
+// method lookup or target resolution they would otherwise follow.
 void
-print_object_xml(const torrent::Object& obj, tinyxml2::XMLPrinter* printer) {
-  switch (obj.type()) {
-  case torrent::Object::TYPE_STRING:
-    printer->OpenElement("string", true);
-    printer->PushText(obj.as_string().c_str());
-    printer->CloseElement(true);
-    break;
-  case torrent::Object::TYPE_VALUE:
-    printer->OpenElement("i8", true);
-    printer->PushText(std::to_string(obj.as_value()).c_str());
-    printer->CloseElement(true);
-    break;
-  case torrent::Object::TYPE_LIST:
-    printer->OpenElement("array", true);
-    printer->OpenElement("data", true);
-    for (const auto& itr : obj.as_list()) {
-      printer->OpenElement("value", true);
-      print_object_xml(itr, printer);
-      printer->CloseElement(true);
-    }
-    printer->CloseElement(true);
-    printer->CloseElement(true);
-    break;
-  case torrent::Object::TYPE_MAP:
-    printer->OpenElement("struct", true);
-    for (const auto& itr : obj.as_map()) {
-      printer->OpenElement("member", true);
-      printer->OpenElement("name", true);
-      printer->PushText(itr.first.c_str());
-      printer->CloseElement(true);
-      printer->OpenElement("value", true);
-      print_object_xml(itr.second, printer);
-      printer->CloseElement(true);
-      printer->CloseElement(true);
-    }
-    printer->CloseElement(true);
-    break;
-  case torrent::Object::TYPE_DICT_KEY:
-    printer->OpenElement("array", true);
-    printer->OpenElement("data", true);
-    printer->OpenElement("value", true);
-    print_object_xml(obj.as_dict_key(), printer);
-    printer->CloseElement(true);
-
-    if (obj.as_dict_obj().is_list()) {
-      for (auto itr : obj.as_dict_obj().as_list()) {
-        printer->OpenElement("value", true);
-        print_object_xml(itr, printer);
-        printer->CloseElement(true);
-      }
-    } else {
-      printer->OpenElement("value", true);
-      print_object_xml(obj.as_dict_obj(), printer);
-      printer->CloseElement(true);
-    }
-    printer->CloseElement(true);
-    printer->CloseElement(true);
-    break;
-  default:
-    printer->OpenElement("i8", true);
-    printer->PushText(0);
-    printer->CloseElement(true);
-  }
-}
-
-torrent::Object
-execute_command(std::string method_name, const tinyxml2::XMLElement* params_element) {
-  CommandMap::iterator cmd_itr = commands.find(method_name.c_str());
-
-  if (cmd_itr == commands.end() || !(cmd_itr->second.m_flags & CommandMap::flag_public_rpc)) {
-    throw rpc_error(XMLRPC_NO_SUCH_METHOD_ERROR, "method '" + method_name + "' not defined");
-  }
+parse_call_params(const tinyxml2::XMLElement* params_element, RpcCall* call) {
+  if (params_element == nullptr)
+    return;
 
-  torrent::Object             params_raw = torrent::Object::create_list();
-  torrent::Object::list_type& params     = params_raw.as_list();
-  rpc::target_type            target     = rpc::make_target();
+  // If it's not a <params>, it's probably a <array> passed in via system.multicall
+  bool        is_params = std::strncmp(params_element->Name(), "params", sizeof("params")) == 0;
+  const char* child_name = is_params ? "param" : "value";
 
-  if (params_element != nullptr) {
-    if (std::strncmp(params_element->Name(), "params", sizeof("params")) == 0) {
-      // Parse out the target if available
-      const auto* child = params_element->FirstChildElement("param");
+  const tinyxml2::XMLElement* child = nullptr;
 
-      if (child != nullptr) {
-        std::function<void()> deleter = []() {};
+  if (is_params)
+    child = params_element->FirstChildElement("param");
+  else if (params_element->FirstChildElement("data") != nullptr)
+    child = params_element->FirstChildElement("data")->FirstChildElement("value");
 
-        RpcManager::object_to_target(xml_value_to_object(child->FirstChildElement("value")), cmd_itr->second.m_flags, &target, &deleter);
-        child = child->NextSiblingElement("param");
+  if (child == nullptr)
+    return;
 
-        // Parse out any other params
-        while (child != nullptr) {
-          params.push_back(xml_value_to_object(child->FirstChildElement("value")));
-          child = child->NextSiblingElement("param");
-        }
-      }
+  auto child_value = [is_params](const tinyxml2::XMLElement* elem) {
+    return is_params ? elem->FirstChildElement("value") : elem;
+  };
 
-    } else if (params_element->FirstChildElement("data") != nullptr) {
-      // If it's not a <params>, it's probably a <array> passed in via system.multicall
-      const auto* child = params_element->FirstChildElement("data")->FirstChildElement("value");
+  RpcCall::parse_error_type stage = RpcCall::parse_error_after_lookup;
+  auto&                     params = call->params.as_list();
 
-      if (child != nullptr) {
-        std::function<void()> deleter = []() {};
+  try {
+    call->has_target = true;
+    call->target     = xml_value_to_object(child_value(child));
 
-        RpcManager::object_to_target(xml_value_to_object(child), cmd_itr->second.m_flags, &target, &deleter);
-        child = child->NextSiblingElement("value");
+    stage = RpcCall::parse_error_after_target;
 
-        while (child != nullptr) {
-          params.push_back(xml_value_to_object(child));
-          child = child->NextSiblingElement("value");
-        }
-      }
-    }
-  }
+    for (child = child->NextSiblingElement(child_name); child != nullptr; child = child->NextSiblingElement(child_name))
+      params.push_back(xml_value_to_object(child_value(child)));
 
-  if (params.empty() && (cmd_itr->second.m_flags & (CommandMap::flag_file_target | CommandMap::flag_tracker_target))) {
-    throw rpc_error(XMLRPC_TYPE_ERROR, "invalid parameters: too few");
-  }
-
-  try {
-    return rpc::commands.call_command(cmd_itr, params_raw, target);
-  } catch (untrusted_error& e) {
-    throw rpc_error(XMLRPC_REQUEST_REFUSED_ERROR, e.what());
+  } catch (rpc_error& e) {
+    call->set_parse_error(stage, e.type(), e.what());
+  } catch (torrent::local_error& e) {
+    call->set_parse_error(stage, XMLRPC_INTERNAL_ERROR, e.what());
   }
 }
 
 void
-process_document(const tinyxml2::XMLDocument* doc, tinyxml2::XMLPrinter* printer) {
+parse_document(const tinyxml2::XMLDocument* doc, RpcRequest* request) {
   if (doc->Error())
     throw rpc_error(XMLRPC_PARSE_ERROR, doc->ErrorStr());
   if (doc->FirstChildElement("methodCall") == nullptr)
     throw rpc_error(XMLRPC_PARSE_ERROR, "methodCall element not found");
   if (doc->FirstChildElement("methodCall")->FirstChildElement("methodName") == nullptr)
     throw rpc_error(XMLRPC_PARSE_ERROR, "methodName element not found");
-  auto            method_name = doc->FirstChildElement("methodCall")->FirstChildElement("methodName")->GetText();
-  torrent::Object result;
+
+  auto method_name = doc->FirstChildElement("methodCall")->FirstChildElement("methodName")->GetText();
+
+  if (method_name == nullptr)
+    method_name = "";
 
   // Add a shim here for system.multicall to allow better code reuse, and
   // because system.multicall is one of the few methods that doesn't take a target
-  if (method_name == std::string("system.multicall")) {
-    result                = torrent::Object::create_list();
-    auto& result_list     = result.as_list();
-    auto  parent_elements = element_access(doc->RootElement(), {"params", "param", "value", "array", "data"});
-    for (auto child = parent_elements->FirstChildElement("value"); child; child = child->NextSiblingElement("value")) {
-      auto sub_method_name = element_access(child, {"struct", "member", "value", "string"})->GetText();
-      // If sub_params ends up a nullptr at the end of this if-chian,
-      // execute_command will turn it into an empty list
-      auto sub_params = element_access(child, {"struct", "member"});
-      if (sub_params != nullptr)
-        sub_params = sub_params->NextSiblingElement("member");
-      if (sub_params != nullptr)
-        sub_params = sub_params->FirstChildElement("value");
-      if (sub_params != nullptr)
-        sub_params = sub_params->FirstChildElement("array");
-      try {
-        auto sub_result = torrent::Object::create_list();
-        sub_result.as_list().push_back(execute_command(sub_method_name, sub_params));
-        result_list.push_back(sub_result);
-      } catch (rpc_error& e) {
-        auto fault                    = torrent::Object::create_map();
-        fault.as_map()["faultString"] = e.what();
-        fault.as_map()["faultCode"]   = e.type();
-        result_list.push_back(fault);
-      } catch (torrent::local_error& e) {
-        auto fault                    = torrent::Object::create_map();
-        fault.as_map()["faultString"] = e.what();
-        fault.as_map()["faultCode"]   = XMLRPC_INTERNAL_ERROR;
-        result_list.push_back(fault);
-      }
-    }
-  } else {
-    result = execute_command(method_name, doc->FirstChildElement("methodCall")->FirstChildElement("params"));
+  if (std::strcmp(method_name, "system.multicall") != 0) {
+    request->calls.emplace_back();
+    request->calls.back().method = method_name;
+
+    parse_call_params(doc->FirstChildElement("methodCall")->FirstChildElement("params"), &request->calls.back());
+    return;
   }
 
-  printer->PushHeader(false, true);
-  printer->OpenElement("methodResponse", true);
-  printer->OpenElement("params", true);
+  request->is_batch = true;
+
+  auto parent_elements = element_access(doc->RootElement(), {"params", "param", "value", "array", "data"});
 
-  printer->OpenElement("param", true);
-  printer->OpenElement("value", true);
-  print_object_xml(result, printer);
-  printer->CloseElement(true);
-  printer->CloseElement(true);
+  for (auto child = parent_elements->FirstChildElement("value"); child; child = child->NextSiblingElement("value")) {
+    auto sub_method_name = element_access(child, {"struct", "member", "value", "string"})->GetText();
+    // If sub_params ends up a nullptr at the end of this if-chian,
+    // the call will have an empty list of parameters
+    auto sub_params = element_access(child, {"struct", "member"});
+    if (sub_params != nullptr)
+      sub_params = sub_params->NextSiblingElement("member");
+    if (sub_params != nullptr)
+      sub_params = sub_params->FirstChildElement("value");
+    if (sub_params != nullptr)
+      sub_params = sub_params->FirstChildElement("array");
 
-  printer->CloseElement(true);
-  printer->CloseElement(true);
+    request->calls.emplace_back();
+    request->calls.back().method = sub_method_name != nullptr ? sub_method_name : "";
+
+    parse_call_params(sub_params, &request->calls.back());
+  }
+}
+
+torrent::Object
+execute_command(const RpcCall& call) {
+  CommandMap::iterator cmd_itr = commands.find(call.method.c_str());
+
+  if (cmd_itr == commands.end() || !(cmd_itr->second.m_flags & CommandMap::flag_public_rpc)) {
+    throw rpc_error(XMLRPC_NO_SUCH_METHOD_ERROR, "method '" + call.method + "' not defined");
+  }
+
+  if (call.parse_error == RpcCall::parse_error_after_lookup)
+    throw rpc_error(call.parse_error_code, call.parse_error_message);
+
+  rpc::target_type target = rpc::make_target();
+
+  std::function<void()> deleter = []() {};
+  utils::scope_guard    guard([&deleter]() { deleter(); });
+
+  if (call.has_target)
+    RpcManager::object_to_target(call.target, cmd_itr->second.m_flags, &target, &deleter);
+
+  if (call.parse_error == RpcCall::parse_error_after_target)
+    throw rpc_error(call.parse_error_code, call.parse_error_message);
+
+  if (call.params.as_list().empty() && (cmd_itr->second.m_flags & (CommandMap::flag_file_target | CommandMap::flag_tracker_target))) {
+    throw rpc_error(XMLRPC_TYPE_ERROR, "invalid parameters: too few");
+  }
+
+  try {
+    return rpc::commands.call_command(cmd_itr, call.params, target);
+  } catch (untrusted_error& e) {
+    throw rpc_error(XMLRPC_REQUEST_REFUSED_ERROR, e.what());
+  }
+}
+
+torrent::Object
+make_fault(int faultCode, const std::string& faultString) {
+  auto fault = torrent::Object::create_map();
+  fault.as_map()["faultCode"]   = int64_t(faultCode);
+  fault.as_map()["faultString"] = faultString;
+
+  return fault;
 }
 
 void
-print_xmlrpc_fault(int faultCode, std::string faultString, tinyxml2::XMLPrinter* printer) {
-  printer->PushHeader(false, true);
-
-  printer->OpenElement("methodResponse", true);
-  printer->OpenElement("fault", true);
-  printer->OpenElement("value", true);
-  printer->OpenElement("struct", true);
-
-  printer->OpenElement("member", true);
-  printer->OpenElement("name", true);
-  printer->PushText("faultCode");
-  printer->CloseElement(true);
-  printer->OpenElement("value", true);
-  printer->OpenElement("i8", true);
-  printer->PushText(faultCode);
-  printer->CloseElement(true);
-  printer->CloseElement(true);
-  printer->CloseElement(true);
-
-  printer->OpenElement("member", true);
-  printer->OpenElement("name", true);
-  printer->PushText("faultString");
-  printer->CloseElement(true);
-  printer->OpenElement("value", true);
-  printer->OpenElement("string", true);
-  printer->PushText(faultString.c_str());
-  printer->CloseElement(true);
-  printer->CloseElement(true);
-  printer->CloseElement(true);
-
-  printer->CloseElement(true);
-  printer->CloseElement(true);
-  printer->CloseElement(true);
-  printer->CloseElement(true);
+print_xmlrpc_fault(int faultCode, const std::string& faultString, ResponseBuffer* output) {
+  static constexpr char fault_first[] = "<?xml version=\"1.0\"?><methodResponse><fault><value>";
+  static constexpr char fault_last[]  = "</value></fault></methodResponse>";
+
+  output->append(fault_first, sizeof(fault_first) - 1);
+  object_encode_xml(make_fault(faultCode, faultString), output);
+  output->append(fault_last, sizeof(fault_last) - 1);
 }
 
-bool
-XmlRpc::process(const char* inBuffer, uint32_t length, slot_write slotWrite) {
+void
+XmlRpc::parse(const char* inBuffer, uint32_t length, RpcRequest* request) {
   if (length > m_sizeLimit) {
-    tinyxml2::XMLPrinter printer(nullptr, true, 0);
-    print_xmlrpc_fault(XMLRPC_LIMIT_EXCEEDED_ERROR, "Content size exceeds maximum XML-RPC limit", &printer);
-    return slotWrite(printer.CStr(), printer.CStrSize() - 1);
+    request->set_error(XMLRPC_LIMIT_EXCEEDED_ERROR, "Content size exceeds maximum XML-RPC limit");
+    return;
   }
+
   tinyxml2::XMLDocument doc;
   doc.Parse(inBuffer, length);
+
   try {
-    // This printer can't be reused in the 'catch' because while the
-    // buffer can be cleared, the internal stack of opened elements
-    // remains.
-    tinyxml2::XMLPrinter printer(nullptr, true, 0);
-    process_document(&doc, &printer);
-    return slotWrite(printer.CStr(), printer.CStrSize() - 1);
+    parse_document(&doc, request);
   } catch (rpc_error& e) {
-    tinyxml2::XMLPrinter printer(nullptr, true, 0);
-    print_xmlrpc_fault(e.type(), e.what(), &printer);
-    return slotWrite(printer.CStr(), printer.CStrSize() - 1);
+    request->calls.clear();
+    request->set_error(e.type(), e.what());
   } catch (torrent::local_error& e) {
-    tinyxml2::XMLPrinter printer(nullptr, true, 0);
-    print_xmlrpc_fault(XMLRPC_INTERNAL_ERROR, e.what(), &printer);
-    return slotWrite(printer.CStr(), printer.CStrSize() - 1);
+    request->calls.clear();
+    request->set_error(XMLRPC_INTERNAL_ERROR, e.what());
+  }
+}
+
+void
+XmlRpc::execute(RpcRequest* request, ResponseBuffer*) {
+  for (auto& call : request->calls) {
+    try {
+      call.result = execute_command(call);
+    } catch (rpc_error& e) {
+      call.set_error(e.type(), e.what());
+    } catch (torrent::local_error& e) {
+      call.set_error(XMLRPC_INTERNAL_ERROR, e.what());
+    }
   }
 }
 
+// The results of system.multicall are each wrapped in a list, while
+// failed calls are returned as a fault struct in their place.
+void
+XmlRpc::serialize(const RpcRequest& request, ResponseBuffer* output) {
+  static constexpr char response_first[] = "<?xml version=\"1.0\"?><methodResponse><params><param><value>";
+  static constexpr char response_last[]  = "</value></param></params></methodResponse>";
+
+  if (request.failed)
+    return print_xmlrpc_fault(request.error_code, request.error_message, output);
+
+  if (!request.is_batch) {
+    const auto& call = request.calls.front();
+
+    if (call.failed)
+      return print_xmlrpc_fault(call.error_code, call.error_message, output);
+
+    output->append(response_first, sizeof(response_first) - 1);
+    object_encode_xml(call.result, output);
+    output->append(response_last, sizeof(response_last) - 1);
+    return;
+  }
+
+  static constexpr char result_first[] = "<value><array><data><value>";
+  static constexpr char result_last[]  = "</value></data></array></value>";
+
+  output->append(response_first, sizeof(response_first) - 1);
+
+  if (request.calls.empty()) {
+    static constexpr char empty_list[] = "<array><data/></array>";
+    output->append(empty_list, sizeof(empty_list) - 1);
+
+  } else {
+    static constexpr char list_first[] = "<array><data>";
+    static constexpr char list_last[]  = "</data></array>";
+
+    output->append(list_first, sizeof(list_first) - 1);
+
+    for (const auto& call : request.calls) {
+      if (call.failed) {
+        output->append("<value>", 7);
+        object_encode_xml(make_fault(call.error_code, call.error_message), output);
+        output->append("</value>", 8);
+        continue;
+      }
+
+      output->append(result_first, sizeof(result_first) - 1);
+      object_encode_xml(call.result, output);
+      output->append(result_last, sizeof(result_last) - 1);
+    }
+
+    output->append(list_last, sizeof(list_last) - 1);
+  }
+
+  output->append(response_last, sizeof(response_last) - 1);
+}
+
 void
 XmlRpc::initialize() { m_isValid = true; }
 void
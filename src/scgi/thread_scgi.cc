@@ -37,6 +37,9 @@ void
 ThreadScgi::cleanup_thread() {
   if (m_scgi != nullptr)
     m_scgi.load()->stop();
+
+  if (m_http != nullptr)
+    m_http.load()->stop();
 }
 
 rpc::SCgi*
@@ -48,18 +51,33 @@ ThreadScgi::scgi() {
 
 bool
 ThreadScgi::set_scgi(rpc::SCgi* scgi) {
+  return set_listener(m_scgi, scgi);
+}
+
+rpc::SCgi*
+ThreadScgi::http() {
+  return m_http;
+}
+
+bool
+ThreadScgi::set_http(rpc::SCgi* http) {
+  return set_listener(m_http, http);
+}
+
+bool
+ThreadScgi::set_listener(std::atomic<rpc::SCgi*>& slot, rpc::SCgi* listener) {
   rpc::SCgi* expected = nullptr;
 
-  if (!m_scgi.compare_exchange_strong(expected, scgi))
+  if (!slot.compare_exchange_strong(expected, listener))
     return false;
 
-  change_rpc_log();
+  change_rpc_log(listener);
 
-  callback([this]() {
-      if (m_scgi == nullptr)
-        throw torrent::internal_error("Tried to start SCGI but object was not present.");
+  callback([&slot]() {
+      if (slot == nullptr)
+        throw torrent::internal_error("Tried to start RPC listener but object was not present.");
 
-      m_scgi.load()->activate();
+      slot.load()->activate();
     });
 
   return true;
@@ -75,12 +93,18 @@ ThreadScgi::set_rpc_log(const std::string& filename) {
 
 void
 ThreadScgi::change_rpc_log() {
-  if (scgi() == nullptr)
+  change_rpc_log(scgi());
+  change_rpc_log(http());
+}
+
+void
+ThreadScgi::change_rpc_log(rpc::SCgi* listener) {
+  if (listener == nullptr)
     return;
 
-  if (scgi()->log_fd() != -1) {
-    ::close(scgi()->log_fd());
-    scgi()->set_log_fd(-1);
+  if (listener->log_fd() != -1) {
+    ::close(listener->log_fd());
+    listener->set_log_fd(-1);
 
     lt_log_print(torrent::LOG_NOTICE, "Closed RPC log.", 0);
   }
@@ -88,9 +112,9 @@ ThreadScgi::change_rpc_log() {
   if (m_rpc_log_filename.empty())
     return;
 
-  scgi()->set_log_fd(open(expand_path(m_rpc_log_filename).c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644));
+  listener->set_log_fd(open(expand_path(m_rpc_log_filename).c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644));
 
-  if (scgi()->log_fd() == -1) {
+  if (listener->log_fd() == -1) {
     lt_log_print(torrent::LOG_NOTICE, "Could not open RPC log file '%s'.", m_rpc_log_filename.c_str());
     return;
   }
@@ -129,6 +153,8 @@ void        callback_interrupt(torrent::system::callback_id& id, std::function<v
 
 rpc::SCgi*  scgi()                                       { return scgi::ThreadScgi::thread_scgi()->scgi(); }
 void        set_scgi(rpc::SCgi* scgi)                    { scgi::ThreadScgi::thread_scgi()->set_scgi(scgi); }
+rpc::SCgi*  http()                                       { return scgi::ThreadScgi::thread_scgi()->http(); }
+void        set_http(rpc::SCgi* http)                    { scgi::ThreadScgi::thread_scgi()->set_http(http); }
 void        set_rpc_log(const std::string& filename)     { scgi::ThreadScgi::thread_scgi()->set_rpc_log(filename); }
 
 } // namespace scgi_thread
@@ -23,6 +23,9 @@ public:
   rpc::SCgi*          scgi();
   bool                set_scgi(rpc::SCgi* scgi);
 
+  rpc::SCgi*          http();
+  bool                set_http(rpc::SCgi* http);
+
   void                set_rpc_log(const std::string& filename);
 
 protected:
@@ -38,10 +41,14 @@ protected:
 private:
   void                task_touch_log();
   void                change_rpc_log();
+  void                change_rpc_log(rpc::SCgi* listener);
+
+  bool                set_listener(std::atomic<rpc::SCgi*>& slot, rpc::SCgi* listener);
 
   static ThreadScgi*      m_thread_scgi;
 
   std::atomic<rpc::SCgi*> m_scgi{};
+  std::atomic<rpc::SCgi*> m_http{};
   std::string             m_rpc_log_filename;
 };
 
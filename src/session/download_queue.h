@@ -0,0 +1,120 @@
+#ifndef RTORRENT_SESSION_DOWNLOAD_QUEUE_H
+#define RTORRENT_SESSION_DOWNLOAD_QUEUE_H
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <torrent/exceptions.h>
+
+namespace core {
+class Download;
+}
+
+namespace session {
+
+// FIFO queue holding at most one entry per download, with constant
+// time lookup and removal by download so that queueing every download
+// stays linear.
+//
+// The download pointers are only used as keys and never dereferenced.
+
+template <typename T>
+class DownloadQueue {
+public:
+  typedef core::Download* key_type;
+  typedef T               value_type;
+
+  struct entry_type {
+    key_type   download;
+    value_type value;
+  };
+
+  typedef std::list<entry_type>              list_type;
+  typedef typename list_type::iterator       iterator;
+  typedef typename list_type::const_iterator const_iterator;
+
+  size_t              size() const  { return m_list.size(); }
+  bool                empty() const { return m_list.empty(); }
+
+  iterator            begin()       { return m_list.begin(); }
+  iterator            end()         { return m_list.end(); }
+  const_iterator      begin() const { return m_list.begin(); }
+  const_iterator      end() const   { return m_list.end(); }
+
+  bool                contains(key_type download) const { return m_index.find(download) != m_index.end(); }
+
+  // Returns NULL if the download is not queued.
+  value_type*         find(key_type download);
+
+  // The download must not already be queued.
+  void                push_back(key_type download, value_type value);
+
+  value_type          pop_front();
+
+  iterator            erase(iterator itr);
+  bool                erase(key_type download);
+
+  void                clear() { m_list.clear(); m_index.clear(); }
+
+private:
+  list_type                              m_list;
+  std::unordered_map<key_type, iterator> m_index;
+};
+
+template <typename T>
+inline typename DownloadQueue<T>::value_type*
+DownloadQueue<T>::find(key_type download) {
+  auto itr = m_index.find(download);
+
+  if (itr == m_index.end())
+    return nullptr;
+
+  return &itr->second->value;
+}
+
+template <typename T>
+inline void
+DownloadQueue<T>::push_back(key_type download, value_type value) {
+  auto itr = m_list.insert(m_list.end(), entry_type{download, std::move(value)});
+
+  if (!m_index.emplace(download, itr).second) {
+    m_list.erase(itr);
+    throw torrent::internal_error("DownloadQueue::push_back(...) download already queued.");
+  }
+}
+
+template <typename T>
+inline typename DownloadQueue<T>::value_type
+DownloadQueue<T>::pop_front() {
+  if (m_list.empty())
+    throw torrent::internal_error("DownloadQueue::pop_front() called on an empty queue.");
+
+  value_type value = std::move(m_list.front().value);
+
+  erase(m_list.begin());
+  return value;
+}
+
+template <typename T>
+inline typename DownloadQueue<T>::iterator
+DownloadQueue<T>::erase(iterator itr) {
+  m_index.erase(itr->download);
+  return m_list.erase(itr);
+}
+
+template <typename T>
+inline bool
+DownloadQueue<T>::erase(key_type download) {
+  auto itr = m_index.find(download);
+
+  if (itr == m_index.end())
+    return false;
+
+  m_list.erase(itr->second);
+  m_index.erase(itr);
+  return true;
+}
+
+} // namespace session
+
+#endif
@@ -73,6 +73,11 @@ DownloadStorer::build_streams(bool skip_static) {
   m_libtorrent_stream = std::move(resume_stream);
 }
 
+std::string
+DownloadStorer::build_hash() {
+  return torrent::utils::transform_to_hex_str(m_download->info()->info_hash());
+}
+
 std::string
 DownloadStorer::build_path(const std::string& session_path) {
   if (session_path.empty())
@@ -81,7 +86,7 @@ DownloadStorer::build_path(const std::string& session_path) {
   if (session_path.back() != '/')
     throw torrent::internal_error("DownloadStorer::build_path() session path missing trailing slash.");
 
-  return session_path + torrent::utils::transform_to_hex_str(m_download->info()->info_hash()) + ".torrent";
+  return session_path + build_hash() + ".torrent";
 }
 
 void
@@ -22,6 +22,7 @@ public:
 
   core::Download*     download() const { return m_download; }
 
+  std::string         build_hash();
   std::string         build_path(const std::string& session_path);
 
   void                build_full_streams()   { build_streams(false); }
@@ -0,0 +1,63 @@
+#ifndef RTORRENT_SESSION_INSERTED_QUEUE_H
+#define RTORRENT_SESSION_INSERTED_QUEUE_H
+
+#include <vector>
+#include <torrent/hash_string.h>
+
+namespace core {
+class Download;
+}
+
+namespace session {
+
+// Downloads loaded from the session waiting for
+// event.download.inserted_session, which is called once for each in the
+// order they were inserted, a batch at a time.
+//
+// Downloads are kept by info hash as the handlers of earlier downloads
+// in the batch might erase them.
+
+class InsertedQueue {
+public:
+  typedef torrent::HashString key_type;
+
+  size_t              size() const  { return m_hashes.size(); }
+  bool                empty() const { return m_hashes.empty(); }
+
+  void                push_back(const key_type& hash) { m_hashes.push_back(hash); }
+  void                clear()                         { m_hashes.clear(); }
+
+  // Calls 'call' with each queued download that 'find' still returns
+  // non-NULL for, and returns the number of calls. The queue is emptied
+  // first, so downloads queued by the handlers wait for the next batch.
+  template <typename Find, typename Call>
+  size_t              dispatch(Find find, Call call);
+
+private:
+  std::vector<key_type> m_hashes;
+};
+
+template <typename Find, typename Call>
+inline size_t
+InsertedQueue::dispatch(Find find, Call call) {
+  std::vector<key_type> hashes;
+  hashes.swap(m_hashes);
+
+  size_t count = 0;
+
+  for (const auto& hash : hashes) {
+    core::Download* download = find(hash);
+
+    if (download == nullptr)
+      continue;
+
+    call(download);
+    count++;
+  }
+
+  return count;
+}
+
+} // namespace session
+
+#endif
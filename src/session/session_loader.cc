@@ -0,0 +1,408 @@
+#include "config.h"
+
+#include "session/session_loader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <torrent/exceptions.h>
+#include <torrent/object_stream.h>
+#include <torrent/system/callbacks.h>
+#include <torrent/system/thread.h>
+#include <torrent/utils/log.h>
+
+#include "control.h"
+#include "globals.h"
+#include "core/download.h"
+#include "core/download_factory.h"
+#include "core/download_list.h"
+#include "core/manager.h"
+#include "rpc/object_storage.h"
+#include "rpc/parse_commands.h"
+#include "session/download_storer.h"
+#include "session/session_log.h"
+#include "utils/directory.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(torrent::LOG_SESSION_EVENTS, "session-loader: " log_fmt, __VA_ARGS__);
+
+namespace session {
+
+namespace {
+
+bool
+read_file(const std::string& path, std::string* data) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd == -1)
+    return false;
+
+  struct stat st;
+
+  if (::fstat(fd, &st) == -1) {
+    ::close(fd);
+    return false;
+  }
+
+  data->resize(st.st_size);
+
+  size_t pos = 0;
+
+  while (pos < data->size()) {
+    ssize_t result = ::read(fd, &(*data)[pos], data->size() - pos);
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result <= 0)
+      break;
+
+    pos += result;
+  }
+
+  ::close(fd);
+
+  data->resize(pos);
+  return true;
+}
+
+std::unique_ptr<torrent::Object>
+decode_object(const std::string& data) {
+  if (data.empty())
+    return std::unique_ptr<torrent::Object>();
+
+  std::istringstream stream(data);
+
+  auto obj = std::make_unique<torrent::Object>();
+
+  try {
+    stream >> *obj;
+  } catch (torrent::local_error&) {
+    return std::unique_ptr<torrent::Object>();
+  }
+
+  if (!stream.good())
+    return std::unique_ptr<torrent::Object>();
+
+  return obj;
+}
+
+int64_t
+elapsed_us(SessionLoader::clock_type::time_point first, SessionLoader::clock_type::time_point last) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(last - first).count();
+}
+
+} // namespace
+
+SessionLoader::SessionLoader(core::Manager* manager) :
+    m_manager(manager),
+    m_callback_id(torrent::system::make_callback_id()) {
+}
+
+SessionLoader::~SessionLoader() {
+  for (auto& worker : m_workers)
+    if (worker.joinable())
+      worker.join();
+}
+
+void
+SessionLoader::start(const std::string& path, SessionLog* session_log) {
+  assert(torrent::this_thread::thread() == torrent::main_thread::thread());
+
+  m_started     = clock_type::now();
+  m_session_log = session_log;
+
+  std::vector<std::string> log_hashes;
+
+  if (m_session_log != nullptr) {
+    log_hashes = m_session_log->torrent_hashes();
+
+    for (const auto& hash : log_hashes) {
+      entry_type entry;
+      entry.path     = path + hash + ".torrent";
+      entry.hash     = hash;
+      entry.from_log = true;
+
+      m_entries.push_back(std::move(entry));
+    }
+  }
+
+  // Session files are also loaded when using the log, for downloads
+  // that have not been saved to the log yet, e.g. when rtorrent exited
+  // before all downloads were saved after switching formats. They are
+  // written to the log on their next save.
+  auto entries = DownloadStorer::get_formated_entries(path);
+
+  for (const auto& file : entries) {
+    // We don't really support session torrents that are links. These
+    // would be overwritten anyway on exit, and thus not really be
+    // useful.
+    if (!file.is_file())
+      continue;
+
+    if (std::binary_search(log_hashes.begin(), log_hashes.end(), file.s_name.substr(0, 40)))
+      continue;
+
+    entry_type entry;
+    entry.path = entries.path() + file.s_name;
+
+    m_entries.push_back(std::move(entry));
+  }
+
+  m_file_count = m_entries.size() - log_hashes.size();
+
+  m_scan_time = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - m_started);
+
+  if (m_entries.empty())
+    return finish();
+
+  int workers = std::min<size_t>(std::clamp<int>(std::thread::hardware_concurrency(), 1, max_workers), m_entries.size());
+
+  LT_LOG("loading %zu session torrents with %i workers : log:%zu files:%zu", m_entries.size(), workers, m_entries.size() - m_file_count, m_file_count);
+
+  // The entries must not be modified by the main thread until handed
+  // over by the workers.
+  for (int i = 0; i < workers; i++)
+    m_workers.emplace_back([this]() { worker_loop(); });
+}
+
+void
+SessionLoader::cleanup() {
+  assert(torrent::this_thread::thread() == torrent::main_thread::thread());
+
+  m_next_entry = m_entries.size();
+
+  for (auto& worker : m_workers)
+    worker.join();
+
+  m_workers.clear();
+
+  // The workers are done, so no new callbacks can be scheduled.
+  torrent::main_thread::thread()->cancel_callback(m_callback_id);
+}
+
+void
+SessionLoader::worker_loop() {
+  std::string torrent;
+  std::string rtorrent;
+  std::string libtorrent_resume;
+
+  while (true) {
+    size_t index = m_next_entry++;
+
+    if (index >= m_entries.size())
+      return;
+
+    auto* entry   = &m_entries[index];
+    auto  started = clock_type::now();
+
+    read_entry(entry, &torrent, &rtorrent, &libtorrent_resume);
+
+    auto read = clock_type::now();
+
+    if (entry->error.empty())
+      decode_entry(entry, torrent, rtorrent, libtorrent_resume);
+
+    auto decoded = clock_type::now();
+
+    m_read_time   += elapsed_us(started, read);
+    m_decode_time += elapsed_us(read, decoded);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    entry->is_read = true;
+
+    while (m_ready_end != m_entries.size() && m_entries[m_ready_end].is_read)
+      m_ready_end++;
+
+    // Hand over full batches, and whatever remains once all entries
+    // have been read.
+    if (m_callback_scheduled || (m_ready_end - m_released < batch_size && m_ready_end != m_entries.size()))
+      continue;
+
+    m_callback_scheduled = true;
+
+    torrent::main_thread::callback(m_callback_id, [this]() {
+        process_ready();
+      });
+  }
+}
+
+void
+SessionLoader::read_entry(entry_type* entry, std::string* torrent, std::string* rtorrent, std::string* libtorrent_resume) {
+  torrent->clear();
+  rtorrent->clear();
+  libtorrent_resume->clear();
+
+  if (entry->from_log) {
+    SessionLog::entry_type log_entry;
+
+    if (!m_session_log->read_entry(entry->hash, &log_entry)) {
+      entry->error = "Could not read session log entry";
+      return;
+    }
+
+    *torrent           = std::move(log_entry.torrent);
+    *rtorrent          = std::move(log_entry.rtorrent);
+    *libtorrent_resume = std::move(log_entry.libtorrent_resume);
+    return;
+  }
+
+  if (!read_file(entry->path, torrent)) {
+    entry->error = "Could not open file";
+    return;
+  }
+
+  // Missing resume files are handled the same as empty ones.
+  read_file(entry->path + ".rtorrent", rtorrent);
+  read_file(entry->path + ".libtorrent_resume", libtorrent_resume);
+}
+
+void
+SessionLoader::decode_entry(entry_type* entry, const std::string& torrent, const std::string& rtorrent, const std::string& libtorrent_resume) {
+  entry->torrent = decode_object(torrent);
+
+  if (entry->torrent == nullptr) {
+    entry->error = "Reading torrent file failed";
+    return;
+  }
+
+  entry->rtorrent          = decode_object(rtorrent);
+  entry->libtorrent_resume = decode_object(libtorrent_resume);
+}
+
+void
+SessionLoader::process_ready() {
+  assert(torrent::this_thread::thread() == torrent::main_thread::thread());
+
+  size_t first;
+  size_t last;
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_callback_scheduled = false;
+
+    first      = m_released;
+    last       = m_ready_end;
+    m_released = m_ready_end;
+  }
+
+  for (size_t index = first; index != last; index++) {
+    auto* entry = &m_entries[index];
+
+    m_processed_count++;
+
+    if (!entry->error.empty()) {
+      m_failed_count++;
+      m_manager->push_log_std(entry->error + ": \"" + entry->path + "\"");
+      continue;
+    }
+
+    auto* f = new core::DownloadFactory(m_manager);
+
+    f->set_session(true);
+    f->set_init_load(true);
+    f->set_defer_event(true);
+    f->slot_finished([this, f]() { receive_factory_finished(f); });
+    f->load_session_objects(entry->path, !entry->from_log,
+                            std::move(entry->torrent),
+                            std::move(entry->rtorrent),
+                            std::move(entry->libtorrent_resume));
+    f->commit();
+
+    m_pending_factories++;
+  }
+
+  LT_LOG("handed batch to main thread : entries:%zu processed:%zu total:%zu", last - first, m_processed_count, m_entries.size());
+
+  if (m_processed_count == m_entries.size() && m_pending_factories == 0)
+    finish();
+}
+
+void
+SessionLoader::receive_factory_finished(core::DownloadFactory* factory) {
+  m_insert_time += factory->insert_time();
+
+  if (factory->deferred_download() != nullptr)
+    m_inserted.push_back(factory->deferred_download()->info()->hash());
+
+  delete factory;
+
+  m_pending_factories--;
+
+  if (m_inserted.size() >= batch_size || m_pending_factories == 0)
+    dispatch_inserted();
+
+  if (m_processed_count == m_entries.size() && m_pending_factories == 0)
+    finish();
+}
+
+void
+SessionLoader::dispatch_inserted() {
+  if (m_inserted.empty())
+    return;
+
+  auto started = clock_type::now();
+
+  rpc::object_storage_node* event;
+
+  try {
+    event = control->object_storage()->find_function_c_str("event.download.inserted_session");
+  } catch (torrent::input_error& e) {
+    m_inserted.clear();
+    m_manager->push_log_std("Download event action failed: " + std::string(e.what()));
+    return;
+  }
+
+  auto download_list = m_manager->download_list();
+
+  size_t count = m_inserted.dispatch([download_list](const torrent::HashString& hash) -> core::Download* {
+      auto itr = download_list->find(hash);
+      return itr != download_list->end() ? *itr : nullptr;
+    }, [this, event](core::Download* download) {
+      try {
+        rpc::object_storage::call_function_node(event, rpc::make_target(download), torrent::Object());
+      } catch (torrent::input_error& e) {
+        m_manager->push_log_std("Download event action failed: " + std::string(e.what()));
+      }
+    });
+
+  m_hash_resume_time += std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - started);
+
+  LT_LOG("dispatched inserted event : downloads:%zu", count);
+}
+
+void
+SessionLoader::finish() {
+  for (auto& worker : m_workers)
+    worker.join();
+
+  m_workers.clear();
+
+  auto to_ms = [](int64_t us) { return us / 1000; };
+
+  LT_LOG("loaded session torrents : entries:%zu failed:%zu total:%" PRIi64 "ms scan:%" PRIi64 "ms read:%" PRIi64 "ms "
+         "decode:%" PRIi64 "ms insert:%" PRIi64 "ms hash_resume:%" PRIi64 "ms",
+         m_entries.size(), m_failed_count,
+         to_ms(elapsed_us(m_started, clock_type::now())),
+         to_ms(m_scan_time.count()),
+         to_ms(m_read_time.load()),
+         to_ms(m_decode_time.load()),
+         to_ms(m_insert_time.count()),
+         to_ms(m_hash_resume_time.count()));
+
+  auto slot = std::move(m_slot_finished);
+
+  delete this;
+
+  if (slot)
+    slot();
+}
+
+} // namespace session
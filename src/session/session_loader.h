@@ -0,0 +1,123 @@
+#ifndef RTORRENT_SESSION_SESSION_LOADER_H
+#define RTORRENT_SESSION_SESSION_LOADER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <torrent/common.h>
+#include <torrent/hash_string.h>
+#include <torrent/object.h>
+
+#include "session/inserted_queue.h"
+
+namespace core {
+class DownloadFactory;
+class Manager;
+}
+
+namespace session {
+
+class SessionLog;
+
+// Loads the session torrents at startup. The session files, or log
+// entries, are read and bencode decoded by a pool of worker threads,
+// which hand the decoded objects to the main thread in batches where
+// the downloads are created. Entries are handed over in the order they
+// were listed, regardless of which worker finishes first. The
+// inserted_session event is then called for each batch of downloads,
+// with the handlers looked up once.
+//
+// Deletes itself once all downloads have been inserted, after calling
+// the finished slot, unless 'cleanup' was called first.
+
+class SessionLoader {
+public:
+  typedef std::function<void ()>    slot_void;
+  typedef std::chrono::steady_clock clock_type;
+
+  constexpr static int    max_workers = 8;
+  constexpr static size_t batch_size  = 64;
+
+  SessionLoader(core::Manager* manager);
+  ~SessionLoader();
+
+  void                slot_finished(slot_void s) { m_slot_finished = std::move(s); }
+
+  // Loads from the session log if not NULL, and the session files in
+  // path of downloads missing from the log.
+  void                start(const std::string& path, SessionLog* session_log);
+
+  // Stops the workers once done with their current entries and drops
+  // any pending hand over, when shutting down before loading finished.
+  // The caller deletes the loader.
+  void                cleanup();
+
+private:
+  struct entry_type {
+    std::string                      path;
+    std::string                      hash;
+    std::string                      error;
+    bool                             from_log{};
+    bool                             is_read{};
+
+    std::unique_ptr<torrent::Object> torrent;
+    std::unique_ptr<torrent::Object> rtorrent;
+    std::unique_ptr<torrent::Object> libtorrent_resume;
+  };
+
+  void                worker_loop();
+  void                read_entry(entry_type* entry, std::string* torrent, std::string* rtorrent, std::string* libtorrent_resume);
+  void                decode_entry(entry_type* entry, const std::string& torrent, const std::string& rtorrent, const std::string& libtorrent_resume);
+
+  void                process_ready();
+  void                receive_factory_finished(core::DownloadFactory* factory);
+  void                dispatch_inserted();
+  void                finish();
+
+  core::Manager*               m_manager;
+  SessionLog*                  m_session_log{};
+
+  torrent::system::callback_id m_callback_id;
+  slot_void                    m_slot_finished;
+
+  std::vector<entry_type>      m_entries;
+  size_t                       m_file_count{};
+  std::atomic<size_t>          m_next_entry{};
+  std::vector<std::thread>     m_workers;
+
+  // Entries before m_ready_end have all been read, and those from
+  // m_released up to it are waiting to be handed over. Scheduling the
+  // callback under m_mutex ensures the last callback is the one that
+  // finishes loading.
+  std::mutex                   m_mutex;
+  size_t                       m_released{};
+  size_t                       m_ready_end{};
+  bool                         m_callback_scheduled{};
+
+  // Only used by the main thread.
+  size_t                       m_processed_count{};
+  size_t                       m_pending_factories{};
+  size_t                       m_failed_count{};
+
+  InsertedQueue                m_inserted;
+
+  clock_type::time_point       m_started;
+  std::chrono::microseconds    m_scan_time{};
+
+  // Summed over all workers.
+  std::atomic<int64_t>         m_read_time{};
+  std::atomic<int64_t>         m_decode_time{};
+
+  std::chrono::microseconds    m_insert_time{};
+  std::chrono::microseconds    m_hash_resume_time{};
+};
+
+} // namespace session
+
+#endif // RTORRENT_SESSION_SESSION_LOADER_H
@@ -0,0 +1,729 @@
+#include "config.h"
+
+#include "session/session_log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include <torrent/exceptions.h>
+#include <torrent/utils/log.h>
+
+#include "session/session_manager.h"
+#include "utils/directory.h"
+
+#define LT_LOG(log_fmt, ...)                                            \
+  lt_log_print(torrent::LOG_SESSION_EVENTS, "session-log: " log_fmt, __VA_ARGS__);
+
+namespace session {
+
+namespace {
+
+const char   segment_prefix[]   = "session.log.";
+const size_t segment_prefix_len = sizeof(segment_prefix) - 1;
+const size_t segment_digits     = 8;
+
+void
+set_u32(char* data, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    data[i] = static_cast<char>(value >> (8 * i));
+}
+
+uint32_t
+get_u32(const char* data) {
+  uint32_t value = 0;
+
+  for (int i = 0; i < 4; i++)
+    value |= static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+
+  return value;
+}
+
+void
+put_field(std::string* data, const std::string& field) {
+  char size[4];
+  set_u32(size, field.size());
+
+  data->append(size, 4);
+  data->append(field);
+}
+
+bool
+get_field(const std::string& payload, size_t* pos, std::string* field) {
+  if (payload.size() - *pos < 4)
+    return false;
+
+  uint32_t size = get_u32(payload.data() + *pos);
+  *pos += 4;
+
+  if (payload.size() - *pos < size)
+    return false;
+
+  field->assign(payload, *pos, size);
+  *pos += size;
+
+  return true;
+}
+
+uint32_t
+payload_crc(const char* data, size_t size) {
+  return ::crc32(::crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(data), size);
+}
+
+bool
+parse_segment_name(const std::string& name, uint32_t* id) {
+  if (name.size() != segment_prefix_len + segment_digits || name.compare(0, segment_prefix_len, segment_prefix) != 0)
+    return false;
+
+  *id = 0;
+
+  for (auto itr = name.begin() + segment_prefix_len; itr != name.end(); ++itr) {
+    if (*itr < '0' || *itr > '9')
+      return false;
+
+    *id = *id * 10 + (*itr - '0');
+  }
+
+  return *id != 0;
+}
+
+bool
+read_full(int fd, char* data, size_t size, uint64_t offset) {
+  while (size != 0) {
+    ssize_t result = ::pread(fd, data, size, offset);
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result <= 0)
+      return false;
+
+    data   += result;
+    size   -= result;
+    offset += result;
+  }
+
+  return true;
+}
+
+bool
+write_full(int fd, const char* data, size_t size) {
+  while (size != 0) {
+    ssize_t result = ::write(fd, data, size);
+
+    if (result == -1 && errno == EINTR)
+      continue;
+
+    if (result <= 0)
+      return false;
+
+    data += result;
+    size -= result;
+  }
+
+  return true;
+}
+
+int
+sync_fd(int fd) {
+#ifdef __APPLE__
+  return ::fsync(fd);
+#else
+  return ::fdatasync(fd);
+#endif
+}
+
+std::string
+stream_data(const std::stringstream* stream) {
+  return stream != nullptr ? stream->str() : std::string();
+}
+
+} // namespace
+
+SessionLog::SessionLog(const std::string& path) :
+    m_path(path) {
+}
+
+SessionLog::~SessionLog() {
+  close();
+}
+
+bool
+SessionLog::is_open() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_open;
+}
+
+bool
+SessionLog::is_new() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_new;
+}
+
+uint64_t
+SessionLog::total_size() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_total_size;
+}
+
+uint64_t
+SessionLog::live_size() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_live_size;
+}
+
+size_t
+SessionLog::segment_count() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  return m_segment_count;
+}
+
+void
+SessionLog::open() {
+  std::unique_lock<std::mutex> write_lock(m_write_mutex);
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  if (m_open)
+    throw torrent::internal_error("SessionLog::open() called on an open log.");
+
+  m_segments.clear();
+  m_index.clear();
+
+  m_total_size    = 0;
+  m_live_size     = 0;
+  m_segment_count = 0;
+
+  utils::Directory directory(m_path);
+
+  if (!directory.update(utils::Directory::update_hide_dot))
+    throw torrent::storage_error("could not open session directory : " + m_path);
+
+  for (const auto& entry : directory) {
+    uint32_t id;
+
+    if (parse_segment_name(entry.s_name, &id))
+      m_segments.emplace(id, 0);
+  }
+
+  for (auto itr = m_segments.begin(); itr != m_segments.end(); ++itr)
+    replay_segment_unsafe(itr->first, std::next(itr) == m_segments.end());
+
+  m_new = m_index.empty();
+
+  lock.unlock();
+  open_segment_unsafe(m_segments.empty() ? 1 : m_segments.rbegin()->first, false);
+  lock.lock();
+
+  m_open = true;
+
+  LT_LOG("opened session log : path:%s segments:%zu size:%" PRIu64 " live:%" PRIu64 " entries:%zu",
+         m_path.c_str(), m_segment_count, m_total_size, m_live_size, m_index.size());
+}
+
+void
+SessionLog::close() {
+  std::unique_lock<std::mutex> write_lock(m_write_mutex);
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  if (!m_open)
+    return;
+
+  ::close(m_fd);
+  m_fd = -1;
+
+  close_read_fd_unsafe();
+
+  m_open = false;
+
+  LT_LOG("closed session log : path:%s", m_path.c_str());
+}
+
+bool
+SessionLog::has_torrent(const std::string& hash) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  auto itr = m_index.find(hash);
+
+  return itr != m_index.end() && itr->second.torrent.size != 0;
+}
+
+std::vector<std::string>
+SessionLog::torrent_hashes() {
+  std::vector<std::string> hashes;
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    hashes.reserve(m_index.size());
+
+    for (const auto& entry : m_index)
+      if (entry.second.torrent.size != 0)
+        hashes.push_back(entry.first);
+  }
+
+  std::sort(hashes.begin(), hashes.end());
+  return hashes;
+}
+
+bool
+SessionLog::read_entry(const std::string& hash, entry_type* entry) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  auto itr = m_index.find(hash);
+
+  if (itr == m_index.end() || itr->second.torrent.size == 0)
+    return false;
+
+  record_data record;
+
+  if (!read_record_unsafe(itr->second.torrent, &record))
+    return false;
+
+  entry->torrent = std::move(record.torrent);
+
+  if (itr->second.resume.segment != itr->second.torrent.segment || itr->second.resume.offset != itr->second.torrent.offset) {
+    if (!read_record_unsafe(itr->second.resume, &record))
+      return false;
+  }
+
+  entry->rtorrent          = std::move(record.rtorrent);
+  entry->libtorrent_resume = std::move(record.libtorrent_resume);
+
+  return true;
+}
+
+void
+SessionLog::append_batch(const std::vector<SaveRequest>& requests, bool use_fsyncdisk) {
+  record_buffer buffer;
+
+  for (const auto& request : requests)
+    encode_record(&buffer, request.torrent_stream != nullptr ? record_full : record_resume, request.hash,
+                  stream_data(request.torrent_stream.get()),
+                  stream_data(request.rtorrent_stream.get()),
+                  stream_data(request.libtorrent_stream.get()));
+
+  std::unique_lock<std::mutex> write_lock(m_write_mutex);
+
+  if (m_fd == -1)
+    throw torrent::internal_error("SessionLog::append_batch() called on a closed log.");
+
+  write_buffer_unsafe(buffer, use_fsyncdisk);
+}
+
+void
+SessionLog::append_remove(const std::string& hash) {
+  std::unique_lock<std::mutex> write_lock(m_write_mutex);
+
+  if (m_fd == -1)
+    throw torrent::internal_error("SessionLog::append_remove() called on a closed log.");
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_index.find(hash) == m_index.end())
+      return;
+  }
+
+  record_buffer buffer;
+  encode_record(&buffer, record_remove, hash, std::string(), std::string(), std::string());
+
+  // Removals are made durable by the next committed batch.
+  write_buffer_unsafe(buffer, false);
+}
+
+bool
+SessionLog::needs_compaction() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  return m_open && m_total_size > min_compaction_size && m_total_size > 2 * m_live_size;
+}
+
+void
+SessionLog::compact(bool use_fsyncdisk) {
+  std::unique_lock<std::mutex> write_lock(m_write_mutex);
+
+  if (m_fd == -1)
+    return;
+
+  auto     started    = std::chrono::steady_clock::now();
+  uint32_t first_id   = m_segments.rbegin()->first + 1;
+  uint64_t start_size = total_size();
+
+  open_segment_unsafe(first_id, use_fsyncdisk);
+
+  std::vector<std::string> hashes;
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    hashes.reserve(m_index.size());
+
+    for (const auto& entry : m_index)
+      hashes.push_back(entry.first);
+  }
+
+  write_lock.unlock();
+
+  // Copy in chunks, so appends and lookups only wait for a single
+  // chunk. Anything appended meanwhile is already in the new segments.
+  auto itr = hashes.begin();
+
+  while (itr != hashes.end()) {
+    record_buffer buffer;
+
+    write_lock.lock();
+
+    if (m_fd == -1)
+      return;
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+
+      for (; itr != hashes.end() && buffer.data.size() < compaction_chunk; ++itr) {
+        auto entry_itr = m_index.find(*itr);
+
+        if (entry_itr == m_index.end())
+          continue;
+
+        auto& entry = entry_itr->second;
+
+        if (entry.torrent.size == 0) {
+          LT_LOG("dropping resume data without torrent : hash:%s", itr->c_str());
+
+          m_live_size -= entry_size(entry);
+          m_index.erase(entry_itr);
+          continue;
+        }
+
+        if (entry.torrent.segment >= first_id && entry.resume.segment >= first_id)
+          continue;
+
+        record_data torrent_record;
+        record_data resume_record;
+
+        if (!read_record_unsafe(entry.torrent, &torrent_record) || !read_record_unsafe(entry.resume, &resume_record))
+          throw torrent::storage_error("failed to read session log record during compaction : hash:" + *itr);
+
+        encode_record(&buffer, record_full, *itr, torrent_record.torrent, resume_record.rtorrent, resume_record.libtorrent_resume);
+      }
+    }
+
+    write_buffer_unsafe(buffer, use_fsyncdisk);
+    write_lock.unlock();
+  }
+
+  write_lock.lock();
+
+  if (m_fd == -1)
+    return;
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  if (m_read_segment < first_id)
+    close_read_fd_unsafe();
+
+  // Unlink in ascending order, so that an interrupted compaction never
+  // leaves a segment whose records were superseded by an unlinked one.
+  while (m_segments.begin()->first < first_id) {
+    auto path = segment_path(m_segments.begin()->first);
+
+    if (::unlink(path.c_str()) == -1 && errno != ENOENT)
+      throw torrent::storage_error("failed to unlink session log segment : " + path + " : " + std::strerror(errno));
+
+    m_total_size -= m_segments.begin()->second;
+    m_segment_count--;
+    m_segments.erase(m_segments.begin());
+  }
+
+  auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+
+  LT_LOG("compacted session log : size:%" PRIu64 "->%" PRIu64 " segments:%zu entries:%zu time:%" PRIi64 "ms",
+         start_size, m_total_size, m_segment_count, m_index.size(), static_cast<int64_t>(duration.count()));
+}
+
+void
+SessionLog::encode_record(record_buffer* buffer, uint8_t type, const std::string& hash,
+                          const std::string& torrent, const std::string& rtorrent, const std::string& libtorrent_resume) {
+  auto& data   = buffer->data;
+  auto  offset = data.size();
+
+  data.append(header_size, '\0');
+  data.push_back(static_cast<char>(type));
+
+  put_field(&data, hash);
+  put_field(&data, torrent);
+  put_field(&data, rtorrent);
+  put_field(&data, libtorrent_resume);
+
+  uint64_t payload_size = data.size() - offset - header_size;
+
+  if (payload_size > UINT32_MAX - header_size)
+    throw torrent::storage_error("session log record too large : hash:" + hash);
+
+  set_u32(&data[offset], record_magic);
+  set_u32(&data[offset + 4], payload_size);
+  set_u32(&data[offset + 8], payload_crc(data.data() + offset + header_size, payload_size));
+
+  buffer->records.push_back(record_buffer::record{type, hash, offset, static_cast<uint32_t>(header_size + payload_size)});
+}
+
+bool
+SessionLog::decode_record(const std::string& payload, record_data* record, bool headers_only) {
+  if (payload.empty())
+    return false;
+
+  size_t pos = 1;
+
+  record->type = payload[0];
+
+  if (record->type < record_full || record->type > record_remove)
+    return false;
+
+  if (!get_field(payload, &pos, &record->hash) || record->hash.empty())
+    return false;
+
+  if (headers_only)
+    return true;
+
+  return
+    get_field(payload, &pos, &record->torrent) &&
+    get_field(payload, &pos, &record->rtorrent) &&
+    get_field(payload, &pos, &record->libtorrent_resume) &&
+    pos == payload.size();
+}
+
+uint64_t
+SessionLog::entry_size(const index_entry& entry) {
+  if (entry.resume.segment == entry.torrent.segment && entry.resume.offset == entry.torrent.offset)
+    return entry.torrent.size;
+
+  return entry.torrent.size + entry.resume.size;
+}
+
+std::string
+SessionLog::segment_path(uint32_t id) const {
+  char name[segment_prefix_len + segment_digits + 1];
+  std::snprintf(name, sizeof(name), "%s%08" PRIu32, segment_prefix, id);
+
+  return m_path + name;
+}
+
+void
+SessionLog::open_segment_unsafe(uint32_t id, bool sync_previous) {
+  auto path = segment_path(id);
+  int  fd   = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+  if (fd == -1)
+    throw torrent::storage_error("failed to open session log segment : " + path + " : " + std::strerror(errno));
+
+  if (m_fd != -1) {
+    if (sync_previous)
+      sync_fd(m_fd);
+
+    ::close(m_fd);
+  }
+
+  m_fd = fd;
+
+  if (!m_segments.emplace(id, 0).second)
+    return;
+
+  // Make sure the new segment survives a crash.
+  int dir_fd = ::open(m_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (dir_fd != -1) {
+    ::fsync(dir_fd);
+    ::close(dir_fd);
+  }
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_segment_count++;
+
+  LT_LOG("opened new session log segment : path:%s", path.c_str());
+}
+
+// Stops at the first record that is incomplete or fails the checksum.
+// If this is the last segment it is a torn write and the tail is
+// truncated, otherwise the rest of the segment is ignored.
+void
+SessionLog::replay_segment_unsafe(uint32_t id, bool is_last) {
+  auto path = segment_path(id);
+  int  fd   = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+  if (fd == -1)
+    throw torrent::storage_error("failed to open session log segment : " + path + " : " + std::strerror(errno));
+
+  struct stat st;
+
+  if (::fstat(fd, &st) == -1) {
+    ::close(fd);
+    throw torrent::storage_error("failed to stat session log segment : " + path + " : " + std::strerror(errno));
+  }
+
+  uint64_t file_size = st.st_size;
+  uint64_t offset    = 0;
+
+  std::string payload;
+  record_data record;
+
+  while (file_size - offset >= header_size) {
+    char header[header_size];
+
+    if (!read_full(fd, header, header_size, offset) || get_u32(header) != record_magic)
+      break;
+
+    uint32_t payload_size = get_u32(header + 4);
+
+    if (payload_size > file_size - offset - header_size)
+      break;
+
+    payload.resize(payload_size);
+
+    if (!read_full(fd, &payload[0], payload_size, offset + header_size))
+      break;
+
+    if (payload_crc(payload.data(), payload_size) != get_u32(header + 8) || !decode_record(payload, &record, true))
+      break;
+
+    update_index_unsafe(record.type, record.hash, location_type{id, offset, header_size + payload_size});
+
+    offset += header_size + payload_size;
+  }
+
+  ::close(fd);
+
+  if (offset != file_size) {
+    if (is_last) {
+      lt_log_print(torrent::LOG_WARN, "Discarding incomplete record at the end of session log : %s : offset:%" PRIu64, path.c_str(), offset);
+
+      if (::truncate(path.c_str(), offset) == -1)
+        throw torrent::storage_error("failed to truncate session log segment : " + path + " : " + std::strerror(errno));
+
+      file_size = offset;
+
+    } else {
+      lt_log_print(torrent::LOG_ERROR, "Corrupt record in session log, ignoring rest of segment : %s : offset:%" PRIu64, path.c_str(), offset);
+    }
+  }
+
+  m_segments[id] = file_size;
+  m_total_size  += file_size;
+  m_segment_count++;
+}
+
+void
+SessionLog::write_buffer_unsafe(const record_buffer& buffer, bool use_fsyncdisk) {
+  if (buffer.records.empty())
+    return;
+
+  if (m_segments.rbegin()->second >= max_segment_size)
+    open_segment_unsafe(m_segments.rbegin()->first + 1, use_fsyncdisk);
+
+  auto& segment = *m_segments.rbegin();
+  auto  base    = segment.second;
+
+  if (!write_full(m_fd, buffer.data.data(), buffer.data.size())) {
+    int error = errno;
+
+    // Don't leave a partial record that would hide later appends.
+    if (::ftruncate(m_fd, base) == -1)
+      LT_LOG("failed to truncate partial write : path:%s", segment_path(segment.first).c_str());
+
+    throw torrent::storage_error("failed to write session log : " + segment_path(segment.first) + " : " + std::strerror(error));
+  }
+
+  segment.second += buffer.data.size();
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_total_size += buffer.data.size();
+
+    for (const auto& record : buffer.records)
+      update_index_unsafe(record.type, record.hash, location_type{segment.first, base + record.offset, record.size});
+  }
+
+  if (use_fsyncdisk && sync_fd(m_fd) == -1)
+    throw torrent::storage_error("failed to sync session log : " + segment_path(segment.first) + " : " + std::strerror(errno));
+}
+
+bool
+SessionLog::read_record_unsafe(const location_type& location, record_data* record) {
+  if (location.size < header_size)
+    return false;
+
+  if (m_read_fd == -1 || m_read_segment != location.segment) {
+    close_read_fd_unsafe();
+
+    m_read_fd = ::open(segment_path(location.segment).c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (m_read_fd == -1)
+      return false;
+
+    m_read_segment = location.segment;
+  }
+
+  std::string data(location.size, '\0');
+
+  if (!read_full(m_read_fd, &data[0], data.size(), location.offset))
+    return false;
+
+  if (get_u32(data.data()) != record_magic || get_u32(data.data() + 4) != location.size - header_size)
+    return false;
+
+  std::string payload = data.substr(header_size);
+
+  if (payload_crc(payload.data(), payload.size()) != get_u32(data.data() + 8))
+    return false;
+
+  return decode_record(payload, record, false);
+}
+
+void
+SessionLog::update_index_unsafe(uint8_t type, const std::string& hash, const location_type& location) {
+  auto itr = m_index.find(hash);
+
+  if (itr != m_index.end())
+    m_live_size -= entry_size(itr->second);
+
+  switch (type) {
+  case record_full:
+    itr = m_index.emplace(hash, index_entry()).first;
+    itr->second.torrent = location;
+    itr->second.resume  = location;
+    break;
+
+  case record_resume:
+    itr = m_index.emplace(hash, index_entry()).first;
+    itr->second.resume = location;
+    break;
+
+  case record_remove:
+    if (itr != m_index.end())
+      m_index.erase(itr);
+
+    return;
+
+  default:
+    throw torrent::internal_error("SessionLog::update_index_unsafe() invalid record type.");
+  }
+
+  m_live_size += entry_size(itr->second);
+}
+
+void
+SessionLog::close_read_fd_unsafe() {
+  if (m_read_fd != -1)
+    ::close(m_read_fd);
+
+  m_read_fd      = -1;
+  m_read_segment = 0;
+}
+
+} // namespace session
@@ -0,0 +1,158 @@
+#ifndef RTORRENT_SESSION_SESSION_LOG_H
+#define RTORRENT_SESSION_SESSION_LOG_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace session {
+
+struct SaveRequest;
+
+// Append-only session store, used instead of three files per download
+// when 'session.format' is set to 'log'.
+//
+// Records are appended to numbered segment files in the session
+// directory. Each record has a checksum, so a torn write at the end of
+// the log is detected and discarded when the log is opened. Replaying
+// the segments in order rebuilds an index of the latest torrent and
+// resume record of each download.
+//
+// Compaction appends a copy of every live record to new segments, then
+// unlinks the old segments in ascending order. The log stays valid if
+// interrupted at any point, as the copies are newer than anything in
+// the segments they replace.
+//
+// All public methods are thread-safe. Writes are serialized by
+// m_write_mutex, while the index is protected by m_mutex so lookups
+// don't wait for an fdatasync to finish.
+
+class SessionLog {
+public:
+  struct entry_type {
+    std::string torrent;
+    std::string rtorrent;
+    std::string libtorrent_resume;
+  };
+
+  constexpr static uint32_t record_magic        = 0x4c535452;
+  constexpr static uint32_t header_size         = 12;
+
+  constexpr static uint64_t max_segment_size    = uint64_t(64) << 20;
+  constexpr static uint64_t min_compaction_size = uint64_t(16) << 20;
+  constexpr static size_t   compaction_chunk    = size_t(4) << 20;
+
+  SessionLog(const std::string& path);
+  ~SessionLog();
+
+  bool                is_open();
+
+  // True if the log had no entries when opened, e.g. when switching
+  // an existing session directory to the log format.
+  bool                is_new();
+
+  void                open();
+  void                close();
+
+  uint64_t            total_size();
+  uint64_t            live_size();
+  size_t              segment_count();
+
+  bool                has_torrent(const std::string& hash);
+
+  // Hashes of all downloads with torrent data, in sorted order.
+  std::vector<std::string> torrent_hashes();
+
+  bool                read_entry(const std::string& hash, entry_type* entry);
+
+  // Appends the requests and commits them with a single fdatasync.
+  void                append_batch(const std::vector<SaveRequest>& requests, bool use_fsyncdisk);
+  void                append_remove(const std::string& hash);
+
+  bool                needs_compaction();
+  void                compact(bool use_fsyncdisk);
+
+private:
+  enum record_type : uint8_t {
+    record_full   = 1,
+    record_resume = 2,
+    record_remove = 3
+  };
+
+  struct location_type {
+    uint32_t segment{};
+    uint64_t offset{};
+    uint32_t size{};
+  };
+
+  struct index_entry {
+    location_type torrent;
+    location_type resume;
+  };
+
+  struct record_data {
+    uint8_t     type{};
+    std::string hash;
+    std::string torrent;
+    std::string rtorrent;
+    std::string libtorrent_resume;
+  };
+
+  struct record_buffer {
+    struct record {
+      uint8_t     type;
+      std::string hash;
+      uint64_t    offset;
+      uint32_t    size;
+    };
+
+    std::string         data;
+    std::vector<record> records;
+  };
+
+  static void         encode_record(record_buffer* buffer, uint8_t type, const std::string& hash,
+                                    const std::string& torrent, const std::string& rtorrent, const std::string& libtorrent_resume);
+  static bool         decode_record(const std::string& payload, record_data* record, bool headers_only);
+
+  static uint64_t     entry_size(const index_entry& entry);
+
+  std::string         segment_path(uint32_t id) const;
+
+  // Require m_write_mutex.
+  void                open_segment_unsafe(uint32_t id, bool sync_previous);
+  void                replay_segment_unsafe(uint32_t id, bool is_last);
+  void                write_buffer_unsafe(const record_buffer& buffer, bool use_fsyncdisk);
+
+  // Require m_mutex.
+  bool                read_record_unsafe(const location_type& location, record_data* record);
+  void                update_index_unsafe(uint8_t type, const std::string& hash, const location_type& location);
+  void                close_read_fd_unsafe();
+
+  std::string                  m_path;
+  bool                         m_new{};
+
+  std::mutex                   m_write_mutex;
+  int                          m_fd{-1};
+
+  // Segment id to size, the last segment is the one being appended to.
+  std::map<uint32_t, uint64_t> m_segments;
+
+  std::mutex                   m_mutex;
+  bool                         m_open{};
+
+  int                          m_read_fd{-1};
+  uint32_t                     m_read_segment{};
+
+  uint64_t                     m_total_size{};
+  uint64_t                     m_live_size{};
+  size_t                       m_segment_count{};
+
+  std::unordered_map<std::string, index_entry> m_index;
+};
+
+} // namespace session
+
+#endif // RTORRENT_SESSION_SESSION_LOG_H
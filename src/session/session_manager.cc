@@ -2,15 +2,21 @@
 
 #include "session/session_manager.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cinttypes>
 #include <cstdlib>
+#include <utility>
 #include <torrent/exceptions.h>
 #include <torrent/system/callbacks.h>
 #include <torrent/utils/log.h>
 
 #include "globals.h"
+#include "core/download.h"
 #include "session/download_storer.h"
+#include "session/session_log.h"
 #include "utils/lockfile.h"
+#include "utils/loop_stats.h"
 
 #define LT_LOG(log_fmt, ...)                                            \
   lt_log_print(torrent::LOG_SESSION_EVENTS, "session-events: " log_fmt, __VA_ARGS__);
@@ -28,7 +34,17 @@ SessionManager::SessionManager(torrent::system::Thread* thread)
     m_lockfile(std::make_unique<utils::Lockfile>()) {
 }
 
-SessionManager::~SessionManager() = default;
+SessionManager::~SessionManager() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  if (!m_workers.empty())
+    stop_workers(lock);
+
+  FinishedSave* finished = m_finished_saves.exchange(nullptr);
+
+  while (finished != nullptr)
+    delete std::exchange(finished, finished->next);
+}
 
 void
 SessionManager::set_path(std::string path) {
@@ -65,6 +81,90 @@ SessionManager::set_use_lock(bool use_lock) {
   m_use_lock = use_lock;
 }
 
+std::string
+SessionManager::format_name() const {
+  switch (m_format) {
+  case format_log: return "log";
+  default:         return "files";
+  }
+}
+
+void
+SessionManager::set_format(const std::string& name) {
+  assert(torrent::this_thread::thread() == torrent::main_thread::thread());
+
+  if (m_freeze_info)
+    throw torrent::input_error("Session format cannot be changed after startup.");
+
+  if (name == "files")
+    m_format = format_files;
+  else if (name == "log")
+    m_format = format_log;
+  else
+    throw torrent::input_error("Unknown session format: " + name);
+}
+
+void
+SessionManager::set_save_workers(int workers) {
+  assert(torrent::this_thread::thread() == torrent::main_thread::thread());
+
+  if (m_freeze_info)
+    throw torrent::input_error("Session save workers cannot be changed after startup.");
+
+  if (workers < 1 || workers > max_save_workers)
+    throw torrent::input_error("Session save workers must be between 1 and " + std::to_string(max_save_workers) + ".");
+
+  m_save_workers = workers;
+}
+
+int64_t
+SessionManager::save_queue_size() {
+  assert(torrent::this_thread::thread() == torrent::main_thread::thread());
+
+  std::unique_lock<std::mutex> lock(m_pending_builds_mutex);
+
+  return m_pending_builds.size() + m_save_request_counter;
+}
+
+int64_t
+SessionManager::save_count() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  return m_save_count;
+}
+
+int64_t
+SessionManager::save_rate() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  int64_t now   = std::chrono::duration_cast<std::chrono::seconds>(clock_type::now().time_since_epoch()).count();
+  int64_t saves = 0;
+
+  for (auto& bucket : m_save_rate_buckets)
+    if (now - bucket.first < save_rate_seconds)
+      saves += bucket.second;
+
+  return saves / save_rate_seconds;
+}
+
+int64_t
+SessionManager::save_latency_p99() {
+  std::vector<std::chrono::microseconds> latencies;
+
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    latencies = m_save_latencies;
+  }
+
+  if (latencies.empty())
+    return 0;
+
+  auto p99 = latencies.begin() + (latencies.size() * 99) / 100;
+  std::nth_element(latencies.begin(), p99, latencies.end());
+
+  return p99->count();
+}
+
 void
 SessionManager::save_resume_download(core::Download* download) {
   assert(torrent::this_thread::thread() == torrent::main_thread::thread());
@@ -79,13 +179,13 @@ SessionManager::save_resume_download(core::Download* download) {
     if (!m_active)
       throw torrent::internal_error("SessionManager::save_resume_download() called while not active.");
 
-    if (std::find(m_pending_builds.begin(), m_pending_builds.end(), download) != m_pending_builds.end()) {
+    if (m_pending_builds.contains(download)) {
       // TODO: Do we need to make sure we're getting processed?
       LT_LOG("download already in pending build of resume save : download:%p", download);
       return;
     }
 
-    m_pending_builds.push_back(download);
+    m_pending_builds.push_back(download, download);
 
     callback_pending_builds();
 
@@ -93,6 +193,21 @@ SessionManager::save_resume_download(core::Download* download) {
   }
 }
 
+void
+SessionManager::save_changed_download(core::Download* download, bool save_all) {
+  assert(torrent::this_thread::thread() == torrent::main_thread::thread());
+
+  if (m_path.empty())
+    return;
+
+  if (!save_all && !download->is_session_dirty()) {
+    m_save_skipped_count++;
+    return;
+  }
+
+  save_resume_download(download);
+}
+
 void
 SessionManager::save_full_download(core::Download* download) {
   assert(torrent::this_thread::thread() == torrent::main_thread::thread());
@@ -102,14 +217,17 @@ SessionManager::save_full_download(core::Download* download) {
 
   DownloadStorer storer(download);
 
+  download->refresh_changes();
   storer.build_full_streams();
 
   auto save_request = SaveRequest{
     download,
     storer.build_path(m_path),
+    storer.build_hash(),
     storer.torrent_stream(),
     storer.rtorrent_stream(),
-    storer.libtorrent_stream()
+    storer.libtorrent_stream(),
+    download->change_generation()
   };
 
   {
@@ -125,13 +243,13 @@ SessionManager::save_full_download(core::Download* download) {
       return;
     }
 
-    m_save_requests.push_back(std::move(save_request));
+    m_save_requests.push_back(download, std::move(save_request));
     m_save_request_counter = m_save_requests.size();
 
     LT_LOG("queued new full save request : download:%p", download);
   }
 
-  callback_save_request();
+  m_request_condition.notify_one();
 }
 
 void
@@ -149,7 +267,16 @@ SessionManager::remove_download(core::Download* download) {
   if (remove_completely_unsafe(download, lock))
     LT_LOG("canceled pending save request : download:%p", download);
 
-  DownloadStorer(download).unlink_files(m_path);
+  m_saved_generations.erase(download);
+
+  DownloadStorer storer(download);
+
+  if (m_log != nullptr)
+    m_log->append_remove(storer.build_hash());
+
+  // Also used with the log format, to clean up files left from before
+  // switching formats.
+  storer.unlink_files(m_path);
 
   LT_LOG("removed session files : download:%p", download);
 }
@@ -185,6 +312,18 @@ SessionManager::start() {
 
     LT_LOG("locked session directory: %s", m_path.c_str());
   }
+
+  if (m_format == format_log) {
+    m_log = std::make_unique<SessionLog>(m_path);
+
+    try {
+      m_log->open();
+    } catch (torrent::storage_error& e) {
+      throw torrent::input_error("Could not open session log: " + std::string(e.what()));
+    }
+  }
+
+  start_workers_unsafe();
 }
 
 void
@@ -214,6 +353,9 @@ SessionManager::cleanup() {
 
   flush_all_and_wait_unsafe(lock);
 
+  if (m_log != nullptr)
+    m_log->close();
+
   if (m_use_lock) {
     if (!m_lockfile->unlock())
       LT_LOG("could not unlock session directory: %s", m_path.c_str());
@@ -240,28 +382,32 @@ SessionManager::callback_pending_builds() {
 }
 
 void
-SessionManager::callback_save_request() {
-  if (m_save_request_counter == 0)
+SessionManager::callback_finished_saves() {
+  if (m_callback_scheduled_process_finished_saves.exchange(true))
     return;
 
-  if (m_processing_save_counter >= max_concurrent_processing)
-    return;
+  session_thread::callback(m_callback_id, [this]() {
+      process_finished_saves();
+    });
+}
 
-  if (m_callback_scheduled_process_saves_request.exchange(true))
+void
+SessionManager::callback_saved_generations() {
+  if (m_callback_scheduled_saved_generations.exchange(true))
     return;
 
-  session_thread::callback(m_callback_id, [this]() {
-      process_save_request();
+  torrent::main_thread::callback(m_callback_id, [this]() {
+      process_saved_generations();
     });
 }
 
 void
-SessionManager::callback_finished_saves() {
-  if (m_callback_scheduled_process_finished_saves.exchange(true))
+SessionManager::callback_compact_log() {
+  if (m_callback_scheduled_compact_log.exchange(true))
     return;
 
   session_thread::callback(m_callback_id, [this]() {
-      process_finished_saves();
+      process_compact_log();
     });
 }
 
@@ -269,6 +415,8 @@ void
 SessionManager::process_pending_builds(bool is_flushing) {
   assert(torrent::this_thread::thread() == torrent::main_thread::thread());
 
+  utils::LoopTimer timer(&loop_stats, utils::LoopStats::SESSION_BUILD, is_flushing ? "flush" : "pending");
+
   std::vector<SaveRequest> requests;
 
   // Only main thread is allowed to process pending builds or remove downloads, as such it is safe
@@ -282,21 +430,29 @@ SessionManager::process_pending_builds(bool is_flushing) {
       if (!is_flushing && m_save_request_counter + requests.size() >= max_concurrent_requests)
         break;
 
-      auto* download = m_pending_builds.front();
-      m_pending_builds.pop_front();
+      auto* download = m_pending_builds.pop_front();
 
       LT_LOG("processing pending resume save : download:%p", download);
 
       DownloadStorer storer(download);
 
-      storer.build_resume_streams();
+      download->refresh_changes();
+
+      // The log needs the torrent data in at least one record, which is
+      // missing for downloads loaded from session files.
+      if (m_log != nullptr && !m_log->has_torrent(storer.build_hash()))
+        storer.build_full_streams();
+      else
+        storer.build_resume_streams();
 
       auto save_request = SaveRequest{
         download,
         storer.build_path(m_path),
-        nullptr,
+        storer.build_hash(),
+        storer.torrent_stream(),
         storer.rtorrent_stream(),
-        storer.libtorrent_stream()
+        storer.libtorrent_stream(),
+        download->change_generation()
       };
 
       requests.push_back(std::move(save_request));
@@ -318,128 +474,273 @@ SessionManager::process_pending_builds(bool is_flushing) {
         continue;
       }
 
-      m_save_requests.push_back(std::move(save_request));
-      m_save_request_counter = m_save_requests.size();
-
       LT_LOG("queued new resume save request : download:%p", save_request.download);
+
+      m_save_requests.push_back(save_request.download, std::move(save_request));
+      m_save_request_counter = m_save_requests.size();
     }
   }
 
-  if (!is_flushing)
-    callback_save_request();
+  m_request_condition.notify_all();
 }
 
 void
-SessionManager::process_save_request() {
+SessionManager::process_finished_saves() {
   assert(m_thread == torrent::this_thread::thread());
 
-  if (m_path.empty())
-    throw torrent::internal_error("SessionManager::process_save_request() called with empty path.");
+  m_callback_scheduled_process_finished_saves = false;
 
   {
     std::unique_lock<std::mutex> lock(m_mutex);
 
-    m_callback_scheduled_process_saves_request = false;
-
     if (!m_active)
-      throw torrent::internal_error("SessionManager::process_save_request() called while not active.");
+      throw torrent::internal_error("SessionManager::process_finished_saves() called while not active.");
+  }
 
-    while (!m_save_requests.empty()) {
-      if (m_processing_saves.size() >= max_concurrent_processing)
-        break;
+  // The stack is in reverse order of completion.
+  FinishedSave* first = m_finished_saves.exchange(nullptr, std::memory_order_acquire);
+  FinishedSave* reversed = nullptr;
 
-      process_next_save_request_unsafe();
-    }
+  while (first != nullptr) {
+    FinishedSave* next = first->next;
+
+    first->next = reversed;
+    reversed    = first;
+    first       = next;
   }
 
-  callback_pending_builds();
+  while (reversed != nullptr) {
+    std::unique_ptr<FinishedSave> request(reversed);
+    reversed = reversed->next;
+
+    try {
+      if (request->error)
+        std::rethrow_exception(request->error);
+
+    } catch (torrent::storage_error& e) {
+      LT_LOG("error saving download : storage error :download:%p path:%s : %s", request->download, request->path.c_str(), e.what());
+
+      m_save_failed = true;
+
+      if (m_last_storage_error_message + std::chrono::minutes(5) > torrent::this_thread::cached_time()) {
+        m_ignored_storage_error_count++;
+        continue;
+      }
+
+      lt_log_print(torrent::LOG_ERROR, "Storage errors saving session data for download: ignored:%u : %s", m_ignored_storage_error_count, e.what());
+
+      m_last_storage_error_message = torrent::this_thread::cached_time();
+      m_ignored_storage_error_count = 0;
+
+      continue;
+
+    } catch (torrent::internal_error& e) {
+      LT_LOG("error saving download : internal error : download:%p path:%s : %s", request->download, request->path.c_str(), e.what());
+      throw;
+
+    } catch (...) {
+      LT_LOG("error saving download : unknown error : download:%p path:%s", request->download, request->path.c_str());
+      throw;
+    }
+
+    LT_LOG("finished saving download : download:%p path:%s", request->download, request->path.c_str());
+  }
 }
 
 void
-SessionManager::process_next_save_request_unsafe() {
-  auto request = std::move(m_save_requests.front());
+SessionManager::process_saved_generations() {
+  assert(torrent::this_thread::thread() == torrent::main_thread::thread());
 
-  m_save_requests.pop_front();
-  m_save_request_counter = m_save_requests.size();
+  m_callback_scheduled_saved_generations = false;
 
-  auto itr = m_processing_saves.insert(m_processing_saves.end(), ProcessingSave{});
-  m_processing_save_counter = m_processing_saves.size();
+  saved_generation_queue saved;
 
-  itr->second = std::move(request);
-  itr->first = std::async(std::launch::async, [this, itr]() {
-      auto cleanup_fn = [this, itr]() {
-          std::unique_lock<std::mutex> lock(m_mutex);
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::swap(saved, m_saved_generations);
+  }
 
-          callback_finished_saves();
+  for (auto& entry : saved)
+    entry.download->set_session_saved(entry.value);
+}
 
-          m_finished_saves.push_back(std::move(*itr));
-          m_finished_condition.notify_all();
+void
+SessionManager::process_compact_log() {
+  assert(m_thread == torrent::this_thread::thread());
 
-          m_processing_saves.erase(itr);
-          m_processing_save_counter = m_processing_saves.size();
-        };
+  m_callback_scheduled_compact_log = false;
 
-      try {
-        DownloadStorer::save_and_move_streams(itr->second.path, m_use_fsyncdisk,
-                                              itr->second.torrent_stream.get(),
-                                              itr->second.rtorrent_stream.get(),
-                                              itr->second.libtorrent_stream.get());
-      } catch (...) {
-        cleanup_fn();
-        throw;
-      }
+  LT_LOG("compacting session log : size:%" PRIu64 " live:%" PRIu64, m_log->total_size(), m_log->live_size());
 
-      cleanup_fn();
-    });
+  try {
+    m_log->compact(m_use_fsyncdisk);
 
-  LT_LOG("started save of download : download:%p path:%s", itr->second.download, itr->second.path.c_str());
+  } catch (torrent::storage_error& e) {
+    lt_log_print(torrent::LOG_ERROR, "Storage error compacting session log: %s", e.what());
+  }
 }
 
 void
-SessionManager::process_finished_saves() {
-  assert(m_thread == torrent::this_thread::thread());
+SessionManager::start_workers_unsafe() {
+  // The log is appended to by a single worker, which commits all
+  // queued requests as a batch.
+  int workers = m_log != nullptr ? 1 : m_save_workers;
 
-  std::unique_lock<std::mutex> lock(m_mutex);
+  LT_LOG("starting %i session save workers", workers);
 
-  m_callback_scheduled_process_finished_saves = false;
+  m_stopping_workers = false;
+  m_save_latencies.reserve(save_latency_samples);
 
-  if (!m_active)
-    throw torrent::internal_error("SessionManager::process_finished_saves() called while not active.");
+  for (int i = 0; i < workers; i++)
+    m_workers.emplace_back([this]() { worker_loop(); });
+}
 
-  for (auto& request : m_finished_saves) {
-    try {
-      request.first.get();
+void
+SessionManager::stop_workers(std::unique_lock<std::mutex>& lock) {
+  auto workers = std::move(m_workers);
 
-    } catch (torrent::storage_error& e) {
-      LT_LOG("error saving download : storage error :download:%p path:%s : %s", request.second.download, request.second.path.c_str(), e.what());
+  m_stopping_workers = true;
+  m_request_condition.notify_all();
 
-      if (m_last_storage_error_message + std::chrono::minutes(5) > torrent::this_thread::cached_time()) {
-        m_ignored_storage_error_count++;
-        continue;
-      }
+  lock.unlock();
 
-      lt_log_print(torrent::LOG_ERROR, "Storage errors saving session data for download: ignored:%u : %s", m_ignored_storage_error_count, e.what());
+  for (auto& worker : workers)
+    worker.join();
 
-      m_last_storage_error_message = torrent::this_thread::cached_time();
-      m_ignored_storage_error_count = 0;
+  lock.lock();
+
+  LT_LOG("stopped %zu session save workers", workers.size());
+}
+
+// Workers only exit once the queue is empty, so stopping them also
+// flushes any remaining save requests.
+void
+SessionManager::worker_loop() {
+  std::unique_lock<std::mutex> lock(m_mutex);
 
+  size_t                   batch_size = m_log != nullptr ? max_log_batch : 1;
+  std::vector<SaveRequest> batch;
+
+  while (true) {
+    SaveRequest request{};
+
+    while (batch.size() < batch_size && pop_save_request_unsafe(&request)) {
+      m_processing_downloads.push_back(request.download);
+      batch.push_back(std::move(request));
+    }
+
+    if (batch.empty()) {
+      if (m_stopping_workers)
+        return;
+
+      m_request_condition.wait(lock);
       continue;
+    }
 
-    } catch (torrent::internal_error& e) {
-      LT_LOG("error saving download : internal error : download:%p path:%s : %s", request.second.download, request.second.path.c_str(), e.what());
-      throw;
+    lock.unlock();
+
+    callback_pending_builds();
 
+    std::exception_ptr error;
+    auto started = clock_type::now();
+
+    try {
+      if (m_log != nullptr)
+        m_log->append_batch(batch, m_use_fsyncdisk);
+      else
+        DownloadStorer::save_and_move_streams(batch.front().path, m_use_fsyncdisk,
+                                              batch.front().torrent_stream.get(),
+                                              batch.front().rtorrent_stream.get(),
+                                              batch.front().libtorrent_stream.get());
     } catch (...) {
-      LT_LOG("error saving download : unknown error : download:%p path:%s", request.second.download, request.second.path.c_str());
-      throw;
+      error = std::current_exception();
+    }
+
+    auto finished_time = clock_type::now();
+
+    for (auto& saved : batch)
+      push_finished_save(new FinishedSave{saved.download, saved.path, error});
+
+    callback_finished_saves();
+
+    if (m_log != nullptr && m_log->needs_compaction())
+      callback_compact_log();
+
+    lock.lock();
+
+    // Added before the downloads stop being processed, so
+    // remove_download() sees them once it is done waiting.
+    if (!error) {
+      for (auto& saved : batch)
+        push_saved_generation(&m_saved_generations, saved.download, saved.generation);
+
+      callback_saved_generations();
     }
 
-    LT_LOG("finished saving download : download:%p path:%s", request.second.download, request.second.path.c_str());
+    for (auto& saved : batch)
+      m_processing_downloads.erase(std::find(m_processing_downloads.begin(), m_processing_downloads.end(), saved.download));
+
+    record_save_unsafe(finished_time, std::chrono::duration_cast<std::chrono::microseconds>(finished_time - started), batch.size());
+
+    batch.clear();
+
+    m_finished_condition.notify_all();
+
+    // A request for the same download might have been skipped while
+    // this one was being saved.
+    m_request_condition.notify_one();
   }
+}
+
+// Skips requests for downloads that are currently being saved by
+// another worker, so the same files are never written concurrently.
+bool
+SessionManager::pop_save_request_unsafe(SaveRequest* request) {
+  auto itr = std::find_if(m_save_requests.begin(), m_save_requests.end(), [this](auto& entry) {
+      return std::find(m_processing_downloads.begin(), m_processing_downloads.end(), entry.download) == m_processing_downloads.end();
+    });
+
+  if (itr == m_save_requests.end())
+    return false;
+
+  *request = std::move(itr->value);
+
+  m_save_requests.erase(itr);
+  m_save_request_counter = m_save_requests.size();
+
+  return true;
+}
+
+void
+SessionManager::push_finished_save(FinishedSave* finished) {
+  finished->next = m_finished_saves.load(std::memory_order_relaxed);
 
-  m_finished_saves.clear();
+  while (!m_finished_saves.compare_exchange_weak(finished->next, finished, std::memory_order_release, std::memory_order_relaxed))
+    ; // Retry with the updated head.
+}
+
+void
+SessionManager::record_save_unsafe(clock_type::time_point finished, std::chrono::microseconds latency, size_t count) {
+  m_save_count += count;
+
+  // The latency is sampled once per write, as the saves committed
+  // together by a batch share it and would otherwise crowd out the
+  // samples of single saves.
+
+  if (m_save_latencies.size() < save_latency_samples)
+    m_save_latencies.push_back(latency);
+  else
+    m_save_latencies[m_save_latency_index] = latency;
+
+  m_save_latency_index = (m_save_latency_index + 1) % save_latency_samples;
 
-  callback_save_request();
+  int64_t second = std::chrono::duration_cast<std::chrono::seconds>(finished.time_since_epoch()).count();
+  auto&   bucket = m_save_rate_buckets[second % save_rate_seconds];
+
+  if (bucket.first != second)
+    bucket = {second, 0};
+
+  bucket.second += count;
 }
 
 void
@@ -448,22 +749,24 @@ SessionManager::flush_all_and_wait_unsafe(std::unique_lock<std::mutex>& lock) {
 
   // Caller already ensured pending builds are empty.
 
-  while (!m_save_requests.empty()) {
-    if (m_processing_save_counter >= max_cleanup_processing) {
-      m_finished_condition.wait(lock);
-      continue;
-    }
+  m_request_condition.notify_all();
 
-    process_next_save_request_unsafe();
-  }
-
-  while (!m_processing_saves.empty())
+  while (!m_save_requests.empty() || !m_processing_downloads.empty())
     m_finished_condition.wait(lock);
 
-  for (auto& request : m_finished_saves)
-    LT_LOG("finished saving download : download:%p path:%s", request.second.download, request.second.path.c_str());
+  stop_workers(lock);
+
+  FinishedSave* finished = m_finished_saves.exchange(nullptr, std::memory_order_acquire);
 
-  m_finished_saves.clear();
+  while (finished != nullptr) {
+    std::unique_ptr<FinishedSave> request(finished);
+    finished = finished->next;
+
+    if (request->error)
+      LT_LOG("error saving download during flush : download:%p path:%s", request->download, request->path.c_str());
+    else
+      LT_LOG("finished saving download : download:%p path:%s", request->download, request->path.c_str());
+  }
 
   LT_LOG("flushed all pending saves", 0);
 }
@@ -472,11 +775,9 @@ bool
 SessionManager::replace_save_request_unsafe(SaveRequest& save_request) {
   // Can be run in any thread.
 
-  auto itr = std::find_if(m_save_requests.begin(), m_save_requests.end(), [download = save_request.download](auto& req) {
-      return req.download == download;
-    });
+  auto itr = m_save_requests.find(save_request.download);
 
-  if (itr == m_save_requests.end())
+  if (itr == nullptr)
     return false;
 
   if (itr->path != save_request.path)
@@ -502,6 +803,8 @@ SessionManager::replace_save_request_unsafe(SaveRequest& save_request) {
     itr->libtorrent_stream = std::move(save_request.libtorrent_stream);
   }
 
+  itr->generation = save_request.generation;
+
   return true;
 }
 
@@ -512,26 +815,13 @@ SessionManager::remove_completely_unsafe(core::Download* download, std::unique_l
   auto remove_pending = [this, download]() {
     std::unique_lock<std::mutex> pending_lock(m_pending_builds_mutex);
 
-    auto itr = std::remove_if(m_pending_builds.begin(), m_pending_builds.end(), [download](auto* req) {
-        return req == download;
-      });
-
-    if (itr == m_pending_builds.end())
-      return false;
-
-    m_pending_builds.erase(itr, m_pending_builds.end());
-    return true;
+    return m_pending_builds.erase(download);
   };
 
   auto remove_requests = [this, download]() {
-    auto itr = std::remove_if(m_save_requests.begin(), m_save_requests.end(), [download](auto& req) {
-        return req.download == download;
-      });
-
-    if (itr == m_save_requests.end())
+    if (!m_save_requests.erase(download))
       return false;
 
-    m_save_requests.erase(itr, m_save_requests.end());
     m_save_request_counter = m_save_requests.size();
     return true;
   };
@@ -547,16 +837,8 @@ SessionManager::remove_completely_unsafe(core::Download* download, std::unique_l
   }
 
   // This may block for a relatively long time if fdatasync is in use, however this is necessary.
-  while (true) {
-    auto itr = std::find_if(m_processing_saves.begin(), m_processing_saves.end(), [download](auto& req) {
-        return req.second.download == download;
-      });
-
-    if (itr == m_processing_saves.end())
-      break;
-
+  while (std::find(m_processing_downloads.begin(), m_processing_downloads.end(), download) != m_processing_downloads.end())
     m_finished_condition.wait(lock);
-  }
 
   // Since we're the main thread, no more requests for this download can be added.
 
@@ -1,17 +1,22 @@
 #ifndef RTORRENT_SESSION_SESSION_MANAGER_H
 #define RTORRENT_SESSION_SESSION_MANAGER_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
-#include <deque>
-#include <future>
-#include <list>
+#include <exception>
 #include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <torrent/common.h>
 
+#include "session/download_queue.h"
+
 class Control;
 
 namespace core {
@@ -24,25 +29,63 @@ class Lockfile;
 
 namespace session {
 
+class SessionLog;
 class ThreadSession;
 
 struct SaveRequest {
   core::Download*                    download;
   std::string                        path;
+  std::string                        hash;
   std::unique_ptr<std::stringstream> torrent_stream;
   std::unique_ptr<std::stringstream> rtorrent_stream;
   std::unique_ptr<std::stringstream> libtorrent_stream;
+  uint64_t                           generation{};
+};
+
+// Change generations of downloads whose resume data has been written,
+// waiting for the main thread to mark them as saved.
+typedef DownloadQueue<uint64_t> saved_generation_queue;
+
+inline void
+push_saved_generation(saved_generation_queue* queue, core::Download* download, uint64_t generation) {
+  auto saved = queue->find(download);
+
+  if (saved == nullptr)
+    queue->push_back(download, generation);
+  else
+    *saved = std::max(*saved, generation);
+}
+
+// Saves finished by the worker threads, handed to the session thread
+// through a lock-free stack.
+struct FinishedSave {
+  core::Download*    download;
+  std::string        path;
+  std::exception_ptr error;
+  FinishedSave*      next{};
 };
 
 class SessionManager {
 public:
   typedef std::unique_ptr<std::stringstream> stream_ptr;
+  typedef std::chrono::steady_clock          clock_type;
 
-  // TODO: This should depend on max open sockets / be configurable.
+  enum format_type {
+    format_files,
+    format_log
+  };
 
-  constexpr static int max_concurrent_requests   = 16;
-  constexpr static int max_concurrent_processing = 16;
-  constexpr static int max_cleanup_processing    = 64;
+  constexpr static int max_concurrent_requests = 16;
+
+  constexpr static int default_save_workers    = 4;
+  constexpr static int max_save_workers        = 64;
+
+  constexpr static int save_latency_samples    = 1024;
+  constexpr static int save_rate_seconds       = 10;
+
+  // Maximum number of requests committed by a single fdatasync when
+  // using the log format.
+  constexpr static int max_log_batch           = 256;
 
   SessionManager(torrent::system::Thread* thread);
   ~SessionManager();
@@ -58,8 +101,33 @@ public:
   bool                use_lock() const;
   void                set_use_lock(bool use_lock);
 
+  format_type         format() const;
+  std::string         format_name() const;
+  void                set_format(const std::string& name);
+
+  // Only valid after startup when using the log format.
+  SessionLog*         session_log();
+
+  int                 save_workers() const;
+  void                set_save_workers(int workers);
+
+  // Statistics, safe to call from the main thread.
+  int64_t             save_queue_size();
+  int64_t             save_count();
+  int64_t             save_rate();
+  int64_t             save_latency_p99();
+  int64_t             save_skipped_count() const { return m_save_skipped_count; }
+
   void                save_full_download(core::Download* download);
   void                save_resume_download(core::Download* download);
+
+  // Skips downloads that have not changed since their resume data was
+  // last built, unless 'save_all' is set.
+  void                save_changed_download(core::Download* download, bool save_all);
+
+  // Returns true if a save has failed since the last call, in which
+  // case session.save writes all downloads.
+  bool                reset_save_failed() { return m_save_failed.exchange(false); }
   void                remove_download(core::Download* download);
 
 protected:
@@ -75,22 +143,29 @@ protected:
 
 private:
   void                callback_pending_builds();
-  void                callback_save_request();
   void                callback_finished_saves();
+  void                callback_compact_log();
+  void                callback_saved_generations();
 
   void                process_pending_builds(bool is_flushing);
-  void                process_save_request();
-  void                process_next_save_request_unsafe();
   void                process_finished_saves();
+  void                process_saved_generations();
+  void                process_compact_log();
+
+  void                start_workers_unsafe();
+  void                stop_workers(std::unique_lock<std::mutex>& lock);
+  void                worker_loop();
+
+  bool                pop_save_request_unsafe(SaveRequest* request);
+  void                push_finished_save(FinishedSave* finished);
+  void                record_save_unsafe(clock_type::time_point finished, std::chrono::microseconds latency, size_t count);
 
-  // Requires a higher number of open sockets, and should only be used during shutdown.
+  // Only used during shutdown, waits for the workers to finish all queued saves.
   void                flush_all_and_wait_unsafe(std::unique_lock<std::mutex>& lock);
 
   bool                replace_save_request_unsafe(SaveRequest& download);
   bool                remove_completely_unsafe(core::Download* download, std::unique_lock<std::mutex>& lock);
 
-  using ProcessingSave = std::pair<std::future<void>, SaveRequest>;
-
   torrent::system::Thread*     m_thread;
   torrent::system::callback_id m_callback_id;
 
@@ -98,21 +173,45 @@ private:
   std::string                  m_path;
   bool                         m_use_fsyncdisk{true};
   bool                         m_use_lock{true};
+  int                          m_save_workers{default_save_workers};
+  format_type                  m_format{format_files};
+
+  std::unique_ptr<SessionLog>  m_log;
 
   align_cacheline std::mutex   m_mutex;
 
   bool                         m_active{};
+  bool                         m_stopping_workers{};
+
+  std::vector<std::thread>     m_workers;
+  std::condition_variable      m_request_condition;
 
-  std::deque<SaveRequest>      m_save_requests;
+  DownloadQueue<SaveRequest>   m_save_requests;
   std::atomic<size_t>          m_save_request_counter{};
-  std::list<ProcessingSave>    m_processing_saves;
-  std::atomic<size_t>          m_processing_save_counter{};
+  std::vector<core::Download*> m_processing_downloads;
   std::condition_variable      m_finished_condition;
-  std::vector<ProcessingSave>  m_finished_saves;
+
+  // Downloads are removed from the queue by remove_download(), so the
+  // main thread only sees downloads that still exist.
+  saved_generation_queue       m_saved_generations;
+
+  align_cacheline std::atomic<FinishedSave*> m_finished_saves{};
+
+  // Save statistics, protected by m_mutex.
+  uint64_t                     m_save_count{};
+  unsigned int                 m_save_latency_index{};
+  std::vector<std::chrono::microseconds> m_save_latencies;
+  std::array<std::pair<int64_t, unsigned int>, save_rate_seconds> m_save_rate_buckets{};
+
+  // Only used by the main thread.
+  uint64_t                     m_save_skipped_count{};
+
+  std::atomic<bool>            m_save_failed{};
 
   std::atomic<bool>            m_callback_scheduled_process_pending_builds{};
-  std::atomic<bool>            m_callback_scheduled_process_saves_request{};
   std::atomic<bool>            m_callback_scheduled_process_finished_saves{};
+  std::atomic<bool>            m_callback_scheduled_compact_log{};
+  std::atomic<bool>            m_callback_scheduled_saved_generations{};
 
   std::unique_ptr<utils::Lockfile> m_lockfile;
 
@@ -121,15 +220,19 @@ private:
 
   // Pending builds are only ever locked by main thread.
   std::mutex                   m_pending_builds_mutex;
-  std::deque<core::Download*>  m_pending_builds;
+  DownloadQueue<core::Download*> m_pending_builds;
 };
 
 inline bool        SessionManager::is_used() const            { return !m_path.empty(); }
 inline std::string SessionManager::path() const               { return m_path; }
 inline bool        SessionManager::use_fsyncdisk() const      { return true; }
 inline bool        SessionManager::use_lock() const           { return m_use_lock; }
+inline int         SessionManager::save_workers() const       { return m_save_workers; }
+inline SessionLog* SessionManager::session_log()              { return m_log.get(); }
 inline void        SessionManager::flush_all_pending_builds() { process_pending_builds(true); }
 
+inline SessionManager::format_type SessionManager::format() const { return m_format; }
+
 } // namespace session
 
 #endif // RTORRENT_SESSION_SESSION_MANAGER_H
@@ -13,7 +13,9 @@
 #include "option_parser.h"
 #include "core/download_factory.h"
 #include "rpc/parse_commands.h"
-#include "session/download_storer.h"
+#include "session/session_loader.h"
+#include "session/session_log.h"
+#include "session/session_manager.h"
 #include "utils/directory.h"
 
 void do_panic(int signum);
@@ -147,24 +149,25 @@ parse_config_file_comments(const std::string& path) {
 //
 
 void
-load_session_torrents(const std::string& path) {
-  auto entries = session::DownloadStorer::get_formated_entries(path);
-
-  for (const auto& entry : entries) {
-    // We don't really support session torrents that are links. These
-    // would be overwritten anyway on exit, and thus not really be
-    // useful.
-    if (!entry.is_file())
-      continue;
+load_session_torrents(const std::string& path, std::function<void ()> slot_finished) {
+  auto* session_log = session_thread::manager()->session_log();
 
-    auto* f = new core::DownloadFactory(control->core());
+  // A new log is filled from the session files, if any, as the
+  // downloads are saved.
+  if (session_log != nullptr && session_log->is_new())
+    session_log = nullptr;
 
-    f->set_session(true);
-    f->set_init_load(true);
-    f->slot_finished([f](){ delete f; });
-    f->load(entries.path() + entry.s_name);
-    f->commit();
-  }
+  auto* loader = new session::SessionLoader(control->core());
+
+  control->set_session_loader(loader);
+
+  loader->slot_finished([slot_finished = std::move(slot_finished)]() {
+      control->set_session_loader(nullptr);
+
+      if (slot_finished)
+        slot_finished();
+    });
+  loader->start(path, session_log);
 }
 
 void
@@ -8,7 +8,9 @@ int  parse_main_options(int argc, char** argv);
 void parse_config_file(int argc, char** argv, std::function<void (const std::string&)> parse_fn);
 void parse_config_file_comments(const std::string& path);
 
-void load_session_torrents(const std::string& path);
+// Session torrents are loaded in the background, slot_finished is
+// called once all have been inserted.
+void load_session_torrents(const std::string& path, std::function<void ()> slot_finished);
 void load_arg_torrents(char** first, char** last);
 
 static constexpr int log_flag_use_gz      = 0x1;
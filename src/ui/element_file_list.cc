@@ -76,7 +76,7 @@ ElementFileList::activate(display::Frame* frame, bool focus) {
 
   m_elementInfo = element_file_list_create_info();
   m_elementInfo->slot_exit(std::bind(&ElementFileList::activate_display, this, DISPLAY_LIST));
-  m_elementInfo->set_target(rpc::make_target(&m_selected));
+  m_elementInfo->set_target(rpc::make_target(rpc::command_base::target_file_itr, &m_selected, m_download));
 
   m_frame = frame;
 
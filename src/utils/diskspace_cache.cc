@@ -0,0 +1,181 @@
+#include "config.h"
+
+#include "utils/diskspace_cache.h"
+
+#include <set>
+#include <utility>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <torrent/exceptions.h>
+#include <torrent/system/callbacks.h>
+#include <torrent/system/thread.h>
+#include <torrent/utils/log.h>
+
+#include "globals.h"
+
+namespace utils {
+
+DiskspaceCache::DiskspaceCache() :
+    m_callback_id(torrent::system::make_callback_id()),
+    m_slot_refresh([this](std::function<void ()>&& fn) { session_thread::callback(m_callback_id, std::move(fn)); }) {
+}
+
+DiskspaceCache::~DiskspaceCache() = default;
+
+void
+DiskspaceCache::set_ttl(std::chrono::seconds ttl) {
+  if (ttl < std::chrono::seconds(1) || ttl > std::chrono::hours(1))
+    throw torrent::input_error("Diskspace cache ttl must be between 1 and 3600 seconds.");
+
+  m_ttl = ttl;
+}
+
+bool
+DiskspaceCache::statvfs_free(const std::string& path, uint64_t* free) {
+  struct statvfs stat;
+
+  if (::statvfs(path.c_str(), &stat) != 0)
+    return false;
+
+  *free = (uint64_t)stat.f_bavail * (uint64_t)stat.f_frsize;
+  return true;
+}
+
+bool
+DiskspaceCache::lookup(const std::string& path, dev_t* device, uint64_t* free) {
+  auto path_itr = m_paths.find(path);
+
+  if (path_itr == m_paths.end()) {
+    struct stat stat;
+
+    if (::stat(path.c_str(), &stat) != 0)
+      return false;
+
+    path_itr = m_paths.emplace(path, path_type{stat.st_dev, m_refresh_count}).first;
+  }
+
+  path_itr->second.last_used = m_refresh_count;
+
+  auto device_itr = m_devices.find(path_itr->second.device);
+
+  // New filesystems are stat'ed immediately so the first lookup of a
+  // download doesn't return stale or missing values.
+  if (device_itr == m_devices.end()) {
+    uint64_t device_free;
+
+    if (!statvfs_free(path, &device_free)) {
+      m_paths.erase(path_itr);
+      return false;
+    }
+
+    device_itr = m_devices.emplace(path_itr->second.device, device_type{path_itr->second.device, path, device_free}).first;
+  }
+
+  *device = device_itr->second.device;
+  *free   = device_itr->second.free;
+
+  refresh_if_expired();
+  return true;
+}
+
+bool
+DiskspaceCache::lookup_lowest(const std::vector<std::string>& paths, dev_t* device, uint64_t* free) {
+  bool found = false;
+
+  for (const auto& path : paths) {
+    dev_t    path_device;
+    uint64_t path_free;
+
+    if (!lookup(path, &path_device, &path_free))
+      continue;
+
+    if (!found || path_free < *free) {
+      *device = path_device;
+      *free   = path_free;
+    }
+
+    found = true;
+  }
+
+  return found;
+}
+
+void
+DiskspaceCache::cleanup() {
+  m_active = false;
+
+  torrent::system::cancel_callback_and_wait(m_callback_id, session_thread::thread(), torrent::main_thread::thread());
+}
+
+void
+DiskspaceCache::refresh_if_expired() {
+  auto now = torrent::this_thread::cached_time();
+
+  if (!m_active || m_refreshing || now < m_updated + m_ttl)
+    return;
+
+  m_refreshing = true;
+  m_updated    = now;
+
+  std::vector<device_type> devices;
+  devices.reserve(m_devices.size());
+
+  for (const auto& [device, entry] : m_devices)
+    devices.push_back(entry);
+
+  m_slot_refresh([this, devices = std::move(devices)]() mutable {
+      std::vector<dev_t> failed;
+
+      for (auto& entry : devices)
+        if (!statvfs_free(entry.path, &entry.free))
+          failed.push_back(entry.device);
+
+      torrent::main_thread::callback(m_callback_id, [this, devices = std::move(devices), failed = std::move(failed)]() mutable {
+          receive_refresh(std::move(devices), std::move(failed));
+        });
+    });
+}
+
+void
+DiskspaceCache::receive_refresh(std::vector<device_type> devices, std::vector<dev_t> failed) {
+  m_refreshing = false;
+  m_refresh_count++;
+
+  for (const auto& entry : devices) {
+    auto itr = m_devices.find(entry.device);
+
+    if (itr != m_devices.end())
+      itr->second.free = entry.free;
+  }
+
+  // Drop filesystems that could not be stat'ed, e.g. when unmounted, and
+  // have their paths looked up again.
+  for (auto device : failed) {
+    lt_log_print(torrent::LOG_DEBUG, "Diskspace cache: could not stat filesystem, dropping device %llu.", (unsigned long long)device);
+    m_devices.erase(device);
+  }
+
+  for (auto itr = m_paths.begin(); itr != m_paths.end();) {
+    if (m_devices.find(itr->second.device) == m_devices.end() ||
+        m_refresh_count - itr->second.last_used > path_expire_refreshes)
+      itr = m_paths.erase(itr);
+    else
+      itr++;
+  }
+
+  // Devices no longer referenced by any path would otherwise keep being
+  // refreshed.
+  std::set<dev_t> used;
+
+  for (const auto& [path, entry] : m_paths)
+    used.insert(entry.device);
+
+  for (auto itr = m_devices.begin(); itr != m_devices.end();) {
+    if (used.find(itr->first) == used.end())
+      itr = m_devices.erase(itr);
+    else
+      itr++;
+  }
+}
+
+}
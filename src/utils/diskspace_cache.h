@@ -0,0 +1,90 @@
+#ifndef RTORRENT_UTILS_DISKSPACE_CACHE_H
+#define RTORRENT_UTILS_DISKSPACE_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <torrent/common.h>
+
+namespace utils {
+
+// Free diskspace per filesystem, keyed by device id, shared by all
+// downloads on the same filesystem.
+//
+// Paths are mapped to devices the first time they are looked up, after
+// which lookups don't make any syscalls on the main thread. Once the
+// free diskspace is older than the ttl it is refreshed on the session
+// thread, with lookups returning the previous value until then.
+
+class DiskspaceCache {
+public:
+  static constexpr auto default_ttl = std::chrono::seconds(10);
+
+  // Paths not looked up for this many refreshes are dropped.
+  static constexpr unsigned int path_expire_refreshes = 6;
+
+  struct device_type {
+    dev_t       device;
+    std::string path;
+    uint64_t    free;
+  };
+
+  typedef std::map<dev_t, device_type>                    device_map;
+  typedef std::function<void (std::function<void ()>&&)> slot_refresh_type;
+
+  DiskspaceCache();
+  ~DiskspaceCache();
+
+  std::chrono::seconds ttl() const                         { return m_ttl; }
+  void                 set_ttl(std::chrono::seconds ttl);
+
+  // Runs the statvfs calls of a refresh, on the session thread unless
+  // replaced, e.g. by tests. The result is received on the main thread.
+  void                 slot_refresh(slot_refresh_type s)   { m_slot_refresh = std::move(s); }
+
+  const device_map&    devices() const                     { return m_devices; }
+  size_t               size_paths() const                  { return m_paths.size(); }
+
+  // Returns false if the path or its filesystem could not be stat'ed.
+  bool                 lookup(const std::string& path, dev_t* device, uint64_t* free);
+
+  // Returns the filesystem with the lowest free diskspace of those
+  // holding the paths, skipping paths that could not be stat'ed. Returns
+  // false if none could.
+  bool                 lookup_lowest(const std::vector<std::string>& paths, dev_t* device, uint64_t* free);
+
+  void                 cleanup();
+
+private:
+  struct path_type {
+    dev_t        device;
+    unsigned int last_used;
+  };
+
+  void                 refresh_if_expired();
+  void                 receive_refresh(std::vector<device_type> devices, std::vector<dev_t> failed);
+
+  static bool          statvfs_free(const std::string& path, uint64_t* free);
+
+  std::chrono::seconds m_ttl{default_ttl};
+
+  std::unordered_map<std::string, path_type> m_paths;
+  device_map                                 m_devices;
+
+  bool                         m_active{true};
+  bool                         m_refreshing{};
+  unsigned int                 m_refresh_count{};
+  std::chrono::microseconds    m_updated{};
+
+  torrent::system::callback_id m_callback_id;
+  slot_refresh_type            m_slot_refresh;
+};
+
+}
+
+#endif
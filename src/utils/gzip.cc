@@ -7,19 +7,27 @@
 
 namespace utils {
 
-void
-gzip_compress_to_vector(const char* buffer, unsigned int length, std::vector<char>& output, unsigned int offset) {
-  z_stream zs{};
-  zs.zalloc = Z_NULL;
-  zs.zfree  = Z_NULL;
-  zs.opaque = Z_NULL;
+static void
+gzip_deflate_init(z_stream* zs, int level) {
+  zs->zalloc = Z_NULL;
+  zs->zfree  = Z_NULL;
+  zs->opaque = Z_NULL;
 
   constexpr int window_bits   = 15;
   constexpr int gzip_encoding = 16;
-  constexpr int gzip_level    = 6;
+  constexpr int memory_level  = 8;
 
-  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits | gzip_encoding, gzip_level, Z_DEFAULT_STRATEGY) != Z_OK)
+  if (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION)
+    throw torrent::internal_error("gzip_compress_to_vector(...) invalid compression level.");
+
+  if (deflateInit2(zs, level, Z_DEFLATED, window_bits | gzip_encoding, memory_level, Z_DEFAULT_STRATEGY) != Z_OK)
     throw torrent::internal_error("gzip_compress_to_vector(...) could not initialize gzip deflate.");
+}
+
+void
+gzip_compress_to_vector(const char* buffer, unsigned int length, std::vector<char>& output, unsigned int offset, int level) {
+  z_stream zs{};
+  gzip_deflate_init(&zs, level);
 
   auto max_response_size = deflateBound(&zs, length);
 
@@ -32,10 +40,64 @@ gzip_compress_to_vector(const char* buffer, unsigned int length, std::vector<cha
 
   int ret = deflate(&zs, Z_FINISH);
 
+  deflateEnd(&zs);
+
   if (ret != Z_STREAM_END)
     throw torrent::internal_error("gzip_compress_to_vector(...) deflate did not return Z_STREAM_END: " + std::to_string(ret));
 
   output.resize(offset + max_response_size - zs.avail_out);
 }
 
+void
+gzip_compress_to_vector(const std::vector<struct iovec>& buffers, std::vector<char>& output, int level) {
+  z_stream zs{};
+  gzip_deflate_init(&zs, level);
+
+  uLong length = 0;
+
+  for (const auto& buffer : buffers)
+    length += buffer.iov_len;
+
+  output.resize(deflateBound(&zs, length));
+
+  zs.next_out  = (Bytef*)output.data();
+  zs.avail_out = output.size();
+
+  for (size_t i = 0; i <= buffers.size(); i++) {
+    int flush = i == buffers.size() ? Z_FINISH : Z_NO_FLUSH;
+
+    if (i != buffers.size()) {
+      zs.next_in  = (Bytef*)buffers[i].iov_base;
+      zs.avail_in = buffers[i].iov_len;
+    }
+
+    while (true) {
+      int ret = deflate(&zs, flush);
+
+      if (ret == Z_STREAM_END)
+        break;
+
+      if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        deflateEnd(&zs);
+        throw torrent::internal_error("gzip_compress_to_vector(...) deflate failed: " + std::to_string(ret));
+      }
+
+      if (flush != Z_FINISH && zs.avail_in == 0)
+        break;
+
+      // Only grow if the bound was not sufficient.
+      if (zs.avail_out == 0) {
+        size_t used = output.size();
+
+        output.resize(used * 2);
+        zs.next_out  = (Bytef*)(output.data() + used);
+        zs.avail_out = output.size() - used;
+      }
+    }
+  }
+
+  output.resize(output.size() - zs.avail_out);
+  deflateEnd(&zs);
+}
+
 } // namespace utils
@@ -2,10 +2,18 @@
 #define RTORRENT_UTILS_GZIP_H
 
 #include <functional>
+#include <vector>
+#include <sys/uio.h>
 
 namespace utils {
 
-void gzip_compress_to_vector(const char* buffer, unsigned int length, std::vector<char>& output, unsigned int offset = 0);
+// The level is 0-9, or -1 to use zlib's default.
+constexpr int gzip_default_level = -1;
+
+void gzip_compress_to_vector(const char* buffer, unsigned int length, std::vector<char>& output, unsigned int offset = 0, int level = gzip_default_level);
+
+// Compresses the concatenated buffers as a single gzip stream.
+void gzip_compress_to_vector(const std::vector<struct iovec>& buffers, std::vector<char>& output, int level = gzip_default_level);
 
 } // namespace utils
 
@@ -0,0 +1,108 @@
+#include "config.h"
+
+#include "utils/loop_stats.h"
+
+#include <cinttypes>
+#include <utility>
+#include <torrent/exceptions.h>
+#include <torrent/utils/log.h>
+
+namespace utils {
+
+void
+LoopStats::entry_type::add(const char* name, uint64_t elapsed, bool stalled) {
+  count++;
+  total += elapsed;
+
+  if (stalled)
+    stalls++;
+
+  if (elapsed >= max) {
+    max = elapsed;
+    max_name = name;
+  }
+}
+
+const char*
+LoopStats::category_name(category_type category) {
+  switch (category) {
+  case RPC:           return "rpc";
+  case SCHEDULER:     return "scheduler";
+  case DISPLAY:       return "display";
+  case SESSION_BUILD: return "session_build";
+  case EVENT:         return "event";
+  default:
+    throw torrent::internal_error("LoopStats::category_name(...) invalid category.");
+  }
+}
+
+bool
+LoopStats::uses_name(category_type category, uint64_t elapsed) const {
+  if (category >= CATEGORY_SIZE)
+    throw torrent::internal_error("LoopStats::uses_name(...) invalid category.");
+
+  return category == SCHEDULER || elapsed >= m_categories[category].max || (m_stall_threshold != 0 && elapsed >= m_stall_threshold);
+}
+
+void
+LoopStats::record(category_type category, const char* name, uint64_t elapsed) {
+  if (category >= CATEGORY_SIZE)
+    throw torrent::internal_error("LoopStats::record(...) invalid category.");
+
+  bool stalled = m_stall_threshold != 0 && elapsed >= m_stall_threshold;
+
+  m_categories[category].add(name, elapsed, stalled);
+
+  if (category == SCHEDULER) {
+    auto itr = m_scheduler_keys.find(name);
+
+    if (itr == m_scheduler_keys.end() && m_scheduler_keys.size() < max_keys)
+      itr = m_scheduler_keys.emplace(name, entry_type()).first;
+
+    if (itr != m_scheduler_keys.end())
+      itr->second.add(name, elapsed, stalled);
+  }
+
+  if (!stalled)
+    return;
+
+  m_stalls++;
+
+  lt_log_print(torrent::LOG_WARN, "Main loop stall: %s '%s' took %" PRIu64 " ms.",
+               category_name(category), name, elapsed / 1000);
+}
+
+void
+LoopStats::reset() {
+  for (auto& entry : m_categories)
+    entry = entry_type();
+
+  m_scheduler_keys.clear();
+  m_stalls = 0;
+}
+
+LoopTimer::LoopTimer(LoopStats* stats, LoopStats::category_type category, const char* name) :
+    m_stats(stats),
+    m_category(category),
+    m_name(name),
+    m_start(std::chrono::steady_clock::now()) {
+}
+
+LoopTimer::LoopTimer(LoopStats* stats, LoopStats::category_type category, slot_name name) :
+    m_stats(stats),
+    m_category(category),
+    m_name(""),
+    m_slot_name(std::move(name)),
+    m_start(std::chrono::steady_clock::now()) {
+}
+
+LoopTimer::~LoopTimer() {
+  uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+
+  if (m_slot_name && m_stats->uses_name(m_category, elapsed))
+    m_stats->record(m_category, m_slot_name().c_str(), elapsed);
+  else
+    m_stats->record(m_category, m_name, elapsed);
+}
+
+}
@@ -0,0 +1,104 @@
+#ifndef RTORRENT_UTILS_LOOP_STATS_H
+#define RTORRENT_UTILS_LOOP_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace utils {
+
+// Accounts for the time the main thread spends in the work rtorrent
+// schedules on it, so a stalled event loop can be traced back to the
+// task that held it.
+//
+// Categories are timed inclusively, e.g. events triggered by an RPC
+// call are counted both as events and as part of the RPC call. Only
+// used from the main thread.
+
+class LoopStats {
+public:
+  enum category_type {
+    RPC,
+    SCHEDULER,
+    DISPLAY,
+    SESSION_BUILD,
+    EVENT,
+    CATEGORY_SIZE
+  };
+
+  // All times are in microseconds.
+  struct entry_type {
+    uint64_t    count{};
+    uint64_t    total{};
+    uint64_t    max{};
+    uint64_t    stalls{};
+    std::string max_name;
+
+    void        add(const char* name, uint64_t elapsed, bool stalled);
+  };
+
+  typedef std::map<std::string, entry_type, std::less<>> key_map;
+
+  static constexpr uint64_t default_stall_threshold = 100000;
+
+  // Limits the number of scheduler keys tracked separately, as keys
+  // may be generated by user scripts.
+  static constexpr size_t   max_keys = 1024;
+
+  static const char*  category_name(category_type category);
+
+  const entry_type&   category(category_type category) const { return m_categories[category]; }
+  const key_map&      scheduler_keys() const                 { return m_scheduler_keys; }
+
+  uint64_t            stalls() const { return m_stalls; }
+
+  // Tasks that take longer than the threshold are logged, zero disables
+  // the logging.
+  uint64_t            stall_threshold() const             { return m_stall_threshold; }
+  void                set_stall_threshold(uint64_t usec)  { m_stall_threshold = usec; }
+
+  // Returns true if recording a task of this length keeps or logs its
+  // name, so callers only need to build costly names then.
+  bool                uses_name(category_type category, uint64_t elapsed) const;
+
+  void                record(category_type category, const char* name, uint64_t elapsed);
+  void                reset();
+
+private:
+  entry_type          m_categories[CATEGORY_SIZE];
+  key_map             m_scheduler_keys;
+
+  uint64_t            m_stalls{};
+  uint64_t            m_stall_threshold{default_stall_threshold};
+};
+
+// Records the time from construction to destruction, including when
+// the task throws.
+//
+// The name must outlive the timer. Names that need to be built are
+// passed as a slot, which is only called if the name is used.
+
+class LoopTimer {
+public:
+  typedef std::function<std::string ()> slot_name;
+
+  LoopTimer(LoopStats* stats, LoopStats::category_type category, const char* name);
+  LoopTimer(LoopStats* stats, LoopStats::category_type category, slot_name name);
+  ~LoopTimer();
+
+private:
+  LoopTimer(const LoopTimer&);
+  void operator=(const LoopTimer&);
+
+  LoopStats*                            m_stats;
+  LoopStats::category_type              m_category;
+  const char*                           m_name;
+  slot_name                             m_slot_name;
+  std::chrono::steady_clock::time_point m_start;
+};
+
+}
+
+#endif
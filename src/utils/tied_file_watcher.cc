@@ -0,0 +1,253 @@
+#include "config.h"
+
+#include "utils/tied_file_watcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <torrent/exceptions.h>
+#include <torrent/utils/directory_events.h>
+#include <torrent/utils/file_stat.h>
+#include <torrent/utils/log.h>
+
+#include "control.h"
+#include "globals.h"
+#include "core/download.h"
+#include "core/download_list.h"
+#include "core/manager.h"
+#include "rpc/parse_commands.h"
+
+namespace utils {
+
+TiedFileWatcher::TiedFileWatcher() :
+    m_directory_events(new torrent::directory_events()) {
+}
+
+TiedFileWatcher::~TiedFileWatcher() = default;
+
+void
+TiedFileWatcher::set_action(int action, bool enabled) {
+  int actions = enabled ? (m_actions | action) : (m_actions & ~action);
+
+  if (actions != 0 && m_actions == 0 && m_active) {
+    if (!m_directory_events->open())
+      throw torrent::input_error("Could not open inotify:" + std::string(std::strerror(errno)));
+
+    // The files were not watched until now, so refresh their state
+    // without acting on it.
+    for (auto& [path, file] : m_files)
+      file.exists = torrent::utils::FileStat().update(path);
+
+    for (auto& [directory, entry] : m_directories)
+      watch(directory, &entry);
+  }
+
+  m_actions = actions;
+}
+
+void
+TiedFileWatcher::insert(core::Download* download) {
+  insert(download, expand_path(rpc::call_command_string("d.tied_to_file", rpc::make_target(download))));
+}
+
+void
+TiedFileWatcher::insert(core::Download* download, const std::string& path) {
+  if (m_downloads.find(download) != m_downloads.end())
+    throw torrent::internal_error("TiedFileWatcher::insert(...) download already inserted.");
+
+  index(download, path);
+}
+
+void
+TiedFileWatcher::erase(core::Download* download) {
+  if (m_downloads.find(download) == m_downloads.end())
+    return;
+
+  unindex(download);
+  m_downloads.erase(download);
+}
+
+void
+TiedFileWatcher::update(core::Download* download) {
+  if (m_downloads.find(download) == m_downloads.end())
+    return;
+
+  update(download, expand_path(rpc::call_command_string("d.tied_to_file", rpc::make_target(download))));
+}
+
+void
+TiedFileWatcher::update(core::Download* download, const std::string& path) {
+  auto itr = m_downloads.find(download);
+
+  if (itr == m_downloads.end())
+    return;
+
+  if (path == itr->second)
+    return;
+
+  unindex(download);
+  index(download, path);
+}
+
+bool
+TiedFileWatcher::is_watched(const std::string& directory) const {
+  auto itr = m_directories.find(directory);
+
+  return itr != m_directories.end() && itr->second.watched;
+}
+
+void
+TiedFileWatcher::shutdown() {
+  m_active = false;
+  m_directory_events->close();
+}
+
+std::string
+TiedFileWatcher::directory_of(const std::string& path) {
+  auto pos = path.find_last_of('/');
+
+  if (pos == std::string::npos)
+    return "./";
+
+  return path.substr(0, pos + 1);
+}
+
+void
+TiedFileWatcher::index(core::Download* download, const std::string& path) {
+  m_downloads[download] = path;
+
+  if (path.empty())
+    return;
+
+  auto [file_itr, inserted] = m_files.try_emplace(path);
+
+  if (inserted) {
+    auto  directory = directory_of(path);
+    auto& entry     = m_directories[directory];
+
+    entry.files++;
+
+    // The state of files is refreshed when the watcher is enabled.
+    if (m_actions != 0 && m_active) {
+      file_itr->second.exists = torrent::utils::FileStat().update(path);
+      watch(directory, &entry);
+    }
+  }
+
+  file_itr->second.downloads.push_back(download);
+}
+
+void
+TiedFileWatcher::unindex(core::Download* download) {
+  auto& path = m_downloads[download];
+
+  if (path.empty())
+    return;
+
+  auto  file_itr  = m_files.find(path);
+  auto& downloads = file_itr->second.downloads;
+
+  downloads.erase(std::find(downloads.begin(), downloads.end(), download));
+
+  if (downloads.empty()) {
+    auto dir_itr = m_directories.find(directory_of(path));
+
+    m_files.erase(file_itr);
+
+    // Watches cannot be removed, so watched directories are kept to
+    // avoid adding them again.
+    if (--dir_itr->second.files == 0 && !dir_itr->second.watched)
+      m_directories.erase(dir_itr);
+  }
+
+  path.clear();
+}
+
+void
+TiedFileWatcher::watch(const std::string& directory, directory_type* entry) {
+  if (entry->watched)
+    return;
+
+  try {
+    m_directory_events->notify_on(directory.c_str(),
+                                  torrent::directory_events::flag_on_added | torrent::directory_events::flag_on_removed,
+                                  [this](const std::string& path) { receive_event(path); });
+  } catch (torrent::input_error& e) {
+    lt_log_print(torrent::LOG_WARN, "Could not watch directory of tied files: %s : %s", directory.c_str(), e.what());
+    return;
+  }
+
+  entry->watched = true;
+}
+
+void
+TiedFileWatcher::receive_event(const std::string& event_path) {
+  if (m_actions == 0 || !m_active)
+    return;
+
+  std::string path = event_path;
+  path.erase(std::unique(path.begin(), path.end(), [](char a, char b) { return a == '/' && b == '/'; }), path.end());
+
+  auto itr = m_files.find(path);
+
+  if (itr == m_files.end())
+    return;
+
+  bool exists = torrent::utils::FileStat().update(path);
+
+  if (exists == itr->second.exists)
+    return;
+
+  itr->second.exists = exists;
+
+  // The index may change while acting on the downloads.
+  auto downloads = itr->second.downloads;
+
+  try {
+    if (exists)
+      apply_appeared(downloads);
+    else
+      apply_vanished(downloads);
+
+  } catch (torrent::input_error& e) {
+    lt_log_print(torrent::LOG_WARN, "Tied file action failed: %s : %s", path.c_str(), e.what());
+  }
+}
+
+void
+TiedFileWatcher::apply_appeared(const std::vector<core::Download*>& downloads) {
+  if (!has_action(action_start))
+    return;
+
+  for (auto download : downloads) {
+    if (m_downloads.find(download) == m_downloads.end())
+      continue;
+
+    if (rpc::call_command_value("d.state", rpc::make_target(download)) == 1)
+      continue;
+
+    rpc::parse_command_single(rpc::make_target(download), "d.try_start=");
+  }
+}
+
+void
+TiedFileWatcher::apply_vanished(const std::vector<core::Download*>& downloads) {
+  for (auto download : downloads) {
+    if (has_action(action_stop) && m_downloads.find(download) != m_downloads.end() &&
+        rpc::call_command_value("d.state", rpc::make_target(download)) != 0)
+      rpc::parse_command_single(rpc::make_target(download), "d.try_stop=");
+
+    if (has_action(action_close) && m_downloads.find(download) != m_downloads.end() &&
+        rpc::call_command_value("d.ignore_commands", rpc::make_target(download)) == 0)
+      rpc::parse_command_single(rpc::make_target(download), "d.try_close=");
+
+    if (has_action(action_remove) && m_downloads.find(download) != m_downloads.end()) {
+      // Need to clear tied_to_file so it doesn't try to delete it.
+      rpc::call_command("d.tied_to_file.set", std::string(), rpc::make_target(download));
+
+      control->core()->download_list()->erase_ptr(download);
+    }
+  }
+}
+
+}
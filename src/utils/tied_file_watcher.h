@@ -0,0 +1,101 @@
+#ifndef RTORRENT_UTILS_TIED_FILE_WATCHER_H
+#define RTORRENT_UTILS_TIED_FILE_WATCHER_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace core {
+class Download;
+}
+
+namespace torrent {
+class directory_events;
+}
+
+namespace utils {
+
+// Keeps an index of the files downloads are tied to, grouped by
+// directory, and watches those directories with inotify so downloads
+// are started, stopped, closed or removed only when their tied file
+// appears or vanishes.
+//
+// Uses its own directory_events instance as inotify only reports to
+// the first watch registered for a directory, and tied files are often
+// kept in directories also used by directory.watch.added.
+//
+// The start_tied, stop_untied, close_untied and remove_untied sweeps
+// are unaffected, and remain available as a fallback.
+
+class TiedFileWatcher {
+public:
+  enum action_flags {
+    action_start  = 0x1,
+    action_stop   = 0x2,
+    action_close  = 0x4,
+    action_remove = 0x8
+  };
+
+  TiedFileWatcher();
+  ~TiedFileWatcher();
+
+  int                 actions() const               { return m_actions; }
+  bool                has_action(int action) const  { return (m_actions & action); }
+  void                set_action(int action, bool enabled);
+
+  size_t              size_files() const            { return m_files.size(); }
+  size_t              size_directories() const      { return m_directories.size(); }
+
+  // Called by DownloadList when downloads are inserted or erased, and
+  // when d.tied_to_file is changed. Downloads that were not inserted
+  // are ignored by update().
+  void                insert(core::Download* download);
+  void                erase(core::Download* download);
+  void                update(core::Download* download);
+
+  // As above, with the expanded path of the tied file.
+  void                insert(core::Download* download, const std::string& path);
+  void                update(core::Download* download, const std::string& path);
+
+  // Directories that could not be watched, e.g. because they don't
+  // exist yet, are tried again when another file in them is indexed.
+  bool                is_watched(const std::string& directory) const;
+
+  void                shutdown();
+
+private:
+  struct file_type {
+    bool                         exists{};
+    std::vector<core::Download*> downloads;
+  };
+
+  struct directory_type {
+    size_t files{};
+    bool   watched{};
+  };
+
+  static std::string  directory_of(const std::string& path);
+
+  void                index(core::Download* download, const std::string& path);
+  void                unindex(core::Download* download);
+
+  void                watch(const std::string& directory, directory_type* entry);
+  void                receive_event(const std::string& path);
+
+  void                apply_appeared(const std::vector<core::Download*>& downloads);
+  void                apply_vanished(const std::vector<core::Download*>& downloads);
+
+  int                 m_actions{};
+  bool                m_active{true};
+
+  std::unordered_map<core::Download*, std::string> m_downloads;
+  std::unordered_map<std::string, file_type>       m_files;
+  std::unordered_map<std::string, directory_type>  m_directories;
+
+  std::unique_ptr<torrent::directory_events>       m_directory_events;
+};
+
+}
+
+#endif
@@ -2,6 +2,8 @@
 
 #include "test/rpc/test_command_map.h"
 
+#include <numeric>
+
 #include "command_helpers.h"
 #include "rpc/command_map.h"
 
@@ -28,3 +30,91 @@ TestCommandMap::test_basics() {
   CPPUNIT_ASSERT(m_map.call_command("test_b", (int64_t)1).as_value() == 2);
   CPPUNIT_ASSERT(m_map.call_command("any_string", "").as_value() == 3);
 }
+
+void
+TestCommandMap::test_modifies_download() {
+  CMD2_ANY("d.test", &cmd_test_map_a);
+  CMD2_ANY("d.test.set", &cmd_test_map_a);
+  CMD2_ANY("d.test.set_if_z", &cmd_test_map_a);
+  CMD2_ANY("d.test.push_back", &cmd_test_map_a);
+  CMD2_ANY("d.test.push_back_unique", &cmd_test_map_a);
+  CMD2_ANY("d.test.remove", &cmd_test_map_a);
+  CMD2_ANY("f.test.set", &cmd_test_map_a);
+  CMD2_ANY("fi.test.set", &cmd_test_map_a);
+  CMD2_ANY("p.test.set", &cmd_test_map_a);
+  CMD2_ANY("t.test.set", &cmd_test_map_a);
+  CMD2_ANY("t.test", &cmd_test_map_a);
+  CMD2_ANY("throttle.test.set", &cmd_test_map_a);
+  CMD2_ANY("d.test.settings", &cmd_test_map_a);
+
+  auto modifies = [this](const char* key) {
+    return (m_map.find(key)->second.m_flags & rpc::CommandMap::flag_modifies_download) != 0;
+  };
+
+  CPPUNIT_ASSERT(!modifies("d.test"));
+  CPPUNIT_ASSERT(modifies("d.test.set"));
+  CPPUNIT_ASSERT(modifies("d.test.set_if_z"));
+  CPPUNIT_ASSERT(modifies("d.test.push_back"));
+  CPPUNIT_ASSERT(modifies("d.test.push_back_unique"));
+  CPPUNIT_ASSERT(modifies("d.test.remove"));
+  CPPUNIT_ASSERT(!modifies("d.test.settings"));
+
+  // Setters of files, trackers and peers change the owning download.
+  CPPUNIT_ASSERT(modifies("f.test.set"));
+  CPPUNIT_ASSERT(modifies("fi.test.set"));
+  CPPUNIT_ASSERT(modifies("p.test.set"));
+  CPPUNIT_ASSERT(modifies("t.test.set"));
+  CPPUNIT_ASSERT(!modifies("t.test"));
+  CPPUNIT_ASSERT(!modifies("throttle.test.set"));
+
+  // Child targets without an owning download are left alone.
+  CPPUNIT_ASSERT(m_map.call_command("t.test.set", (int64_t)1, rpc::make_target(rpc::command_base::target_tracker, nullptr, nullptr)).as_value() == 1);
+}
+
+void
+TestCommandMap::test_profile() {
+  CMD2_ANY("test_a", &cmd_test_map_a);
+  CMD2_ANY("test_nested", [this](const auto&, const auto& obj) { return m_map.call_command("test_a", obj); });
+
+  m_map.call_command("test_a", (int64_t)1);
+  CPPUNIT_ASSERT(m_map.find("test_a")->second.m_profile == nullptr);
+
+  m_map.set_profiling(true);
+
+  CPPUNIT_ASSERT(m_map.call_command("test_a", (int64_t)1).as_value() == 1);
+  CPPUNIT_ASSERT(m_map.call_command("test_nested", (int64_t)2).as_value() == 2);
+
+  auto profile_a      = m_map.find("test_a")->second.m_profile;
+  auto profile_nested = m_map.find("test_nested")->second.m_profile;
+
+  CPPUNIT_ASSERT(profile_a != nullptr && profile_a->calls == 2);
+  CPPUNIT_ASSERT(profile_nested != nullptr && profile_nested->calls == 1);
+  CPPUNIT_ASSERT(profile_nested->self <= profile_nested->total);
+  CPPUNIT_ASSERT(std::accumulate(profile_a->histogram.begin(), profile_a->histogram.end(), uint64_t{}) == 2);
+
+  m_map.set_profiling(false);
+  m_map.call_command("test_a", (int64_t)1);
+  CPPUNIT_ASSERT(profile_a->calls == 2);
+
+  m_map.profile_reset();
+  CPPUNIT_ASSERT(m_map.find("test_a")->second.m_profile == nullptr);
+}
+
+void
+TestCommandMap::test_profile_histogram() {
+  rpc::command_profile_type profile;
+
+  profile.add(std::chrono::nanoseconds(500), std::chrono::nanoseconds(500));
+  profile.add(std::chrono::microseconds(1500), std::chrono::microseconds(1000));
+  profile.add(std::chrono::seconds(3600), std::chrono::seconds(3600));
+
+  CPPUNIT_ASSERT(profile.calls == 3);
+  CPPUNIT_ASSERT(profile.histogram[0] == 1);
+  CPPUNIT_ASSERT(profile.histogram[11] == 1);
+  CPPUNIT_ASSERT(profile.histogram[rpc::command_profile_type::histogram_size - 1] == 1);
+  CPPUNIT_ASSERT(profile.max == std::chrono::seconds(3600));
+
+  CPPUNIT_ASSERT(profile.percentile(0.0) == std::chrono::microseconds(1));
+  CPPUNIT_ASSERT(profile.percentile(0.5) == std::chrono::microseconds(2048));
+  CPPUNIT_ASSERT(profile.percentile(0.99) == std::chrono::seconds(3600));
+}
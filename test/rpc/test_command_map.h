@@ -6,6 +6,9 @@ class TestCommandMap : public test_fixture {
   CPPUNIT_TEST_SUITE(TestCommandMap);
 
   CPPUNIT_TEST(test_basics);
+  CPPUNIT_TEST(test_modifies_download);
+  CPPUNIT_TEST(test_profile);
+  CPPUNIT_TEST(test_profile_histogram);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -15,6 +18,9 @@ public:
   void setUp() { m_commandItr = m_commands; }
 
   void test_basics();
+  void test_modifies_download();
+  void test_profile();
+  void test_profile_histogram();
 
 private:
   rpc::CommandMap m_map;
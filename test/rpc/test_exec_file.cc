@@ -0,0 +1,226 @@
+#include "config.h"
+
+#include "test/rpc/test_exec_file.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <torrent/exceptions.h>
+
+#include "command_helpers.h"
+#include "rpc/command_map.h"
+#include "rpc/exec_file.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestExecFile);
+
+namespace {
+
+const char* test_callback_command = "test.exec.callback";
+
+int             callback_calls;
+torrent::Object callback_args;
+
+torrent::Object
+cmd_exec_callback([[maybe_unused]] rpc::target_type target, const torrent::Object::list_type& args) {
+  callback_calls++;
+  callback_args = torrent::Object::create_list();
+  callback_args.as_list() = args;
+  return torrent::Object();
+}
+
+torrent::Object
+shell_args(const std::string& script) {
+  auto args = torrent::Object::create_list();
+  args.as_list().push_back("/bin/sh");
+  args.as_list().push_back("-c");
+  args.as_list().push_back(script);
+  return args;
+}
+
+torrent::Object::list_type
+async_args(const std::string& callback, const std::string& script) {
+  auto args = torrent::Object::create_list();
+  args.as_list().push_back(callback);
+  args.as_list().push_back("/bin/sh");
+  args.as_list().push_back("-c");
+  args.as_list().push_back(script);
+  return args.as_list();
+}
+
+// Reads the output of the children and waits for them to exit, as the
+// main thread's poll and scheduler would.
+bool
+run_children(rpc::ExecFile* exec_file, TestMainThread* main_thread) {
+  for (int i = 0; i < 1000 && exec_file->size_async() != 0; i++) {
+    for (auto& child : exec_file->children())
+      if (child->file_descriptor() != -1)
+        child->event_read();
+
+    main_thread->test_add_cached_time(rpc::ExecChild::wait_interval);
+    main_thread->test_process_events_without_cached_time();
+
+    ::usleep(5000);
+  }
+
+  return exec_file->size_async() == 0;
+}
+
+} // namespace
+
+void
+TestExecFile::setUp() {
+  TestFixtureWithMainThread::setUp();
+
+  callback_calls = 0;
+  callback_args  = torrent::Object();
+
+  m_main_thread->test_set_cached_time(std::chrono::seconds(0));
+
+  if (!rpc::commands.has(test_callback_command))
+    CMD2_ANY_LIST(test_callback_command, &cmd_exec_callback);
+}
+
+void
+TestExecFile::tearDown() {
+  TestFixtureWithMainThread::tearDown();
+}
+
+void
+TestExecFile::test_capture() {
+  rpc::ExecFile exec_file;
+
+  auto result = exec_file.execute_object(shell_args("echo captured"), rpc::ExecFile::flag_capture);
+
+  CPPUNIT_ASSERT(result.is_string());
+  CPPUNIT_ASSERT(result.as_string() == "captured\n");
+
+  exec_file.cleanup();
+}
+
+void
+TestExecFile::test_status() {
+  rpc::ExecFile exec_file;
+
+  CPPUNIT_ASSERT(exec_file.execute_object(shell_args("exit 0"), 0).as_value() == 0);
+  CPPUNIT_ASSERT(exec_file.execute_object(shell_args("exit 3"), 0).as_value() != 0);
+  CPPUNIT_ASSERT_THROW(exec_file.execute_object(shell_args("exit 3"), rpc::ExecFile::flag_throw), torrent::input_error);
+
+  exec_file.cleanup();
+}
+
+void
+TestExecFile::test_spawn_failure() {
+  rpc::ExecFile exec_file;
+
+  auto args = torrent::Object::create_list();
+  args.as_list().push_back("/nonexistent/rtorrent-test");
+
+  // Depending on the platform either spawning or the child fails.
+  CPPUNIT_ASSERT(exec_file.execute_object(args, 0).as_value() != 0);
+
+  exec_file.cleanup();
+}
+
+void
+TestExecFile::test_background_output() {
+  char directory[] = "/tmp/rtorrent-exec-XXXXXX";
+  CPPUNIT_ASSERT(::mkdtemp(directory) != nullptr);
+
+  std::string done = std::string(directory) + "/done";
+
+  int log_pipe[2];
+  CPPUNIT_ASSERT(::pipe(log_pipe) == 0);
+  CPPUNIT_ASSERT(::fcntl(log_pipe[0], F_SETFL, O_NONBLOCK) == 0);
+
+  rpc::ExecFile exec_file;
+  exec_file.set_log_fd(log_pipe[1]);
+
+  auto result = exec_file.execute_object(shell_args("echo bg-out-$((1 + 1)); echo bg-err-$((1 + 1)) >&2; touch " + done), rpc::ExecFile::flag_background);
+
+  CPPUNIT_ASSERT(result.as_value() == 0);
+
+  struct stat st;
+
+  for (int i = 0; i < 1000 && ::stat(done.c_str(), &st) != 0; i++)
+    ::usleep(5000);
+
+  CPPUNIT_ASSERT(::stat(done.c_str(), &st) == 0);
+
+  // Background tasks aren't attached to the log, which only has the
+  // command line with the unexpanded arguments.
+  std::string log;
+  char        buffer[4096];
+  ssize_t     length;
+
+  while ((length = ::read(log_pipe[0], buffer, sizeof(buffer))) > 0)
+    log.append(buffer, length);
+
+  CPPUNIT_ASSERT(log.find("Background task") != std::string::npos);
+  CPPUNIT_ASSERT(log.find("bg-out-2") == std::string::npos);
+  CPPUNIT_ASSERT(log.find("bg-err-2") == std::string::npos);
+
+  exec_file.cleanup();
+
+  ::close(log_pipe[0]);
+  ::close(log_pipe[1]);
+  ::unlink(done.c_str());
+  ::rmdir(directory);
+}
+
+void
+TestExecFile::test_async() {
+  rpc::ExecFile exec_file;
+
+  auto pid = exec_file.execute_async(rpc::make_target(), async_args(test_callback_command, "echo async; exit 3"));
+
+  CPPUNIT_ASSERT(pid.as_value() > 0);
+  CPPUNIT_ASSERT(exec_file.size_async() == 1);
+  CPPUNIT_ASSERT(callback_calls == 0);
+
+  CPPUNIT_ASSERT(run_children(&exec_file, m_main_thread.get()));
+
+  CPPUNIT_ASSERT(callback_calls == 1);
+  CPPUNIT_ASSERT(callback_args.as_list().size() == 2);
+  CPPUNIT_ASSERT(callback_args.as_list().front().as_value() == 3);
+  CPPUNIT_ASSERT(callback_args.as_list().back().as_string() == "async\n");
+
+  // Without a callback the child is only waited for.
+  exec_file.execute_async(rpc::make_target(), async_args("", "exit 0"));
+
+  CPPUNIT_ASSERT(run_children(&exec_file, m_main_thread.get()));
+  CPPUNIT_ASSERT(callback_calls == 1);
+
+  exec_file.cleanup();
+}
+
+void
+TestExecFile::test_async_output_limit() {
+  rpc::ExecFile exec_file;
+
+  exec_file.execute_async(rpc::make_target(), async_args(test_callback_command, "head -c 3000000 /dev/zero"));
+
+  CPPUNIT_ASSERT(run_children(&exec_file, m_main_thread.get()));
+
+  CPPUNIT_ASSERT(callback_calls == 1);
+  CPPUNIT_ASSERT(callback_args.as_list().front().as_value() == 0);
+  CPPUNIT_ASSERT(callback_args.as_list().back().as_string().size() == rpc::ExecChild::max_output);
+
+  exec_file.cleanup();
+}
+
+void
+TestExecFile::test_async_errors() {
+  rpc::ExecFile exec_file;
+
+  torrent::Object::list_type too_few{torrent::Object(std::string(test_callback_command))};
+
+  CPPUNIT_ASSERT_THROW(exec_file.execute_async(rpc::make_target(), too_few), torrent::input_error);
+  CPPUNIT_ASSERT_THROW(exec_file.execute_async(rpc::make_target(), async_args("test.exec.missing", "exit 0")), torrent::input_error);
+
+  CPPUNIT_ASSERT(exec_file.size_async() == 0);
+
+  exec_file.cleanup();
+}
@@ -0,0 +1,29 @@
+#include "test/helpers/test_main_thread.h"
+
+class TestExecFile : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(TestExecFile);
+
+  CPPUNIT_TEST(test_capture);
+  CPPUNIT_TEST(test_status);
+  CPPUNIT_TEST(test_spawn_failure);
+  CPPUNIT_TEST(test_background_output);
+
+  CPPUNIT_TEST(test_async);
+  CPPUNIT_TEST(test_async_output_limit);
+  CPPUNIT_TEST(test_async_errors);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_capture();
+  void test_status();
+  void test_spawn_failure();
+  void test_background_output();
+
+  void test_async();
+  void test_async_output_limit();
+  void test_async_errors();
+};
@@ -0,0 +1,242 @@
+#include "config.h"
+
+#include "test/rpc/test_http_request.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rpc/http_request.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestHttpRequest);
+
+static constexpr unsigned int max_content_size = 1 << 20;
+
+static int
+parse_request(const std::string& input, rpc::HttpRequest* request, const std::string& host = "") {
+  auto header_end = input.find("\r\n\r\n");
+
+  CPPUNIT_ASSERT(header_end != std::string::npos);
+
+  return rpc::http_parse_request(std::string_view(input.data(), header_end + 4), host, max_content_size, request);
+}
+
+static int
+parse_status(const std::string& input, const std::string& host = "") {
+  rpc::HttpRequest request;
+  return parse_request(input, &request, host);
+}
+
+static std::string
+make_request(const std::string& headers, const std::string& body = "{}") {
+  return "POST /RPC2 HTTP/1.1\r\n" + headers + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+void
+TestHttpRequest::test_parse_basic() {
+  rpc::HttpRequest request;
+
+  std::string input = "POST /RPC2 HTTP/1.1\r\n"
+                      "Host: 127.0.0.1:5001\r\n"
+                      "Content-Type: application/json; charset=utf-8\r\n"
+                      "content-length:  11 \r\n"
+                      "Accept-Encoding: deflate, gzip\r\n"
+                      "\r\n"
+                      "{\"id\": 1}\r\n";
+
+  CPPUNIT_ASSERT(parse_request(input, &request) == 0);
+  CPPUNIT_ASSERT(request.header_size == input.find("\r\n\r\n") + 4);
+  CPPUNIT_ASSERT(request.content_length == 11);
+  CPPUNIT_ASSERT(request.size() == input.size());
+  CPPUNIT_ASSERT(request.content_type == "application/json; charset=utf-8");
+  CPPUNIT_ASSERT(request.keep_alive);
+  CPPUNIT_ASSERT(!request.expect_continue);
+  CPPUNIT_ASSERT(request.accepts_compression);
+
+  rpc::HttpRequest request_xml;
+
+  CPPUNIT_ASSERT(parse_request(make_request("Host: localhost\r\nContent-Type: text/xml\r\nExpect: 100-continue\r\n", "<x/>"), &request_xml) == 0);
+  CPPUNIT_ASSERT(request_xml.content_type == "text/xml");
+  CPPUNIT_ASSERT(request_xml.content_length == 4);
+  CPPUNIT_ASSERT(request_xml.expect_continue);
+  CPPUNIT_ASSERT(!request_xml.accepts_compression);
+}
+
+void
+TestHttpRequest::test_parse_connection() {
+  static const std::string headers = "Host: localhost\r\nContent-Type: text/xml\r\n";
+
+  rpc::HttpRequest request_close;
+  rpc::HttpRequest request_10;
+  rpc::HttpRequest request_10_keep_alive;
+
+  CPPUNIT_ASSERT(parse_request(make_request(headers + "Connection: Close\r\n"), &request_close) == 0);
+  CPPUNIT_ASSERT(!request_close.keep_alive);
+
+  CPPUNIT_ASSERT(parse_request("POST / HTTP/1.0\r\n" + headers + "Content-Length: 2\r\n\r\n{}", &request_10) == 0);
+  CPPUNIT_ASSERT(!request_10.keep_alive);
+
+  CPPUNIT_ASSERT(parse_request("POST / HTTP/1.0\r\n" + headers + "Connection: keep-alive\r\nContent-Length: 2\r\n\r\n{}", &request_10_keep_alive) == 0);
+  CPPUNIT_ASSERT(request_10_keep_alive.keep_alive);
+}
+
+void
+TestHttpRequest::test_parse_errors() {
+  static const std::string headers = "Host: localhost\r\nContent-Type: text/xml\r\n";
+
+  CPPUNIT_ASSERT(parse_status("GET / HTTP/1.1\r\n" + headers + "\r\n") == 405);
+  CPPUNIT_ASSERT(parse_status("POST / HTTP/2\r\n" + headers + "\r\n") == 505);
+  CPPUNIT_ASSERT(parse_status("POST\r\n" + headers + "\r\n") == 400);
+  CPPUNIT_ASSERT(parse_status("POST / HTTP/1.1\r\n" + headers + "\r\n") == 411);
+  CPPUNIT_ASSERT(parse_status("POST / HTTP/1.1\r\n" + headers + "Content-Length: 0\r\n\r\n") == 400);
+  CPPUNIT_ASSERT(parse_status("POST / HTTP/1.1\r\n" + headers + "Content-Length: 1x\r\n\r\n") == 400);
+  CPPUNIT_ASSERT(parse_status("POST / HTTP/1.1\r\n" + headers + "Content-Length: 99999999999\r\n\r\n") == 413);
+  CPPUNIT_ASSERT(parse_status("POST / HTTP/1.1\r\n" + headers + "Content-Length: 1\r\nContent-Length: 2\r\n\r\n") == 400);
+  CPPUNIT_ASSERT(parse_status("POST / HTTP/1.1\r\n" + headers + "Transfer-Encoding: chunked\r\n\r\n") == 501);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Expect: something\r\n")) == 417);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "No separator\r\n")) == 400);
+}
+
+void
+TestHttpRequest::test_reject_origin() {
+  static const std::string headers = "Host: localhost\r\nContent-Type: application/json\r\n";
+
+  CPPUNIT_ASSERT(parse_status(make_request(headers)) == 0);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Origin: http://localhost\r\n")) == 403);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "origin: null\r\n")) == 403);
+  CPPUNIT_ASSERT(parse_status(make_request("Origin: https://example.com\r\n" + headers)) == 403);
+}
+
+void
+TestHttpRequest::test_reject_host() {
+  static const std::string headers = "Content-Type: application/json\r\n";
+
+  CPPUNIT_ASSERT(parse_status(make_request(headers)) == 400);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Host: localhost\r\nHost: localhost\r\n")) == 400);
+
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Host: 127.0.0.1\r\n")) == 0);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Host: [::1]:5001\r\n")) == 0);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Host: example.com\r\n")) == 403);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Host: 192.168.1.10:5001\r\n")) == 403);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Host: \r\n")) == 403);
+
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Host: seedbox.lan:5001\r\n"), "seedbox.lan") == 0);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Host: other.lan:5001\r\n"), "seedbox.lan") == 403);
+}
+
+void
+TestHttpRequest::test_reject_content_type() {
+  static const std::string headers = "Host: localhost\r\n";
+
+  CPPUNIT_ASSERT(parse_status(make_request(headers)) == 415);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Content-Type: text/plain\r\n")) == 415);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Content-Type: application/x-www-form-urlencoded\r\n")) == 415);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Content-Type: multipart/form-data; boundary=x\r\n")) == 415);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Content-Type: text/xmlx\r\n")) == 415);
+
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Content-Type: Application/JSON\r\n")) == 0);
+  CPPUNIT_ASSERT(parse_status(make_request(headers + "Content-Type: text/xml;charset=UTF-8\r\n")) == 0);
+}
+
+void
+TestHttpRequest::test_allowed_host() {
+  CPPUNIT_ASSERT(rpc::http_is_allowed_host("localhost", ""));
+  CPPUNIT_ASSERT(rpc::http_is_allowed_host("LOCALHOST:80", ""));
+  CPPUNIT_ASSERT(rpc::http_is_allowed_host("127.0.0.1", ""));
+  CPPUNIT_ASSERT(rpc::http_is_allowed_host("127.1.2.3:5001", ""));
+  CPPUNIT_ASSERT(rpc::http_is_allowed_host("[::1]", ""));
+  CPPUNIT_ASSERT(rpc::http_is_allowed_host("[::1]:5001", ""));
+  CPPUNIT_ASSERT(rpc::http_is_allowed_host("rtorrent.lan", "rtorrent.lan"));
+  CPPUNIT_ASSERT(rpc::http_is_allowed_host("RTorrent.lan:8080", "rtorrent.lan"));
+
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host(":5001", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("localhost:", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("localhost:x", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("localhost.example.com", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("127.0.0.1.example.com", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("128.0.0.1", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("::1", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("[::2]", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("[::1", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("[::1]x", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("rtorrent.lan", ""));
+  CPPUNIT_ASSERT(!rpc::http_is_allowed_host("rtorrent.lan.evil.com", "rtorrent.lan"));
+}
+
+void
+TestHttpRequest::test_accepts_gzip() {
+  CPPUNIT_ASSERT(rpc::http_accepts_gzip("gzip"));
+  CPPUNIT_ASSERT(rpc::http_accepts_gzip("deflate, GZIP;q=0.5"));
+  CPPUNIT_ASSERT(rpc::http_accepts_gzip("x-gzip"));
+  CPPUNIT_ASSERT(rpc::http_accepts_gzip("*"));
+
+  CPPUNIT_ASSERT(!rpc::http_accepts_gzip(""));
+  CPPUNIT_ASSERT(!rpc::http_accepts_gzip("deflate"));
+  CPPUNIT_ASSERT(!rpc::http_accepts_gzip("gzip;q=0"));
+  CPPUNIT_ASSERT(!rpc::http_accepts_gzip("*;q=0.0"));
+  CPPUNIT_ASSERT(!rpc::http_accepts_gzip("gzip;q=0, *"));
+}
+
+// Requests pipelined behind each other are parsed one at a time, with
+// the input following each request moved to the front of the buffer
+// once it has been answered.
+
+void
+TestHttpRequest::test_pipelined() {
+  std::vector<std::string> bodies = { "{\"id\":1}", "<methodCall/>", "{\"id\":3}" };
+
+  std::string input = make_request("Host: localhost\r\nContent-Type: application/json\r\n", bodies[0]) +
+                      make_request("Host: localhost\r\nContent-Type: text/xml\r\nConnection: close\r\n", bodies[1]) +
+                      make_request("Host: localhost\r\nContent-Type: application/json\r\n", bodies[2]);
+
+  // The last request is only partially received.
+  unsigned int received = input.size() - 4;
+
+  std::vector<char> buffer(1024);
+  std::copy(input.begin(), input.begin() + received, buffer.begin());
+
+  unsigned int position = received;
+
+  for (unsigned int i = 0; i < 2; i++) {
+    auto header_end = std::string_view(buffer.data(), position).find("\r\n\r\n");
+
+    CPPUNIT_ASSERT(header_end != std::string_view::npos);
+
+    rpc::HttpRequest request;
+
+    CPPUNIT_ASSERT(rpc::http_parse_request(std::string_view(buffer.data(), header_end + 4), "", max_content_size, &request) == 0);
+    CPPUNIT_ASSERT(request.size() <= position);
+    CPPUNIT_ASSERT(std::string(buffer.data() + request.header_size, request.content_length) == bodies[i]);
+    CPPUNIT_ASSERT(request.keep_alive == (i == 0));
+
+    position = rpc::http_shift_pipelined(&buffer, position, request.size(), 1024);
+  }
+
+  auto header_end = std::string_view(buffer.data(), position).find("\r\n\r\n");
+
+  rpc::HttpRequest request;
+
+  CPPUNIT_ASSERT(header_end != std::string_view::npos);
+  CPPUNIT_ASSERT(rpc::http_parse_request(std::string_view(buffer.data(), header_end + 4), "", max_content_size, &request) == 0);
+  CPPUNIT_ASSERT(request.size() == position + 4);
+  CPPUNIT_ASSERT(std::string(buffer.data() + request.header_size, position - request.header_size) == bodies[2].substr(0, bodies[2].size() - 4));
+
+  CPPUNIT_ASSERT(rpc::http_shift_pipelined(&buffer, position, position, 1024) == 0);
+  CPPUNIT_ASSERT(buffer.size() == 1024);
+}
+
+void
+TestHttpRequest::test_pipelined_shrink() {
+  std::vector<char> buffer(8192, 'a');
+  std::fill(buffer.begin() + 6000, buffer.begin() + 6010, 'b');
+
+  // Remaining input that doesn't fit the default size keeps the buffer.
+  CPPUNIT_ASSERT(rpc::http_shift_pipelined(&buffer, 8000, 1000, 1024) == 7000);
+  CPPUNIT_ASSERT(buffer.size() == 8192);
+  CPPUNIT_ASSERT(std::string(buffer.data() + 5000, 10) == "bbbbbbbbbb");
+
+  CPPUNIT_ASSERT(rpc::http_shift_pipelined(&buffer, 5010, 5000, 1024) == 10);
+  CPPUNIT_ASSERT(buffer.size() == 1024);
+  CPPUNIT_ASSERT(std::string(buffer.data(), 10) == "bbbbbbbbbb");
+}
@@ -0,0 +1,36 @@
+#include "test/helpers/test_fixture.h"
+
+class TestHttpRequest : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestHttpRequest);
+
+  CPPUNIT_TEST(test_parse_basic);
+  CPPUNIT_TEST(test_parse_connection);
+  CPPUNIT_TEST(test_parse_errors);
+
+  CPPUNIT_TEST(test_reject_origin);
+  CPPUNIT_TEST(test_reject_host);
+  CPPUNIT_TEST(test_reject_content_type);
+
+  CPPUNIT_TEST(test_allowed_host);
+  CPPUNIT_TEST(test_accepts_gzip);
+
+  CPPUNIT_TEST(test_pipelined);
+  CPPUNIT_TEST(test_pipelined_shrink);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_parse_basic();
+  void test_parse_connection();
+  void test_parse_errors();
+
+  void test_reject_origin();
+  void test_reject_host();
+  void test_reject_content_type();
+
+  void test_allowed_host();
+  void test_accepts_gzip();
+
+  void test_pipelined();
+  void test_pipelined_shrink();
+};
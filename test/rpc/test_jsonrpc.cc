@@ -8,6 +8,8 @@
 #include "globals.h"
 #include "command_helpers.h"
 #include "rpc/command_map.h"
+#include "rpc/response_buffer.h"
+#include "rpc/rpc_request.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TestJsonrpc);
 
@@ -16,6 +18,16 @@ jsonrpc_cmd_test_reflect([[maybe_unused]] rpc::target_type t, const torrent::Obj
 
 void initialize_command_dynamic();
 
+static std::string
+jsonrpc_process(rpc::JsonRpc& jsonrpc, const std::string& input) {
+  // Reserve header space the same way SCgiTask does.
+  rpc::ResponseBuffer output(64);
+
+  jsonrpc.process(input.c_str(), input.size(), &output);
+
+  return output.to_string();
+}
+
 // Name, Request, Expected response
 std::vector<std::tuple<std::string, std::string, std::string>> basic_jsonrpc_requests = {
   std::make_tuple("Basic call",
@@ -140,8 +152,42 @@ TestJsonrpc::tearDown() {
 void
 TestJsonrpc::test_basics() {
   for (auto& test : basic_jsonrpc_requests) {
-    std::string output;
-    m_jsonrpc.process(std::get<1>(test).c_str(), std::get<1>(test).size(), [&output](const char* c, uint32_t l) { output.append(c, l); return true; });
+    std::string output = jsonrpc_process(m_jsonrpc, std::get<1>(test));
     CPPUNIT_ASSERT_EQUAL_MESSAGE(std::get<0>(test), std::get<2>(test), output);
   }
 }
+
+// Parsing must not depend on the command map, as it is done on the
+// SCGI thread while only the execution is done on the main thread.
+void
+TestJsonrpc::test_parse_execute() {
+  std::string input = R"([{"jsonrpc": "2.0", "method": "jsonrpc_reflect", "params": ["", 41], "id": 1},)"
+                      R"({"jsonrpc": "2.0", "method": "no_such_method", "params": ["", 1.5], "id": "a"},)"
+                      R"({"jsonrpc": "2.0", "method": "jsonrpc_reflect"}])";
+
+  rpc::RpcRequest request;
+  m_jsonrpc.parse(input.c_str(), input.size(), &request);
+
+  CPPUNIT_ASSERT(!request.failed);
+  CPPUNIT_ASSERT(request.is_batch);
+  CPPUNIT_ASSERT_EQUAL(size_t(3), request.calls.size());
+
+  CPPUNIT_ASSERT_EQUAL(std::string("jsonrpc_reflect"), request.calls[0].method);
+  CPPUNIT_ASSERT_EQUAL(std::string("1"), request.calls[0].id);
+  CPPUNIT_ASSERT_EQUAL(size_t(2), request.calls[0].params.as_list().size());
+
+  CPPUNIT_ASSERT_EQUAL(std::string("\"a\""), request.calls[1].id);
+  CPPUNIT_ASSERT(!request.calls[1].failed);
+  CPPUNIT_ASSERT(request.calls[1].parse_error == rpc::RpcCall::parse_error_after_lookup);
+
+  CPPUNIT_ASSERT(request.calls[2].is_notification);
+
+  rpc::ResponseBuffer output(64);
+
+  m_jsonrpc.execute(&request, &output);
+  CPPUNIT_ASSERT(output.empty());
+
+  m_jsonrpc.serialize(request, &output);
+  CPPUNIT_ASSERT_EQUAL(std::string(R"([{"id":1,"jsonrpc":"2.0","result":[41]},{"error":{"code":-32601,"message":"method not found: no_such_method"},"id":"a","jsonrpc":"2.0"}])"),
+                       output.to_string());
+}
@@ -0,0 +1,215 @@
+#include "config.h"
+
+#include "test/rpc/test_lua.h"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <torrent/exceptions.h>
+
+#include "rpc/command_map.h"
+#include "rpc/lua.h"
+#include "rpc/rpc_manager.h"
+
+#ifdef HAVE_LUA
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestLua);
+
+namespace {
+
+torrent::Object
+run_lua(rpc::LuaEngine* engine, const std::string& source) {
+  int top = lua_gettop(engine->state());
+
+  engine->push_chunk(source, true);
+  return engine->call(top, 0);
+}
+
+torrent::Object
+run_lua_file(rpc::LuaEngine* engine, const std::string& path) {
+  int top = lua_gettop(engine->state());
+
+  engine->push_chunk(path, false);
+  return engine->call(top, 0);
+}
+
+// Writes the file with the given modification time, so rewrites can be
+// made within the same second.
+void
+write_file(const std::string& path, const std::string& contents, time_t sec, long nsec) {
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+  CPPUNIT_ASSERT(fd != -1);
+  CPPUNIT_ASSERT(::write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size()));
+
+  timespec times[2] = {{sec, nsec}, {sec, nsec}};
+
+  CPPUNIT_ASSERT(::futimens(fd, times) == 0);
+  CPPUNIT_ASSERT(::close(fd) == 0);
+}
+
+bool
+run_lua_fails(rpc::LuaEngine* engine, const std::string& source, const std::string& message) {
+  try {
+    run_lua(engine, source);
+  } catch (torrent::input_error& e) {
+    return std::string(e.what()).find(message) != std::string::npos;
+  }
+
+  return false;
+}
+
+} // namespace
+
+void
+TestLua::test_string_chunks() {
+  rpc::LuaEngine engine;
+
+  CPPUNIT_ASSERT(run_lua(&engine, "return 1").as_value() == 1);
+  CPPUNIT_ASSERT(run_lua(&engine, "return 1").as_value() == 1);
+  CPPUNIT_ASSERT(engine.size_chunks() == 1);
+
+  CPPUNIT_ASSERT(run_lua(&engine, "return 2").as_value() == 2);
+  CPPUNIT_ASSERT(engine.size_chunks() == 2);
+
+  // Strings that fail to compile aren't cached.
+  CPPUNIT_ASSERT_THROW(run_lua(&engine, "return +"), torrent::input_error);
+  CPPUNIT_ASSERT(engine.size_chunks() == 2);
+
+  engine.clear_chunks();
+  CPPUNIT_ASSERT(engine.size_chunks() == 0);
+
+  // The cache is dropped rather than growing past the limit.
+  for (size_t i = 0; i < rpc::LuaEngine::max_string_chunks + 1; i++)
+    run_lua(&engine, "return " + std::to_string(i));
+
+  CPPUNIT_ASSERT(engine.size_chunks() == 1);
+  CPPUNIT_ASSERT(lua_gettop(engine.state()) == 0);
+}
+
+void
+TestLua::test_file_chunks() {
+  char path_template[] = "/tmp/rtorrent-lua-XXXXXX";
+  int  fd = ::mkstemp(path_template);
+
+  CPPUNIT_ASSERT(fd != -1);
+  CPPUNIT_ASSERT(::close(fd) == 0);
+
+  std::string    path = path_template;
+  rpc::LuaEngine engine;
+
+  write_file(path, "return 1", 1000000000, 100);
+  CPPUNIT_ASSERT(run_lua_file(&engine, path).as_value() == 1);
+  CPPUNIT_ASSERT(engine.size_chunks() == 1);
+
+  // The chunk is reused while the inode, size and time match.
+  write_file(path, "return 3", 1000000000, 100);
+  CPPUNIT_ASSERT(run_lua_file(&engine, path).as_value() == 1);
+
+  // Same size and second, only the nanoseconds differ.
+  write_file(path, "return 2", 1000000000, 200);
+  CPPUNIT_ASSERT(run_lua_file(&engine, path).as_value() == 2);
+  CPPUNIT_ASSERT(engine.size_chunks() == 1);
+
+  CPPUNIT_ASSERT(::unlink(path.c_str()) == 0);
+
+  CPPUNIT_ASSERT_THROW(run_lua_file(&engine, path), torrent::input_error);
+  CPPUNIT_ASSERT(lua_gettop(engine.state()) == 0);
+}
+
+void
+TestLua::test_insert_method() {
+  rpc::LuaEngine engine;
+
+  run_lua(&engine, "require('rtorrent').insert_method('test.lua.method', function(target, a, b) return a + b end)");
+
+  CPPUNIT_ASSERT(rpc::commands.has("test.lua.method"));
+
+  auto args = torrent::Object::create_list();
+  args.as_list().push_back(int64_t(2));
+  args.as_list().push_back(int64_t(3));
+
+  CPPUNIT_ASSERT(rpc::commands.call_command("test.lua.method", args).as_value() == 5);
+
+  // Existing commands can't be replaced.
+  CPPUNIT_ASSERT(run_lua_fails(&engine, "require('rtorrent').insert_method('test.lua.method', function() return 0 end)", "Invalid key"));
+  CPPUNIT_ASSERT(rpc::commands.call_command("test.lua.method", args).as_value() == 5);
+
+  // The name can be reused once erased, calling the new function.
+  rpc::commands.erase(rpc::commands.find("test.lua.method"));
+
+  run_lua(&engine, "require('rtorrent').insert_method('test.lua.method', function(target, a, b) return a * b end)");
+  CPPUNIT_ASSERT(rpc::commands.call_command("test.lua.method", args).as_value() == 6);
+
+  rpc::commands.erase(rpc::commands.find("test.lua.method"));
+  CPPUNIT_ASSERT(lua_gettop(engine.state()) == 0);
+}
+
+void
+TestLua::test_find_method() {
+  rpc::LuaEngine engine;
+
+  CPPUNIT_ASSERT(engine.find_method("test.lua.find") == rpc::commands.end());
+
+  run_lua(&engine, "require('rtorrent').insert_method('test.lua.find', function() return 1 end)");
+
+  auto itr = engine.find_method("test.lua.find");
+
+  CPPUNIT_ASSERT(itr != rpc::commands.end());
+  CPPUNIT_ASSERT(itr == rpc::commands.find("test.lua.find"));
+  CPPUNIT_ASSERT(engine.find_method("test.lua.find") == itr);
+
+  // Erasing bumps the command generation, dropping the cached iterator.
+  rpc::commands.erase(itr);
+
+  CPPUNIT_ASSERT(engine.find_method("test.lua.find") == rpc::commands.end());
+}
+
+void
+TestLua::test_call() {
+  rpc::LuaEngine engine;
+
+  run_lua(&engine, "require('rtorrent').insert_method('test.lua.call', function(target, a, b) return a + b end)");
+  run_lua(&engine, "require('rtorrent').insert_method('test.lua.call_error', function() error('call failed') end)");
+
+  CPPUNIT_ASSERT(run_lua(&engine, "return require('rtorrent').call('test.lua.call', '', 2, 3)").as_value() == 5);
+
+  // Errors from commands are raised as Lua errors, leaving the engine
+  // usable.
+  CPPUNIT_ASSERT(run_lua_fails(&engine, "return require('rtorrent').call('test.lua.missing', '')", "method not found"));
+  CPPUNIT_ASSERT(run_lua_fails(&engine, "return require('rtorrent').call('test.lua.call_error', '')", "call failed"));
+  CPPUNIT_ASSERT(run_lua_fails(&engine, "return require('rtorrent').call('test.lua.call', 'invalid')", "invalid target"));
+
+  CPPUNIT_ASSERT(run_lua(&engine, "return select(2, pcall(require('rtorrent').call, 'test.lua.missing', ''))").as_string().find("method not found") != std::string::npos);
+  CPPUNIT_ASSERT(run_lua(&engine, "return require('rtorrent').call('test.lua.call', '', 4, 5)").as_value() == 9);
+
+  rpc::commands.erase(rpc::commands.find("test.lua.call"));
+  rpc::commands.erase(rpc::commands.find("test.lua.call_error"));
+  CPPUNIT_ASSERT(lua_gettop(engine.state()) == 0);
+}
+
+void
+TestLua::test_multicall_field_keys() {
+  rpc::LuaEngine engine;
+
+  auto multicall = [&engine](const std::string& fields) {
+    return run_lua_fails(&engine, "return require('rtorrent').multicall('', " + fields + ")", "invalid field");
+  };
+
+  // Keys outside the array part would size the row tables.
+  CPPUNIT_ASSERT(multicall("{[0] = 'd.name='}"));
+  CPPUNIT_ASSERT(multicall("{[-1] = 'd.name='}"));
+  CPPUNIT_ASSERT(multicall("{[2] = 'd.name='}"));
+  CPPUNIT_ASSERT(multicall("{[1000000000] = 'd.name='}"));
+  CPPUNIT_ASSERT(multicall("{[1.5] = 'd.name='}"));
+  CPPUNIT_ASSERT(multicall("{[true] = 'd.name='}"));
+
+  // Errors from reading the fields are raised as Lua errors.
+  CPPUNIT_ASSERT(run_lua_fails(&engine, "return require('rtorrent').multicall('', {1})", "fields must be strings"));
+
+  CPPUNIT_ASSERT(lua_gettop(engine.state()) == 0);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#include "test/helpers/test_fixture.h"
+
+class TestLua : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestLua);
+
+  CPPUNIT_TEST(test_string_chunks);
+  CPPUNIT_TEST(test_file_chunks);
+  CPPUNIT_TEST(test_insert_method);
+  CPPUNIT_TEST(test_find_method);
+  CPPUNIT_TEST(test_call);
+
+  CPPUNIT_TEST(test_multicall_field_keys);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_string_chunks();
+  void test_file_chunks();
+  void test_insert_method();
+  void test_find_method();
+  void test_call();
+
+  void test_multicall_field_keys();
+};
@@ -0,0 +1,281 @@
+#include "config.h"
+
+#include "test/rpc/test_object_encoder.h"
+
+#include <string>
+#include <vector>
+#include <torrent/exceptions.h>
+
+#include "helpers/assert.h"
+#include "rpc/nlohmann/json.h"
+#include "rpc/response_buffer.h"
+
+#if defined(HAVE_XMLRPC_TINYXML2) && !defined(HAVE_XMLRPC_C)
+#include "rpc/tinyxml2/tinyxml2.h"
+#endif
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestObjectEncoder);
+
+using json = nlohmann::json;
+
+// The document based conversion previously used by JsonRpc, kept as a
+// reference for the output and performance of the encoder.
+static json
+reference_object_to_json(const torrent::Object& object) {
+  switch (object.type()) {
+  case torrent::Object::TYPE_VALUE:
+    return object.as_value();
+  case torrent::Object::TYPE_STRING:
+    return object.as_string();
+  case torrent::Object::TYPE_LIST: {
+    json result = json::array();
+    for (const auto& obj : object.as_list())
+      result.push_back(reference_object_to_json(obj));
+    return result;
+  }
+  case torrent::Object::TYPE_MAP: {
+    json result = json::object();
+    for (const auto& entry : object.as_map())
+      result.emplace(entry.first, reference_object_to_json(entry.second));
+    return result;
+  }
+  case torrent::Object::TYPE_DICT_KEY: {
+    json result = json::array();
+    result.push_back(reference_object_to_json(object.as_dict_key()));
+
+    if (object.as_dict_obj().is_list()) {
+      for (const auto& element : object.as_dict_obj().as_list())
+        result.push_back(reference_object_to_json(element));
+    } else {
+      result.push_back(reference_object_to_json(object.as_dict_obj()));
+    }
+
+    return result;
+  }
+  default:
+    return 0;
+  }
+}
+
+#if defined(HAVE_XMLRPC_TINYXML2) && !defined(HAVE_XMLRPC_C)
+
+// The tinyxml2 printer previously used by XmlRpc.
+static void
+reference_print_object_xml(const torrent::Object& obj, rpc::tinyxml2::XMLPrinter* printer) {
+  switch (obj.type()) {
+  case torrent::Object::TYPE_STRING:
+    printer->OpenElement("string", true);
+    printer->PushText(obj.as_string().c_str());
+    printer->CloseElement(true);
+    break;
+  case torrent::Object::TYPE_VALUE:
+    printer->OpenElement("i8", true);
+    printer->PushText(std::to_string(obj.as_value()).c_str());
+    printer->CloseElement(true);
+    break;
+  case torrent::Object::TYPE_LIST:
+    printer->OpenElement("array", true);
+    printer->OpenElement("data", true);
+    for (const auto& itr : obj.as_list()) {
+      printer->OpenElement("value", true);
+      reference_print_object_xml(itr, printer);
+      printer->CloseElement(true);
+    }
+    printer->CloseElement(true);
+    printer->CloseElement(true);
+    break;
+  case torrent::Object::TYPE_MAP:
+    printer->OpenElement("struct", true);
+    for (const auto& itr : obj.as_map()) {
+      printer->OpenElement("member", true);
+      printer->OpenElement("name", true);
+      printer->PushText(itr.first.c_str());
+      printer->CloseElement(true);
+      printer->OpenElement("value", true);
+      reference_print_object_xml(itr.second, printer);
+      printer->CloseElement(true);
+      printer->CloseElement(true);
+    }
+    printer->CloseElement(true);
+    break;
+  default:
+    printer->OpenElement("i8", true);
+    printer->PushText(0);
+    printer->CloseElement(true);
+  }
+}
+
+#endif
+
+static std::string
+encode_json(const torrent::Object& object) {
+  rpc::ResponseBuffer output(0);
+
+  rpc::object_encode_json(object, &output);
+  return output.to_string();
+}
+
+static std::string
+encode_xml(const torrent::Object& object) {
+  rpc::ResponseBuffer output(0);
+
+  rpc::object_encode_xml(object, &output);
+  return output.to_string();
+}
+
+static torrent::Object
+create_test_object() {
+  auto object = torrent::Object::create_map();
+
+  object.as_map()["value"]      = int64_t(-2247483647);
+  object.as_map()["string"]     = "foo \"bar\" <baz> & \xd1\x87\xd0\xb0\xd0\xbe";
+  object.as_map()["empty_list"] = torrent::Object::create_list();
+  object.as_map()["empty_map"]  = torrent::Object::create_map();
+  object.as_map()["none"]       = torrent::Object();
+
+  auto& list = object.as_map()["list"] = torrent::Object::create_list();
+  list.as_list().push_back(int64_t(1));
+  list.as_list().push_back("");
+  list.as_list().push_back(torrent::Object::create_list());
+
+  auto dict_key = torrent::Object::create_dict_key();
+  dict_key.as_dict_key() = "key";
+  dict_key.as_dict_obj() = torrent::Object::create_list();
+  dict_key.as_dict_obj().as_list().push_back(int64_t(2));
+  dict_key.as_dict_obj().as_list().push_back("x");
+  list.as_list().push_back(dict_key);
+
+  return object;
+}
+
+// Roughly the shape of a large d.multicall2 result.
+static torrent::Object
+create_multicall_object(size_t rows) {
+  auto result = torrent::Object::create_list();
+
+  for (size_t i = 0; i < rows; i++) {
+    auto& row = result.as_list().insert(result.as_list().end(), torrent::Object::create_list())->as_list();
+
+    row.push_back(std::string(40, "0123456789ABCDEF"[i % 16]));
+    row.push_back("Some.Download.Name." + std::to_string(i) + ".mkv");
+    row.push_back("/home/user/downloads/" + std::to_string(i));
+    row.push_back("tag & <label>");
+
+    for (int64_t j = 0; j < 12; j++)
+      row.push_back(int64_t(i) * 1000 * j);
+  }
+
+  return result;
+}
+
+void
+TestObjectEncoder::test_buffer() {
+  rpc::ResponseBuffer output(8);
+  std::string         expected;
+
+  CPPUNIT_ASSERT(output.empty() && output.chunk_count() == 0);
+
+  for (size_t i = 0; expected.size() < 3 * rpc::ResponseBuffer::chunk_size; i++) {
+    std::string str(i % 1000, 'a' + i % 26);
+
+    output.append(str.data(), str.size());
+    output.push_back('|');
+    expected += str + '|';
+  }
+
+  CPPUNIT_ASSERT(output.size() == expected.size());
+  CPPUNIT_ASSERT(output.chunk_count() == 4);
+  CPPUNIT_ASSERT(output.to_string() == expected);
+
+  output.prepend("head", 4);
+
+  std::vector<struct iovec> iovecs;
+  std::string               sent;
+
+  output.iovecs(&iovecs);
+
+  for (const auto& iov : iovecs)
+    sent.append(static_cast<const char*>(iov.iov_base), iov.iov_len);
+
+  CPPUNIT_ASSERT(sent == "head" + expected);
+
+  output.clear();
+
+  CPPUNIT_ASSERT(output.empty() && output.chunk_count() == 1);
+  CPPUNIT_ASSERT(output.to_string().empty());
+}
+
+void
+TestObjectEncoder::test_json() {
+  CPPUNIT_ASSERT_EQUAL(std::string("0"), encode_json(torrent::Object()));
+  CPPUNIT_ASSERT_EQUAL(std::string("-41"), encode_json(torrent::Object(int64_t(-41))));
+  CPPUNIT_ASSERT_EQUAL(std::string("[]"), encode_json(torrent::Object::create_list()));
+  CPPUNIT_ASSERT_EQUAL(std::string("{}"), encode_json(torrent::Object::create_map()));
+
+  auto object = create_test_object();
+
+  CPPUNIT_ASSERT_EQUAL(reference_object_to_json(object).dump(), encode_json(object));
+}
+
+void
+TestObjectEncoder::test_json_strings() {
+  std::string control;
+
+  for (int c = 0; c < 0x80; c++)
+    control.push_back(c);
+
+  for (const auto& str : { std::string(), control, std::string("\"\\/"), std::string("\xf0\x9f\x98\x8a \xef\xbf\xbf \xc2\x80") }) {
+    CPPUNIT_ASSERT_EQUAL(json(str).dump(), encode_json(torrent::Object(str)));
+  }
+}
+
+void
+TestObjectEncoder::test_json_invalid_utf8() {
+  for (const auto& str : { "\xc3\x28", "\xc0\xaf", "\xed\xa0\x80", "\xf4\x90\x80\x80", "a\xe2\x82", "\xff" }) {
+    ASSERT_CATCH_INPUT_ERROR( { encode_json(torrent::Object(str)); } );
+    ASSERT_CATCH_INPUT_ERROR( { encode_json(torrent::Object(std::string("ok") + str)); } );
+  }
+}
+
+void
+TestObjectEncoder::test_xml() {
+  CPPUNIT_ASSERT_EQUAL(std::string("<i8>0</i8>"), encode_xml(torrent::Object()));
+  CPPUNIT_ASSERT_EQUAL(std::string("<i8>-41</i8>"), encode_xml(torrent::Object(int64_t(-41))));
+  CPPUNIT_ASSERT_EQUAL(std::string("<string></string>"), encode_xml(torrent::Object("")));
+  CPPUNIT_ASSERT_EQUAL(std::string("<array><data/></array>"), encode_xml(torrent::Object::create_list()));
+  CPPUNIT_ASSERT_EQUAL(std::string("<struct/>"), encode_xml(torrent::Object::create_map()));
+
+  auto map = torrent::Object::create_map();
+  map.as_map()["b"] = int64_t(2);
+  map.as_map()["a"] = torrent::Object::create_list();
+  map.as_map()["a"].as_list().push_back("x");
+
+  CPPUNIT_ASSERT_EQUAL(std::string("<struct>"
+                                   "<member><name>a</name><value><array><data><value><string>x</string></value></data></array></value></member>"
+                                   "<member><name>b</name><value><i8>2</i8></value></member>"
+                                   "</struct>"),
+                       encode_xml(map));
+}
+
+void
+TestObjectEncoder::test_xml_strings() {
+  CPPUNIT_ASSERT_EQUAL(std::string("<string>&lt;a&gt; &amp; \"b\" 'c'</string>"), encode_xml(torrent::Object("<a> & \"b\" 'c'")));
+  CPPUNIT_ASSERT_EQUAL(std::string("<string>abc</string>"), encode_xml(torrent::Object(std::string("abc\0def", 7))));
+  CPPUNIT_ASSERT_EQUAL(std::string("<string>\xc3\x28</string>"), encode_xml(torrent::Object("\xc3\x28")));
+}
+
+// Encodes a large d.multicall2 style result and compares it with the
+// document based paths the encoders replaced.
+void
+TestObjectEncoder::test_reference() {
+  auto object = create_multicall_object(10000);
+
+  CPPUNIT_ASSERT(encode_json(object) == reference_object_to_json(object).dump());
+
+#if defined(HAVE_XMLRPC_TINYXML2) && !defined(HAVE_XMLRPC_C)
+  rpc::tinyxml2::XMLPrinter reference_printer(nullptr, true, 0);
+  reference_print_object_xml(object, &reference_printer);
+
+  CPPUNIT_ASSERT(encode_xml(object) == std::string(reference_printer.CStr(), reference_printer.CStrSize() - 1));
+#endif
+}
@@ -0,0 +1,30 @@
+#include "test/helpers/test_fixture.h"
+
+#include "rpc/object_encoder.h"
+#include "rpc/response_buffer.h"
+
+class TestObjectEncoder : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestObjectEncoder);
+
+  CPPUNIT_TEST(test_buffer);
+  CPPUNIT_TEST(test_json);
+  CPPUNIT_TEST(test_json_strings);
+  CPPUNIT_TEST(test_json_invalid_utf8);
+  CPPUNIT_TEST(test_xml);
+  CPPUNIT_TEST(test_xml_strings);
+  CPPUNIT_TEST(test_reference);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_buffer();
+
+  void test_json();
+  void test_json_strings();
+  void test_json_invalid_utf8();
+
+  void test_xml();
+  void test_xml_strings();
+
+  void test_reference();
+};
@@ -0,0 +1,138 @@
+#include "config.h"
+
+#include "test/rpc/test_scgi.h"
+
+#include <string>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "rpc/rpc_manager.h"
+#include "rpc/scgi.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestSCgi);
+
+static constexpr unsigned int default_max_connections = 512;
+
+// Rejects a connection on one end of a socket pair, and returns what
+// was written to the other end before it was closed.
+static std::string
+reject_and_read(rpc::SCgi* scgi) {
+  int fds[2];
+
+  CPPUNIT_ASSERT(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  scgi->reject_connection(fds[0]);
+
+  std::string response;
+  char        buffer[256];
+  ssize_t     result;
+
+  while ((result = ::recv(fds[1], buffer, sizeof(buffer), 0)) > 0)
+    response.append(buffer, result);
+
+  CPPUNIT_ASSERT(result == 0);
+  CPPUNIT_ASSERT(::close(fds[1]) == 0);
+
+  return response;
+}
+
+void
+TestSCgi::tearDown() {
+  rpc::rpc.set_scgi_max_connections(default_max_connections);
+  test_fixture::tearDown();
+}
+
+void
+TestSCgi::test_pool_exhausted() {
+  rpc::SCgi scgi;
+  rpc::rpc.set_scgi_max_connections(2);
+
+  CPPUNIT_ASSERT(scgi.pool_size() == 0);
+
+  rpc::SCgiTask* first  = scgi.acquire_task();
+  rpc::SCgiTask* second = scgi.acquire_task();
+
+  CPPUNIT_ASSERT(first != nullptr && second != nullptr && first != second);
+  CPPUNIT_ASSERT(scgi.in_flight() == 2);
+  CPPUNIT_ASSERT(scgi.pool_size() == 2);
+
+  CPPUNIT_ASSERT(scgi.acquire_task() == nullptr);
+  CPPUNIT_ASSERT(scgi.in_flight() == 2);
+  CPPUNIT_ASSERT(scgi.pool_size() == 2);
+
+  scgi.release_task(first);
+  scgi.release_task(second);
+
+  CPPUNIT_ASSERT(scgi.in_flight() == 0);
+}
+
+void
+TestSCgi::test_pool_reuse() {
+  rpc::SCgi scgi;
+  rpc::rpc.set_scgi_max_connections(2);
+
+  rpc::SCgiTask* first  = scgi.acquire_task();
+  rpc::SCgiTask* second = scgi.acquire_task();
+
+  scgi.release_task(first);
+
+  // Released tasks are handed out again instead of growing the pool.
+  CPPUNIT_ASSERT(scgi.acquire_task() == first);
+  CPPUNIT_ASSERT(scgi.pool_size() == 2);
+
+  scgi.release_task(second);
+  scgi.release_task(first);
+
+  CPPUNIT_ASSERT(scgi.acquire_task() == first);
+  CPPUNIT_ASSERT(scgi.acquire_task() == second);
+  CPPUNIT_ASSERT(scgi.pool_size() == 2);
+  CPPUNIT_ASSERT(scgi.in_flight() == 2);
+
+  scgi.release_task(first);
+  scgi.release_task(second);
+}
+
+void
+TestSCgi::test_pool_lower_limit() {
+  rpc::SCgi scgi;
+  rpc::rpc.set_scgi_max_connections(3);
+
+  rpc::SCgiTask* tasks[3];
+
+  for (auto& task : tasks)
+    task = scgi.acquire_task();
+
+  scgi.release_task(tasks[0]);
+  scgi.release_task(tasks[1]);
+
+  // Free tasks left over after lowering the limit are kept, but not
+  // handed out past the limit.
+  rpc::rpc.set_scgi_max_connections(1);
+
+  CPPUNIT_ASSERT(scgi.acquire_task() == nullptr);
+  CPPUNIT_ASSERT(scgi.pool_size() == 3);
+
+  scgi.release_task(tasks[2]);
+
+  CPPUNIT_ASSERT(scgi.acquire_task() == tasks[2]);
+  CPPUNIT_ASSERT(scgi.acquire_task() == nullptr);
+
+  scgi.release_task(tasks[2]);
+}
+
+void
+TestSCgi::test_reject_scgi() {
+  rpc::SCgi scgi;
+
+  CPPUNIT_ASSERT(reject_and_read(&scgi) == "Status: 503 Service Unavailable\r\nContent-Type: text/plain\r\nContent-Length: 0\r\n\r\n");
+  CPPUNIT_ASSERT(scgi.rejected() == 1);
+}
+
+void
+TestSCgi::test_reject_http() {
+  rpc::SCgi scgi(rpc::SCgi::HTTP);
+
+  CPPUNIT_ASSERT(reject_and_read(&scgi) == "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+  CPPUNIT_ASSERT(reject_and_read(&scgi).find(" 503 ") != std::string::npos);
+  CPPUNIT_ASSERT(scgi.rejected() == 2);
+}
@@ -0,0 +1,24 @@
+#include "test/helpers/test_fixture.h"
+
+class TestSCgi : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestSCgi);
+
+  CPPUNIT_TEST(test_pool_exhausted);
+  CPPUNIT_TEST(test_pool_reuse);
+  CPPUNIT_TEST(test_pool_lower_limit);
+
+  CPPUNIT_TEST(test_reject_scgi);
+  CPPUNIT_TEST(test_reject_http);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void tearDown();
+
+  void test_pool_exhausted();
+  void test_pool_reuse();
+  void test_pool_lower_limit();
+
+  void test_reject_scgi();
+  void test_reject_http();
+};
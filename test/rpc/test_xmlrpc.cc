@@ -8,6 +8,7 @@
 #include "globals.h"
 #include "command_helpers.h"
 #include "rpc/command_map.h"
+#include "rpc/response_buffer.h"
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TestXmlrpc);
 
@@ -25,6 +26,16 @@ void initialize_command_dynamic();
 
 #if defined(HAVE_XMLRPC_TINYXML2) && !defined(HAVE_XMLRPC_C)
 
+static std::string
+xmlrpc_process(rpc::XmlRpc& xmlrpc, const std::string& input) {
+  // Reserve header space the same way SCgiTask does.
+  rpc::ResponseBuffer output(64);
+
+  xmlrpc.process(input.c_str(), input.size(), &output);
+
+  return output.to_string();
+}
+
 std::vector<std::tuple<std::string, std::string, std::string>> basic_requests = {
   std::make_tuple("Basic call",
                   "<?xml version=\"1.0\"?><methodCall><methodName>xmlrpc_reflect</methodName><params></params></methodCall>",
@@ -137,8 +148,7 @@ TestXmlrpc::tearDown() {
 void
 TestXmlrpc::test_basics() {
   for (auto& test : basic_requests) {
-    std::string output;
-    m_xmlrpc.process(std::get<1>(test).c_str(), std::get<1>(test).size(), [&output](const char* c, uint32_t l){ output.append(c, l); return true;});
+    std::string output = xmlrpc_process(m_xmlrpc, std::get<1>(test));
     CPPUNIT_ASSERT_EQUAL_MESSAGE(std::get<0>(test), std::get<2>(test), output);
   }
 }
@@ -150,8 +160,7 @@ TestXmlrpc::test_invalid_utf8() {
   // just a series of bytes so it reflects just fine.
   std::string input = "<?xml version=\"1.0\"?><methodCall><methodName>xmlrpc_reflect</methodName><params><param><value><string></string></value></param><param><value><string>\xc3\x28</string></value></param></params></methodCall>";
   std::string expected = "<?xml version=\"1.0\"?><methodResponse><params><param><value><array><data><value><string>\xc3\x28</string></value></data></array></value></param></params></methodResponse>";
-  std::string output;
-  m_xmlrpc.process(input.c_str(), input.size(), [&output](const char* c, uint32_t l){ output.append(c, l); return true;});
+  std::string output = xmlrpc_process(m_xmlrpc, input);
   CPPUNIT_ASSERT_EQUAL(expected, output);
 }
 
@@ -159,9 +168,8 @@ void
 TestXmlrpc::test_size_limit() {
   std::string input = "<?xml version=\"1.0\"?><methodCall><methodName>xmlrpc_reflect</methodName><params><param><value><string></string></value></param><param><value><string>\xc3\x28</string></value></param></params></methodCall>";
   std::string expected = "<?xml version=\"1.0\"?><methodResponse><fault><value><struct><member><name>faultCode</name><value><i8>-509</i8></value></member><member><name>faultString</name><value><string>Content size exceeds maximum XML-RPC limit</string></value></member></struct></value></fault></methodResponse>";
-  std::string output;
   m_xmlrpc.set_size_limit(1);
-  m_xmlrpc.process(input.c_str(), input.size(), [&output](const char* c, uint32_t l){ output.append(c, l); return true;});
+  std::string output = xmlrpc_process(m_xmlrpc, input);
   CPPUNIT_ASSERT_EQUAL(expected, output);
 }
 
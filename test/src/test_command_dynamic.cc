@@ -61,3 +61,73 @@ TestCommandDynamic::test_old_style() {
   rpc::commands.call_command("method.insert", rpc::create_object_list("test_old_style.4", "simple", "cat=test.3"));
   CPPUNIT_ASSERT(rpc::commands.call_command("test_old_style.4", torrent::Object()).as_string() == "test.3");
 }
+
+void
+TestCommandDynamic::test_compiled() {
+  rpc::commands.call_command("method.insert.value", rpc::create_object_list("test_compiled.1", int64_t(1)));
+
+  auto cmd_value = rpc::parse_command_compile_cached("test_compiled.1=");
+  auto cmd_exec  = rpc::parse_command_compile_cached("cat=$test_compiled.1=,foo");
+  auto cmd_empty = rpc::parse_command_compile_cached("# comment");
+
+  CPPUNIT_ASSERT(!cmd_value->needs_execute);
+  CPPUNIT_ASSERT(cmd_exec->needs_execute);
+  CPPUNIT_ASSERT(cmd_empty->key.empty());
+
+  CPPUNIT_ASSERT(rpc::parse_command_call(*cmd_value, rpc::make_target()).as_value() == 1);
+  CPPUNIT_ASSERT(rpc::parse_command_call(*cmd_exec, rpc::make_target()).as_string() == "1foo");
+  CPPUNIT_ASSERT(rpc::parse_command_call(*cmd_empty, rpc::make_target()).is_empty());
+
+  CPPUNIT_ASSERT(rpc::parse_command_compile_cached("test_compiled.1=") == cmd_value);
+
+  // Erasing the method must not leave the compiled command pointing to
+  // the erased entry, and the command is resolved again when the map
+  // changes.
+  rpc::commands.call_command("method.erase", "test_compiled.1");
+
+  CPPUNIT_ASSERT_THROW(rpc::parse_command_call(*cmd_value, rpc::make_target()), torrent::input_error);
+  CPPUNIT_ASSERT(rpc::parse_command_compile_cached("test_compiled.1=") == cmd_value);
+
+  rpc::commands.call_command("method.insert.value", rpc::create_object_list("test_compiled.2", int64_t(2)));
+  auto cmd_other = rpc::parse_command_compile_cached("test_compiled.2=");
+
+  rpc::commands.call_command("method.insert.value", rpc::create_object_list("test_compiled.3", int64_t(3)));
+  CPPUNIT_ASSERT(rpc::parse_command_call(*cmd_other, rpc::make_target()).as_value() == 2);
+}
+
+void
+TestCommandDynamic::test_method_compiled() {
+  rpc::commands.call_command("method.insert.value", rpc::create_object_list("test_method_compiled.3", int64_t(5)));
+  rpc::commands.call_command("method.insert.simple", rpc::create_object_list("test_method_compiled.1", "cat=1 ;cat=$test_method_compiled.3=,2"));
+  CPPUNIT_ASSERT(rpc::commands.call_command("test_method_compiled.1", torrent::Object()).as_string() == "52");
+
+  // Commands prefixed by '$' are still called every time.
+  rpc::commands.call_command("test_method_compiled.3.set", int64_t(6));
+  CPPUNIT_ASSERT(rpc::commands.call_command("test_method_compiled.1", torrent::Object()).as_string() == "62");
+
+  // Redefining the method replaces the compiled body.
+  rpc::commands.call_command("method.set", rpc::create_object_list("test_method_compiled.1", "cat=3"));
+  CPPUNIT_ASSERT(rpc::commands.call_command("test_method_compiled.1", torrent::Object()).as_string() == "3");
+
+  // Parse errors are only thrown when called.
+  rpc::commands.call_command("method.set", rpc::create_object_list("test_method_compiled.1", "cat=1 ;=2"));
+  CPPUNIT_ASSERT_THROW(rpc::commands.call_command("test_method_compiled.1", torrent::Object()), torrent::input_error);
+
+  rpc::commands.call_command("method.insert", rpc::create_object_list("test_method_compiled.2", "multi"));
+  rpc::commands.call_command("method.set_key", rpc::create_object_list("test_method_compiled.2", "a", "test_method_compiled.3.set=1"));
+  rpc::commands.call_command("method.set_key", rpc::create_object_list("test_method_compiled.2", "b", "test_method_compiled.3.set=2"));
+
+  rpc::commands.call_command("test_method_compiled.2", torrent::Object());
+  CPPUNIT_ASSERT(rpc::commands.call_command("test_method_compiled.3", torrent::Object()).as_value() == 2);
+
+  rpc::commands.call_command("method.set_key", rpc::create_object_list("test_method_compiled.2", "b"));
+  rpc::commands.call_command("test_method_compiled.2", torrent::Object());
+  CPPUNIT_ASSERT(rpc::commands.call_command("test_method_compiled.3", torrent::Object()).as_value() == 1);
+
+  auto stats = rpc::commands.call_command("method.stats", "test_method_compiled.1");
+  CPPUNIT_ASSERT(stats.get_key_value("calls") == 4);
+
+  auto all_stats = rpc::commands.call_command("method.stats", "");
+  CPPUNIT_ASSERT(all_stats.get_key("test_method_compiled.2").get_key_value("calls") == 2);
+  CPPUNIT_ASSERT(!all_stats.has_key("test_method_compiled.3"));
+}
@@ -7,6 +7,8 @@ class TestCommandDynamic : public test_fixture {
   CPPUNIT_TEST(test_basics);
   CPPUNIT_TEST(test_get_set);
   CPPUNIT_TEST(test_old_style);
+  CPPUNIT_TEST(test_compiled);
+  CPPUNIT_TEST(test_method_compiled);
 
   CPPUNIT_TEST_SUITE_END();
 
@@ -18,6 +20,8 @@ public:
   void test_get_set();
 
   void test_old_style();
+  void test_compiled();
+  void test_method_compiled();
 
 private:
   std::unique_ptr<TestMainThread> m_test_main_thread;
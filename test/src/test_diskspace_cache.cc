@@ -0,0 +1,212 @@
+#include "config.h"
+
+#include "test/src/test_diskspace_cache.h"
+
+#include <cstdlib>
+#include <functional>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "utils/diskspace_cache.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestDiskspaceCache);
+
+namespace {
+
+// Holds on to the refreshes so the tests decide when the statvfs calls
+// are made, rather than running them on the session thread.
+struct test_refresher {
+  test_refresher(utils::DiskspaceCache* cache) {
+    cache->slot_refresh([this](std::function<void ()>&& fn) { pending.push_back(std::move(fn)); });
+  }
+
+  // Runs the pending refreshes and receives their results.
+  void run(TestMainThread* main_thread) {
+    auto fns = std::move(pending);
+    pending.clear();
+
+    for (auto& fn : fns)
+      fn();
+
+    main_thread->test_process_events_without_cached_time();
+  }
+
+  std::vector<std::function<void ()>> pending;
+};
+
+} // namespace
+
+void
+TestDiskspaceCache::setUp() {
+  TestFixtureWithMainThread::setUp();
+
+  m_main_thread->test_set_cached_time(std::chrono::seconds(0));
+
+  char path[] = "/tmp/rtorrent-diskspace-XXXXXX";
+
+  CPPUNIT_ASSERT(::mkdtemp(path) != nullptr);
+  m_path = path;
+
+  CPPUNIT_ASSERT(::mkdir((m_path + "/a").c_str(), 0700) == 0);
+  CPPUNIT_ASSERT(::mkdir((m_path + "/b").c_str(), 0700) == 0);
+}
+
+void
+TestDiskspaceCache::tearDown() {
+  ::rmdir((m_path + "/a").c_str());
+  ::rmdir((m_path + "/b").c_str());
+  ::rmdir(m_path.c_str());
+
+  TestFixtureWithMainThread::tearDown();
+}
+
+// Paths on the same filesystem share a device entry, while paths that
+// can't be stat'ed aren't cached.
+void
+TestDiskspaceCache::test_lookup() {
+  utils::DiskspaceCache cache;
+  test_refresher refresher(&cache);
+
+  dev_t    device_a, device_b;
+  uint64_t free_a, free_b;
+
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/a", &device_a, &free_a));
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/b", &device_b, &free_b));
+
+  struct stat st;
+  CPPUNIT_ASSERT(::stat(m_path.c_str(), &st) == 0);
+
+  CPPUNIT_ASSERT(device_a == st.st_dev);
+  CPPUNIT_ASSERT(device_b == st.st_dev);
+  CPPUNIT_ASSERT(free_a == free_b);
+
+  CPPUNIT_ASSERT(cache.size_paths() == 2);
+  CPPUNIT_ASSERT(cache.devices().size() == 1);
+  CPPUNIT_ASSERT(cache.devices().begin()->second.path == m_path + "/a");
+
+  CPPUNIT_ASSERT(!cache.lookup(m_path + "/missing", &device_a, &free_a));
+  CPPUNIT_ASSERT(cache.size_paths() == 2);
+
+  refresher.run(m_main_thread.get());
+}
+
+// Paths that can't be stat'ed, such as files not yet created, are
+// skipped unless no path can be looked up.
+void
+TestDiskspaceCache::test_lookup_lowest() {
+  utils::DiskspaceCache cache;
+  test_refresher refresher(&cache);
+
+  dev_t    device, device_a;
+  uint64_t free, free_a;
+
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/a", &device_a, &free_a));
+
+  CPPUNIT_ASSERT(cache.lookup_lowest({m_path + "/missing", m_path + "/a", m_path + "/b"}, &device, &free));
+  CPPUNIT_ASSERT(device == device_a);
+  CPPUNIT_ASSERT(free == free_a);
+  CPPUNIT_ASSERT(cache.size_paths() == 2);
+
+  CPPUNIT_ASSERT(!cache.lookup_lowest({m_path + "/missing"}, &device, &free));
+  CPPUNIT_ASSERT(!cache.lookup_lowest({}, &device, &free));
+
+  refresher.run(m_main_thread.get());
+}
+
+// A refresh is started by the first lookup after the ttl expires, with
+// lookups served from the cache without touching the filesystem until
+// its result is received.
+void
+TestDiskspaceCache::test_refresh_ttl() {
+  utils::DiskspaceCache cache;
+  test_refresher refresher(&cache);
+
+  dev_t    device;
+  uint64_t free;
+
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/a", &device, &free));
+  CPPUNIT_ASSERT(refresher.pending.size() == 1);
+
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/a", &device, &free));
+  CPPUNIT_ASSERT(refresher.pending.size() == 1);
+
+  refresher.run(m_main_thread.get());
+
+  m_main_thread->test_add_cached_time(cache.ttl() - std::chrono::seconds(1));
+
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/a", &device, &free));
+  CPPUNIT_ASSERT(refresher.pending.empty());
+
+  // Removing the directory shows the lookup doesn't stat the path.
+  CPPUNIT_ASSERT(::rmdir((m_path + "/a").c_str()) == 0);
+
+  m_main_thread->test_add_cached_time(std::chrono::seconds(1));
+
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/a", &device, &free));
+  CPPUNIT_ASSERT(refresher.pending.size() == 1);
+
+  refresher.run(m_main_thread.get());
+}
+
+// Filesystems that fail to stat during a refresh are dropped along with
+// their paths, which are stat'ed again on the next lookup.
+void
+TestDiskspaceCache::test_failed_device() {
+  utils::DiskspaceCache cache;
+  test_refresher refresher(&cache);
+
+  dev_t    device;
+  uint64_t free;
+
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/a", &device, &free));
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/b", &device, &free));
+  CPPUNIT_ASSERT(cache.devices().size() == 1);
+
+  // The device entry was stat'ed through the first path.
+  CPPUNIT_ASSERT(::rmdir((m_path + "/a").c_str()) == 0);
+
+  refresher.run(m_main_thread.get());
+
+  CPPUNIT_ASSERT(cache.devices().empty());
+  CPPUNIT_ASSERT(cache.size_paths() == 0);
+
+  CPPUNIT_ASSERT(!cache.lookup(m_path + "/a", &device, &free));
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/b", &device, &free));
+
+  CPPUNIT_ASSERT(cache.devices().size() == 1);
+  CPPUNIT_ASSERT(cache.devices().begin()->second.path == m_path + "/b");
+
+  refresher.run(m_main_thread.get());
+}
+
+// Paths are dropped once more than path_expire_refreshes refreshes
+// have completed since they were last looked up.
+void
+TestDiskspaceCache::test_path_expiry() {
+  utils::DiskspaceCache cache;
+  test_refresher refresher(&cache);
+
+  dev_t    device;
+  uint64_t free;
+
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/b", &device, &free));
+  refresher.run(m_main_thread.get());
+
+  for (unsigned int i = 1; i < utils::DiskspaceCache::path_expire_refreshes; i++) {
+    m_main_thread->test_add_cached_time(cache.ttl());
+
+    CPPUNIT_ASSERT(cache.lookup(m_path + "/a", &device, &free));
+    refresher.run(m_main_thread.get());
+  }
+
+  CPPUNIT_ASSERT(cache.size_paths() == 2);
+
+  m_main_thread->test_add_cached_time(cache.ttl());
+
+  CPPUNIT_ASSERT(cache.lookup(m_path + "/a", &device, &free));
+  refresher.run(m_main_thread.get());
+
+  CPPUNIT_ASSERT(cache.size_paths() == 1);
+  CPPUNIT_ASSERT(cache.devices().size() == 1);
+}
@@ -0,0 +1,28 @@
+#include "test/helpers/test_main_thread.h"
+
+#include <string>
+
+class TestDiskspaceCache : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(TestDiskspaceCache);
+
+  CPPUNIT_TEST(test_lookup);
+  CPPUNIT_TEST(test_lookup_lowest);
+  CPPUNIT_TEST(test_refresh_ttl);
+  CPPUNIT_TEST(test_failed_device);
+  CPPUNIT_TEST(test_path_expiry);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_lookup();
+  void test_lookup_lowest();
+  void test_refresh_ttl();
+  void test_failed_device();
+  void test_path_expiry();
+
+private:
+  std::string         m_path;
+};
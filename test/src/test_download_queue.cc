@@ -0,0 +1,148 @@
+#include "config.h"
+
+#include "test/src/test_download_queue.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "session/download_queue.h"
+#include "session/session_manager.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestDownloadQueue);
+
+namespace {
+
+// The queue never dereferences the downloads, so synthetic pointers
+// are enough.
+std::vector<core::Download*>
+synthetic_downloads(size_t count) {
+  std::vector<core::Download*> downloads(count);
+
+  for (size_t i = 0; i < count; i++)
+    downloads[i] = reinterpret_cast<core::Download*>((i + 1) * 64);
+
+  return downloads;
+}
+
+} // namespace
+
+void
+TestDownloadQueue::test_basics() {
+  auto downloads = synthetic_downloads(3);
+
+  session::DownloadQueue<std::string> queue;
+
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(queue.find(downloads[0]) == nullptr);
+
+  queue.push_back(downloads[0], "first");
+  queue.push_back(downloads[1], "second");
+  queue.push_back(downloads[2], "third");
+
+  CPPUNIT_ASSERT(queue.size() == 3);
+  CPPUNIT_ASSERT(queue.contains(downloads[1]));
+  CPPUNIT_ASSERT(*queue.find(downloads[1]) == "second");
+
+  *queue.find(downloads[1]) = "replaced";
+
+  CPPUNIT_ASSERT_THROW(queue.push_back(downloads[0], "duplicate"), torrent::internal_error);
+  CPPUNIT_ASSERT(queue.size() == 3);
+
+  CPPUNIT_ASSERT(queue.pop_front() == "first");
+  CPPUNIT_ASSERT(!queue.contains(downloads[0]));
+  CPPUNIT_ASSERT(queue.pop_front() == "replaced");
+  CPPUNIT_ASSERT(queue.pop_front() == "third");
+  CPPUNIT_ASSERT(queue.empty());
+
+  CPPUNIT_ASSERT_THROW(queue.pop_front(), torrent::internal_error);
+}
+
+void
+TestDownloadQueue::test_erase() {
+  auto downloads = synthetic_downloads(4);
+
+  session::DownloadQueue<int> queue;
+
+  for (int i = 0; i < 4; i++)
+    queue.push_back(downloads[i], i);
+
+  CPPUNIT_ASSERT(queue.erase(downloads[1]));
+  CPPUNIT_ASSERT(!queue.erase(downloads[1]));
+  CPPUNIT_ASSERT(!queue.contains(downloads[1]));
+
+  auto itr = queue.begin();
+  CPPUNIT_ASSERT(itr->download == downloads[0]);
+
+  itr = queue.erase(itr);
+  CPPUNIT_ASSERT(itr->download == downloads[2]);
+  CPPUNIT_ASSERT(!queue.contains(downloads[0]));
+  CPPUNIT_ASSERT(queue.size() == 2);
+
+  // Erased downloads can be queued again, at the back.
+  queue.push_back(downloads[1], 5);
+
+  CPPUNIT_ASSERT(queue.pop_front() == 2);
+  CPPUNIT_ASSERT(queue.pop_front() == 3);
+  CPPUNIT_ASSERT(queue.pop_front() == 5);
+}
+
+// Queues every download the way SessionManager::save_resume_download()
+// does for session.save, with a second pass hitting the duplicate
+// check for all of them.
+void
+TestDownloadQueue::test_session_save() {
+  const size_t count  = 50000;
+  const int    passes = 2;
+
+  auto downloads = synthetic_downloads(count);
+
+  session::DownloadQueue<core::Download*> queue;
+
+  for (int pass = 0; pass < passes; pass++)
+    for (auto download : downloads)
+      if (!queue.contains(download))
+        queue.push_back(download, download);
+
+  CPPUNIT_ASSERT(queue.size() == count);
+
+  for (auto download : downloads)
+    CPPUNIT_ASSERT(queue.contains(download));
+
+  size_t popped = 0;
+
+  while (!queue.empty())
+    popped += queue.pop_front() == downloads[popped];
+
+  CPPUNIT_ASSERT(popped == count);
+  CPPUNIT_ASSERT(!queue.contains(downloads.front()));
+  CPPUNIT_ASSERT(!queue.contains(downloads.back()));
+}
+
+// Downloads are only marked as saved with the generation of the newest
+// resume data written, and not at all once removed.
+void
+TestDownloadQueue::test_saved_generations() {
+  auto downloads = synthetic_downloads(3);
+
+  session::saved_generation_queue saved;
+
+  session::push_saved_generation(&saved, downloads[0], 5);
+  session::push_saved_generation(&saved, downloads[1], 7);
+  session::push_saved_generation(&saved, downloads[2], 9);
+
+  // Saves finishing out of order don't move the generation back.
+  session::push_saved_generation(&saved, downloads[0], 8);
+  session::push_saved_generation(&saved, downloads[1], 6);
+
+  CPPUNIT_ASSERT(saved.size() == 3);
+  CPPUNIT_ASSERT(*saved.find(downloads[0]) == 8);
+  CPPUNIT_ASSERT(*saved.find(downloads[1]) == 7);
+
+  // As done by SessionManager::remove_download().
+  CPPUNIT_ASSERT(saved.erase(downloads[2]));
+
+  CPPUNIT_ASSERT(saved.pop_front() == 8);
+  CPPUNIT_ASSERT(saved.pop_front() == 7);
+  CPPUNIT_ASSERT(saved.empty());
+}
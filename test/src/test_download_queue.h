@@ -0,0 +1,18 @@
+#include "test/helpers/test_fixture.h"
+
+class TestDownloadQueue : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestDownloadQueue);
+
+  CPPUNIT_TEST(test_basics);
+  CPPUNIT_TEST(test_erase);
+  CPPUNIT_TEST(test_session_save);
+  CPPUNIT_TEST(test_saved_generations);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basics();
+  void test_erase();
+  void test_session_save();
+  void test_saved_generations();
+};
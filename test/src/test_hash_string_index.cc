@@ -0,0 +1,87 @@
+#include "config.h"
+
+#include "test/src/test_hash_string_index.h"
+
+#include <random>
+#include <vector>
+
+#include "core/hash_string_index.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestHashStringIndex);
+
+namespace {
+
+std::vector<torrent::HashString>
+random_hashes(size_t count) {
+  std::mt19937_64 generator(count);
+  std::vector<torrent::HashString> hashes(count);
+
+  for (auto& hash : hashes)
+    for (auto itr = hash.begin(); itr != hash.end(); itr++)
+      *itr = static_cast<char>(generator());
+
+  return hashes;
+}
+
+// Hashes that share the leading bytes, and thus the same home slot.
+torrent::HashString
+colliding_hash(char last) {
+  torrent::HashString hash;
+
+  std::fill(hash.begin(), hash.end(), 0);
+  *(hash.end() - 1) = last;
+
+  return hash;
+}
+
+} // namespace
+
+void
+TestHashStringIndex::test_basics() {
+  core::HashStringIndex<int> index;
+  auto hashes = random_hashes(1000);
+
+  CPPUNIT_ASSERT(index.find(hashes[0]) == NULL);
+  CPPUNIT_ASSERT(!index.erase(hashes[0]));
+
+  for (size_t i = 0; i < hashes.size(); i++)
+    CPPUNIT_ASSERT(index.insert(hashes[i], i));
+
+  CPPUNIT_ASSERT(index.size() == hashes.size());
+  CPPUNIT_ASSERT(!index.insert(hashes[0], -1));
+  CPPUNIT_ASSERT(index.capacity() >= index.size() * 2);
+
+  for (size_t i = 0; i < hashes.size(); i++)
+    CPPUNIT_ASSERT(index.find(hashes[i]) != NULL && *index.find(hashes[i]) == (int)i);
+
+  for (size_t i = 0; i < hashes.size(); i += 2)
+    CPPUNIT_ASSERT(index.erase(hashes[i]));
+
+  CPPUNIT_ASSERT(index.size() == hashes.size() / 2);
+
+  for (size_t i = 0; i < hashes.size(); i++)
+    CPPUNIT_ASSERT((index.find(hashes[i]) != NULL) == (i % 2 == 1));
+}
+
+void
+TestHashStringIndex::test_erase_collisions() {
+  core::HashStringIndex<int> index;
+
+  for (int i = 0; i < 8; i++)
+    CPPUNIT_ASSERT(index.insert(colliding_hash(i), i));
+
+  // Erasing from the middle of a probe sequence must keep the
+  // following entries reachable.
+  CPPUNIT_ASSERT(index.erase(colliding_hash(3)));
+  CPPUNIT_ASSERT(index.erase(colliding_hash(0)));
+
+  for (int i = 0; i < 8; i++) {
+    if (i == 0 || i == 3)
+      CPPUNIT_ASSERT(index.find(colliding_hash(i)) == NULL);
+    else
+      CPPUNIT_ASSERT(index.find(colliding_hash(i)) != NULL && *index.find(colliding_hash(i)) == i);
+  }
+
+  CPPUNIT_ASSERT(index.insert(colliding_hash(3), 3));
+  CPPUNIT_ASSERT(*index.find(colliding_hash(3)) == 3);
+}
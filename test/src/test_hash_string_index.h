@@ -0,0 +1,14 @@
+#include "test/helpers/test_fixture.h"
+
+class TestHashStringIndex : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestHashStringIndex);
+
+  CPPUNIT_TEST(test_basics);
+  CPPUNIT_TEST(test_erase_collisions);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_basics();
+  void test_erase_collisions();
+};
@@ -0,0 +1,136 @@
+#include "config.h"
+
+#include "test/src/test_inserted_queue.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "session/inserted_queue.h"
+#include "session/session_loader.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestInsertedQueue);
+
+namespace {
+
+// Stands in for the download list, with the hash holding the index of
+// a synthetic download pointer that is never dereferenced.
+struct test_downloads {
+  test_downloads(size_t count) : erased(count) {}
+
+  static torrent::HashString hash(size_t index);
+
+  core::Download*     download(size_t index) const { return reinterpret_cast<core::Download*>((index + 1) * 64); }
+  core::Download*     find(const torrent::HashString& hash) const;
+
+  std::vector<bool>   erased;
+};
+
+torrent::HashString
+test_downloads::hash(size_t index) {
+  torrent::HashString hash;
+
+  std::fill(hash.begin(), hash.end(), 0);
+  std::copy_n(reinterpret_cast<const char*>(&index), sizeof(index), hash.begin());
+
+  return hash;
+}
+
+core::Download*
+test_downloads::find(const torrent::HashString& hash) const {
+  size_t index;
+  std::copy_n(hash.begin(), sizeof(index), reinterpret_cast<char*>(&index));
+
+  return index < erased.size() && !erased[index] ? download(index) : nullptr;
+}
+
+} // namespace
+
+// Pushes and dispatches the downloads the way SessionLoader does as
+// their factories finish, which must call the event exactly once for
+// each download in load order.
+void
+TestInsertedQueue::test_load_order() {
+  const size_t count = session::SessionLoader::batch_size * 2 + 22;
+
+  test_downloads downloads(count);
+  session::InsertedQueue queue;
+
+  std::vector<core::Download*> called;
+  size_t batches = 0;
+
+  auto find = [&](const torrent::HashString& hash) { return downloads.find(hash); };
+  auto call = [&](core::Download* download) { called.push_back(download); };
+
+  for (size_t i = 0; i < count; i++) {
+    queue.push_back(test_downloads::hash(i));
+
+    if (queue.size() >= session::SessionLoader::batch_size || i + 1 == count) {
+      size_t batch = queue.size();
+
+      CPPUNIT_ASSERT(queue.dispatch(find, call) == batch);
+      batches++;
+    }
+  }
+
+  CPPUNIT_ASSERT(batches == 3);
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(called.size() == count);
+
+  for (size_t i = 0; i < count; i++)
+    CPPUNIT_ASSERT(called[i] == downloads.download(i));
+}
+
+// Downloads erased by the handlers of earlier downloads in the batch
+// are skipped.
+void
+TestInsertedQueue::test_erased() {
+  test_downloads downloads(4);
+  session::InsertedQueue queue;
+
+  std::vector<core::Download*> called;
+
+  for (size_t i = 0; i < 4; i++)
+    queue.push_back(test_downloads::hash(i));
+
+  downloads.erased[3] = true;
+
+  size_t result = queue.dispatch([&](const torrent::HashString& hash) { return downloads.find(hash); },
+                                 [&](core::Download* download) {
+                                   called.push_back(download);
+
+                                   if (download == downloads.download(0))
+                                     downloads.erased[1] = true;
+                                 });
+
+  CPPUNIT_ASSERT(result == 2);
+  CPPUNIT_ASSERT(queue.empty());
+  CPPUNIT_ASSERT(called == std::vector<core::Download*>({downloads.download(0), downloads.download(2)}));
+}
+
+// Downloads queued while dispatching are left for the next batch.
+void
+TestInsertedQueue::test_queued_by_handler() {
+  test_downloads downloads(3);
+  session::InsertedQueue queue;
+
+  std::vector<core::Download*> called;
+
+  auto find = [&](const torrent::HashString& hash) { return downloads.find(hash); };
+  auto call = [&](core::Download* download) {
+    called.push_back(download);
+
+    if (download == downloads.download(0))
+      queue.push_back(test_downloads::hash(2));
+  };
+
+  queue.push_back(test_downloads::hash(0));
+  queue.push_back(test_downloads::hash(1));
+
+  CPPUNIT_ASSERT(queue.dispatch(find, call) == 2);
+  CPPUNIT_ASSERT(queue.size() == 1);
+
+  CPPUNIT_ASSERT(queue.dispatch(find, call) == 1);
+  CPPUNIT_ASSERT(queue.empty());
+
+  CPPUNIT_ASSERT(called == std::vector<core::Download*>({downloads.download(0), downloads.download(1), downloads.download(2)}));
+}
@@ -0,0 +1,16 @@
+#include "test/helpers/test_fixture.h"
+
+class TestInsertedQueue : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestInsertedQueue);
+
+  CPPUNIT_TEST(test_load_order);
+  CPPUNIT_TEST(test_erased);
+  CPPUNIT_TEST(test_queued_by_handler);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_load_order();
+  void test_erased();
+  void test_queued_by_handler();
+};
@@ -0,0 +1,134 @@
+#include "config.h"
+
+#include "test/src/test_loop_stats.h"
+
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "utils/loop_stats.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestLoopStats);
+
+void
+TestLoopStats::test_record() {
+  utils::LoopStats stats;
+
+  stats.record(utils::LoopStats::RPC, "d.multicall2", 200);
+  stats.record(utils::LoopStats::RPC, "system.multicall", 500);
+  stats.record(utils::LoopStats::RPC, "d.name", 100);
+  stats.record(utils::LoopStats::DISPLAY, "update", 50);
+
+  auto& rpc = stats.category(utils::LoopStats::RPC);
+
+  CPPUNIT_ASSERT(rpc.count == 3);
+  CPPUNIT_ASSERT(rpc.total == 800);
+  CPPUNIT_ASSERT(rpc.max == 500);
+  CPPUNIT_ASSERT(rpc.max_name == "system.multicall");
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::DISPLAY).count == 1);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::EVENT).count == 0);
+  CPPUNIT_ASSERT(stats.scheduler_keys().empty());
+
+  stats.reset();
+
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::RPC).count == 0);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::RPC).max_name.empty());
+}
+
+void
+TestLoopStats::test_stall_threshold() {
+  utils::LoopStats stats;
+
+  CPPUNIT_ASSERT(stats.stall_threshold() == utils::LoopStats::default_stall_threshold);
+
+  stats.set_stall_threshold(1000);
+  stats.record(utils::LoopStats::SESSION_BUILD, "pending", 999);
+  stats.record(utils::LoopStats::SESSION_BUILD, "flush", 1000);
+  stats.record(utils::LoopStats::EVENT, "event.download.finished", 5000);
+
+  CPPUNIT_ASSERT(stats.stalls() == 2);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::SESSION_BUILD).stalls == 1);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::EVENT).stalls == 1);
+
+  stats.set_stall_threshold(0);
+  stats.record(utils::LoopStats::EVENT, "event.download.finished", 5000000);
+
+  CPPUNIT_ASSERT(stats.stalls() == 2);
+}
+
+void
+TestLoopStats::test_scheduler_keys() {
+  utils::LoopStats stats;
+
+  stats.record(utils::LoopStats::SCHEDULER, "session_save", 300);
+  stats.record(utils::LoopStats::SCHEDULER, "session_save", 100);
+  stats.record(utils::LoopStats::SCHEDULER, "low_diskspace", 10);
+
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::SCHEDULER).count == 3);
+  CPPUNIT_ASSERT(stats.scheduler_keys().size() == 2);
+  CPPUNIT_ASSERT(stats.scheduler_keys().at("session_save").count == 2);
+  CPPUNIT_ASSERT(stats.scheduler_keys().at("session_save").total == 400);
+
+  for (size_t i = 0; i != utils::LoopStats::max_keys; i++)
+    stats.record(utils::LoopStats::SCHEDULER, ("key_" + std::to_string(i)).c_str(), 1);
+
+  CPPUNIT_ASSERT(stats.scheduler_keys().size() == utils::LoopStats::max_keys);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::SCHEDULER).count == 3 + utils::LoopStats::max_keys);
+}
+
+void
+TestLoopStats::test_timer() {
+  utils::LoopStats stats;
+
+  {
+    utils::LoopTimer timer(&stats, utils::LoopStats::SCHEDULER, "sleep");
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+
+  try {
+    utils::LoopTimer timer(&stats, utils::LoopStats::RPC, "throws");
+    throw std::runtime_error("test");
+  } catch (std::runtime_error&) {
+  }
+
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::SCHEDULER).count == 1);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::SCHEDULER).max >= 2000);
+  CPPUNIT_ASSERT(stats.scheduler_keys().at("sleep").count == 1);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::RPC).count == 1);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::RPC).max_name == "throws");
+}
+
+void
+TestLoopStats::test_timer_slot_name() {
+  utils::LoopStats stats;
+  int              calls = 0;
+
+  auto slot_name = [&calls]() { calls++; return std::string("slow"); };
+
+  stats.record(utils::LoopStats::RPC, "fast", 0);
+
+  // Names are only built for new maximums and stalls.
+  stats.record(utils::LoopStats::RPC, "slowest", 1000000);
+  stats.set_stall_threshold(0);
+
+  {
+    utils::LoopTimer timer(&stats, utils::LoopStats::RPC, slot_name);
+  }
+
+  CPPUNIT_ASSERT(calls == 0);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::RPC).count == 3);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::RPC).max_name == "slowest");
+
+  {
+    utils::LoopTimer timer(&stats, utils::LoopStats::EVENT, slot_name);
+  }
+
+  CPPUNIT_ASSERT(calls == 1);
+  CPPUNIT_ASSERT(stats.category(utils::LoopStats::EVENT).max_name == "slow");
+
+  CPPUNIT_ASSERT(!stats.uses_name(utils::LoopStats::RPC, 999999));
+  CPPUNIT_ASSERT(stats.uses_name(utils::LoopStats::RPC, 1000000));
+
+  // Scheduler keys are always tracked.
+  CPPUNIT_ASSERT(stats.uses_name(utils::LoopStats::SCHEDULER, 0));
+}
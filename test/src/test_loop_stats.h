@@ -0,0 +1,20 @@
+#include "test/helpers/test_fixture.h"
+
+class TestLoopStats : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestLoopStats);
+
+  CPPUNIT_TEST(test_record);
+  CPPUNIT_TEST(test_stall_threshold);
+  CPPUNIT_TEST(test_scheduler_keys);
+  CPPUNIT_TEST(test_timer);
+  CPPUNIT_TEST(test_timer_slot_name);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_record();
+  void test_stall_threshold();
+  void test_scheduler_keys();
+  void test_timer();
+  void test_timer_slot_name();
+};
@@ -0,0 +1,210 @@
+#include "config.h"
+
+#include "test/src/test_session_log.h"
+
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "session/session_log.h"
+#include "session/session_manager.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestSessionLog);
+
+namespace {
+
+const std::string hash_a(40, 'A');
+const std::string hash_b(40, 'B');
+
+std::unique_ptr<std::stringstream>
+make_stream(const std::string& data) {
+  if (data.empty())
+    return nullptr;
+
+  return std::make_unique<std::stringstream>(data);
+}
+
+session::SaveRequest
+make_request(const std::string& hash, const std::string& torrent, const std::string& rtorrent, const std::string& resume) {
+  return session::SaveRequest{nullptr, std::string(), hash, make_stream(torrent), make_stream(rtorrent), make_stream(resume)};
+}
+
+void
+append_one(session::SessionLog& log, session::SaveRequest request) {
+  std::vector<session::SaveRequest> requests;
+  requests.push_back(std::move(request));
+
+  log.append_batch(requests, false);
+}
+
+std::vector<std::string>
+segment_files(const std::string& path) {
+  std::vector<std::string> files;
+  DIR* dir = ::opendir(path.c_str());
+
+  CPPUNIT_ASSERT(dir != nullptr);
+
+  while (auto entry = ::readdir(dir))
+    if (std::string(entry->d_name).compare(0, 12, "session.log.") == 0)
+      files.push_back(path + entry->d_name);
+
+  ::closedir(dir);
+  return files;
+}
+
+} // namespace
+
+void
+TestSessionLog::setUp() {
+  test_fixture::setUp();
+
+  char path[] = "/tmp/rtorrent-session-log-XXXXXX";
+
+  CPPUNIT_ASSERT(::mkdtemp(path) != nullptr);
+
+  m_path = std::string(path) + "/";
+}
+
+void
+TestSessionLog::tearDown() {
+  for (const auto& file : segment_files(m_path))
+    ::unlink(file.c_str());
+
+  ::rmdir(m_path.c_str());
+
+  test_fixture::tearDown();
+}
+
+void
+TestSessionLog::test_append_and_reopen() {
+  {
+    session::SessionLog log(m_path);
+    log.open();
+
+    CPPUNIT_ASSERT(log.is_new());
+
+    std::vector<session::SaveRequest> requests;
+    requests.push_back(make_request(hash_a, "torrent_a", "rtorrent_a1", "resume_a1"));
+    requests.push_back(make_request(hash_b, "torrent_b", "rtorrent_b1", "resume_b1"));
+
+    log.append_batch(requests, false);
+    append_one(log, make_request(hash_a, "", "rtorrent_a2", "resume_a2"));
+
+    CPPUNIT_ASSERT(log.has_torrent(hash_a));
+    CPPUNIT_ASSERT(!log.has_torrent(std::string(40, 'C')));
+  }
+
+  session::SessionLog log(m_path);
+  log.open();
+
+  CPPUNIT_ASSERT(!log.is_new());
+  CPPUNIT_ASSERT(log.torrent_hashes() == std::vector<std::string>({hash_a, hash_b}));
+
+  session::SessionLog::entry_type entry;
+
+  CPPUNIT_ASSERT(log.read_entry(hash_a, &entry));
+  CPPUNIT_ASSERT(entry.torrent == "torrent_a");
+  CPPUNIT_ASSERT(entry.rtorrent == "rtorrent_a2");
+  CPPUNIT_ASSERT(entry.libtorrent_resume == "resume_a2");
+
+  CPPUNIT_ASSERT(log.read_entry(hash_b, &entry));
+  CPPUNIT_ASSERT(entry.torrent == "torrent_b");
+  CPPUNIT_ASSERT(entry.rtorrent == "rtorrent_b1");
+}
+
+void
+TestSessionLog::test_remove() {
+  {
+    session::SessionLog log(m_path);
+    log.open();
+
+    append_one(log, make_request(hash_a, "torrent_a", "rtorrent_a", "resume_a"));
+    append_one(log, make_request(hash_b, "torrent_b", "rtorrent_b", "resume_b"));
+    log.append_remove(hash_a);
+
+    CPPUNIT_ASSERT(!log.has_torrent(hash_a));
+  }
+
+  session::SessionLog log(m_path);
+  log.open();
+
+  CPPUNIT_ASSERT(log.torrent_hashes() == std::vector<std::string>({hash_b}));
+}
+
+void
+TestSessionLog::test_torn_tail() {
+  {
+    session::SessionLog log(m_path);
+    log.open();
+
+    append_one(log, make_request(hash_a, "torrent_a", "rtorrent_a", "resume_a"));
+  }
+
+  auto files = segment_files(m_path);
+  CPPUNIT_ASSERT(files.size() == 1);
+
+  struct stat st;
+  CPPUNIT_ASSERT(::stat(files.front().c_str(), &st) == 0);
+
+  auto valid_size = st.st_size;
+
+  // A record header claiming more payload than was written.
+  int fd = ::open(files.front().c_str(), O_WRONLY | O_APPEND);
+  CPPUNIT_ASSERT(fd != -1);
+  CPPUNIT_ASSERT(::write(fd, "RTSL\xff\x00\x00\x00garbage", 15) == 15);
+  ::close(fd);
+
+  session::SessionLog log(m_path);
+  log.open();
+
+  CPPUNIT_ASSERT(log.has_torrent(hash_a));
+  CPPUNIT_ASSERT(::stat(files.front().c_str(), &st) == 0);
+  CPPUNIT_ASSERT(st.st_size == valid_size);
+
+  // Appends after the truncated tail must be readable on the next open.
+  append_one(log, make_request(hash_b, "torrent_b", "rtorrent_b", "resume_b"));
+  log.close();
+  log.open();
+
+  CPPUNIT_ASSERT(log.torrent_hashes() == std::vector<std::string>({hash_a, hash_b}));
+}
+
+void
+TestSessionLog::test_compaction() {
+  {
+    session::SessionLog log(m_path);
+    log.open();
+
+    append_one(log, make_request(hash_a, "torrent_a", "rtorrent_a0", "resume_a0"));
+    append_one(log, make_request(hash_b, "torrent_b", "rtorrent_b0", "resume_b0"));
+
+    for (int i = 1; i <= 100; i++)
+      append_one(log, make_request(hash_a, "", "rtorrent_a" + std::to_string(i), "resume_a" + std::to_string(i)));
+
+    log.append_remove(hash_b);
+
+    CPPUNIT_ASSERT(log.total_size() > 2 * log.live_size());
+
+    log.compact(false);
+
+    CPPUNIT_ASSERT(log.segment_count() == 1);
+    CPPUNIT_ASSERT(log.total_size() == log.live_size());
+    CPPUNIT_ASSERT(segment_files(m_path).size() == 1);
+  }
+
+  session::SessionLog log(m_path);
+  log.open();
+
+  session::SessionLog::entry_type entry;
+
+  CPPUNIT_ASSERT(log.torrent_hashes() == std::vector<std::string>({hash_a}));
+  CPPUNIT_ASSERT(log.read_entry(hash_a, &entry));
+  CPPUNIT_ASSERT(entry.torrent == "torrent_a");
+  CPPUNIT_ASSERT(entry.rtorrent == "rtorrent_a100");
+  CPPUNIT_ASSERT(entry.libtorrent_resume == "resume_a100");
+}
@@ -0,0 +1,26 @@
+#include "test/helpers/test_fixture.h"
+
+#include <string>
+
+class TestSessionLog : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestSessionLog);
+
+  CPPUNIT_TEST(test_append_and_reopen);
+  CPPUNIT_TEST(test_remove);
+  CPPUNIT_TEST(test_torn_tail);
+  CPPUNIT_TEST(test_compaction);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void test_append_and_reopen();
+  void test_remove();
+  void test_torn_tail();
+  void test_compaction();
+
+private:
+  std::string m_path;
+};
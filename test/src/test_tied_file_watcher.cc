@@ -0,0 +1,200 @@
+#include "config.h"
+
+#include "test/src/test_tied_file_watcher.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <torrent/exceptions.h>
+
+#include "utils/tied_file_watcher.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestTiedFileWatcher);
+
+namespace {
+
+// Downloads are only used as keys while no actions are enabled, or the
+// tied files don't exist.
+core::Download*
+fake_download(uintptr_t id) {
+  return reinterpret_cast<core::Download*>(id * 16);
+}
+
+std::string
+temporary_directory() {
+  char path[] = "/tmp/rtorrent-tied-XXXXXX";
+
+  CPPUNIT_ASSERT(::mkdtemp(path) != nullptr);
+
+  return std::string(path) + "/";
+}
+
+// Returns false if inotify isn't available.
+bool
+enable_watcher(utils::TiedFileWatcher* watcher) {
+  try {
+    watcher->set_action(utils::TiedFileWatcher::action_start, true);
+  } catch (torrent::input_error&) {
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace
+
+void
+TestTiedFileWatcher::test_index_shared_file() {
+  utils::TiedFileWatcher watcher;
+
+  watcher.insert(fake_download(1), "/a/1.torrent");
+  watcher.insert(fake_download(2), "/a/1.torrent");
+  watcher.insert(fake_download(3), "/a/2.torrent");
+  watcher.insert(fake_download(4), "/b/3.torrent");
+  watcher.insert(fake_download(5), "");
+
+  CPPUNIT_ASSERT(watcher.size_files() == 3);
+  CPPUNIT_ASSERT(watcher.size_directories() == 2);
+
+  // The file is kept while another download is tied to it.
+  watcher.erase(fake_download(1));
+
+  CPPUNIT_ASSERT(watcher.size_files() == 3);
+
+  watcher.erase(fake_download(2));
+
+  CPPUNIT_ASSERT(watcher.size_files() == 2);
+  CPPUNIT_ASSERT(watcher.size_directories() == 2);
+
+  watcher.erase(fake_download(3));
+
+  CPPUNIT_ASSERT(watcher.size_files() == 1);
+  CPPUNIT_ASSERT(watcher.size_directories() == 1);
+
+  watcher.erase(fake_download(4));
+  watcher.erase(fake_download(5));
+
+  CPPUNIT_ASSERT(watcher.size_files() == 0);
+  CPPUNIT_ASSERT(watcher.size_directories() == 0);
+}
+
+void
+TestTiedFileWatcher::test_update_moves_download() {
+  utils::TiedFileWatcher watcher;
+
+  watcher.insert(fake_download(1), "");
+  watcher.insert(fake_download(2), "/a/2.torrent");
+
+  CPPUNIT_ASSERT(watcher.size_files() == 1);
+
+  watcher.update(fake_download(1), "/a/1.torrent");
+
+  CPPUNIT_ASSERT(watcher.size_files() == 2);
+  CPPUNIT_ASSERT(watcher.size_directories() == 1);
+
+  watcher.update(fake_download(1), "/b/1.torrent");
+
+  CPPUNIT_ASSERT(watcher.size_files() == 2);
+  CPPUNIT_ASSERT(watcher.size_directories() == 2);
+
+  watcher.update(fake_download(2), "/b/1.torrent");
+
+  CPPUNIT_ASSERT(watcher.size_files() == 1);
+  CPPUNIT_ASSERT(watcher.size_directories() == 1);
+
+  watcher.update(fake_download(1), "");
+  watcher.update(fake_download(2), "");
+
+  CPPUNIT_ASSERT(watcher.size_files() == 0);
+  CPPUNIT_ASSERT(watcher.size_directories() == 0);
+
+  // Downloads that were never inserted are ignored.
+  watcher.update(fake_download(3), "/c/3.torrent");
+
+  CPPUNIT_ASSERT(watcher.size_files() == 0);
+  CPPUNIT_ASSERT(watcher.size_directories() == 0);
+}
+
+void
+TestTiedFileWatcher::test_erase_unknown_download() {
+  utils::TiedFileWatcher watcher;
+
+  watcher.insert(fake_download(1), "/a/1.torrent");
+  watcher.erase(fake_download(2));
+  watcher.erase(fake_download(1));
+  watcher.erase(fake_download(1));
+
+  CPPUNIT_ASSERT(watcher.size_files() == 0);
+  CPPUNIT_ASSERT(watcher.size_directories() == 0);
+}
+
+void
+TestTiedFileWatcher::test_insert_twice() {
+  utils::TiedFileWatcher watcher;
+
+  watcher.insert(fake_download(1), "/a/1.torrent");
+
+  CPPUNIT_ASSERT_THROW(watcher.insert(fake_download(1), "/a/2.torrent"), torrent::internal_error);
+  CPPUNIT_ASSERT(watcher.size_files() == 1);
+}
+
+void
+TestTiedFileWatcher::test_watch_keeps_directory() {
+  utils::TiedFileWatcher watcher;
+  auto directory = temporary_directory();
+
+  if (!enable_watcher(&watcher)) {
+    ::rmdir(directory.c_str());
+    return;
+  }
+
+  watcher.insert(fake_download(1), directory + "1.torrent");
+
+  CPPUNIT_ASSERT(watcher.is_watched(directory));
+
+  // Watches cannot be removed, so the directory is kept once watched.
+  watcher.erase(fake_download(1));
+
+  CPPUNIT_ASSERT(watcher.size_files() == 0);
+  CPPUNIT_ASSERT(watcher.size_directories() == 1);
+  CPPUNIT_ASSERT(watcher.is_watched(directory));
+
+  watcher.shutdown();
+  ::rmdir(directory.c_str());
+}
+
+void
+TestTiedFileWatcher::test_watch_failure() {
+  utils::TiedFileWatcher watcher;
+  auto directory = temporary_directory();
+
+  CPPUNIT_ASSERT(::rmdir(directory.c_str()) == 0);
+
+  if (!enable_watcher(&watcher))
+    return;
+
+  // Directories that can't be watched are logged, and don't fail the
+  // insert.
+  watcher.insert(fake_download(1), directory + "1.torrent");
+
+  CPPUNIT_ASSERT(watcher.size_files() == 1);
+  CPPUNIT_ASSERT(watcher.size_directories() == 1);
+  CPPUNIT_ASSERT(!watcher.is_watched(directory));
+
+  // The watch is retried when another file in the directory is indexed.
+  CPPUNIT_ASSERT(::mkdir(directory.c_str(), 0700) == 0);
+
+  watcher.insert(fake_download(2), directory + "2.torrent");
+
+  CPPUNIT_ASSERT(watcher.is_watched(directory));
+
+  watcher.erase(fake_download(1));
+  watcher.erase(fake_download(2));
+
+  CPPUNIT_ASSERT(watcher.size_directories() == 1);
+
+  watcher.shutdown();
+  ::rmdir(directory.c_str());
+}
@@ -0,0 +1,22 @@
+#include "test/helpers/test_main_thread.h"
+
+class TestTiedFileWatcher : public TestFixtureWithMainThread {
+  CPPUNIT_TEST_SUITE(TestTiedFileWatcher);
+
+  CPPUNIT_TEST(test_index_shared_file);
+  CPPUNIT_TEST(test_update_moves_download);
+  CPPUNIT_TEST(test_erase_unknown_download);
+  CPPUNIT_TEST(test_insert_twice);
+  CPPUNIT_TEST(test_watch_keeps_directory);
+  CPPUNIT_TEST(test_watch_failure);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void test_index_shared_file();
+  void test_update_moves_download();
+  void test_erase_unknown_download();
+  void test_insert_twice();
+  void test_watch_keeps_directory();
+  void test_watch_failure();
+};
@@ -0,0 +1,281 @@
+#include "config.h"
+
+#include "test/src/test_view.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "command_helpers.h"
+#include "core/view.h"
+#include "rpc/command_map.h"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestView);
+
+namespace {
+
+const char* test_key_command = "test.view.key";
+std::map<void*, int64_t> sort_keys;
+
+torrent::Object
+cmd_view_key(rpc::target_type target, [[maybe_unused]] const torrent::Object& args) {
+  return sort_keys.at(target.second);
+}
+
+// Downloads are only passed to the key command, which looks them up by
+// address.
+core::Download*
+fake_download(uintptr_t id, int64_t key) {
+  auto download = reinterpret_cast<core::Download*>(id * 16);
+  sort_keys[download] = key;
+  return download;
+}
+
+torrent::Object
+make_sort(const char* order) {
+  auto sort = torrent::Object::create_dict_key();
+  sort.as_dict_key() = order;
+  sort.as_dict_obj() = torrent::Object::create_dict_key();
+  sort.as_dict_obj().as_dict_key() = test_key_command;
+  return sort;
+}
+
+torrent::HashString
+make_hash(char c) {
+  torrent::HashString hash;
+  std::fill(hash.begin(), hash.end(), c);
+  return hash;
+}
+
+size_t
+insert_position(std::vector<core::Download*>& range, core::Download* d, const torrent::Object& sort) {
+  return core::View::find_insert_position(range.begin(), range.end(), d, sort) - range.begin();
+}
+
+} // namespace
+
+void
+TestView::setUp() {
+  test_fixture::setUp();
+
+  sort_keys.clear();
+
+  if (!rpc::commands.has(test_key_command))
+    CMD2_ANY(test_key_command, &cmd_view_key);
+}
+
+void
+TestView::test_insert_position() {
+  std::vector<core::Download*> range{fake_download(1, 1), fake_download(2, 3), fake_download(3, 3), fake_download(4, 7)};
+
+  auto sort = make_sort("less");
+
+  CPPUNIT_ASSERT(insert_position(range, fake_download(5, 0), sort) == 0);
+  CPPUNIT_ASSERT(insert_position(range, fake_download(6, 2), sort) == 1);
+  CPPUNIT_ASSERT(insert_position(range, fake_download(7, 5), sort) == 3);
+  CPPUNIT_ASSERT(insert_position(range, fake_download(8, 9), sort) == 4);
+
+  // Equal keys go after the downloads already in the range.
+  CPPUNIT_ASSERT(insert_position(range, fake_download(9, 3), sort) == 3);
+}
+
+void
+TestView::test_insert_position_greater() {
+  std::vector<core::Download*> range{fake_download(1, 7), fake_download(2, 3), fake_download(3, 1)};
+
+  auto sort = make_sort("greater");
+
+  CPPUNIT_ASSERT(insert_position(range, fake_download(4, 9), sort) == 0);
+  CPPUNIT_ASSERT(insert_position(range, fake_download(5, 5), sort) == 1);
+  CPPUNIT_ASSERT(insert_position(range, fake_download(6, 0), sort) == 3);
+}
+
+void
+TestView::test_insert_position_unsorted() {
+  // The visible range is ordered by sort_current, which need not agree
+  // with the sort_new command used for the insert. The download goes
+  // before the first one it sorts before, as with the generic
+  // comparator.
+  std::vector<core::Download*> range{fake_download(1, 5), fake_download(2, 1), fake_download(3, 9), fake_download(4, 2)};
+
+  CPPUNIT_ASSERT(insert_position(range, fake_download(5, 3), make_sort("less")) == 0);
+  CPPUNIT_ASSERT(insert_position(range, fake_download(6, 7), make_sort("less")) == 2);
+  CPPUNIT_ASSERT(insert_position(range, fake_download(7, 0), make_sort("greater")) == 4);
+  CPPUNIT_ASSERT(insert_position(range, fake_download(8, 3), make_sort("greater")) == 1);
+}
+
+// Only downloads changed since the last pass are evaluated, and only
+// those that changed whether they match are moved.
+void
+TestView::test_filter_changed() {
+  std::vector<core::Download*>       range{fake_download(1, 0), fake_download(2, 0), fake_download(3, 0), fake_download(4, 0)};
+  std::map<core::Download*, uint64_t> generations;
+  std::map<core::Download*, bool>     matching;
+  std::vector<core::Download*>       evaluated;
+
+  for (auto download : range) {
+    generations[download] = 1;
+    matching[download]    = download != range[1];
+  }
+
+  uint64_t filter_generation = 0;
+
+  auto filter_pass = [&](size_t split, std::vector<core::Download*>* removed, std::vector<core::Download*>* added) {
+    evaluated.clear();
+
+    auto evaluate = [&](core::Download* d) { return core::View::needs_filter(false, generations[d], filter_generation, false); };
+    auto matches  = [&](core::Download* d) { evaluated.push_back(d); return matching[d]; };
+
+    auto result = core::View::filter_range(range.begin(), range.begin() + split, range.end(), evaluate, matches, removed, added);
+
+    filter_generation = 5;
+    return static_cast<size_t>(result - range.begin());
+  };
+
+  std::vector<core::Download*> removed;
+  std::vector<core::Download*> added;
+
+  CPPUNIT_ASSERT(filter_pass(4, &removed, &added) == 3);
+  CPPUNIT_ASSERT(evaluated.size() == 4);
+  CPPUNIT_ASSERT(removed == std::vector<core::Download*>({fake_download(2, 0)}));
+  CPPUNIT_ASSERT(added.empty());
+  CPPUNIT_ASSERT(range == std::vector<core::Download*>({fake_download(1, 0), fake_download(3, 0), fake_download(4, 0), fake_download(2, 0)}));
+
+  // Nothing changed.
+  removed.clear();
+
+  CPPUNIT_ASSERT(filter_pass(3, &removed, &added) == 3);
+  CPPUNIT_ASSERT(evaluated.empty());
+  CPPUNIT_ASSERT(removed.empty() && added.empty());
+
+  // A changed download that no longer matches leaves the visible range,
+  // the rest keep their order without being evaluated.
+  generations[fake_download(1, 0)] = 6;
+  matching[fake_download(1, 0)]    = false;
+
+  // Changes that don't alter the match don't move the download.
+  generations[fake_download(4, 0)] = 6;
+
+  CPPUNIT_ASSERT(filter_pass(3, &removed, &added) == 2);
+  CPPUNIT_ASSERT(evaluated == std::vector<core::Download*>({fake_download(1, 0), fake_download(4, 0)}));
+  CPPUNIT_ASSERT(removed == std::vector<core::Download*>({fake_download(1, 0)}));
+  CPPUNIT_ASSERT(added.empty());
+  CPPUNIT_ASSERT(range == std::vector<core::Download*>({fake_download(3, 0), fake_download(4, 0), fake_download(1, 0), fake_download(2, 0)}));
+
+  // A filtered download that changed to matching goes to the end of the
+  // visible range.
+  removed.clear();
+  generations[fake_download(2, 0)] = 7;
+  matching[fake_download(2, 0)]    = true;
+  filter_generation                = 6;
+
+  CPPUNIT_ASSERT(filter_pass(2, &removed, &added) == 3);
+  CPPUNIT_ASSERT(evaluated == std::vector<core::Download*>({fake_download(2, 0)}));
+  CPPUNIT_ASSERT(removed.empty());
+  CPPUNIT_ASSERT(added == std::vector<core::Download*>({fake_download(2, 0)}));
+  CPPUNIT_ASSERT(range == std::vector<core::Download*>({fake_download(3, 0), fake_download(4, 0), fake_download(2, 0), fake_download(1, 0)}));
+}
+
+// Filters set on a view might depend on more than the download, so
+// incremental filtering has to be enabled again afterwards.
+void
+TestView::test_filter_incremental_reset() {
+  core::View view;
+
+  CPPUNIT_ASSERT(!view.filter_incremental());
+
+  view.set_filter_incremental(true);
+  view.set_filter_temp(torrent::Object("d.name="));
+  CPPUNIT_ASSERT(view.filter_incremental());
+
+  view.set_filter(torrent::Object("d.complete="));
+  CPPUNIT_ASSERT(!view.filter_incremental());
+}
+
+// Clients pass the generation they were last returned, which is at or
+// after the generation of every removal they were sent.
+void
+TestView::test_removed_since() {
+  core::ViewRemovedLog log(16);
+  log.reset(10);
+
+  log.push_back(11, make_hash('a'));
+  log.push_back(13, make_hash('b'));
+  log.push_back(13, make_hash('c'));
+
+  core::ViewRemovedLog::hash_list result;
+
+  CPPUNIT_ASSERT(log.since(10, &result));
+  CPPUNIT_ASSERT(result == core::ViewRemovedLog::hash_list({make_hash('a'), make_hash('b'), make_hash('c')}));
+
+  result.clear();
+  CPPUNIT_ASSERT(log.since(11, &result));
+  CPPUNIT_ASSERT(result == core::ViewRemovedLog::hash_list({make_hash('b'), make_hash('c')}));
+
+  // Each removal is reported once to a client that passes back the
+  // generation it was last returned.
+  result.clear();
+  CPPUNIT_ASSERT(log.since(13, &result));
+  CPPUNIT_ASSERT(result.empty());
+
+  log.push_back(14, make_hash('a'));
+
+  CPPUNIT_ASSERT(log.since(13, &result));
+  CPPUNIT_ASSERT(result == core::ViewRemovedLog::hash_list({make_hash('a')}));
+}
+
+// Removals before the view was created aren't known, so older
+// generations must be sent the whole view.
+void
+TestView::test_removed_since_floor() {
+  core::ViewRemovedLog log(16);
+  log.reset(10);
+
+  core::ViewRemovedLog::hash_list result;
+
+  CPPUNIT_ASSERT(!log.since(9, &result));
+  CPPUNIT_ASSERT(!log.since(0, &result));
+  CPPUNIT_ASSERT(log.since(10, &result));
+  CPPUNIT_ASSERT(result.empty());
+
+  log.push_back(12, make_hash('a'));
+  log.reset(20);
+
+  CPPUNIT_ASSERT(log.size() == 0);
+  CPPUNIT_ASSERT(!log.since(12, &result));
+  CPPUNIT_ASSERT(result.empty());
+}
+
+// Dropping the oldest removal raises the floor to its generation, so
+// clients that haven't seen it get a full resend.
+void
+TestView::test_removed_since_overflow() {
+  const size_t max_size = 4;
+
+  core::ViewRemovedLog log(max_size);
+  log.reset(0);
+
+  for (size_t i = 0; i < max_size; i++)
+    log.push_back(i + 1, make_hash('a' + i));
+
+  core::ViewRemovedLog::hash_list result;
+
+  CPPUNIT_ASSERT(log.since(0, &result));
+  CPPUNIT_ASSERT(result.size() == max_size);
+
+  log.push_back(max_size + 1, make_hash('z'));
+
+  CPPUNIT_ASSERT(log.size() == max_size);
+  CPPUNIT_ASSERT(log.floor() == 1);
+
+  result.clear();
+  CPPUNIT_ASSERT(!log.since(0, &result));
+  CPPUNIT_ASSERT(result.empty());
+
+  // Clients that saw the dropped removal get the remaining ones.
+  CPPUNIT_ASSERT(log.since(1, &result));
+  CPPUNIT_ASSERT(result.size() == max_size);
+  CPPUNIT_ASSERT(result.front() == make_hash('b'));
+  CPPUNIT_ASSERT(result.back() == make_hash('z'));
+}
@@ -0,0 +1,32 @@
+#include "test/helpers/test_fixture.h"
+
+class TestView : public test_fixture {
+  CPPUNIT_TEST_SUITE(TestView);
+
+  CPPUNIT_TEST(test_insert_position);
+  CPPUNIT_TEST(test_insert_position_greater);
+  CPPUNIT_TEST(test_insert_position_unsorted);
+
+  CPPUNIT_TEST(test_filter_changed);
+  CPPUNIT_TEST(test_filter_incremental_reset);
+
+  CPPUNIT_TEST(test_removed_since);
+  CPPUNIT_TEST(test_removed_since_floor);
+  CPPUNIT_TEST(test_removed_since_overflow);
+
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+
+  void test_insert_position();
+  void test_insert_position_greater();
+  void test_insert_position_unsorted();
+
+  void test_filter_changed();
+  void test_filter_incremental_reset();
+
+  void test_removed_since();
+  void test_removed_since_floor();
+  void test_removed_since_overflow();
+};